@@ -414,15 +414,17 @@ namespace AtticusServer
                                         {
                                             messageLog(this, new MessageEvent("Creating Variable Timebase Task on fpga device " + fsettings.DeviceName + "."));
                                             int nSegs = 0;
+                                            int nSegsBeforeMerge = 0;
                                             FpgaTimebaseTask ftask = new FpgaTimebaseTask(fsettings,
                                                 opalKellyDevices[opalKellyDeviceNames.IndexOf(fsettings.DeviceName)],
                                                 sequence,
                                                 Common.getPeriodFromFrequency(fsettings.SampleClockRate),
                                                 out nSegs,
+                                                out nSegsBeforeMerge,
                                                 myServerSettings.UseFpgaRfModulatedClockOutput,
                                                 myServerSettings.UseFpgaAssymetricDutyCycleClocking);
                                             fpgaTasks.Add(fsettings.DeviceName, ftask);
-                                            messageLog(this, new MessageEvent("...Done (" + nSegs + " segments total)"));
+                                            messageLog(this, new MessageEvent("...Done (" + nSegs + " segments total, merged from " + nSegsBeforeMerge + ")"));
                                         }
                                         else
                                         {
@@ -1103,7 +1105,7 @@ namespace AtticusServer
                             {
                                 int masterFreq = myServerSettings.myDevicesSettings[serverSettings.DeviceToSyncSoftwareTimedTasksTo].SampleClockRate;
                                 TimestepTimebaseSegmentCollection segments = sequence.generateVariableTimebaseSegments(SequenceData.VariableTimebaseTypes.AnalogGroupControlledVariableFrequencyClock, Common.getPeriodFromFrequency(masterFreq));
-                                int masterSamp = sequence.getMasterSampleFromDerivedSample(errorSamp, segments);
+                                long masterSamp = sequence.getMasterSampleFromDerivedSample(errorSamp, segments);
                                 double seqTime = ((double)masterSamp) / ((double)masterFreq);
                                 TimeStep step = sequence.getTimeStepAtTime(seqTime);
                                 messageLog(this, new MessageEvent("This mistrigger was at master sample " + masterSamp + ", sequence time " + seqTime + ", Timestep [" + step.StepName + "] (based on timing info from " + myServerSettings.DeviceToSyncSoftwareTimedTasksTo + ")"));
@@ -276,7 +276,9 @@ namespace AtticusServer
             TimestepTimebaseSegmentCollection timebaseSegments = sequenceData.generateVariableTimebaseSegments(timebaseType,
                 Common.getPeriodFromFrequency(masterFrequency));
 
-            bool [] buffer = sequenceData.getVariableTimebaseClock(timebaseSegments);
+            // rendered in chunks straight into the port buffer, rather than through a bool buffer of the same length
+            VariableTimebaseClockEdges clockEdges = sequenceData.getVariableTimebaseClockEdges(timebaseSegments);
+            int bufferLength = checked((int)clockEdges.ClockBufferLength);
 
             string timebaseDeviceName = HardwareChannel.parseDeviceNameStringFromPhysicalChannelString(channelName);
             
@@ -284,7 +286,7 @@ namespace AtticusServer
 
             task.DOChannels.CreateChannel(timebasePort, "", ChannelLineGrouping.OneChannelForAllLines);
 
-            task.Timing.ConfigureSampleClock("", (double)masterFrequency, deviceSettings.ClockEdge, SampleQuantityMode.FiniteSamples, buffer.Length);
+            task.Timing.ConfigureSampleClock("", (double)masterFrequency, deviceSettings.ClockEdge, SampleQuantityMode.FiniteSamples, bufferLength);
 
             if (serverSettings.VariableTimebaseTriggerInput != "")
             {
@@ -293,12 +295,18 @@ namespace AtticusServer
             
             DigitalSingleChannelWriter writer = new DigitalSingleChannelWriter(task.Stream);
 
-            byte[] byteBuffer = new byte[buffer.Length];
-            for (int j = 0; j < buffer.Length; j++)
+            byte[] byteBuffer = new byte[bufferLength];
+            bool[] chunk = new bool[65536];
+            for (int start = 0; start < bufferLength; start += chunk.Length)
             {
-                if (buffer[j])
+                clockEdges.renderClock(start, chunk);
+                int n = Math.Min(chunk.Length, bufferLength - start);
+                for (int j = 0; j < n; j++)
                 {
-                    byteBuffer[j] = 255;
+                    if (chunk[j])
+                    {
+                        byteBuffer[start + j] = 255;
+                    }
                 }
             }
 
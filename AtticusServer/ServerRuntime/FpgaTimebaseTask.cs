@@ -24,13 +24,18 @@ namespace AtticusServer
         }
         
 
+        /// <summary>
+        /// Largest on or off count the FPGA accepts; on_counts and off_counts are 48 bits wide in the FIFO words.
+        /// </summary>
+        private const ulong maxCounts = (1UL << 48) - 1;
+
         private struct ListItem
         {
-            public uint onCounts;
-            public uint offCounts;
+            public ulong onCounts;
+            public ulong offCounts;
             public uint repeats;
 
-            public ListItem(uint onCounts, uint offCounts, uint repeats)
+            public ListItem(ulong onCounts, ulong offCounts, uint repeats)
             {
                 this.onCounts = onCounts;
                 this.offCounts = offCounts;
@@ -45,155 +50,629 @@ namespace AtticusServer
             }
         }
 
+        /// <summary>
+        /// Merges runs of adjacent list items with identical on and off counts into single items by
+        /// summing their repeats, which gives exactly the same clock output in fewer FIFO records.
+        /// Consecutive segments often match, for instance across timesteps with no running analog group.
+        /// Retrigger items (repeats = 0) are never merged, and nothing is merged across them.
+        /// Repeats that no longer fit the 32 bit repeat field are split over as many items as needed.
+        /// </summary>
+        /// <param name="listItems"></param>
+        /// <returns></returns>
+        private static List<ListItem> mergeListItems(List<ListItem> listItems)
+        {
+            List<ListItem> merged = new List<ListItem>(listItems.Count);
+
+            foreach (ListItem item in listItems)
+                appendMerged(merged, item);
+
+            return merged;
+        }
+
+        /// <summary>
+        /// One step of mergeListItems: appends item to merged, or merges it into the last item.
+        /// A run of mergeable items always ends up as full items followed by the remainder, whatever
+        /// pieces it is appended in, so runs merged separately and then appended give the same records
+        /// as merging everything at once.
+        /// </summary>
+        /// <param name="merged"></param>
+        /// <param name="item"></param>
+        /// <returns>False if item was appended unchanged.</returns>
+        private static bool appendMerged(List<ListItem> merged, ListItem item)
+        {
+            int last = merged.Count - 1;
+            if (!canMerge(merged, item))
+            {
+                merged.Add(item);
+                return false;
+            }
+
+            ulong repeats = (ulong)merged[last].repeats + item.repeats;
+            if (repeats <= uint.MaxValue)
+            {
+                merged[last] = new ListItem(item.onCounts, item.offCounts, (uint)repeats);
+            }
+            else
+            {
+                merged[last] = new ListItem(item.onCounts, item.offCounts, uint.MaxValue);
+                merged.Add(new ListItem(item.onCounts, item.offCounts, (uint)(repeats - uint.MaxValue)));
+            }
+            return true;
+        }
+
+        private static bool canMerge(List<ListItem> merged, ListItem item)
+        {
+            int last = merged.Count - 1;
+            return item.repeats != 0 && last >= 0 && merged[last].repeats != 0
+                && merged[last].onCounts == item.onCounts && merged[last].offCounts == item.offCounts;
+        }
+
+        /// <summary>
+        /// The wait for retrigger item of a timestep, if it waits for one.
+        /// </summary>
+        private static bool getRetriggerItem(TimeStep step, double masterClockPeriod, out ListItem item)
+        {
+            item = new ListItem();
+            if (!step.RetriggerOptions.WaitForRetrigger)
+                return false;
+
+            double waitSamples = step.RetriggerOptions.RetriggerTimeout.getBaseValue() / masterClockPeriod;
+            // the FPGA counts retrigger wait samples in 32 bits, so the timeout cannot use the full 48 bit on_counts
+            if (!(waitSamples <= uint.MaxValue))
+                throw new Exception("Retrigger timeout of timestep " + step.StepName + " is too long for the FPGA (more than " + uint.MaxValue + " master samples).");
+            uint waitTime = (uint)waitSamples;
+            
+            uint retriggerFlags = 0;
+            if (step.RetriggerOptions.RetriggerOnEdge)
+                retriggerFlags += 1;
+            if (!step.RetriggerOptions.RetriggerOnNegativeValueOrEdge)
+                retriggerFlags += 2;
+            
+            item = new ListItem(waitTime, retriggerFlags, 0);
+                   // counts = 0 is a special signal for WAIT_FOR_RETRIGGER mode
+                   // in this mode, FPGA waits a maximum of on_counts master samples
+                   // before moving on anyway.
+                   // (unless on_counts = 0, in which case it never artificially retriggers)
+                    // retrigger flags set if the FPGA will trigger on edge or on value
+                    // and whether to trigger on positive or negative (edge or value)
+            return true;
+        }
+
+        /// <summary>
+        /// Appends the list items of the segments of one timestep.
+        /// </summary>
+        private static void addSegmentItems(TimeStep step, List<SequenceData.VariableTimebaseSegment> stepSegments, bool assymetric, List<ListItem> listItems)
+        {
+            for (int i = 0; i < stepSegments.Count; i++)
+            {
+                ListItem item = new ListItem();
+                SequenceData.VariableTimebaseSegment currentSeg = stepSegments[i];
+
+                item.repeats = (uint)currentSeg.NSegmentSamples;
+                item.offCounts = (ulong)(currentSeg.MasterSamplesPerSegmentSample / 2);
+                item.onCounts = (ulong)currentSeg.MasterSamplesPerSegmentSample - item.offCounts;
+
+                // in assymmetric mode (spelling?), the clock duty cycle is not held at 50%, but rather the pulses are made to be
+                // 5 master cycles long at most. This is a workaround for the weird behavior of one of our fiber links
+                // for sharing the variable timebase signal.
+                if (assymetric)
+                {
+                    if (item.onCounts > 5)
+                    {
+                        ulong difference = item.onCounts - 5;
+                        item.onCounts = 5;
+                        item.offCounts = item.offCounts + difference;
+                    }
+                }
+
+                if (item.onCounts > maxCounts || item.offCounts > maxCounts)
+                {
+                    throw new Exception("Variable timebase segment of " + currentSeg.MasterSamplesPerSegmentSample + " master samples per sample in timestep " + step.StepName + " does not fit in the FPGA's 48 bit counters.");
+                }
+
+                if (!item.isAllZeros())
+                { // filter out any erroneously produced all-zero codes, since these have
+                    // special meaning to the FPGA (they are "wait for retrigger" codes
+                    listItems.Add(item);
+                }
+            }
+        }
+
+        /// <summary>
+        /// Add one final "pulse" at the end to trigger the dwell values. I'm basing this off the
+        /// old variable timebase code that I found in the SequenceData program. 
+        /// </summary>
+        private static ListItem getFinishItem(double masterClockPeriod, bool assymetric)
+        {
+            // This final pulse is made to be 100 us long at least, just to be on the safe side. (unless assymetric mode is on)
+
+            int minCounts = (int)(0.0001 / masterClockPeriod);
+            if (minCounts <= 0)
+                minCounts = 1;
+
+            ListItem finishItem = new ListItem((ulong)minCounts, (ulong)minCounts, 1);
+
+            if (assymetric)
+            {
+                finishItem.onCounts = 5;
+            }
+            return finishItem;
+        }
+
+        /// <summary>
+        /// Encodes list items into FIFO records, natively if okSegmentCodec.dll is there.
+        /// </summary>
+        private static byte[] encodeListItems(List<ListItem> listItems)
+        {
+            int count = listItems.Count;
+            ulong[] onCounts = new ulong[count];
+            ulong[] offCounts = new ulong[count];
+            uint[] repeats = new uint[count];
+            for (int i = 0; i < count; i++)
+            {
+                onCounts[i] = listItems[i].onCounts;
+                offCounts[i] = listItems[i].offCounts;
+                repeats[i] = listItems[i].repeats;
+            }
+
+            byte[] byteArray = new byte[count * 16];
+
+            // okSegmentCodec.dll encodes the same records natively, if it is there.
+            if (!OkSegmentCodec.encode(onCounts, offCounts, repeats, count, byteArray))
+                encodeRecords(onCounts, offCounts, repeats, count, byteArray);
+
+            return byteArray;
+        }
+
         /// <summary>
         /// Create byte array for use in programming FPGA
         /// </summary>
         /// <param name="segments"></param>
         /// <param name="sequence"></param>
-        /// <param name="nSegments"></param>
+        /// <param name="nSegments">Number of FIFO records uploaded.</param>
+        /// <param name="nSegmentsBeforeMerge">Number of FIFO records before identical adjacent records were merged.</param>
         /// <param name="masterClockPeriod"></param>
         /// <param name="assymetric"></param>
         /// <returns></returns>
         private static byte[] createByteArray(TimestepTimebaseSegmentCollection segments,
-                                                SequenceData sequence, out int nSegments, double masterClockPeriod, bool assymetric)
+                                                SequenceData sequence, out int nSegments, out int nSegmentsBeforeMerge, double masterClockPeriod, bool assymetric)
         {
+            return createByteArray(segments, sequence, out nSegments, out nSegmentsBeforeMerge, masterClockPeriod, assymetric, null);
+        }
+
+        /// <summary>
+        /// As above, reusing from cache the encoded records of timesteps whose segments (by reference, see
+        /// VariableTimebaseSegmentCache) and retrigger item are the same as in the previous shot. Only the
+        /// changed timesteps and the records where neighbouring timesteps merge are encoded; the result is
+        /// byte for byte the uncached one.
+        /// </summary>
+        /// <param name="cache">May be null.</param>
+        private static byte[] createByteArray(TimestepTimebaseSegmentCollection segments,
+                                                SequenceData sequence, out int nSegments, out int nSegmentsBeforeMerge, double masterClockPeriod, bool assymetric,
+                                                UploadCache cache)
+        {
+            if (cache != null)
+                return createByteArrayCached(segments, sequence, out nSegments, out nSegmentsBeforeMerge, masterClockPeriod, assymetric, cache);
+
             List<ListItem> listItems = new List<ListItem>();
 
             for (int stepID = 0; stepID < sequence.TimeSteps.Count; stepID++)
             {
-                if (sequence.TimeSteps[stepID].StepEnabled)
+                TimeStep step = sequence.TimeSteps[stepID];
+                if (step.StepEnabled)
                 {
-                    if (sequence.TimeSteps[stepID].RetriggerOptions.WaitForRetrigger)
-                    {
-                        uint waitTime = (uint)(sequence.TimeSteps[stepID].RetriggerOptions.RetriggerTimeout.getBaseValue() / masterClockPeriod);
-                        
-                        uint retriggerFlags = 0;
-                        if (sequence.TimeSteps[stepID].RetriggerOptions.RetriggerOnEdge)
-                            retriggerFlags += 1;
-                        if (!sequence.TimeSteps[stepID].RetriggerOptions.RetriggerOnNegativeValueOrEdge)
-                            retriggerFlags += 2;
-                        
-                        listItems.Add(new ListItem(waitTime, retriggerFlags, 0));
-                               // counts = 0 is a special signal for WAIT_FOR_RETRIGGER mode
-                               // in this mode, FPGA waits a maximum of on_counts master samples
-                               // before moving on anyway.
-                               // (unless on_counts = 0, in which case it never artificially retriggers)
-                                // retrigger flags set if the FPGA will trigger on edge or on value
-                                // and whether to trigger on positive or negative (edge or value)
-                    }
+                    ListItem retriggerItem;
+                    if (getRetriggerItem(step, masterClockPeriod, out retriggerItem))
+                        listItems.Add(retriggerItem);
 
-                    List<SequenceData.VariableTimebaseSegment> stepSegments = segments[sequence.TimeSteps[stepID]];
-                    for (int i = 0; i < stepSegments.Count; i++)
-                    {
-                        ListItem item = new ListItem();
-                        SequenceData.VariableTimebaseSegment currentSeg = stepSegments[i];
-
-                        item.repeats = (uint)currentSeg.NSegmentSamples;
-                        item.offCounts = (uint)(currentSeg.MasterSamplesPerSegmentSample / 2);
-                        item.onCounts = (uint)(currentSeg.MasterSamplesPerSegmentSample - item.offCounts);
-
-                        // in assymmetric mode (spelling?), the clock duty cycle is not held at 50%, but rather the pulses are made to be
-                        // 5 master cycles long at most. This is a workaround for the weird behavior of one of our fiber links
-                        // for sharing the variable timebase signal.
-                        if (assymetric)
-                        {
-                            if (item.onCounts > 5)
-                            {
-                                uint difference = item.onCounts - 5;
-                                item.onCounts = 5;
-                                item.offCounts = item.offCounts + difference;
-                            }
-                        }
-
-                        if (!item.isAllZeros())
-                        { // filter out any erroneously produced all-zero codes, since these have
-                            // special meaning to the FPGA (they are "wait for retrigger" codes
-                            listItems.Add(item);
-                        }
-                    }
+                    addSegmentItems(step, segments[step], assymetric, listItems);
                 }
             }
 
+            listItems.Add(getFinishItem(masterClockPeriod, assymetric));
 
+            nSegmentsBeforeMerge = listItems.Count;
+            listItems = mergeListItems(listItems);
+            nSegments = listItems.Count;
 
-            // Add one final "pulse" at the end to trigger the dwell values. I'm basing this off the
-            // old variable timebase code that I found in the SequenceData program. 
+            return encodeListItems(listItems);
+        }
 
-            // This final pulse is made to be 100 us long at least, just to be on the safe side. (unless assymetric mode is on)
+        private static byte[] createByteArrayCached(TimestepTimebaseSegmentCollection segments,
+                                                SequenceData sequence, out int nSegments, out int nSegmentsBeforeMerge, double masterClockPeriod, bool assymetric,
+                                                UploadCache cache)
+        {
+            List<ListItem> listItems = new List<ListItem>();
+            // records of listItems that are copied from an encoded step, in order
+            List<EncodedSpan> spans = new List<EncodedSpan>();
+            nSegmentsBeforeMerge = 0;
 
-            int minCounts = (int)(0.0001 / masterClockPeriod);
-            if (minCounts <= 0)
-                minCounts = 1;
+            cache.beginShot();
+
+            for (int stepID = 0; stepID < sequence.TimeSteps.Count; stepID++)
+            {
+                TimeStep step = sequence.TimeSteps[stepID];
+                if (!step.StepEnabled)
+                    continue;
 
-            ListItem finishItem = new ListItem((uint)minCounts, (uint)minCounts, 1);
+                ListItem retriggerItem;
+                bool waits = getRetriggerItem(step, masterClockPeriod, out retriggerItem);
+                VariableTimebaseSegmentCollection stepSegments = segments[step];
 
-            if (assymetric)
+                EncodedStep encoded = cache.getEncodedStep(stepSegments, waits, retriggerItem, assymetric);
+                if (encoded == null)
+                {
+                    List<ListItem> stepItems = new List<ListItem>();
+                    if (waits)
+                        stepItems.Add(retriggerItem);
+                    addSegmentItems(step, stepSegments, assymetric, stepItems);
+
+                    encoded = new EncodedStep();
+                    encoded.segments = stepSegments;
+                    encoded.waits = waits;
+                    encoded.retriggerItem = retriggerItem;
+                    encoded.assymetric = assymetric;
+                    encoded.nItemsBeforeMerge = stepItems.Count;
+                    encoded.items = mergeListItems(stepItems);
+                    encoded.records = encodeListItems(encoded.items);
+                    cache.storeEncodedStep(encoded);
+                }
+                nSegmentsBeforeMerge += encoded.nItemsBeforeMerge;
+
+                // The leading items may merge into the last record so far; from the first one that does
+                // not, the step's records go in as they are.
+                int first = 0;
+                while (first < encoded.items.Count && canMerge(listItems, encoded.items[first]))
+                {
+                    appendMergedSpliced(listItems, spans, encoded.items[first]);
+                    first++;
+                }
+                if (first < encoded.items.Count)
+                {
+                    EncodedSpan span;
+                    span.source = encoded.records;
+                    span.sourceIndex = first;
+                    span.index = listItems.Count;
+                    span.count = encoded.items.Count - first;
+                    spans.Add(span);
+                    for (int i = first; i < encoded.items.Count; i++)
+                        listItems.Add(encoded.items[i]);
+                }
+            }
+
+            appendMergedSpliced(listItems, spans, getFinishItem(masterClockPeriod, assymetric));
+            nSegmentsBeforeMerge++;
+            nSegments = listItems.Count;
+
+            // copy the reused records and encode the ones in between
+            byte[] byteArray = new byte[nSegments * 16];
+            int done = 0;
+            foreach (EncodedSpan span in spans)
             {
-                finishItem.onCounts = 5;
+                encodeListItemsInto(listItems, done, span.index - done, byteArray);
+                Buffer.BlockCopy(span.source, 16 * span.sourceIndex, byteArray, 16 * span.index, 16 * span.count);
+                done = span.index + span.count;
             }
+            encodeListItemsInto(listItems, done, nSegments - done, byteArray);
 
-            listItems.Add(finishItem);
+            return byteArray;
+        }
+
+        /// <summary>
+        /// appendMerged for createByteArrayCached: a record that is merged into no longer matches its
+        /// encoded step, so it is taken off the end of the span it was copied with.
+        /// </summary>
+        private static void appendMergedSpliced(List<ListItem> listItems, List<EncodedSpan> spans, ListItem item)
+        {
+            int count = listItems.Count;
+            if (!appendMerged(listItems, item))
+                return;
 
+            int last = spans.Count - 1;
+            if (last >= 0 && spans[last].index + spans[last].count == count)
+            {
+                EncodedSpan span = spans[last];
+                span.count--;
+                if (span.count == 0)
+                    spans.RemoveAt(last);
+                else
+                    spans[last] = span;
+            }
+        }
 
-            nSegments = listItems.Count;
+        private static void encodeListItemsInto(List<ListItem> listItems, int start, int count, byte[] byteArray)
+        {
+            if (count <= 0)
+                return;
+            byte[] records = encodeListItems(listItems.GetRange(start, count));
+            Buffer.BlockCopy(records, 0, byteArray, 16 * start, 16 * count);
+        }
 
-            byte[] byteArray = new byte[listItems.Count * 16];
+        /// <summary>
+        /// Records of listItems in createByteArrayCached that are copied from an encoded step.
+        /// </summary>
+        private struct EncodedSpan
+        {
+            public byte[] source;
+            public int sourceIndex;
+            public int index;
+            public int count;
+        }
+
+        /// <summary>
+        /// The list items of one timestep, merged within the timestep, and their encoded records.
+        /// Valid for as long as the timestep's segment collection and retrigger item stay the same.
+        /// </summary>
+        private class EncodedStep
+        {
+            public VariableTimebaseSegmentCollection segments;
+            public bool waits;
+            public ListItem retriggerItem;
+            public bool assymetric;
+            public int nItemsBeforeMerge;
+            public List<ListItem> items;
+            public byte[] records;
+            /// <summary>
+            /// Last shot that used it.
+            /// </summary>
+            public int shot;
+        }
+
+        /// <summary>
+        /// Variable timebase segments and encoded records of the previous shot on one device, so that in
+        /// list runs only the timesteps whose timing changed are regenerated and re-encoded. Encoded steps
+        /// are found by the reference of their segment collection, which VariableTimebaseSegmentCache hands
+        /// out again for unchanged timesteps. Only what the most recent shot used is kept.
+        /// </summary>
+        private class UploadCache
+        {
+            public readonly VariableTimebaseSegmentCache segments = new VariableTimebaseSegmentCache();
+
+            private Dictionary<VariableTimebaseSegmentCollection, EncodedStep> encodedSteps = new Dictionary<VariableTimebaseSegmentCollection, EncodedStep>();
+            private int shot;
+
+            /// <summary>
+            /// Timesteps whose encoded records were reused / encoded in the most recent shot.
+            /// </summary>
+            public int encodedHits;
+            public int encodedMisses;
+
+            /// <summary>
+            /// Starts a shot, dropping the encoded steps the previous one did not use.
+            /// </summary>
+            public void beginShot()
+            {
+                if (encodedHits + encodedMisses < encodedSteps.Count)
+                {
+                    List<VariableTimebaseSegmentCollection> unused = new List<VariableTimebaseSegmentCollection>();
+                    foreach (KeyValuePair<VariableTimebaseSegmentCollection, EncodedStep> entry in encodedSteps)
+                    {
+                        if (entry.Value.shot != shot)
+                            unused.Add(entry.Key);
+                    }
+                    foreach (VariableTimebaseSegmentCollection key in unused)
+                        encodedSteps.Remove(key);
+                }
+                shot++;
+                encodedHits = 0;
+                encodedMisses = 0;
+            }
+
+            public EncodedStep getEncodedStep(VariableTimebaseSegmentCollection segments, bool waits, ListItem retriggerItem, bool assymetric)
+            {
+                EncodedStep encoded;
+                if (encodedSteps.TryGetValue(segments, out encoded) && encoded.waits == waits && encoded.assymetric == assymetric
+                    && (!waits || (encoded.retriggerItem.onCounts == retriggerItem.onCounts && encoded.retriggerItem.offCounts == retriggerItem.offCounts)))
+                {
+                    encoded.shot = shot;
+                    encodedHits++;
+                    return encoded;
+                }
+                encodedMisses++;
+                return null;
+            }
+
+            public void storeEncodedStep(EncodedStep encoded)
+            {
+                encoded.shot = shot;
+                encodedSteps[encoded.segments] = encoded;
+            }
+        }
+
+        /// <summary>
+        /// Upload cache of each device.
+        /// </summary>
+        private static Dictionary<string, UploadCache> uploadCaches = new Dictionary<string, UploadCache>();
+
+        private static UploadCache getUploadCache(string deviceName)
+        {
+            lock (uploadCaches)
+            {
+                if (!uploadCaches.ContainsKey(deviceName))
+                    uploadCaches.Add(deviceName, new UploadCache());
+                return uploadCaches[deviceName];
+            }
+        }
+
+        /// <summary>
+        /// Generates the variable timebase segments of sequence and encodes them, reusing the segments and records
+        /// of the timesteps that are unchanged since the previous shot on the device.
+        /// </summary>
+        /// <param name="deviceName"></param>
+        /// <param name="sequence"></param>
+        /// <param name="masterClockPeriod"></param>
+        /// <param name="assymetric"></param>
+        /// <param name="nSegments"></param>
+        /// <param name="nSegmentsBeforeMerge"></param>
+        /// <returns></returns>
+        private static byte[] createUpload(string deviceName, SequenceData sequence, double masterClockPeriod, bool assymetric, out int nSegments, out int nSegmentsBeforeMerge)
+        {
+            UploadCache cache = getUploadCache(deviceName);
+            lock (cache)
+            {
+                TimestepTimebaseSegmentCollection segments = sequence.generateVariableTimebaseSegments(SequenceData.VariableTimebaseTypes.AnalogGroupControlledVariableFrequencyClock,
+                                                            masterClockPeriod, cache.segments);
+
+                return createByteArray(segments, sequence, out nSegments, out nSegmentsBeforeMerge, masterClockPeriod, assymetric, cache);
+            }
+        }
+
+        /// <summary>
+        /// Version of the records createByteArray writes for given timing inputs. Bump it when they change, so that
+        /// uploads stored by an older Atticus are not reused.
+        /// </summary>
+        private const long uploadKeyVersion = 1;
+
+        /// <summary>
+        /// Key of the upload of sequence in an upload cache directory, built from the timing inputs without
+        /// generating the upload.
+        /// </summary>
+        /// <param name="sequence"></param>
+        /// <param name="masterClockPeriod"></param>
+        /// <param name="assymetric"></param>
+        /// <returns></returns>
+        private static byte[] createUploadKey(SequenceData sequence, double masterClockPeriod, bool assymetric)
+        {
+            long[] inputs = sequence.getVariableTimebaseInputsKey(SequenceData.VariableTimebaseTypes.AnalogGroupControlledVariableFrequencyClock, masterClockPeriod);
+            long[] key = new long[2 + inputs.Length];
+            key[0] = uploadKeyVersion;
+            key[1] = assymetric ? 1 : 0;
+            Array.Copy(inputs, 0, key, 2, inputs.Length);
+
+            byte[] ans = new byte[8 * key.Length];
+            Buffer.BlockCopy(key, 0, ans, 0, ans.Length);
+            return ans;
+        }
 
+        /// <summary>
+        /// createUpload, trying the upload cache directory first if there is one. An upload found there is used as
+        /// is, without generating anything; one that is not is generated and stored for next time.
+        /// </summary>
+        /// <param name="diskCache">May be null.</param>
+        /// <param name="deviceName"></param>
+        /// <param name="sequence"></param>
+        /// <param name="masterClockPeriod"></param>
+        /// <param name="assymetric"></param>
+        /// <param name="nSegments"></param>
+        /// <param name="nSegmentsBeforeMerge"></param>
+        /// <param name="uploadCrc">CRC-32C of an upload from the directory, null if it was generated.</param>
+        /// <returns></returns>
+        private static byte[] loadOrCreateUpload(OkTimebaseCache diskCache, string deviceName, SequenceData sequence, double masterClockPeriod, bool assymetric, out int nSegments, out int nSegmentsBeforeMerge, out uint? uploadCrc)
+        {
+            uploadCrc = null;
+            if (diskCache == null)
+                return createUpload(deviceName, sequence, masterClockPeriod, assymetric, out nSegments, out nSegmentsBeforeMerge);
+
+            byte[] key = createUploadKey(sequence, masterClockPeriod, assymetric);
+            uint crc;
+            ulong storedSegmentsBeforeMerge;
+            byte[] data = diskCache.lookup(key, out crc, out storedSegmentsBeforeMerge);
+            if (data != null)
+            {
+                nSegments = data.Length / OkSegmentCodec.RecordSize;
+                nSegmentsBeforeMerge = (int)storedSegmentsBeforeMerge;
+                uploadCrc = crc;
+                return data;
+            }
+
+            data = createUpload(deviceName, sequence, masterClockPeriod, assymetric, out nSegments, out nSegmentsBeforeMerge);
+            diskCache.store(key, data, (ulong)nSegmentsBeforeMerge);
+            return data;
+        }
 
+        /// <summary>
+        /// Managed encoder of FIFO records; the fallback when okSegmentCodec.dll is not available.
+        /// </summary>
+        private static void encodeRecords(ulong[] onCounts, ulong[] offCounts, uint[] repeats, int count, byte[] byteArray)
+        {
             // This loop goes through the list items and creates
             // the data as it is to be sent to the FPGA
             // the data is a little shuffled because
             // of the details of the byte order in 
             // piping data to the fpga.
             
-            // Each list item takes up 16 bytes in the output FIFO.
-            for (int i = 0; i < listItems.Count; i++)
+            // Each list item takes up 16 bytes in the output FIFO:
+            // eight little-endian 16 bit words, most significant first
+            // within each count: on[47:32] on[31:16] on[15:0] off[47:32] off[31:16] off[15:0] rep[31:16] rep[15:0].
+            for (int i = 0; i < count; i++)
             {
-                ListItem item = listItems[i];
-
-                byte[] onb = splitIntToBytes(item.onCounts);
-                byte[] offb = splitIntToBytes(item.offCounts);
-                byte[] repb = splitIntToBytes(item.repeats);
+                ulong on = onCounts[i];
+                ulong off = offCounts[i];
+                uint rep = repeats[i];
 
                 int offs = 16 * i;
 
-                byteArray[offs + 2] = onb[1];
-                byteArray[offs + 3] = onb[0];
-                byteArray[offs + 4] = onb[3];
-                byteArray[offs + 5] = onb[2];
-
-                byteArray[offs + 8] = offb[1];
-                byteArray[offs + 9] = offb[0];
-                byteArray[offs + 10] = offb[3];
-                byteArray[offs + 11] = offb[2];
-
-                byteArray[offs + 12] = repb[1];
-                byteArray[offs + 13] = repb[0];
-                byteArray[offs + 14] = repb[3];
-                byteArray[offs + 15] = repb[2];
+                byteArray[offs + 0] = (byte)(on >> 32);
+                byteArray[offs + 1] = (byte)(on >> 40);
+                byteArray[offs + 2] = (byte)(on >> 16);
+                byteArray[offs + 3] = (byte)(on >> 24);
+                byteArray[offs + 4] = (byte)on;
+                byteArray[offs + 5] = (byte)(on >> 8);
+
+                byteArray[offs + 6] = (byte)(off >> 32);
+                byteArray[offs + 7] = (byte)(off >> 40);
+                byteArray[offs + 8] = (byte)(off >> 16);
+                byteArray[offs + 9] = (byte)(off >> 24);
+                byteArray[offs + 10] = (byte)off;
+                byteArray[offs + 11] = (byte)(off >> 8);
+
+                byteArray[offs + 12] = (byte)(rep >> 16);
+                byteArray[offs + 13] = (byte)(rep >> 24);
+                byteArray[offs + 14] = (byte)rep;
+                byteArray[offs + 15] = (byte)(rep >> 8);
             }
-
-            return byteArray;
-
         }
 
-        private static byte[] splitIntToBytes(uint splitMe)
+        private static uint[] crc32cTable;
+
+        /// <summary>
+        /// CRC-32C (Castagnoli) of the upload, as computed by the FPGA on the bytes entering its FIFO.
+        /// </summary>
+        /// <param name="data"></param>
+        /// <returns></returns>
+        private static uint computeUploadCrc(byte[] data)
         {
-            byte[] ans = new byte[4];
-            uint one = splitMe >> 24;
-            uint two = (splitMe-(one << 24))>>16;
-            uint three = (splitMe - (one<<24) - (two<<16))>>8;
-            uint four = splitMe - (one << 24) - (two << 16) - (three << 8);
-            ans[0] = (byte)one;
-            ans[1] = (byte)two;
-            ans[2] = (byte)three;
-            ans[3] = (byte)four;
-            return ans;
+            if (crc32cTable == null)
+            {
+                uint[] table = new uint[256];
+                for (uint i = 0; i < 256; i++)
+                {
+                    uint c = i;
+                    for (int k = 0; k < 8; k++)
+                        c = ((c & 1) != 0) ? ((c >> 1) ^ 0x82F63B78) : (c >> 1);
+                    table[i] = c;
+                }
+                crc32cTable = table;
+            }
+
+            uint crc = 0xFFFFFFFF;
+            for (int i = 0; i < data.Length; i++)
+                crc = (crc >> 8) ^ crc32cTable[(crc ^ data[i]) & 0xFF];
+            return ~crc;
         }
 
         private UInt32 max_elapsedtime_ms;
 
-        public FpgaTimebaseTask(DeviceSettings deviceSettings, okCFrontPanel opalKellyDevice, SequenceData sequence, double masterClockPeriod, out int nSegments, bool useRfModulation, bool assymetric)
+        /// <summary>
+        /// Totals of the upload from okSegmentCodec's validation, for the status poller and the run report.
+        /// Zero, with uploadValidated false, when okSegmentCodec.dll is missing.
+        /// </summary>
+        private bool uploadValidated;
+        private UInt64 expectedMasterSamples;
+        private UInt64 expectedClockEdges;
+
+        /// <summary>
+        /// Master samples generated as last seen by the status poller, rollovers included.
+        /// </summary>
+        private UInt64 masterSamplesGenerated;
+
+        /// <summary>
+        /// Whether the upload came from the upload cache directory, and the directory's counts at the time.
+        /// </summary>
+        private bool uploadFromCache;
+        private OkTimebaseCache.CacheStats uploadCacheStats;
+
+        public FpgaTimebaseTask(DeviceSettings deviceSettings, okCFrontPanel opalKellyDevice, SequenceData sequence, double masterClockPeriod, out int nSegments, out int nSegmentsBeforeMerge, bool useRfModulation, bool assymetric)
             : base()
         {
             com.opalkelly.frontpanel.okCFrontPanel.ErrorCode errorCode;
@@ -202,12 +681,35 @@ namespace AtticusServer
 
             this.masterClockPeriod = masterClockPeriod;
 
-            TimestepTimebaseSegmentCollection segments = sequence.generateVariableTimebaseSegments(SequenceData.VariableTimebaseTypes.AnalogGroupControlledVariableFrequencyClock,
-                                                        masterClockPeriod);
-
             this.max_elapsedtime_ms = (UInt32)((sequence.SequenceDuration * 1000.0) + 100);
 
-            byte[] data = FpgaTimebaseTask.createByteArray(segments, sequence, out nSegments, masterClockPeriod, assymetric );
+            OkTimebaseCache diskCache = null;
+            if (!String.IsNullOrEmpty(deviceSettings.UploadCacheDirectory))
+            {
+                ulong maxBytes = (deviceSettings.UploadCacheSizeMB > 0) ? (ulong)deviceSettings.UploadCacheSizeMB * 1024 * 1024 : OkTimebaseCache.DefaultMaxBytes;
+                diskCache = OkTimebaseCache.open(deviceSettings.UploadCacheDirectory, maxBytes);
+            }
+
+            uint? uploadCrc;
+            byte[] data = FpgaTimebaseTask.loadOrCreateUpload(diskCache, deviceSettings.DeviceName, sequence, masterClockPeriod, assymetric, out nSegments, out nSegmentsBeforeMerge, out uploadCrc);
+            if (diskCache != null)
+            {
+                this.uploadFromCache = uploadCrc.HasValue;
+                this.uploadCacheStats = diskCache.Stats;
+            }
+
+            // Reject a malformed upload before the board is touched.
+            OkSegmentCodec.SegmentStats uploadStats;
+            if (OkSegmentCodec.validate(data, masterClockPeriod, out uploadStats))
+            {
+                if (!uploadStats.Valid)
+                {
+                    throw new Exception("Clock data for FPGA device failed validation (flags 0x" + uploadStats.flags.ToString("X2") + ", " + uploadStats.badRecords + " bad records, first bad record " + uploadStats.firstBadRecord + " of " + uploadStats.records + ").");
+                }
+                this.uploadValidated = true;
+                this.expectedMasterSamples = uploadStats.masterSamples;
+                this.expectedClockEdges = uploadStats.clockEdges;
+            }
 
             // Send the device an abort trigger.
             errorCode = opalKellyDevice.ActivateTriggerIn(0x40, 1);
@@ -233,6 +735,16 @@ namespace AtticusServer
 
             opalKellyDevice.UpdateWireIns();
 
+            if (deviceSettings.VerifyUploadCrc)
+            {
+                // Clear the FPGA's upload CRC.
+                errorCode = opalKellyDevice.ActivateTriggerIn(0x41, 0);
+                if (errorCode != okCFrontPanel.ErrorCode.NoError)
+                {
+                    throw new Exception("Unable to reset upload CRC of FPGA device. Error code " + errorCode.ToString());
+                }
+            }
+
             // pipe the byte stream to the device
             int xfered = opalKellyDevice.WriteToPipeIn(0x80, data.Length, data);
             if (xfered != data.Length)
@@ -240,6 +752,20 @@ namespace AtticusServer
                 throw new Exception("Error when piping clock data to FPGA device. Sent " + xfered + " bytes instead of " + data.Length + "bytes.");
             }
 
+            if (deviceSettings.VerifyUploadCrc)
+            {
+                // Compare against the CRC the FPGA computed over the words its FIFO
+                // accepted, so words dropped on overflow fail the check too.
+                // One wire out update instead of a readback.
+                uint expected = uploadCrc.HasValue ? uploadCrc.Value : computeUploadCrc(data);
+                opalKellyDevice.UpdateWireOuts();
+                uint received = extractUInt32FromAddresses(0x28, 0x29);
+                if (received != expected)
+                {
+                    throw new Exception("Clock data upload to FPGA device was corrupted. FPGA reports CRC 0x" + received.ToString("X8") + ", expected 0x" + expected.ToString("X8") + ".");
+                }
+            }
+
 
 
         }
@@ -415,8 +941,16 @@ namespace AtticusServer
                     continue;
                 lastmSamp = mSamp;
 
+                UInt64 generated = ((UInt64)rollovers << 32) + mSamp;
+                masterSamplesGenerated = generated;
+
                 uint nowTime = (uint)(mSamp * this.masterClockPeriod * 1000.0) + (uint)(rollovers * rolloverTime);
 
+                // The board cannot be further along than the upload it was given; a
+                // misread rollover would otherwise run the clock ahead.
+                if (uploadValidated && generated > expectedMasterSamples)
+                    nowTime = (uint)Math.Min(expectedMasterSamples * this.masterClockPeriod * 1000.0, max_elapsedtime_ms);
+
                 keepGoing = reachTime(nowTime);
                 Thread.Sleep(5);
             }
@@ -428,6 +962,12 @@ namespace AtticusServer
             opalKellyDevice.UpdateWireOuts();
             ans.retriggerWaitedSamples = this.getSamplesWaitedForRetrigger();
             ans.retriggerTimeoutCount = this.getRetriggerTimeoutCount();
+            ans.expectedMasterSamples = this.expectedMasterSamples;
+            ans.expectedClockEdges = this.expectedClockEdges;
+            ans.masterSamplesGenerated = this.masterSamplesGenerated;
+            ans.uploadFromCache = this.uploadFromCache;
+            ans.uploadCacheHits = this.uploadCacheStats.hits;
+            ans.uploadCacheMisses = this.uploadCacheStats.misses;
 
             return ans;
         }
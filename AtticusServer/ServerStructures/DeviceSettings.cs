@@ -348,6 +348,7 @@ Category("RFSG")]
         public DeviceSettings()
         {
             this.deviceEnabled = false;
+            this.uploadCacheSizeMB = 256;
         }
 
         public DeviceSettings(string deviceName, string deviceDescription) : this()
@@ -377,5 +378,35 @@ Category("Error Checking")]
             set { retriggerDebounceSamples = value; }
         }
 
+        private bool verifyUploadCrc;
+
+        [Description("Applies only to FPGA Variable Timebase generation devices. If true, the CRC of the clock data uploaded to the FPGA is compared against the CRC computed by the FPGA, and the run is aborted if they differ. Requires FPGA firmware with the upload CRC (wire outs 0x28 / 0x29); leave false for older firmware."),
+        Category("FPGA")]
+        public bool VerifyUploadCrc
+        {
+            get { return verifyUploadCrc; }
+            set { verifyUploadCrc = value; }
+        }
+
+        private string uploadCacheDirectory;
+
+        [Description("Applies only to FPGA Variable Timebase generation devices. Directory in which the clock data of each sequence is kept once generated, so that a sequence whose timing matches one run before (in this or an earlier session of Atticus) is uploaded without being regenerated. Several devices may share a directory. Leave empty to disable. Requires okSegmentCodec.dll."),
+        Category("FPGA")]
+        public string UploadCacheDirectory
+        {
+            get { return uploadCacheDirectory; }
+            set { uploadCacheDirectory = value; }
+        }
+
+        private int uploadCacheSizeMB;
+
+        [Description("Applies only to FPGA Variable Timebase generation devices with an upload cache directory. Size limit of the directory in megabytes; the least recently used clock data is deleted beyond it. 0 means 256."),
+        Category("FPGA")]
+        public int UploadCacheSizeMB
+        {
+            get { return uploadCacheSizeMB; }
+            set { uploadCacheSizeMB = value; }
+        }
+
     }
 }
@@ -0,0 +1,208 @@
+using System;
+using System.Runtime.InteropServices;
+
+namespace AtticusServer
+{
+    /// <summary>
+    /// Wrapper of okSegmentCodec.dll, the native segment FIFO record encoder and upload validator built from
+    /// Opal Kelly/FrontPanelSupport (okSegmentEncoder.cpp, okSegmentDecoder.cpp, okSegmentCodec.vcxproj). It gives
+    /// byte for byte the records of FpgaTimebaseTask's managed encoder, with SSE2 / AVX2 when every
+    /// count fits in 32 bits.
+    /// 
+    /// The DLL is optional. If it is missing or cannot be loaded (wrong bitness, say), Available is
+    /// false, encode() and validate() return false, and callers fall back to the managed encoder and
+    /// upload without the check.
+    /// </summary>
+    public static class OkSegmentCodec
+    {
+        public const int RecordSize = 16;
+
+        private const string dllName = "okSegmentCodec";
+
+        private class PInvoke
+        {
+            [DllImport(dllName, EntryPoint = "okSegmentEncoder_Encode", CallingConvention = CallingConvention.StdCall)]
+            public static extern long Encode(uint[] onCounts, uint[] offCounts, uint[] repeats, int count, byte[] output);
+
+            [DllImport(dllName, EntryPoint = "okSegmentEncoder_Encode48", CallingConvention = CallingConvention.StdCall)]
+            public static extern long Encode48(ulong[] onCounts, ulong[] offCounts, uint[] repeats, int count, byte[] output);
+
+            [DllImport(dllName, EntryPoint = "okSegmentEncoder_GetInstructionSet", CallingConvention = CallingConvention.StdCall)]
+            public static extern int GetInstructionSet();
+
+            [DllImport(dllName, EntryPoint = "okSegmentDecoder_Validate", CallingConvention = CallingConvention.StdCall)]
+            public static extern int Validate(byte[] data, long length, double masterClockPeriod, ref SegmentStats stats);
+        }
+
+        /// <summary>
+        /// Error flags of SegmentStats.flags (okSegmentDecoder_* in okSegmentDecoder.h).
+        /// </summary>
+        public const uint FlagZeroPhase = 0x01;
+        public const uint FlagOverflow = 0x02;
+        public const uint FlagRetriggerFlags = 0x04;
+        public const uint FlagTruncated = 0x08;
+        public const uint FlagEmpty = 0x10;
+        public const uint FlagErrors = 0x1f;
+
+        /// <summary>
+        /// okSegmentStats. Every field ahead of flags is 64 bits wide, so the layout is the same
+        /// for 32 and 64 bit processes.
+        /// </summary>
+        [StructLayout(LayoutKind.Sequential)]
+        public struct SegmentStats
+        {
+            public long records;
+            public long retriggers;
+            /// <summary>
+            /// Retriggers without a timeout.
+            /// </summary>
+            public long untimedRetriggers;
+            public ulong masterSamples;
+            public ulong clockEdges;
+            public ulong retriggerTimeoutSamples;
+            /// <summary>
+            /// Seconds, every retrigger arriving at once.
+            /// </summary>
+            public double minDuration;
+            /// <summary>
+            /// Seconds, every timed retrigger timing out; negative when an untimed retrigger can wait forever.
+            /// </summary>
+            public double maxDuration;
+            public uint flags;
+            public long badRecords;
+            /// <summary>
+            /// -1 if none.
+            /// </summary>
+            public long firstBadRecord;
+
+            public bool Valid
+            {
+                get
+                {
+                    return (flags & FlagErrors) == 0;
+                }
+            }
+        }
+
+        private static object lockObj = new object();
+
+        /// <summary>
+        /// 0 not yet probed, 1 loaded, -1 unavailable.
+        /// </summary>
+        private static int state = 0;
+
+        private static int instructionSet = -1;
+
+        /// <summary>
+        /// True if okSegmentCodec.dll was found and loaded. The first call probes for it.
+        /// </summary>
+        public static bool Available
+        {
+            get
+            {
+                if (state == 0)
+                {
+                    lock (lockObj)
+                    {
+                        if (state == 0)
+                        {
+                            try
+                            {
+                                instructionSet = PInvoke.GetInstructionSet();
+                                state = 1;
+                            }
+                            catch (Exception e)
+                            {
+                                if (!isLoadFailure(e))
+                                    throw;
+                                state = -1;
+                            }
+                        }
+                    }
+                }
+                return state == 1;
+            }
+        }
+
+        /// <summary>
+        /// Instruction set the native encoder uses for 32 bit counts: 0 plain C, 1 SSE2, 2 AVX2; -1 if not Available.
+        /// </summary>
+        public static int InstructionSet
+        {
+            get
+            {
+                return Available ? instructionSet : -1;
+            }
+        }
+
+        private static bool isLoadFailure(Exception e)
+        {
+            return e is DllNotFoundException || e is EntryPointNotFoundException || e is BadImageFormatException;
+        }
+
+        /// <summary>
+        /// Encodes count records into output (at least 16 * count bytes). Returns false, leaving output
+        /// untouched, if the native encoder is not Available.
+        /// </summary>
+        /// <param name="onCounts">On counts, at most 48 bits each.</param>
+        /// <param name="offCounts">Off counts, at most 48 bits each.</param>
+        /// <param name="repeats"></param>
+        /// <param name="count"></param>
+        /// <param name="output"></param>
+        /// <returns></returns>
+        public static bool encode(ulong[] onCounts, ulong[] offCounts, uint[] repeats, int count, byte[] output)
+        {
+            if (count < 0 || onCounts.Length < count || offCounts.Length < count || repeats.Length < count)
+                throw new ArgumentException("Fewer than " + count + " counts given.");
+            if ((long)output.Length < (long)RecordSize * count)
+                throw new ArgumentException("Output holds fewer than " + count + " records.");
+            if (!Available)
+                return false;
+
+            ulong widest = 0;
+            for (int i = 0; i < count; i++)
+                widest |= onCounts[i] | offCounts[i];
+
+            long written;
+            if (widest <= uint.MaxValue)
+            {
+                uint[] on = new uint[count];
+                uint[] off = new uint[count];
+                for (int i = 0; i < count; i++)
+                {
+                    on[i] = (uint)onCounts[i];
+                    off[i] = (uint)offCounts[i];
+                }
+                written = PInvoke.Encode(on, off, repeats, count, output);
+            }
+            else
+            {
+                written = PInvoke.Encode48(onCounts, offCounts, repeats, count, output);
+            }
+
+            if (written != (long)RecordSize * count)
+                throw new InvalidOperationException("okSegmentCodec encoded " + written + " bytes instead of " + ((long)RecordSize * count) + "; a count does not fit in 48 bits.");
+            return true;
+        }
+
+        /// <summary>
+        /// Checks an encoded upload (zero phases, overflow, retrigger flags, truncation, no timed record)
+        /// and totals its master samples and clock edges. Returns false, with stats cleared, if the native
+        /// validator is not Available; otherwise stats.Valid tells whether the upload passed.
+        /// </summary>
+        /// <param name="data"></param>
+        /// <param name="masterClockPeriod">Seconds, for the durations.</param>
+        /// <param name="stats"></param>
+        /// <returns></returns>
+        public static bool validate(byte[] data, double masterClockPeriod, out SegmentStats stats)
+        {
+            stats = new SegmentStats();
+            stats.firstBadRecord = -1;
+            if (!Available)
+                return false;
+
+            PInvoke.Validate(data, data.Length, masterClockPeriod, ref stats);
+            return true;
+        }
+    }
+}
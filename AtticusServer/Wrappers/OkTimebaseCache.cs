@@ -0,0 +1,156 @@
+using System;
+using System.Collections.Generic;
+using System.Runtime.InteropServices;
+
+namespace AtticusServer
+{
+    /// <summary>
+    /// Wrapper of okTimebaseCache in okSegmentCodec.dll (Opal Kelly/FrontPanelSupport/okTimebaseCache.cpp), a directory of
+    /// encoded FIFO streams kept across server runs. Entries are keyed by the bytes the caller builds from the sequence's
+    /// timing inputs, written once, and memory-mapped when they are looked up again. The native side checks each
+    /// entry's CRC-32C once per run and keeps the directory under its size limit by dropping least recently used entries.
+    /// 
+    /// Like OkSegmentCodec, the cache is optional: open() returns null when okSegmentCodec.dll is not Available.
+    /// </summary>
+    public class OkTimebaseCache
+    {
+        private const string dllName = "okSegmentCodec";
+
+        private class PInvoke
+        {
+            [DllImport(dllName, EntryPoint = "okTimebaseCache_Open", CallingConvention = CallingConvention.StdCall)]
+            public static extern IntPtr Open(string directory, ulong maxBytes);
+
+            [DllImport(dllName, EntryPoint = "okTimebaseCache_Close", CallingConvention = CallingConvention.StdCall)]
+            public static extern void Close(IntPtr cache);
+
+            [DllImport(dllName, EntryPoint = "okTimebaseCache_SetMaxSize", CallingConvention = CallingConvention.StdCall)]
+            public static extern void SetMaxSize(IntPtr cache, ulong maxBytes);
+
+            [DllImport(dllName, EntryPoint = "okTimebaseCache_Lookup", CallingConvention = CallingConvention.StdCall)]
+            public static extern IntPtr Lookup(IntPtr cache, byte[] key, long keyLength, out long length, out uint crc, out ulong value);
+
+            [DllImport(dllName, EntryPoint = "okTimebaseCache_Release", CallingConvention = CallingConvention.StdCall)]
+            public static extern void Release(IntPtr cache, IntPtr data);
+
+            [DllImport(dllName, EntryPoint = "okTimebaseCache_Store", CallingConvention = CallingConvention.StdCall)]
+            public static extern int Store(IntPtr cache, byte[] key, long keyLength, byte[] data, long length, ulong value);
+
+            [DllImport(dllName, EntryPoint = "okTimebaseCache_GetStats", CallingConvention = CallingConvention.StdCall)]
+            public static extern void GetStats(IntPtr cache, ref CacheStats stats);
+        }
+
+        /// <summary>
+        /// okTimebaseCacheStats.
+        /// </summary>
+        [StructLayout(LayoutKind.Sequential)]
+        public struct CacheStats
+        {
+            public long hits;
+            public long misses;
+            public long evictions;
+            public long entries;
+            /// <summary>
+            /// Bytes in the directory.
+            /// </summary>
+            public ulong size;
+            public ulong maxSize;
+        }
+
+        public const ulong DefaultMaxBytes = 256UL * 1024 * 1024;
+
+        /// <summary>
+        /// Open caches by directory, shared by every board using the same directory.
+        /// </summary>
+        private static Dictionary<string, OkTimebaseCache> caches = new Dictionary<string, OkTimebaseCache>();
+
+        private IntPtr handle;
+
+        private OkTimebaseCache(IntPtr handle)
+        {
+            this.handle = handle;
+        }
+
+        /// <summary>
+        /// Returns the cache in directory, creating the directory if needed. Later calls for the same directory give
+        /// the same cache, with its size limit set to maxBytes. Caches stay open for the life of the server. Returns
+        /// null if okSegmentCodec.dll is not Available; throws if the directory cannot be opened.
+        /// </summary>
+        /// <param name="directory"></param>
+        /// <param name="maxBytes"></param>
+        /// <returns></returns>
+        public static OkTimebaseCache open(string directory, ulong maxBytes)
+        {
+            if (!OkSegmentCodec.Available)
+                return null;
+
+            lock (caches)
+            {
+                OkTimebaseCache cache;
+                if (caches.TryGetValue(directory, out cache))
+                {
+                    if (cache.Stats.maxSize != maxBytes)
+                        PInvoke.SetMaxSize(cache.handle, maxBytes);
+                    return cache;
+                }
+
+                IntPtr handle = PInvoke.Open(directory, maxBytes);
+                if (handle == IntPtr.Zero)
+                    throw new Exception("Unable to open upload cache directory " + directory + ".");
+                cache = new OkTimebaseCache(handle);
+                caches.Add(directory, cache);
+                return cache;
+            }
+        }
+
+        /// <summary>
+        /// Copies out the stream stored under key, or returns null on a miss.
+        /// </summary>
+        /// <param name="key"></param>
+        /// <param name="crc">CRC-32C of the stream, as the FPGA computes it over the upload.</param>
+        /// <param name="value">The value stored with the stream.</param>
+        /// <returns></returns>
+        public byte[] lookup(byte[] key, out uint crc, out ulong value)
+        {
+            long length;
+            IntPtr data = PInvoke.Lookup(handle, key, key.Length, out length, out crc, out value);
+            if (data == IntPtr.Zero)
+                return null;
+
+            try
+            {
+                byte[] ans = new byte[length];
+                Marshal.Copy(data, ans, 0, ans.Length);
+                return ans;
+            }
+            finally
+            {
+                PInvoke.Release(handle, data);
+            }
+        }
+
+        /// <summary>
+        /// Stores data under key, along with a value that lookup() hands back. Returns false if the entry was not
+        /// written (larger than the size limit, or the disk write failed); the cache is only an optimization, so
+        /// callers carry on either way.
+        /// </summary>
+        /// <param name="key"></param>
+        /// <param name="data"></param>
+        /// <param name="value"></param>
+        /// <returns></returns>
+        public bool store(byte[] key, byte[] data, ulong value)
+        {
+            return PInvoke.Store(handle, key, key.Length, data, data.Length, value) != 0;
+        }
+
+        public CacheStats Stats
+        {
+            get
+            {
+                CacheStats stats = new CacheStats();
+                PInvoke.GetStats(handle, ref stats);
+                return stats;
+            }
+        }
+    }
+}
@@ -0,0 +1,525 @@
+﻿using AtticusServer;
+using DataStructures;
+using Microsoft.VisualStudio.TestTools.UnitTesting;
+using System;
+using System.Collections.Generic;
+using System.IO;
+
+namespace CiceroSuiteUnitTests
+{
+    
+    
+    /// <summary>
+    ///This is a test class for FpgaTimebaseTaskTest and is intended
+    ///to contain all FpgaTimebaseTaskTest Unit Tests
+    ///</summary>
+    [TestClass()]
+    public class FpgaTimebaseTaskTest
+    {
+
+
+        private TestContext testContextInstance;
+
+        /// <summary>
+        ///Gets or sets the test context which provides
+        ///information about and functionality for the current test run.
+        ///</summary>
+        public TestContext TestContext
+        {
+            get
+            {
+                return testContextInstance;
+            }
+            set
+            {
+                testContextInstance = value;
+            }
+        }
+
+        #region Additional test attributes
+        // 
+        //You can use the following additional attributes as you write your tests:
+        //
+        //Use ClassInitialize to run code before running the first test in the class
+        //[ClassInitialize()]
+        //public static void MyClassInitialize(TestContext testContext)
+        //{
+        //}
+        //
+        //Use ClassCleanup to run code after all tests in a class have run
+        //[ClassCleanup()]
+        //public static void MyClassCleanup()
+        //{
+        //}
+        //
+        //Use TestInitialize to run code before running each test
+        //[TestInitialize()]
+        //public void MyTestInitialize()
+        //{
+        //}
+        //
+        //Use TestCleanup to run code after each test has run
+        //[TestCleanup()]
+        //public void MyTestCleanup()
+        //{
+        //}
+        //
+        #endregion
+
+        private const double masterClockPeriod = 1e-7;
+
+        /// <summary>
+        /// Closing record createByteArray appends: 100 us of master samples on and off.
+        /// </summary>
+        private const ulong finishCounts = 1000;
+
+        private static TimeStep timeStep(string name)
+        {
+            TimeStep step = new TimeStep(name);
+            step.StepEnabled = true;
+            step.StepDuration = new DimensionedParameter(Units.s, 1e-3);
+            return step;
+        }
+
+        /// <summary>
+        /// Runs createByteArray on hand-built segments, one timestep per entry of stepSegments
+        /// (each a list of { nSegmentSamples, masterSamplesPerSegmentSample } pairs).
+        /// </summary>
+        private static byte[] encode(List<TimeStep> steps, List<long[][]> stepSegments, bool assymetric, out int nSegments, out int nSegmentsBeforeMerge)
+        {
+            TimestepTimebaseSegmentCollection segments = new TimestepTimebaseSegmentCollection();
+            for (int i = 0; i < steps.Count; i++)
+            {
+                VariableTimebaseSegmentCollection collection = new VariableTimebaseSegmentCollection();
+                foreach (long[] segment in stepSegments[i])
+                    collection.Add(new SequenceData.VariableTimebaseSegment((int)segment[0], segment[1]));
+                segments.Add(steps[i], collection);
+            }
+            return FpgaTimebaseTask_Accessor.createByteArray(segments, new SequenceData(steps), out nSegments, out nSegmentsBeforeMerge, masterClockPeriod, assymetric);
+        }
+
+        /// <summary>
+        /// One FIFO record as the encoder wrote it before the counts were widened to 48 bits
+        /// (bytes 0-1 and 6-7 always zero).
+        /// </summary>
+        private static void oldRecord(List<byte> stream, uint on, uint off, uint rep)
+        {
+            stream.AddRange(new byte[] {
+                0, 0, (byte)(on >> 16), (byte)(on >> 24), (byte)on, (byte)(on >> 8),
+                0, 0, (byte)(off >> 16), (byte)(off >> 24), (byte)off, (byte)(off >> 8),
+                (byte)(rep >> 16), (byte)(rep >> 24), (byte)rep, (byte)(rep >> 8) });
+        }
+
+        private static void assertBytesEqual(byte[] expected, byte[] actual)
+        {
+            Assert.AreEqual(expected.Length, actual.Length, "Stream lengths differ.");
+            for (int i = 0; i < expected.Length; i++)
+                Assert.AreEqual(expected[i], actual[i], "Streams differ at record " + (i / 16) + " byte " + (i % 16));
+        }
+
+        /// <summary>
+        ///createByteArray with counts below 2^32 gives byte for byte the records of the 32 bit encoder
+        ///</summary>
+        [TestMethod()]
+        public void createByteArray32BitCountsTest()
+        {
+            long[] masterSamples = { 2, 3, 1001, 0x30007, 0x1234567, 0xFFFFFFFEL, 0x1FFFFFFFEL };
+            List<TimeStep> steps = new List<TimeStep>();
+            List<long[][]> stepSegments = new List<long[][]>();
+            List<byte> expected = new List<byte>();
+
+            for (int i = 0; i < masterSamples.Length; i++)
+            {
+                TimeStep step = timeStep("step " + i);
+                if (i == 3)
+                {
+                    // 10 ms timeout, on edge, positive
+                    step.RetriggerOptions = new RetriggerOptions(true, false, true, new DimensionedParameter(Units.s, 10e-3));
+                    oldRecord(expected, 100000, 3, 0);
+                }
+                steps.Add(step);
+                stepSegments.Add(new long[][] { new long[] { i + 1, masterSamples[i] } });
+
+                uint off = (uint)(masterSamples[i] / 2);
+                oldRecord(expected, (uint)(masterSamples[i] - off), off, (uint)(i + 1));
+            }
+            oldRecord(expected, (uint)finishCounts, (uint)finishCounts, 1);
+
+            int nSegments, nSegmentsBeforeMerge;
+            byte[] stream = encode(steps, stepSegments, false, out nSegments, out nSegmentsBeforeMerge);
+            Assert.AreEqual(masterSamples.Length + 2, nSegments);
+            Assert.AreEqual(nSegmentsBeforeMerge, nSegments);
+            assertBytesEqual(expected.ToArray(), stream);
+        }
+
+        /// <summary>
+        ///createByteArray puts on[47:32] and off[47:32] in record bytes 0-1 and 6-7
+        ///</summary>
+        [TestMethod()]
+        public void createByteArray48BitCountsTest()
+        {
+            List<TimeStep> steps = new List<TimeStep>();
+            steps.Add(timeStep("long"));
+            steps.Add(timeStep("longest"));
+            List<long[][]> stepSegments = new List<long[][]>();
+            stepSegments.Add(new long[][] { new long[] { 3, 2 * 0x123456789ABCL + 1 } });
+            stepSegments.Add(new long[][] { new long[] { 1, SequenceData.VariableTimebaseSegment.MaxMasterSamplesPerSegmentSample } });
+
+            int nSegments, nSegmentsBeforeMerge;
+            byte[] stream = encode(steps, stepSegments, false, out nSegments, out nSegmentsBeforeMerge);
+
+            List<byte> expected = new List<byte>();
+            // on 0x123456789ABD, off 0x123456789ABC, 3 repeats
+            expected.AddRange(new byte[] { 0x34, 0x12, 0x78, 0x56, 0xBD, 0x9A, 0x34, 0x12, 0x78, 0x56, 0xBC, 0x9A, 0x00, 0x00, 0x03, 0x00 });
+            // on and off 2^48 - 1, 1 repeat
+            expected.AddRange(new byte[] { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x01, 0x00 });
+            oldRecord(expected, (uint)finishCounts, (uint)finishCounts, 1);
+
+            Assert.AreEqual(3, nSegments);
+            assertBytesEqual(expected.ToArray(), stream);
+        }
+
+        /// <summary>
+        ///createByteArray refuses counts that do not fit in 48 bits
+        ///</summary>
+        [TestMethod()]
+        [ExpectedException(typeof(Exception))]
+        public void createByteArrayCountOverflowTest()
+        {
+            // in assymetric mode all but 5 master samples go to the off count, which overflows here
+            List<TimeStep> steps = new List<TimeStep>();
+            steps.Add(timeStep("longest"));
+            List<long[][]> stepSegments = new List<long[][]>();
+            stepSegments.Add(new long[][] { new long[] { 1, SequenceData.VariableTimebaseSegment.MaxMasterSamplesPerSegmentSample } });
+
+            int nSegments, nSegmentsBeforeMerge;
+            encode(steps, stepSegments, true, out nSegments, out nSegmentsBeforeMerge);
+        }
+
+        private static ulong recordOn(byte[] stream, int record)
+        {
+            int offs = 16 * record;
+            return ((ulong)stream[offs + 1] << 40) | ((ulong)stream[offs + 0] << 32) | ((ulong)stream[offs + 3] << 24)
+                | ((ulong)stream[offs + 2] << 16) | ((ulong)stream[offs + 5] << 8) | stream[offs + 4];
+        }
+
+        private static uint recordRepeats(byte[] stream, int record)
+        {
+            int offs = 16 * record;
+            return ((uint)stream[offs + 13] << 24) | ((uint)stream[offs + 12] << 16) | ((uint)stream[offs + 15] << 8) | stream[offs + 14];
+        }
+
+        /// <summary>
+        /// Encodes one timestep per entry of nSegmentSamples, each a single segment of 4 master samples.
+        /// </summary>
+        private static byte[] encodeRepeats(long[] nSegmentSamples, out int nSegments, out int nSegmentsBeforeMerge)
+        {
+            List<TimeStep> steps = new List<TimeStep>();
+            List<long[][]> stepSegments = new List<long[][]>();
+            for (int i = 0; i < nSegmentSamples.Length; i++)
+            {
+                steps.Add(timeStep("step " + i));
+                stepSegments.Add(new long[][] { new long[] { nSegmentSamples[i], 4 } });
+            }
+            return encode(steps, stepSegments, false, out nSegments, out nSegmentsBeforeMerge);
+        }
+
+        /// <summary>
+        ///mergeListItems merges up to the 32 bit repeat limit and splits beyond it
+        ///</summary>
+        [TestMethod()]
+        public void mergeListItemsRepeatLimitTest()
+        {
+            int nSegments, nSegmentsBeforeMerge;
+
+            // 2^32 - 1 repeats: still one record, followed by the finish record
+            byte[] stream = encodeRepeats(new long[] { int.MaxValue, int.MaxValue, 1 }, out nSegments, out nSegmentsBeforeMerge);
+            Assert.AreEqual(4, nSegmentsBeforeMerge);
+            Assert.AreEqual(2, nSegments);
+            Assert.AreEqual(uint.MaxValue, recordRepeats(stream, 0));
+            Assert.AreEqual(2UL, recordOn(stream, 0));
+            Assert.AreEqual(finishCounts, recordOn(stream, 1));
+
+            // 2^32 repeats: split into 2^32 - 1 and 1
+            stream = encodeRepeats(new long[] { int.MaxValue, int.MaxValue, 1, 1 }, out nSegments, out nSegmentsBeforeMerge);
+            Assert.AreEqual(5, nSegmentsBeforeMerge);
+            Assert.AreEqual(3, nSegments);
+            Assert.AreEqual(uint.MaxValue, recordRepeats(stream, 0));
+            Assert.AreEqual(1U, recordRepeats(stream, 1));
+            Assert.AreEqual(2UL, recordOn(stream, 1));
+
+            // 3 * (2^31 - 1) = 2^32 - 1 + 2^31 - 2: the remainder goes on merging into the split-off record
+            stream = encodeRepeats(new long[] { int.MaxValue, int.MaxValue, int.MaxValue, 5 }, out nSegments, out nSegmentsBeforeMerge);
+            Assert.AreEqual(3, nSegments);
+            Assert.AreEqual(uint.MaxValue, recordRepeats(stream, 0));
+            Assert.AreEqual((uint)int.MaxValue - 1 + 5, recordRepeats(stream, 1));
+
+            // the repeats of every record add up to those of the input
+            ulong total = 0;
+            for (int i = 0; i < nSegments - 1; i++)
+                total += recordRepeats(stream, i);
+            Assert.AreEqual(3UL * int.MaxValue + 5, total);
+        }
+
+        /// <summary>
+        ///mergeListItems does not merge retrigger records, across them, or records whose counts differ
+        ///</summary>
+        [TestMethod()]
+        public void mergeListItemsBarrierTest()
+        {
+            List<TimeStep> steps = new List<TimeStep>();
+            List<long[][]> stepSegments = new List<long[][]>();
+            for (int i = 0; i < 5; i++)
+            {
+                TimeStep step = timeStep("step " + i);
+                // steps 1 and 2 wait for identical retriggers back to back
+                if (i == 1 || i == 2)
+                    step.RetriggerOptions = new RetriggerOptions(true, true, false, new DimensionedParameter(Units.s, 1e-3));
+                steps.Add(step);
+            }
+            stepSegments.Add(new long[][] { new long[] { 7, 4 } });
+            stepSegments.Add(new long[][] { });
+            stepSegments.Add(new long[][] { new long[] { 7, 4 } });
+            stepSegments.Add(new long[][] { new long[] { 7, 4 }, new long[] { 7, 6 }, new long[] { 7, 4 } });
+            stepSegments.Add(new long[][] { new long[] { 7, 4 } });
+
+            int nSegments, nSegmentsBeforeMerge;
+            byte[] stream = encode(steps, stepSegments, false, out nSegments, out nSegmentsBeforeMerge);
+
+            // segment | retrigger | retrigger | segment + segment | segment | segment + segment | finish
+            uint[] repeats = { 7, 0, 0, 14, 7, 14, 1 };
+            Assert.AreEqual(9, nSegmentsBeforeMerge);
+            Assert.AreEqual(repeats.Length, nSegments);
+            for (int i = 0; i < repeats.Length; i++)
+                Assert.AreEqual(repeats[i], recordRepeats(stream, i), "Record " + i);
+            Assert.AreEqual(3UL, recordOn(stream, 4));
+        }
+
+        /// <summary>
+        ///okSegmentCodec.dll gives byte for byte the records of the managed encoder, for 32 and 48 bit counts
+        ///</summary>
+        [TestMethod()]
+        [DeploymentItem(@"Opal Kelly\FrontPanelSupport\bin\Win32\okSegmentCodec.dll")]
+        public void nativeEncoderTest()
+        {
+            if (!OkSegmentCodec.Available)
+                Assert.Inconclusive("okSegmentCodec.dll was not found; build okSegmentCodec.vcxproj first.");
+
+            const ulong maxCounts = (1UL << 48) - 1;
+            Random random = new Random(11);
+            foreach (bool wide in new bool[] { false, true })
+            {
+                // whole AVX2 and SSE2 blocks and a scalar tail
+                int count = 37;
+                ulong[] onCounts = new ulong[count];
+                ulong[] offCounts = new ulong[count];
+                uint[] repeats = new uint[count];
+                for (int i = 0; i < count; i++)
+                {
+                    ulong range = wide ? maxCounts : uint.MaxValue;
+                    onCounts[i] = (ulong)(random.NextDouble() * range);
+                    offCounts[i] = (ulong)(random.NextDouble() * range);
+                    repeats[i] = (uint)(random.NextDouble() * uint.MaxValue);
+                }
+                onCounts[0] = 0;
+                offCounts[0] = wide ? maxCounts : uint.MaxValue;
+                repeats[1] = uint.MaxValue;
+
+                byte[] managed = new byte[16 * count];
+                FpgaTimebaseTask_Accessor.encodeRecords(onCounts, offCounts, repeats, count, managed);
+                byte[] native = new byte[16 * count];
+                Assert.IsTrue(OkSegmentCodec.encode(onCounts, offCounts, repeats, count, native));
+                assertBytesEqual(managed, native);
+            }
+        }
+
+        /// <summary>
+        ///createUpload, which reuses the segments and records of unchanged timesteps from shot to shot, gives byte for byte the uncached upload
+        ///</summary>
+        [TestMethod()]
+        public void createUploadCacheTest()
+        {
+            Random random = new Random(5);
+            foreach (bool assymetric in new bool[] { false, true })
+            {
+                SequenceData sequence = SequenceDataTest.randomGroupSequence(assymetric ? 2 : 1, 300);
+                string deviceName = "createUploadCacheTest " + assymetric;
+                for (int shot = 0; shot < 12; shot++)
+                {
+                    // change a few timesteps between shots, as the iterations of a list run do
+                    for (int k = 0; shot > 0 && k < 3; k++)
+                    {
+                        TimeStep step = sequence.TimeSteps[random.Next(sequence.TimeSteps.Count)];
+                        switch (random.Next(4))
+                        {
+                            case 0:
+                                step.StepDuration = new DimensionedParameter(Units.s, 1e-5 * (1 + random.Next(100)));
+                                break;
+                            case 1:
+                                step.StepEnabled = !step.StepEnabled;
+                                break;
+                            case 2:
+                                step.RetriggerOptions = new RetriggerOptions(random.Next(2) == 0, random.Next(2) == 0, random.Next(2) == 0, new DimensionedParameter(Units.s, 1e-3 * random.Next(3)));
+                                break;
+                            case 3:
+                                if (step.AnalogGroup != null)
+                                    step.AnalogGroup.TimeResolution = new DimensionedParameter(Units.s, 1e-6 * (1 + random.Next(10)));
+                                break;
+                        }
+                    }
+
+                    int nSegments, nSegmentsBeforeMerge;
+                    byte[] actual = FpgaTimebaseTask_Accessor.createUpload(deviceName, sequence, masterClockPeriod, assymetric, out nSegments, out nSegmentsBeforeMerge);
+
+                    int nExpected, nExpectedBeforeMerge;
+                    TimestepTimebaseSegmentCollection segments = sequence.generateVariableTimebaseSegments(SequenceData.VariableTimebaseTypes.AnalogGroupControlledVariableFrequencyClock, masterClockPeriod);
+                    byte[] expected = FpgaTimebaseTask_Accessor.createByteArray(segments, sequence, out nExpected, out nExpectedBeforeMerge, masterClockPeriod, assymetric);
+
+                    assertBytesEqual(expected, actual);
+                    Assert.AreEqual(nExpected, nSegments);
+                    Assert.AreEqual(nExpectedBeforeMerge, nSegmentsBeforeMerge);
+                }
+            }
+
+            // identical timesteps without analog groups merge into one record across reused timesteps
+            {
+                List<TimeStep> steps = new List<TimeStep>();
+                for (int i = 0; i < 20; i++)
+                    steps.Add(timeStep("step " + i));
+                SequenceData sequence = new SequenceData(steps);
+                for (int shot = 0; shot < 3; shot++)
+                {
+                    if (shot == 2)
+                        steps[7].RetriggerOptions = new RetriggerOptions(true, false, true, new DimensionedParameter(Units.s, 1e-3));
+                    int nSegments, nSegmentsBeforeMerge;
+                    byte[] actual = FpgaTimebaseTask_Accessor.createUpload("createUploadCacheTest merged", sequence, masterClockPeriod, false, out nSegments, out nSegmentsBeforeMerge);
+                    Assert.AreEqual((shot == 2) ? 4 : 2, nSegments);
+                    Assert.AreEqual(21, nSegmentsBeforeMerge - ((shot == 2) ? 1 : 0));
+
+                    int nExpected, nExpectedBeforeMerge;
+                    TimestepTimebaseSegmentCollection segments = sequence.generateVariableTimebaseSegments(SequenceData.VariableTimebaseTypes.AnalogGroupControlledVariableFrequencyClock, masterClockPeriod);
+                    assertBytesEqual(FpgaTimebaseTask_Accessor.createByteArray(segments, sequence, out nExpected, out nExpectedBeforeMerge, masterClockPeriod, false), actual);
+                }
+            }
+        }
+
+        /// <summary>
+        ///loadOrCreateUpload stores each new upload in the upload cache directory and reads it back, byte for byte, for any sequence with the same timing
+        ///</summary>
+        [TestMethod()]
+        [DeploymentItem(@"Opal Kelly\FrontPanelSupport\bin\Win32\okSegmentCodec.dll")]
+        public void uploadDiskCacheTest()
+        {
+            if (!OkSegmentCodec.Available)
+                Assert.Inconclusive("okSegmentCodec.dll was not found; build okSegmentCodec.vcxproj first.");
+
+            string directory = Path.Combine(Path.GetTempPath(), "uploadDiskCacheTest " + Guid.NewGuid().ToString());
+            try
+            {
+                OkTimebaseCache cache = OkTimebaseCache.open(directory, OkTimebaseCache.DefaultMaxBytes);
+
+                // a few sequences taking turns, each built afresh as after a restart
+                for (int round = 0; round < 2; round++)
+                {
+                    for (int seed = 11; seed < 14; seed++)
+                        Assert.AreEqual(round == 1, uploadFromDiskCache(cache, SequenceDataTest.randomGroupSequence(seed, 200), false));
+                }
+                Assert.AreEqual(3L, cache.Stats.hits);
+                Assert.AreEqual(3L, cache.Stats.misses);
+                Assert.AreEqual(3L, cache.Stats.entries);
+
+                // a change to any timing input misses, and undoing it hits again
+                SequenceData sequence = SequenceDataTest.randomGroupSequence(11, 200);
+                TimeStep step = null;
+                foreach (TimeStep s in sequence.enabledTimeSteps())
+                {
+                    if (s.AnalogGroup != null && !s.RetriggerOptions.WaitForRetrigger)
+                    {
+                        step = s;
+                        break;
+                    }
+                }
+
+                DimensionedParameter duration = step.StepDuration;
+                step.StepDuration = new DimensionedParameter(Units.s, 2 * duration.getBaseValue());
+                Assert.IsFalse(uploadFromDiskCache(cache, sequence, false));
+                step.StepDuration = duration;
+                Assert.IsTrue(uploadFromDiskCache(cache, sequence, false));
+
+                DimensionedParameter resolution = step.AnalogGroup.TimeResolution;
+                step.AnalogGroup.TimeResolution = new DimensionedParameter(Units.s, 3e-6);
+                Assert.IsFalse(uploadFromDiskCache(cache, sequence, false));
+                step.AnalogGroup.TimeResolution = resolution;
+
+                RetriggerOptions retrigger = step.RetriggerOptions;
+                step.RetriggerOptions = new RetriggerOptions(true, true, false, new DimensionedParameter(Units.s, 1e-3));
+                Assert.IsFalse(uploadFromDiskCache(cache, sequence, false));
+                step.RetriggerOptions = retrigger;
+
+                Assert.IsFalse(uploadFromDiskCache(cache, sequence, true));
+                Assert.IsTrue(uploadFromDiskCache(cache, sequence, false));
+            }
+            finally
+            {
+                Directory.Delete(directory, true);
+            }
+        }
+
+        /// <summary>
+        /// Uploads sequence through loadOrCreateUpload, checks it against the uncached upload, and returns true if it came
+        /// from the cache directory.
+        /// </summary>
+        private static bool uploadFromDiskCache(OkTimebaseCache cache, SequenceData sequence, bool assymetric)
+        {
+            int nSegments, nSegmentsBeforeMerge;
+            uint? uploadCrc;
+            byte[] actual = FpgaTimebaseTask_Accessor.loadOrCreateUpload(cache, "uploadDiskCacheTest", sequence, masterClockPeriod, assymetric, out nSegments, out nSegmentsBeforeMerge, out uploadCrc);
+
+            int nExpected, nExpectedBeforeMerge;
+            TimestepTimebaseSegmentCollection segments = sequence.generateVariableTimebaseSegments(SequenceData.VariableTimebaseTypes.AnalogGroupControlledVariableFrequencyClock, masterClockPeriod);
+            assertBytesEqual(FpgaTimebaseTask_Accessor.createByteArray(segments, sequence, out nExpected, out nExpectedBeforeMerge, masterClockPeriod, assymetric), actual);
+            Assert.AreEqual(nExpected, nSegments);
+            Assert.AreEqual(nExpectedBeforeMerge, nSegmentsBeforeMerge);
+            if (uploadCrc.HasValue)
+                Assert.AreEqual(FpgaTimebaseTask_Accessor.computeUploadCrc(actual), uploadCrc.Value);
+            return uploadCrc.HasValue;
+        }
+
+        /// <summary>
+        ///okSegmentCodec.dll totals a good upload and points at the first bad record of a broken one
+        ///</summary>
+        [TestMethod()]
+        [DeploymentItem(@"Opal Kelly\FrontPanelSupport\bin\Win32\okSegmentCodec.dll")]
+        public void uploadValidationTest()
+        {
+            if (!OkSegmentCodec.Available)
+                Assert.Inconclusive("okSegmentCodec.dll was not found; build okSegmentCodec.vcxproj first.");
+
+            // three timed records around a retrigger with a 1000 sample timeout
+            ulong[] onCounts = new ulong[] { 3, 1000, 2, 7 };
+            ulong[] offCounts = new ulong[] { 5, 0, 2, 1UL << 40 };
+            uint[] repeats = new uint[] { 10, 0, 250, 1 };
+            byte[] data = new byte[16 * 4];
+            FpgaTimebaseTask_Accessor.encodeRecords(onCounts, offCounts, repeats, 4, data);
+
+            OkSegmentCodec.SegmentStats stats;
+            Assert.IsTrue(OkSegmentCodec.validate(data, 1e-8, out stats));
+            Assert.IsTrue(stats.Valid);
+            Assert.AreEqual(4L, stats.records);
+            Assert.AreEqual(1L, stats.retriggers);
+            Assert.AreEqual(80UL + 1000UL + 7UL + (1UL << 40), stats.masterSamples);
+            Assert.AreEqual(261UL, stats.clockEdges);
+            Assert.AreEqual(1000UL, stats.retriggerTimeoutSamples);
+            Assert.AreEqual(-1L, stats.firstBadRecord);
+
+            // a zero off count in record 2
+            offCounts[2] = 0;
+            FpgaTimebaseTask_Accessor.encodeRecords(onCounts, offCounts, repeats, 4, data);
+            Assert.IsTrue(OkSegmentCodec.validate(data, 1e-8, out stats));
+            Assert.IsFalse(stats.Valid);
+            Assert.AreEqual(OkSegmentCodec.FlagZeroPhase, stats.flags & OkSegmentCodec.FlagErrors);
+            Assert.AreEqual(1L, stats.badRecords);
+            Assert.AreEqual(2L, stats.firstBadRecord);
+        }
+    }
+}
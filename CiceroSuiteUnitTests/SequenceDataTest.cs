@@ -197,5 +197,245 @@ namespace CiceroSuiteUnitTests
             Assert.IsNull(target.getTimeStepAtTime(-1));
             Assert.IsNull(target.getTimeStepAtTime(10));
         }
+
+        /// <summary>
+        ///Sample counts of a sequence longer than 2^31 master samples do not wrap
+        ///</summary>
+        [TestMethod()]
+        public void longSequenceSampleCountTest()
+        {
+            List<TimeStep> steps = new List<TimeStep>();
+            for (int i = 0; i < 3; i++)
+            {
+                TimeStep step = new TimeStep("step " + i);
+                step.StepEnabled = true;
+                step.StepDuration = new DimensionedParameter(Units.s, 100);
+                steps.Add(step);
+            }
+            SequenceData target = new SequenceData(steps);
+            double masterSampleDuration = 1e-8;
+
+            Assert.AreEqual(0L, target.getSamplesAtTimestep(steps[0], masterSampleDuration));
+            Assert.AreEqual(20000000000L, target.getSamplesAtTimestep(steps[2], masterSampleDuration));
+            Assert.AreSame(steps[1], target.getTimestepAtSample(15000000000L, masterSampleDuration));
+            Assert.AreSame(steps[2], target.getTimestepAtSample(20000000000L, masterSampleDuration));
+            Assert.IsNull(target.getTimestepAtSample(30000000000L, masterSampleDuration));
+
+            // Fixed timebase buffers are arrays, so their sample count has to fit an int.
+            try
+            {
+                target.nSamples(masterSampleDuration);
+                Assert.Fail("A sample count past 2^31 was returned.");
+            }
+            catch (OverflowException)
+            {
+            }
+        }
+
+        /// <summary>
+        /// A random sequence of short timesteps for the variable timebase: some disabled, some waiting
+        /// for a retrigger, many starting analog groups on a few shared channels (so groups interrupt
+        /// each other) with resolutions that tie and waveforms that outlast several timesteps.
+        /// </summary>
+        internal static SequenceData randomGroupSequence(int seed, int nSteps)
+        {
+            Random random = new Random(seed);
+            double[] resolutions = { 1e-6, 2e-6, 5e-6, 10e-6 };
+            List<TimeStep> steps = new List<TimeStep>();
+            for (int i = 0; i < nSteps; i++)
+            {
+                TimeStep step = new TimeStep("step " + i);
+                step.StepEnabled = random.Next(8) != 0;
+                step.StepDuration = new DimensionedParameter(Units.s, 1e-5 * (1 + random.Next(100)));
+                if (random.Next(6) == 0)
+                    step.RetriggerOptions = new RetriggerOptions(true, random.Next(2) == 0, random.Next(2) == 0, new DimensionedParameter(Units.s, 1e-3 * random.Next(3)));
+                if (random.Next(3) != 0)
+                {
+                    AnalogGroup group = new AnalogGroup("group " + i);
+                    group.TimeResolution = new DimensionedParameter(Units.s, resolutions[random.Next(resolutions.Length)]);
+                    int nChannels = 1 + random.Next(3);
+                    for (int c = 0; c < nChannels; c++)
+                    {
+                        int channelID = random.Next(6);
+                        if (group.channelExists(channelID))
+                            continue;
+                        Waveform waveform = new Waveform("waveform " + i + "." + c);
+                        waveform.XValues.Add(new DimensionedParameter(Units.s, 0));
+                        waveform.YValues.Add(new DimensionedParameter(Units.V, 0));
+                        waveform.WaveformDuration = new DimensionedParameter(Units.s, 1e-5 * random.Next(400));
+                        group.addChannel(channelID, waveform, random.Next(5) != 0, false);
+                    }
+                    step.AnalogGroup = group;
+                }
+                steps.Add(step);
+            }
+            return new SequenceData(steps);
+        }
+
+        /// <summary>
+        ///getRunningGroupRemainingTimes gives, in one pass, what getRunningGroupRemainingTime gives step by step
+        ///</summary>
+        [TestMethod()]
+        public void getRunningGroupRemainingTimesTest()
+        {
+            for (int seed = 0; seed < 20; seed++)
+            {
+                SequenceData target = randomGroupSequence(seed, 200);
+                Dictionary<AnalogGroup, double>[] actual = target.getRunningGroupRemainingTimes();
+                Assert.AreEqual(target.TimeSteps.Count, actual.Length);
+                for (int stepID = 0; stepID < target.TimeSteps.Count; stepID++)
+                {
+                    if (!target.TimeSteps[stepID].StepEnabled)
+                    {
+                        Assert.IsNull(actual[stepID]);
+                        continue;
+                    }
+
+                    // same groups in the same order, and the same remaining times to the bit
+                    List<KeyValuePair<AnalogGroup, double>> expected = new List<KeyValuePair<AnalogGroup, double>>(target.getRunningGroupRemainingTime(stepID));
+                    List<KeyValuePair<AnalogGroup, double>> got = new List<KeyValuePair<AnalogGroup, double>>(actual[stepID]);
+                    Assert.AreEqual(expected.Count, got.Count, "seed " + seed + " step " + stepID);
+                    for (int i = 0; i < expected.Count; i++)
+                    {
+                        Assert.AreSame(expected[i].Key, got[i].Key, "seed " + seed + " step " + stepID);
+                        Assert.AreEqual(expected[i].Value, got[i].Value, "seed " + seed + " step " + stepID);
+                    }
+                }
+            }
+        }
+
+        /// <summary>
+        ///generateVariableTimebaseSegments with a cache hands back the segments of unchanged timesteps and regenerates changed ones
+        ///</summary>
+        [TestMethod()]
+        public void variableTimebaseSegmentCacheTest()
+        {
+            double masterSampleDuration = 1e-7;
+            SequenceData target = randomGroupSequence(3, 200);
+            VariableTimebaseSegmentCache cache = new VariableTimebaseSegmentCache();
+            int nEnabled = target.getNEnabledTimesteps();
+
+            TimestepTimebaseSegmentCollection first = target.generateVariableTimebaseSegments(SequenceData.VariableTimebaseTypes.AnalogGroupControlledVariableFrequencyClock, masterSampleDuration, cache);
+            Assert.AreEqual(nEnabled, cache.Hits + cache.Misses);
+
+            TimestepTimebaseSegmentCollection second = target.generateVariableTimebaseSegments(SequenceData.VariableTimebaseTypes.AnalogGroupControlledVariableFrequencyClock, masterSampleDuration, cache);
+            Assert.AreEqual(nEnabled, cache.Hits);
+            foreach (TimeStep step in target.enabledTimeSteps())
+                Assert.AreSame(first[step], second[step]);
+
+            // lengthening the last enabled step changes only its own segments
+            IList<TimeStep> enabled = target.enabledTimeSteps();
+            TimeStep last = enabled[enabled.Count - 1];
+            last.StepDuration = new DimensionedParameter(Units.s, last.StepDuration.getBaseValue() + 1e-3);
+            TimestepTimebaseSegmentCollection third = target.generateVariableTimebaseSegments(SequenceData.VariableTimebaseTypes.AnalogGroupControlledVariableFrequencyClock, masterSampleDuration, cache);
+            Assert.AreEqual(1, cache.Misses);
+
+            TimestepTimebaseSegmentCollection uncached = target.generateVariableTimebaseSegments(SequenceData.VariableTimebaseTypes.AnalogGroupControlledVariableFrequencyClock, masterSampleDuration);
+            foreach (TimeStep step in enabled)
+            {
+                Assert.AreEqual(uncached[step].Count, third[step].Count);
+                for (int i = 0; i < uncached[step].Count; i++)
+                {
+                    Assert.AreEqual(uncached[step][i].NSegmentSamples, third[step][i].NSegmentSamples);
+                    Assert.AreEqual(uncached[step][i].MasterSamplesPerSegmentSample, third[step][i].MasterSamplesPerSegmentSample);
+                }
+            }
+        }
+
+        /// <summary>
+        ///getVariableTimebaseInputsKey is the same for sequences with the same timing, and differs whenever the segments do
+        ///</summary>
+        [TestMethod()]
+        public void variableTimebaseInputsKeyTest()
+        {
+            double masterSampleDuration = 1e-7;
+            SequenceData.VariableTimebaseTypes type = SequenceData.VariableTimebaseTypes.AnalogGroupControlledVariableFrequencyClock;
+            SequenceData target = randomGroupSequence(4, 200);
+            long[] key = target.getVariableTimebaseInputsKey(type, masterSampleDuration);
+
+            // the same sequence built again, as after a restart
+            Assert.IsTrue(keysEqual(key, randomGroupSequence(4, 200).getVariableTimebaseInputsKey(type, masterSampleDuration)));
+            Assert.IsFalse(keysEqual(key, target.getVariableTimebaseInputsKey(type, 2 * masterSampleDuration)));
+
+            // disabled timesteps do not count
+            foreach (TimeStep step in target.TimeSteps)
+            {
+                if (!step.StepEnabled)
+                    step.StepDuration = new DimensionedParameter(Units.s, 2 * step.StepDuration.getBaseValue());
+            }
+            Assert.IsTrue(keysEqual(key, target.getVariableTimebaseInputsKey(type, masterSampleDuration)));
+
+            Random random = new Random(4);
+            for (int change = 0; change < 100; change++)
+            {
+                List<long> segmentsBefore = flattenSegments(target, target.generateVariableTimebaseSegments(type, masterSampleDuration));
+                long[] keyBefore = target.getVariableTimebaseInputsKey(type, masterSampleDuration);
+
+                TimeStep step = target.TimeSteps[random.Next(target.TimeSteps.Count)];
+                bool retriggerChanged = false;
+                switch (random.Next(5))
+                {
+                    case 0:
+                        step.StepDuration = new DimensionedParameter(Units.s, 1e-5 * (1 + random.Next(100)));
+                        break;
+                    case 1:
+                        step.StepEnabled = !step.StepEnabled;
+                        break;
+                    case 2:
+                        retriggerChanged = step.StepEnabled && !step.RetriggerOptions.WaitForRetrigger;
+                        step.RetriggerOptions = new RetriggerOptions(true, random.Next(2) == 0, random.Next(2) == 0, new DimensionedParameter(Units.s, 1e-3 * random.Next(3)));
+                        break;
+                    case 3:
+                        if (step.AnalogGroup != null)
+                            step.AnalogGroup.TimeResolution = new DimensionedParameter(Units.s, 1e-6 * (1 + random.Next(10)));
+                        break;
+                    case 4:
+                        if (step.AnalogGroup != null)
+                        {
+                            foreach (int channelID in step.AnalogGroup.ChannelDatas.Keys)
+                            {
+                                step.AnalogGroup.ChannelDatas[channelID].ChannelEnabled = !step.AnalogGroup.ChannelDatas[channelID].ChannelEnabled;
+                                break;
+                            }
+                        }
+                        break;
+                }
+
+                List<long> segmentsAfter = flattenSegments(target, target.generateVariableTimebaseSegments(type, masterSampleDuration));
+                long[] keyAfter = target.getVariableTimebaseInputsKey(type, masterSampleDuration);
+                if (retriggerChanged || !keysEqual(segmentsBefore.ToArray(), segmentsAfter.ToArray()))
+                    Assert.IsFalse(keysEqual(keyBefore, keyAfter), "change " + change);
+            }
+        }
+
+        private static bool keysEqual(long[] a, long[] b)
+        {
+            if (a.Length != b.Length)
+                return false;
+            for (int i = 0; i < a.Length; i++)
+            {
+                if (a[i] != b[i])
+                    return false;
+            }
+            return true;
+        }
+
+        /// <summary>
+        /// The segments of the enabled timesteps in order, as (samples, master samples per sample) pairs.
+        /// </summary>
+        private static List<long> flattenSegments(SequenceData sequence, TimestepTimebaseSegmentCollection segments)
+        {
+            List<long> ans = new List<long>();
+            foreach (TimeStep step in sequence.enabledTimeSteps())
+            {
+                ans.Add(segments[step].Count);
+                foreach (SequenceData.VariableTimebaseSegment segment in segments[step])
+                {
+                    ans.Add(segment.NSegmentSamples);
+                    ans.Add(segment.MasterSamplesPerSegmentSample);
+                }
+            }
+            return ans;
+        }
     }
 }
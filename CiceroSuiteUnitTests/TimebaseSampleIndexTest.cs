@@ -0,0 +1,269 @@
+﻿using DataStructures;
+using Microsoft.VisualStudio.TestTools.UnitTesting;
+using System;
+using System.Collections.Generic;
+
+namespace CiceroSuiteUnitTests
+{
+    
+    
+    /// <summary>
+    ///This is a test class for TimebaseSampleIndexTest and is intended
+    ///to contain all TimebaseSampleIndexTest Unit Tests
+    ///</summary>
+    [TestClass()]
+    public class TimebaseSampleIndexTest
+    {
+
+
+        private TestContext testContextInstance;
+
+        /// <summary>
+        ///Gets or sets the test context which provides
+        ///information about and functionality for the current test run.
+        ///</summary>
+        public TestContext TestContext
+        {
+            get
+            {
+                return testContextInstance;
+            }
+            set
+            {
+                testContextInstance = value;
+            }
+        }
+
+        #region Additional test attributes
+        // 
+        //You can use the following additional attributes as you write your tests:
+        //
+        //Use ClassInitialize to run code before running the first test in the class
+        //[ClassInitialize()]
+        //public static void MyClassInitialize(TestContext testContext)
+        //{
+        //}
+        //
+        //Use ClassCleanup to run code after all tests in a class have run
+        //[ClassCleanup()]
+        //public static void MyClassCleanup()
+        //{
+        //}
+        //
+        //Use TestInitialize to run code before running each test
+        //[TestInitialize()]
+        //public void MyTestInitialize()
+        //{
+        //}
+        //
+        //Use TestCleanup to run code after each test has run
+        //[TestCleanup()]
+        //public void MyTestCleanup()
+        //{
+        //}
+        //
+        #endregion
+
+        /// <summary>
+        /// A sequence of nSteps timesteps with random segments, every fourth step disabled, and the
+        /// segments of each. Segments may have no samples; periods are at least 2 and below maxPeriod.
+        /// </summary>
+        internal static SequenceData randomSegments(int seed, int nSteps, long maxPeriod, out TimestepTimebaseSegmentCollection segments)
+        {
+            Random random = new Random(seed);
+            List<TimeStep> steps = new List<TimeStep>();
+            segments = new TimestepTimebaseSegmentCollection();
+            for (int i = 0; i < nSteps; i++)
+            {
+                TimeStep step = new TimeStep("step " + i);
+                step.StepEnabled = (i % 4 != 3);
+                VariableTimebaseSegmentCollection collection = new VariableTimebaseSegmentCollection();
+                int nSegments = random.Next(4);
+                for (int j = 0; j < nSegments; j++)
+                {
+                    int nSamples = (random.Next(5) == 0) ? 0 : random.Next(1, 20);
+                    long period = 2 + (long)(random.NextDouble() * (maxPeriod - 2));
+                    collection.Add(new SequenceData.VariableTimebaseSegment(nSamples, period));
+                }
+                steps.Add(step);
+                segments.Add(step, collection);
+            }
+            return new SequenceData(steps);
+        }
+
+        /// <summary>
+        /// getDerivedSampleFromMasterSample as it was before the index: a walk over every segment sample.
+        /// </summary>
+        private static int walkDerivedSample(SequenceData sequence, TimestepTimebaseSegmentCollection segments, long masterSample)
+        {
+            int currentDerivedSample = 0;
+            long currentMasterSample = 0;
+            if (masterSample == 0)
+                return 0;
+
+            foreach (TimeStep step in sequence.enabledTimeSteps())
+            {
+                foreach (SequenceData.VariableTimebaseSegment segment in segments[step])
+                {
+                    for (int i = 0; i < segment.NSegmentSamples; i++)
+                    {
+                        currentMasterSample += segment.MasterSamplesPerSegmentSample;
+                        currentDerivedSample++;
+                        if (currentMasterSample >= masterSample)
+                            return currentDerivedSample;
+                    }
+                }
+            }
+            return currentDerivedSample;
+        }
+
+        /// <summary>
+        /// getMasterSampleFromDerivedSample as it was before the index.
+        /// </summary>
+        private static long walkMasterSample(SequenceData sequence, TimestepTimebaseSegmentCollection segments, int derivedSample)
+        {
+            int currentDerivedSample = 0;
+            long currentMasterSample = 0;
+            if (derivedSample == 0)
+                return 0;
+            foreach (TimeStep step in sequence.enabledTimeSteps())
+            {
+                foreach (SequenceData.VariableTimebaseSegment segment in segments[step])
+                {
+                    for (int i = 0; i < segment.NSegmentSamples; i++)
+                    {
+                        currentMasterSample += segment.MasterSamplesPerSegmentSample;
+                        currentDerivedSample++;
+                        if (currentDerivedSample >= derivedSample)
+                            return currentMasterSample;
+                    }
+                }
+            }
+            return currentMasterSample;
+        }
+
+        /// <summary>
+        ///Every master sample of short sequences, and a few outside them, map to the derived sample the walk gives
+        ///</summary>
+        [TestMethod()]
+        public void derivedSampleFromMasterSampleTest()
+        {
+            for (int seed = 0; seed < 20; seed++)
+            {
+                TimestepTimebaseSegmentCollection segments;
+                SequenceData sequence = randomSegments(seed, 12, 40, out segments);
+                long nMasterSamples = sequence.getTimebaseSampleIndex(segments).NMasterSamples;
+                for (long masterSample = -3; masterSample <= nMasterSamples + 3; masterSample++)
+                    Assert.AreEqual(walkDerivedSample(sequence, segments, masterSample), sequence.getDerivedSampleFromMasterSample(masterSample, segments),
+                        "Seed " + seed + ", master sample " + masterSample);
+            }
+        }
+
+        /// <summary>
+        ///Every derived sample of short sequences, and a few outside them, map to the master sample the walk gives
+        ///</summary>
+        [TestMethod()]
+        public void masterSampleFromDerivedSampleTest()
+        {
+            for (int seed = 0; seed < 20; seed++)
+            {
+                TimestepTimebaseSegmentCollection segments;
+                SequenceData sequence = randomSegments(seed, 12, 40, out segments);
+                int nDerivedSamples = sequence.getTimebaseSampleIndex(segments).NDerivedSamples;
+                for (int derivedSample = -3; derivedSample <= nDerivedSamples + 3; derivedSample++)
+                    Assert.AreEqual(walkMasterSample(sequence, segments, derivedSample), sequence.getMasterSampleFromDerivedSample(derivedSample, segments),
+                        "Seed " + seed + ", derived sample " + derivedSample);
+            }
+        }
+
+        /// <summary>
+        ///Lookups on segments with periods past 32 bits, at segment boundaries and at random, agree with the walk
+        ///</summary>
+        [TestMethod()]
+        public void longPeriodLookupTest()
+        {
+            TimestepTimebaseSegmentCollection segments;
+            SequenceData sequence = randomSegments(7, 40, 1L << 40, out segments);
+            TimebaseSampleIndex index = sequence.getTimebaseSampleIndex(segments);
+            Random random = new Random(7);
+
+            List<long> masterSamples = new List<long>();
+            long end = 0;
+            foreach (TimeStep step in sequence.enabledTimeSteps())
+            {
+                foreach (SequenceData.VariableTimebaseSegment segment in segments[step])
+                {
+                    end += segment.NSegmentSamples * segment.MasterSamplesPerSegmentSample;
+                    masterSamples.AddRange(new long[] { end - 1, end, end + 1 });
+                }
+            }
+            Assert.AreEqual(end, index.NMasterSamples);
+            for (int i = 0; i < 1000; i++)
+                masterSamples.Add((long)(random.NextDouble() * end));
+
+            foreach (long masterSample in masterSamples)
+                Assert.AreEqual(walkDerivedSample(sequence, segments, masterSample), index.derivedSampleFromMasterSample(masterSample),
+                    "Master sample " + masterSample);
+            for (int derivedSample = 0; derivedSample <= index.NDerivedSamples + 1; derivedSample++)
+                Assert.AreEqual(walkMasterSample(sequence, segments, derivedSample), index.masterSampleFromDerivedSample(derivedSample),
+                    "Derived sample " + derivedSample);
+        }
+
+        /// <summary>
+        ///The batch lookups give the single lookups' results, and reject a short output array
+        ///</summary>
+        [TestMethod()]
+        public void batchLookupTest()
+        {
+            TimestepTimebaseSegmentCollection segments;
+            SequenceData sequence = randomSegments(3, 12, 40, out segments);
+            TimebaseSampleIndex index = sequence.getTimebaseSampleIndex(segments);
+
+            long[] masterSamples = new long[index.NMasterSamples + 2];
+            for (int i = 0; i < masterSamples.Length; i++)
+                masterSamples[i] = masterSamples.Length - 2 - i;
+            int[] derivedSamples = new int[masterSamples.Length];
+            index.derivedSamplesFromMasterSamples(masterSamples, derivedSamples);
+            for (int i = 0; i < masterSamples.Length; i++)
+                Assert.AreEqual(index.derivedSampleFromMasterSample(masterSamples[i]), derivedSamples[i]);
+
+            int[] derived = new int[index.NDerivedSamples + 2];
+            for (int i = 0; i < derived.Length; i++)
+                derived[i] = i - 1;
+            long[] master = new long[derived.Length];
+            index.masterSamplesFromDerivedSamples(derived, master);
+            for (int i = 0; i < derived.Length; i++)
+                Assert.AreEqual(index.masterSampleFromDerivedSample(derived[i]), master[i]);
+
+            try
+            {
+                index.masterSamplesFromDerivedSamples(derived, new long[derived.Length - 1]);
+                Assert.Fail("A short output array was accepted.");
+            }
+            catch (ArgumentException)
+            {
+            }
+        }
+
+        /// <summary>
+        ///A sequence with no segment samples maps everything to 0, as the walk does
+        ///</summary>
+        [TestMethod()]
+        public void emptySegmentsTest()
+        {
+            TimeStep step = new TimeStep("empty");
+            step.StepEnabled = true;
+            TimestepTimebaseSegmentCollection segments = new TimestepTimebaseSegmentCollection();
+            VariableTimebaseSegmentCollection collection = new VariableTimebaseSegmentCollection();
+            collection.Add(new SequenceData.VariableTimebaseSegment(0, 10));
+            segments.Add(step, collection);
+            SequenceData sequence = new SequenceData(new List<TimeStep>(new TimeStep[] { step }));
+
+            for (int i = -2; i <= 2; i++)
+            {
+                Assert.AreEqual(walkDerivedSample(sequence, segments, i), sequence.getDerivedSampleFromMasterSample(i, segments));
+                Assert.AreEqual(walkMasterSample(sequence, segments, i), sequence.getMasterSampleFromDerivedSample(i, segments));
+            }
+        }
+    }
+}
@@ -0,0 +1,286 @@
+﻿using AtticusServer;
+using DataStructures;
+using Microsoft.VisualStudio.TestTools.UnitTesting;
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.IO;
+
+namespace CiceroSuiteUnitTests
+{
+    
+    
+    /// <summary>
+    ///Benchmarks of the variable timebase path on a synthetic sequence corpus (many segments, many
+    ///analog groups of different TimeResolution, heavy retriggering, very long dwells).
+    ///
+    ///Segment generation and FIFO record encoding are timed here, and so is the list run case:
+    ///regenerating and encoding through FpgaTimebaseTask's upload cache after one timestep
+    ///changed, and reading a known sequence back from the upload cache directory (when
+    ///okSegmentCodec.dll is there). Each encoded stream is saved
+    ///to the test run directory as [corpus].fifo; okPipelineBench (Opal Kelly/FrontPanelSupport)
+    ///replays those files to time the native encoder, the pipe upload and status polling
+    ///against the stand-in library. Both write the same csv columns, so the results of a run
+    ///can be concatenated and tracked over time.
+    ///
+    ///The benchmark is slow and checks little beyond the record counts; ordinary runs
+    ///leave it out with /category:"!Benchmark" and /category:Benchmark runs it alone.
+    ///</summary>
+    [TestClass()]
+    public class VariableTimebaseBenchmarkTest
+    {
+        /// <summary>
+        /// 10 MHz, the usual FPGA master clock.
+        /// </summary>
+        private const double masterClockPeriod = 1e-7;
+
+        /// <summary>
+        /// Each stage is timed this many times; the fastest run is reported.
+        /// </summary>
+        private const int repetitions = 3;
+
+        private TestContext testContextInstance;
+
+        /// <summary>
+        ///Gets or sets the test context which provides
+        ///information about and functionality for the current test run.
+        ///</summary>
+        public TestContext TestContext
+        {
+            get
+            {
+                return testContextInstance;
+            }
+            set
+            {
+                testContextInstance = value;
+            }
+        }
+
+        #region Additional test attributes
+        // 
+        //You can use the following additional attributes as you write your tests:
+        //
+        //Use ClassInitialize to run code before running the first test in the class
+        //[ClassInitialize()]
+        //public static void MyClassInitialize(TestContext testContext)
+        //{
+        //}
+        //
+        //Use ClassCleanup to run code after all tests in a class have run
+        //[ClassCleanup()]
+        //public static void MyClassCleanup()
+        //{
+        //}
+        //
+        //Use TestInitialize to run code before running each test
+        //[TestInitialize()]
+        //public void MyTestInitialize()
+        //{
+        //}
+        //
+        //Use TestCleanup to run code after each test has run
+        //[TestCleanup()]
+        //public void MyTestCleanup()
+        //{
+        //}
+        //
+        #endregion
+
+        #region Synthetic corpus
+
+        private static TimeStep timeStep(string name, double duration)
+        {
+            TimeStep step = new TimeStep(name);
+            step.StepEnabled = true;
+            step.StepDuration = new DimensionedParameter(Units.s, duration);
+            return step;
+        }
+
+        /// <summary>
+        /// A group with one linear waveform on the given channel; only the waveform duration
+        /// and the group's TimeResolution matter to the variable timebase.
+        /// </summary>
+        private static AnalogGroup analogGroup(string name, int channelID, double timeResolution, double duration)
+        {
+            Waveform waveform = new Waveform(name);
+            waveform.XValues.Add(new DimensionedParameter(Units.s, 0));
+            waveform.YValues.Add(new DimensionedParameter(Units.V, 0));
+            waveform.WaveformDuration = new DimensionedParameter(Units.s, duration);
+
+            AnalogGroup group = new AnalogGroup(name);
+            group.TimeResolution = new DimensionedParameter(Units.s, timeResolution);
+            group.addChannel(channelID, waveform, true, false);
+            return group;
+        }
+
+        /// <summary>
+        /// 4000 one millisecond steps, each starting a group on one of 8 channels, with resolutions
+        /// cycling from 1 us to 500 us so that consecutive steps do not merge.
+        /// </summary>
+        private static SequenceData manySegmentsSequence()
+        {
+            double[] resolutions = { 1e-6, 2e-6, 5e-6, 10e-6, 20e-6, 50e-6, 100e-6, 500e-6 };
+            List<TimeStep> steps = new List<TimeStep>();
+            for (int i = 0; i < 4000; i++)
+            {
+                TimeStep step = timeStep("step " + i, 1e-3);
+                step.AnalogGroup = analogGroup("group " + i, i % 8, resolutions[i % resolutions.Length], 0.7e-3);
+                steps.Add(step);
+            }
+            return new SequenceData(steps);
+        }
+
+        /// <summary>
+        /// 1000 steps of 10 ms, each starting a group on its own channel that keeps running
+        /// through the next dozen steps, so every step has a dozen groups of different
+        /// resolution and remaining time to cut it into segments.
+        /// </summary>
+        private static SequenceData manyGroupsSequence()
+        {
+            List<TimeStep> steps = new List<TimeStep>();
+            for (int i = 0; i < 1000; i++)
+            {
+                TimeStep step = timeStep("step " + i, 10e-3);
+                step.AnalogGroup = analogGroup("group " + i, i % 64, 1e-6 * (1 + i % 61), 10e-3 * 12 + 0.37e-3 * (i % 23));
+                steps.Add(step);
+            }
+            return new SequenceData(steps);
+        }
+
+        /// <summary>
+        /// 3000 short steps, every other one waiting for a retrigger with a timeout; the timed
+        /// steps run a 10 us resolution group.
+        /// </summary>
+        private static SequenceData retriggerHeavySequence()
+        {
+            List<TimeStep> steps = new List<TimeStep>();
+            for (int i = 0; i < 3000; i++)
+            {
+                TimeStep step = timeStep("step " + i, 100e-6);
+                if (i % 2 == 0)
+                    step.RetriggerOptions = new RetriggerOptions(true, (i % 4) == 0, (i % 6) == 0, new DimensionedParameter(Units.s, 10e-3));
+                else
+                    step.AnalogGroup = analogGroup("group " + i, i % 4, 10e-6, 80e-6);
+                steps.Add(step);
+            }
+            return new SequenceData(steps);
+        }
+
+        /// <summary>
+        /// 1000 steps alternating hour-long dwells, whose counts need the full 48 bit on / off
+        /// range, with short 1 us resolution ramps.
+        /// </summary>
+        private static SequenceData longDwellsSequence()
+        {
+            List<TimeStep> steps = new List<TimeStep>();
+            for (int i = 0; i < 1000; i++)
+            {
+                if (i % 2 == 0)
+                {
+                    steps.Add(timeStep("dwell " + i, 3600.0 + i));
+                }
+                else
+                {
+                    TimeStep step = timeStep("ramp " + i, 1e-3);
+                    step.AnalogGroup = analogGroup("group " + i, i % 4, 1e-6, 0.9e-3);
+                    steps.Add(step);
+                }
+            }
+            return new SequenceData(steps);
+        }
+
+        #endregion
+
+        private void report(StreamWriter csv, string corpus, string stage, int records, double seconds)
+        {
+            long bytes = 16L * records;
+            TestContext.WriteLine("{0,-16} {1,-10} {2,9} records {3,10:F3} ms {4,14:F0} records/s {5,10:F1} MB/s",
+                corpus, stage, records, seconds * 1000, records / seconds, bytes / seconds / 1e6);
+            csv.WriteLine("{0},{1},{2},{3},{4:R},{5:F0},{6:F3}", corpus, stage, records, bytes, seconds, records / seconds, bytes / seconds / 1e6);
+        }
+
+        private void benchmark(StreamWriter csv, string corpus, SequenceData sequence)
+        {
+            TimestepTimebaseSegmentCollection segments = null;
+            byte[] stream = null;
+            int nSegments = 0, nSegmentsBeforeMerge = 0;
+            double generateSeconds = double.MaxValue, encodeSeconds = double.MaxValue;
+
+            for (int i = 0; i < repetitions; i++)
+            {
+                Stopwatch watch = Stopwatch.StartNew();
+                segments = sequence.generateVariableTimebaseSegments(SequenceData.VariableTimebaseTypes.AnalogGroupControlledVariableFrequencyClock, masterClockPeriod);
+                generateSeconds = Math.Min(generateSeconds, watch.Elapsed.TotalSeconds);
+
+                watch = Stopwatch.StartNew();
+                stream = FpgaTimebaseTask_Accessor.createByteArray(segments, sequence, out nSegments, out nSegmentsBeforeMerge, masterClockPeriod, false);
+                encodeSeconds = Math.Min(encodeSeconds, watch.Elapsed.TotalSeconds);
+            }
+
+            Assert.IsTrue(nSegments > 1, corpus + " produced no segments.");
+            Assert.AreEqual(16 * nSegments, stream.Length, corpus + " stream length does not match its record count.");
+
+            // a list run iteration: one timestep in the middle changes, the rest come from the cache
+            double cachedSeconds = double.MaxValue;
+            int nCachedSegments = 0, nCachedSegmentsBeforeMerge = 0;
+            TimeStep changed = sequence.TimeSteps[sequence.TimeSteps.Count / 2];
+            double duration = changed.StepDuration.getBaseValue();
+            FpgaTimebaseTask_Accessor.createUpload(corpus, sequence, masterClockPeriod, false, out nCachedSegments, out nCachedSegmentsBeforeMerge);
+            for (int i = 0; i < repetitions; i++)
+            {
+                changed.StepDuration = new DimensionedParameter(Units.s, duration * ((i % 2 == 0) ? 1.5 : 1.0));
+                Stopwatch watch = Stopwatch.StartNew();
+                FpgaTimebaseTask_Accessor.createUpload(corpus, sequence, masterClockPeriod, false, out nCachedSegments, out nCachedSegmentsBeforeMerge);
+                cachedSeconds = Math.Min(cachedSeconds, watch.Elapsed.TotalSeconds);
+            }
+            changed.StepDuration = new DimensionedParameter(Units.s, duration);
+
+            // a known sequence read back from the upload cache directory: key, lookup and copy
+            double diskSeconds = double.MaxValue;
+            int nDiskSegments = 0, nDiskSegmentsBeforeMerge = 0;
+            OkTimebaseCache diskCache = OkTimebaseCache.open(Path.Combine(TestContext.TestRunDirectory, "UploadCache"), OkTimebaseCache.DefaultMaxBytes);
+            if (diskCache != null)
+            {
+                uint? uploadCrc;
+                FpgaTimebaseTask_Accessor.loadOrCreateUpload(diskCache, corpus, sequence, masterClockPeriod, false, out nDiskSegments, out nDiskSegmentsBeforeMerge, out uploadCrc);
+                for (int i = 0; i < repetitions; i++)
+                {
+                    Stopwatch watch = Stopwatch.StartNew();
+                    FpgaTimebaseTask_Accessor.loadOrCreateUpload(diskCache, corpus, sequence, masterClockPeriod, false, out nDiskSegments, out nDiskSegmentsBeforeMerge, out uploadCrc);
+                    diskSeconds = Math.Min(diskSeconds, watch.Elapsed.TotalSeconds);
+                    Assert.IsTrue(uploadCrc.HasValue, corpus + " was not read back from the upload cache directory.");
+                }
+            }
+
+            // generation is reported against the records it gives rise to, so that stages compare directly.
+            report(csv, corpus, "generate", nSegments, generateSeconds);
+            report(csv, corpus, "encode", nSegments, encodeSeconds);
+            report(csv, corpus, "cached", nCachedSegments, cachedSeconds);
+            if (diskCache != null)
+                report(csv, corpus, "disk", nDiskSegments, diskSeconds);
+
+            File.WriteAllBytes(Path.Combine(TestContext.TestRunDirectory, corpus + ".fifo"), stream);
+        }
+
+        /// <summary>
+        ///Times generateVariableTimebaseSegments and FpgaTimebaseTask.createByteArray on each corpus
+        ///sequence. Results are written to the test output and to VariableTimebaseBenchmark.csv in
+        ///the test run directory; nothing is asserted about the times themselves.
+        ///</summary>
+        [TestMethod()]
+        [TestCategory("Benchmark")]
+        public void VariableTimebasePipelineBenchmark()
+        {
+            string csvPath = Path.Combine(TestContext.TestRunDirectory, "VariableTimebaseBenchmark.csv");
+            using (StreamWriter csv = new StreamWriter(csvPath))
+            {
+                csv.WriteLine("corpus,stage,records,bytes,seconds,records_per_s,MB_per_s");
+                benchmark(csv, "manySegments", manySegmentsSequence());
+                benchmark(csv, "manyGroups", manyGroupsSequence());
+                benchmark(csv, "retriggerHeavy", retriggerHeavySequence());
+                benchmark(csv, "longDwells", longDwellsSequence());
+            }
+        }
+    }
+}
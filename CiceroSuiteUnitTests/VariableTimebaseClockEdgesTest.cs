@@ -0,0 +1,226 @@
+﻿using DataStructures;
+using Microsoft.VisualStudio.TestTools.UnitTesting;
+using System;
+using System.Collections.Generic;
+
+namespace CiceroSuiteUnitTests
+{
+    
+    
+    /// <summary>
+    ///This is a test class for VariableTimebaseClockEdgesTest and is intended
+    ///to contain all VariableTimebaseClockEdgesTest Unit Tests
+    ///</summary>
+    [TestClass()]
+    public class VariableTimebaseClockEdgesTest
+    {
+
+
+        private TestContext testContextInstance;
+
+        /// <summary>
+        ///Gets or sets the test context which provides
+        ///information about and functionality for the current test run.
+        ///</summary>
+        public TestContext TestContext
+        {
+            get
+            {
+                return testContextInstance;
+            }
+            set
+            {
+                testContextInstance = value;
+            }
+        }
+
+        #region Additional test attributes
+        // 
+        //You can use the following additional attributes as you write your tests:
+        //
+        //Use ClassInitialize to run code before running the first test in the class
+        //[ClassInitialize()]
+        //public static void MyClassInitialize(TestContext testContext)
+        //{
+        //}
+        //
+        //Use ClassCleanup to run code after all tests in a class have run
+        //[ClassCleanup()]
+        //public static void MyClassCleanup()
+        //{
+        //}
+        //
+        //Use TestInitialize to run code before running each test
+        //[TestInitialize()]
+        //public void MyTestInitialize()
+        //{
+        //}
+        //
+        //Use TestCleanup to run code after each test has run
+        //[TestCleanup()]
+        //public void MyTestCleanup()
+        //{
+        //}
+        //
+        #endregion
+
+        /// <summary>
+        /// getVariableTimebaseClock as it was before VariableTimebaseClockEdges: one bool per master sample.
+        /// </summary>
+        private static bool[] oldClock(SequenceData sequence, TimestepTimebaseSegmentCollection timebaseSegments)
+        {
+            int nSamples = checked((int)timebaseSegments.nMasterSamples());
+
+            nSamples += 1 + 2;
+
+            if (nSamples % 4 != 0)
+                nSamples += (4 - nSamples % 4);
+
+            bool[] ans = new bool[nSamples];
+            int currentSample = 1;
+
+            for (int stepID = 0; stepID < sequence.TimeSteps.Count; stepID++)
+            {
+                TimeStep currentStep = sequence.TimeSteps[stepID];
+                if (currentStep.StepEnabled)
+                {
+                    List<SequenceData.VariableTimebaseSegment> segments = timebaseSegments[currentStep];
+                    foreach (SequenceData.VariableTimebaseSegment seg in segments)
+                    {
+                        for (int i = 0; i < seg.NSegmentSamples; i++)
+                        {
+                            ans[currentSample] = true;
+                            if (seg.MasterSamplesPerSegmentSample > 2)
+                            {
+                                int repeats = (int)(seg.MasterSamplesPerSegmentSample / 2);
+                                for (int j = 0; j < repeats; j++)
+                                {
+                                    ans[currentSample + j] = true;
+                                }
+                            }
+                            currentSample += (int)seg.MasterSamplesPerSegmentSample;
+                        }
+                    }
+                }
+            }
+
+            ans[currentSample] = true;
+            return ans;
+        }
+
+        /// <summary>
+        /// The segments of the enabled steps only; the old clock counts disabled steps' master samples
+        /// in its length, so its comparisons use these.
+        /// </summary>
+        private static TimestepTimebaseSegmentCollection enabledSegments(SequenceData sequence, TimestepTimebaseSegmentCollection segments)
+        {
+            TimestepTimebaseSegmentCollection ans = new TimestepTimebaseSegmentCollection();
+            foreach (TimeStep step in sequence.enabledTimeSteps())
+                ans.Add(step, segments[step]);
+            return ans;
+        }
+
+        /// <summary>
+        ///getVariableTimebaseClock renders the same buffer as the old loop
+        ///</summary>
+        [TestMethod()]
+        public void getVariableTimebaseClockTest()
+        {
+            for (int seed = 0; seed < 20; seed++)
+            {
+                TimestepTimebaseSegmentCollection segments;
+                SequenceData sequence = TimebaseSampleIndexTest.randomSegments(seed, 12, 40, out segments);
+                segments = enabledSegments(sequence, segments);
+                bool[] expected = oldClock(sequence, segments);
+                bool[] actual = sequence.getVariableTimebaseClock(segments);
+                Assert.AreEqual(expected.Length, actual.Length, "Seed " + seed);
+                for (int i = 0; i < expected.Length; i++)
+                    Assert.AreEqual(expected[i], actual[i], "Seed " + seed + ", sample " + i);
+            }
+        }
+
+        /// <summary>
+        ///renderClock of any window, including ones running past either end of the buffer, is that slice of the old buffer
+        ///</summary>
+        [TestMethod()]
+        public void renderClockWindowTest()
+        {
+            Random random = new Random(1);
+            for (int seed = 0; seed < 20; seed++)
+            {
+                TimestepTimebaseSegmentCollection segments;
+                SequenceData sequence = TimebaseSampleIndexTest.randomSegments(seed, 12, 40, out segments);
+                segments = enabledSegments(sequence, segments);
+                bool[] expected = oldClock(sequence, segments);
+                VariableTimebaseClockEdges edges = sequence.getVariableTimebaseClockEdges(segments);
+                Assert.AreEqual((long)expected.Length, edges.ClockBufferLength, "Seed " + seed);
+
+                for (int w = 0; w < 50; w++)
+                {
+                    long first = random.Next(expected.Length + 8);
+                    bool[] chunk = new bool[1 + random.Next(64)];
+                    for (int i = 0; i < chunk.Length; i++)
+                        chunk[i] = true;
+                    edges.renderClock(first, chunk);
+                    for (int i = 0; i < chunk.Length; i++)
+                    {
+                        long b = first + i;
+                        Assert.AreEqual((b < expected.Length) && expected[b], chunk[i], "Seed " + seed + ", window at " + first + ", sample " + b);
+                    }
+                }
+            }
+        }
+
+        /// <summary>
+        ///readMasterSamples and readTimes give the rising edges of the old buffer, in chunks of any size, and start over after reset
+        ///</summary>
+        [TestMethod()]
+        public void readEdgesTest()
+        {
+            const double masterClockPeriod = 1e-7;
+            for (int seed = 0; seed < 20; seed++)
+            {
+                TimestepTimebaseSegmentCollection segments;
+                SequenceData sequence = TimebaseSampleIndexTest.randomSegments(seed, 12, 40, out segments);
+                segments = enabledSegments(sequence, segments);
+                bool[] clock = oldClock(sequence, segments);
+
+                // every edge is a false to true step, the first at buffer sample 1 (master sample 0);
+                // the last rising edge is the final pulse into the dwell values, which is not a derived sample
+                List<long> expected = new List<long>();
+                for (int b = 1; b < clock.Length; b++)
+                {
+                    if (clock[b] && !clock[b - 1])
+                        expected.Add(b - 1);
+                }
+                expected.RemoveAt(expected.Count - 1);
+
+                VariableTimebaseClockEdges edges = sequence.getVariableTimebaseClockEdges(segments);
+                Assert.AreEqual((long)expected.Count, edges.NEdges, "Seed " + seed);
+                Assert.AreEqual((long)segments.nSegmentSamples(), edges.NEdges, "Seed " + seed);
+
+                foreach (int chunkSize in new int[] { 1, 3, 7, 1000 })
+                {
+                    edges.reset();
+                    List<long> actual = new List<long>();
+                    long[] chunk = new long[chunkSize];
+                    int n;
+                    while ((n = edges.readMasterSamples(chunk)) > 0)
+                    {
+                        for (int i = 0; i < n; i++)
+                            actual.Add(chunk[i]);
+                    }
+                    Assert.AreEqual(expected.Count, actual.Count, "Seed " + seed + ", chunks of " + chunkSize);
+                    for (int i = 0; i < expected.Count; i++)
+                        Assert.AreEqual(expected[i], actual[i], "Seed " + seed + ", chunks of " + chunkSize + ", edge " + i);
+                }
+
+                edges.reset();
+                double[] times = new double[expected.Count + 5];
+                Assert.AreEqual(expected.Count, edges.readTimes(times, masterClockPeriod), "Seed " + seed);
+                for (int i = 0; i < expected.Count; i++)
+                    Assert.AreEqual(expected[i] * masterClockPeriod, times[i], "Seed " + seed + ", edge " + i);
+            }
+        }
+    }
+}
@@ -3,6 +3,7 @@ using System.Collections.Generic;
 using System.Linq;
 using System.Text;
 using System.ComponentModel;
+using System.Runtime.Serialization;
 
 namespace DataStructures
 {
@@ -13,5 +14,31 @@ namespace DataStructures
 
         public UInt32 retriggerWaitedSamples;
         public UInt16 retriggerTimeoutCount;
+
+        /// <summary>
+        /// Master samples and clock edges the upload adds up to, as checked before it was sent.
+        /// 0 when the check did not run (okSegmentCodec.dll missing).
+        /// </summary>
+        [OptionalField]
+        public UInt64 expectedMasterSamples;
+        [OptionalField]
+        public UInt64 expectedClockEdges;
+
+        /// <summary>
+        /// Master samples generated, as last seen by the status poller (counter rollovers included).
+        /// </summary>
+        [OptionalField]
+        public UInt64 masterSamplesGenerated;
+
+        /// <summary>
+        /// True if the upload was read from the device's upload cache directory rather than generated.
+        /// The hit and miss counts are those of the directory since the server started.
+        /// </summary>
+        [OptionalField]
+        public bool uploadFromCache;
+        [OptionalField]
+        public long uploadCacheHits;
+        [OptionalField]
+        public long uploadCacheMisses;
     }
 }
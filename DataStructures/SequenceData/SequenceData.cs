@@ -828,17 +828,17 @@ namespace DataStructures
         public int nSamples(double timeStepSize)
         {
             double remainderTime = 0;
-            return 1 + this.nSamplesBetweenTimeSteps(0, TimeSteps.Count, ref remainderTime, timeStepSize);
+            return checked(1 + this.nSamplesBetweenTimeSteps(0, TimeSteps.Count, ref remainderTime, timeStepSize));
         }
 
 
-        public TimeStep getTimestepAtSample(int nSamples, double timeStepSize)
+        public TimeStep getTimestepAtSample(long nSamples, double timeStepSize)
         {
-            int count = 0;
+            long count = 0;
             double remainderTime = 0;
             foreach (TimeStep step in enabledTimeSteps())
             {
-                int temp = 0;
+                long temp = 0;
                 computeNSamplesAndRemainderTime(ref temp, ref remainderTime, step.StepDuration.getBaseValue(), timeStepSize);
                 count += temp;
                 if (count > nSamples)
@@ -847,9 +847,9 @@ namespace DataStructures
             return null;
         }
 
-        public int getSamplesAtTimestep(TimeStep step, double timeStepSize)
+        public long getSamplesAtTimestep(TimeStep step, double timeStepSize)
         {
-            int count = 0;
+            long count = 0;
             double remainderTime = 0;
             foreach (TimeStep ts in TimeSteps)
             {
@@ -857,7 +857,7 @@ namespace DataStructures
                     return count;
                 if (ts.StepEnabled)
                 {
-                    int temp = 0;
+                    long temp = 0;
                     computeNSamplesAndRemainderTime(ref temp, ref remainderTime, ts.StepDuration.getBaseValue(), timeStepSize);
                     count += temp;
                 }
@@ -906,6 +906,92 @@ namespace DataStructures
             return ans;
         }
 
+        /// <summary>
+        /// getRunningGroupRemainingTime for every timestep at once, in a single forward pass over the sequence
+        /// instead of a rescan of all earlier timesteps per timestep. Entry i is null for disabled timesteps.
+        /// The dictionaries hold the same groups, in the same order and with the same remaining times.
+        /// </summary>
+        /// <returns></returns>
+        public Dictionary<AnalogGroup, double>[] getRunningGroupRemainingTimes()
+        {
+            Dictionary<AnalogGroup, double>[] ans = new Dictionary<AnalogGroup, double>[TimeSteps.Count];
+
+            // groups started so far that are still running, in the order of their starting timesteps
+            List<RunningAnalogGroup> running = new List<RunningAnalogGroup>();
+            double previousTimestepDuration = 0;
+
+            for (int stepID = 0; stepID < TimeSteps.Count; stepID++)
+            {
+                TimeStep step = TimeSteps[stepID];
+                if (!step.StepEnabled)
+                    continue;
+
+                // the same tests as getRunningAnalogGroups makes for each interim step, in the same order
+                for (int i = 0; i < running.Count; i++)
+                {
+                    RunningAnalogGroup rg = running[i];
+                    rg.elapsedTime += previousTimestepDuration;
+                    bool groupStillRunning = !(rg.elapsedTime > rg.effectiveDuration);
+
+                    if (groupStillRunning && step.AnalogGroup != null)
+                    {
+                        AnalogGroup interruptingGroup = step.AnalogGroup;
+                        foreach (int channelID in interruptingGroup.ChannelDatas.Keys)
+                        {
+                            if (interruptingGroup.channelEnabled(channelID))
+                                rg.activeChannels.Remove(channelID);
+                        }
+                    }
+                    if (groupStillRunning && rg.activeChannels.Count == 0)
+                        groupStillRunning = false;
+
+                    if (!groupStillRunning)
+                    {
+                        running.RemoveAt(i);
+                        i--;
+                    }
+                }
+
+                if (step.AnalogGroup != null)
+                {
+                    RunningAnalogGroup rg = new RunningAnalogGroup();
+                    rg.group = step.AnalogGroup;
+                    rg.effectiveDuration = rg.group.getEffectiveDuration();
+                    rg.elapsedTime = 0;
+                    rg.activeChannels = new Dictionary<int, bool>();
+                    foreach (int channelID in rg.group.ChannelDatas.Keys)
+                    {
+                        if (rg.group.channelEnabled(channelID))
+                            rg.activeChannels.Add(channelID, true);
+                    }
+                    running.Add(rg);
+                }
+
+                Dictionary<AnalogGroup, double> stepGroups = new Dictionary<AnalogGroup, double>();
+                foreach (RunningAnalogGroup rg in running)
+                    stepGroups.Add(rg.group, rg.effectiveDuration - rg.elapsedTime);
+                ans[stepID] = stepGroups;
+
+                previousTimestepDuration = step.StepDuration.getBaseValue();
+            }
+
+            return ans;
+        }
+
+        /// <summary>
+        /// A started analog group tracked by getRunningGroupRemainingTimes.
+        /// </summary>
+        private class RunningAnalogGroup
+        {
+            public AnalogGroup group;
+            public double effectiveDuration;
+            public double elapsedTime;
+            /// <summary>
+            /// Enabled channels of the group not yet taken over by a later group.
+            /// </summary>
+            public Dictionary<int, bool> activeChannels;
+        }
+
         /// <summary>
         /// Returns a dictionary containing all of the analog groups that are active at a given timestep, as well as a double
         /// representing how long they have been running.
@@ -1127,33 +1213,28 @@ namespace DataStructures
             return ans;
         }
 
+        /// <summary>
+        /// Returns the master / derived sample index of a set of variable timebase segments, building it
+        /// on first use and keeping it with the segments.
+        /// </summary>
+        /// <param name="timebaseSegments"></param>
+        /// <returns></returns>
+        public TimebaseSampleIndex getTimebaseSampleIndex(TimestepTimebaseSegmentCollection timebaseSegments)
+        {
+            if (timebaseSegments.SampleIndex == null)
+                timebaseSegments.SampleIndex = new TimebaseSampleIndex(enabledTimeSteps(), timebaseSegments);
+            return timebaseSegments.SampleIndex;
+        }
+
         /// <summary>
         /// Returns the sample id of the first derived sample which is on or after the given master sample, given a set of variable timebase segments.
         /// </summary>
         /// <param name="masterSample"></param>
         /// <param name="timebaseSegments"></param>
         /// <returns></returns>
-        public int getDerivedSampleFromMasterSample(int masterSample, TimestepTimebaseSegmentCollection timebaseSegments)
+        public int getDerivedSampleFromMasterSample(long masterSample, TimestepTimebaseSegmentCollection timebaseSegments)
         {
-            int currentDerivedSample = 0;
-            int currentMasterSample = 0;
-            if (masterSample == 0)
-                return 0;
-
-            foreach (TimeStep step in enabledTimeSteps())
-            {
-                foreach (VariableTimebaseSegment segment in timebaseSegments[step])
-                {
-                    for (int i = 0; i < segment.NSegmentSamples; i++)
-                    {
-                        currentMasterSample += segment.MasterSamplesPerSegmentSample;
-                        currentDerivedSample++;
-                        if (currentMasterSample >= masterSample)
-                            return currentDerivedSample;
-                    }
-                }
-            }
-            return currentDerivedSample;
+            return getTimebaseSampleIndex(timebaseSegments).derivedSampleFromMasterSample(masterSample);
         }
 
 
@@ -1163,26 +1244,9 @@ namespace DataStructures
         /// <param name="derivedSample"></param>
         /// <param name="timebaseSegments"></param>
         /// <returns></returns>
-        public int getMasterSampleFromDerivedSample(int derivedSample, TimestepTimebaseSegmentCollection timebaseSegments)
+        public long getMasterSampleFromDerivedSample(int derivedSample, TimestepTimebaseSegmentCollection timebaseSegments)
         {
-            int currentDerivedSample = 0;
-            int currentMasterSample = 0;
-            if (derivedSample == 0)
-                return 0;
-            foreach (TimeStep step in enabledTimeSteps())
-            {
-                foreach (VariableTimebaseSegment segment in timebaseSegments[step])
-                {
-                    for (int i = 0; i < segment.NSegmentSamples; i++)
-                    {
-                        currentMasterSample += segment.MasterSamplesPerSegmentSample;
-                        currentDerivedSample++;
-                        if (currentDerivedSample >= derivedSample)
-                            return currentMasterSample;
-                    }
-                }
-            }
-            return currentMasterSample;
+            return getTimebaseSampleIndex(timebaseSegments).masterSampleFromDerivedSample(derivedSample);
         }
 
         /// <summary>
@@ -1292,7 +1356,7 @@ namespace DataStructures
                 {
                     int temp = 0;
                     computeNSamplesAndRemainderTime(ref temp, ref remainderTime, TimeSteps[i].StepDuration.getBaseValue(), timeStepSize);
-                    nSamples += temp;
+                    nSamples = checked(nSamples + temp);
                 }
             }
             return nSamples;
@@ -1307,7 +1371,17 @@ namespace DataStructures
         /// <param name="timeStepSize"></param>
         public static void computeNSamplesAndRemainderTime(ref int nSteps, ref double remainderTime, double duration, double timeStepSize)
         {
-            nSteps = (int)(duration / timeStepSize);
+            long nLongSteps = 0;
+            computeNSamplesAndRemainderTime(ref nLongSteps, ref remainderTime, duration, timeStepSize);
+            nSteps = checked((int)nLongSteps);
+        }
+
+        /// <summary>
+        /// As above, for counts of master timebase samples, which pass 2^31 in sequences of a few minutes.
+        /// </summary>
+        public static void computeNSamplesAndRemainderTime(ref long nSteps, ref double remainderTime, double duration, double timeStepSize)
+        {
+            nSteps = checked((long)(duration / timeStepSize));
             remainderTime += duration - nSteps * timeStepSize;
             // currentActualTime = currentSampleTime + remainderTime.
             // remainderTime should vary between -timeStepSize/2 and timeStepSize/2
@@ -1500,6 +1574,20 @@ namespace DataStructures
         /// <param name="masterTimebaseSampleDuration"></param>
         /// <returns></returns>
         public TimestepTimebaseSegmentCollection generateVariableTimebaseSegments(VariableTimebaseTypes timebaseType, double masterTimebaseSampleDuration)
+        {
+            return generateVariableTimebaseSegments(timebaseType, masterTimebaseSampleDuration, null);
+        }
+
+        /// <summary>
+        /// As above, reusing the segments of timesteps whose timing inputs are unchanged since the
+        /// previous generation that used the same cache. Reused segment collections are shared with
+        /// the cache, so callers passing a cache must not modify the result.
+        /// </summary>
+        /// <param name="timebaseType"></param>
+        /// <param name="masterTimebaseSampleDuration"></param>
+        /// <param name="cache">May be null.</param>
+        /// <returns></returns>
+        public TimestepTimebaseSegmentCollection generateVariableTimebaseSegments(VariableTimebaseTypes timebaseType, double masterTimebaseSampleDuration, VariableTimebaseSegmentCache cache)
         {
             switch (timebaseType)
             {
@@ -1509,6 +1597,10 @@ namespace DataStructures
                         TimestepTimebaseSegmentCollection ans = new TimestepTimebaseSegmentCollection();
 
                         Dictionary<TimeStep, List<DigitalImpingement>> digitalImpingements = getDigitalImpingements(masterTimebaseSampleDuration);
+                        Dictionary<AnalogGroup, double>[] allRunningGroups = getRunningGroupRemainingTimes();
+
+                        if (cache != null)
+                            cache.beginGeneration();
 
                         for (int stepID = 0; stepID < TimeSteps.Count; stepID++)
                         {
@@ -1516,8 +1608,23 @@ namespace DataStructures
                             {
                                 TimeStep currentStep = TimeSteps[stepID];
 
-                                VariableTimebaseSegmentCollection timestepSegments = new VariableTimebaseSegmentCollection();
-                                Dictionary<AnalogGroup, double> runningGroups = getRunningGroupRemainingTime(stepID);
+                                VariableTimebaseSegmentCollection timestepSegments;
+                                Dictionary<AnalogGroup, double> runningGroups = allRunningGroups[stepID];
+
+                                VariableTimebaseSegmentCache.Key cacheKey = null;
+                                if (cache != null)
+                                {
+                                    cacheKey = variableTimebaseSegmentsKey(currentStep, runningGroups,
+                                        digitalImpingements.ContainsKey(currentStep) ? digitalImpingements[currentStep] : null,
+                                        masterTimebaseSampleDuration);
+                                    if (cache.tryGetSegments(cacheKey, out timestepSegments))
+                                    {
+                                        ans.Add(currentStep, timestepSegments);
+                                        continue;
+                                    }
+                                }
+
+                                timestepSegments = new VariableTimebaseSegmentCollection();
 
                                 // first cull groups that have less remaining time than 2 master timbase cycles.
                                 {
@@ -1534,7 +1641,7 @@ namespace DataStructures
                                 if (runningGroups.Count == 0)
                                 {
 
-                                    timestepSegments.Add(new VariableTimebaseSegment(1, (int)(currentStep.StepDuration.getBaseValue() / masterTimebaseSampleDuration)));
+                                    timestepSegments.Add(new VariableTimebaseSegment(1, VariableTimebaseSegment.masterSamplesFromDouble(currentStep.StepDuration.getBaseValue() / masterTimebaseSampleDuration)));
                                 }
                                 else
                                 {
@@ -1615,7 +1722,7 @@ namespace DataStructures
                                     // one filler segment.
                                     if (currentStep.StepDuration.getBaseValue() - timeIntoCurrentStep >= 2 * masterTimebaseSampleDuration)
                                     {
-                                        timestepSegments.Add(new VariableTimebaseSegment(1, (int)(0.5 + (currentStep.StepDuration.getBaseValue() - timeIntoCurrentStep) / masterTimebaseSampleDuration)));
+                                        timestepSegments.Add(new VariableTimebaseSegment(1, VariableTimebaseSegment.masterSamplesFromDouble(0.5 + (currentStep.StepDuration.getBaseValue() - timeIntoCurrentStep) / masterTimebaseSampleDuration)));
                                     }
                                 }
 
@@ -1629,7 +1736,7 @@ namespace DataStructures
                                     List<DigitalImpingement> impigs = digitalImpingements[currentStep];
                                     foreach (DigitalImpingement impig in impigs)
                                     {
-                                        int samplesTillImpig = impig.nSamplesFromTimestepStart;
+                                        long samplesTillImpig = impig.nSamplesFromTimestepStart;
                                         VariableTimebaseSegment segmentToSplit = null;
                                         foreach (VariableTimebaseSegment seg in timestepSegments)
                                         {
@@ -1648,10 +1755,10 @@ namespace DataStructures
                                             // we now need to split the segment
                                             // this may take as many as 4 new segments to accomplish
                                             List<VariableTimebaseSegment> newSegments = new List<VariableTimebaseSegment>();
-                                            int newSegmentSamples = 0;
+                                            long newSegmentSamples = 0;
 
                                             // Lead in segment. This runs at the original segment's usual clock rate, and runs until right before temp
-                                            int nLeadSegmentSamples = samplesTillImpig / segmentToSplit.MasterSamplesPerSegmentSample;
+                                            int nLeadSegmentSamples = checked((int)(samplesTillImpig / segmentToSplit.MasterSamplesPerSegmentSample));
                                             if (nLeadSegmentSamples != 0)
                                             {
                                                 VariableTimebaseSegment newSeg = new VariableTimebaseSegment(nLeadSegmentSamples, segmentToSplit.MasterSamplesPerSegmentSample);
@@ -1662,8 +1769,8 @@ namespace DataStructures
 
 
                                             // Now, if necessary, add small jog in and jog out segment
-                                            int jogIn = samplesTillImpig;
-                                            int jogOut = segmentToSplit.MasterSamplesPerSegmentSample - jogIn;
+                                            long jogIn = samplesTillImpig;
+                                            long jogOut = segmentToSplit.MasterSamplesPerSegmentSample - jogIn;
 
                                             // have to be carefull. We can't jog in or out by less than 2.
                                             // If both are either greater than 1 or equal to zero, no problem.
@@ -1720,8 +1827,8 @@ namespace DataStructures
                                             }
 
                                             // now add lead out.
-                                            int nSamplesToReplace = segmentToSplit.MasterSamplesPerSegmentSample * segmentToSplit.NSegmentSamples - newSegmentSamples;
-                                            int nEndSegments = nSamplesToReplace / segmentToSplit.MasterSamplesPerSegmentSample;
+                                            long nSamplesToReplace = segmentToSplit.MasterSamplesPerSegmentSample * segmentToSplit.NSegmentSamples - newSegmentSamples;
+                                            int nEndSegments = checked((int)(nSamplesToReplace / segmentToSplit.MasterSamplesPerSegmentSample));
                                             if (nEndSegments * segmentToSplit.MasterSamplesPerSegmentSample != nSamplesToReplace)
                                             {
                                                 throw new InvalidDataException("Confusion during splitting of variable timebase segments due to digital pulses. This should not happen.");
@@ -1755,6 +1862,8 @@ namespace DataStructures
                                     timestepSegments.Remove(seg);
                                 }
 
+                                if (cache != null)
+                                    cache.storeSegments(cacheKey, timestepSegments);
 
                                 ans.Add(currentStep, timestepSegments);
                             }
@@ -1766,6 +1875,114 @@ namespace DataStructures
             }
         }
 
+        /// <summary>
+        /// Describes everything generateVariableTimebaseSegments reads to produce the segments of one
+        /// timestep, as a key for VariableTimebaseSegmentCache. Doubles go in by their bits, so that keys
+        /// only match when the inputs are identical.
+        /// </summary>
+        private static VariableTimebaseSegmentCache.Key variableTimebaseSegmentsKey(TimeStep step, Dictionary<AnalogGroup, double> runningGroups,
+            List<DigitalImpingement> impingements, double masterTimebaseSampleDuration)
+        {
+            int nImpingements = (impingements != null) ? impingements.Count : 0;
+            long[] key = new long[3 + 2 * runningGroups.Count + nImpingements];
+            int n = 0;
+
+            key[n++] = BitConverter.DoubleToInt64Bits(masterTimebaseSampleDuration);
+            key[n++] = BitConverter.DoubleToInt64Bits(step.StepDuration.getBaseValue());
+            key[n++] = runningGroups.Count;
+
+            // group order matters for tie breaking between groups of equal resolution
+            foreach (KeyValuePair<AnalogGroup, double> group in runningGroups)
+            {
+                key[n++] = BitConverter.DoubleToInt64Bits(group.Key.TimeResolution.getBaseValue());
+                key[n++] = BitConverter.DoubleToInt64Bits(group.Value);
+            }
+
+            for (int i = 0; i < nImpingements; i++)
+                key[n++] = impingements[i].nSamplesFromTimestepStart;
+
+            return new VariableTimebaseSegmentCache.Key(key);
+        }
+
+        /// <summary>
+        /// Describes the timing inputs of the whole sequence without generating anything: the master period, and per
+        /// enabled timestep its duration, retrigger options, analog group and digital impingements. An analog group's
+        /// resolution, effective duration and enabled channels go in where it is first used. Doubles go in by their
+        /// bits. Sequences with equal keys give the same variable timebase segments and the same FPGA upload, so
+        /// the key can name a stored upload from one server run to the next.
+        /// </summary>
+        /// <param name="timebaseType"></param>
+        /// <param name="masterTimebaseSampleDuration"></param>
+        /// <returns></returns>
+        public long[] getVariableTimebaseInputsKey(VariableTimebaseTypes timebaseType, double masterTimebaseSampleDuration)
+        {
+            Dictionary<TimeStep, List<DigitalImpingement>> digitalImpingements = getDigitalImpingements(masterTimebaseSampleDuration);
+            Dictionary<AnalogGroup, int> groupIndices = new Dictionary<AnalogGroup, int>();
+
+            List<long> key = new List<long>();
+            key.Add((long)timebaseType);
+            key.Add(BitConverter.DoubleToInt64Bits(masterTimebaseSampleDuration));
+
+            foreach (TimeStep step in enabledTimeSteps())
+            {
+                key.Add(BitConverter.DoubleToInt64Bits(step.StepDuration.getBaseValue()));
+
+                RetriggerOptions retrigger = step.RetriggerOptions;
+                if (retrigger.WaitForRetrigger)
+                {
+                    key.Add(1 | (retrigger.RetriggerOnEdge ? 2 : 0) | (retrigger.RetriggerOnNegativeValueOrEdge ? 4 : 0));
+                    key.Add(BitConverter.DoubleToInt64Bits(retrigger.RetriggerTimeout.getBaseValue()));
+                }
+                else
+                {
+                    key.Add(0);
+                }
+
+                AnalogGroup group = step.AnalogGroup;
+                if (group == null)
+                {
+                    key.Add(-1);
+                }
+                else if (groupIndices.ContainsKey(group))
+                {
+                    key.Add(groupIndices[group]);
+                }
+                else
+                {
+                    // a new group takes the next index, followed by its own inputs
+                    key.Add(groupIndices.Count);
+                    groupIndices.Add(group, groupIndices.Count);
+                    key.Add(BitConverter.DoubleToInt64Bits(group.TimeResolution.getBaseValue()));
+                    key.Add(BitConverter.DoubleToInt64Bits(group.getEffectiveDuration()));
+
+                    List<int> channels = new List<int>();
+                    foreach (int channelID in group.ChannelDatas.Keys)
+                    {
+                        if (group.channelEnabled(channelID))
+                            channels.Add(channelID);
+                    }
+                    channels.Sort();
+                    key.Add(channels.Count);
+                    foreach (int channelID in channels)
+                        key.Add(channelID);
+                }
+
+                List<DigitalImpingement> impingements;
+                if (digitalImpingements.TryGetValue(step, out impingements))
+                {
+                    key.Add(impingements.Count);
+                    foreach (DigitalImpingement impingement in impingements)
+                        key.Add(impingement.nSamplesFromTimestepStart);
+                }
+                else
+                {
+                    key.Add(0);
+                }
+            }
+
+            return key.ToArray();
+        }
+
 
         /// <summary>
         /// This class descibes a single "segment" of a variable timebase clock.
@@ -1785,23 +2002,55 @@ namespace DataStructures
                 get { return nSegmentSamples; }
                 set { nSegmentSamples = value; }
             }
+            /// <summary>
+            /// Largest on or off count the FPGA timebase can hold (its FIFO words carry 48 bit counts).
+            /// </summary>
+            public const long MaxCounts = (1L << 48) - 1;
+
+            /// <summary>
+            /// Largest number of master samples in one segment sample, ie one full on + off period.
+            /// </summary>
+            public const long MaxMasterSamplesPerSegmentSample = 2 * MaxCounts;
+
             /// <summary>
             /// Number of master timebase samples corresponding to each segment sample. Minimum value is 2.
             /// </summary>
-            private int masterSamplesPerSegmentSample;
+            private long masterSamplesPerSegmentSample;
 
-            public int MasterSamplesPerSegmentSample
+            public long MasterSamplesPerSegmentSample
             {
                 get { return masterSamplesPerSegmentSample; }
-                set { masterSamplesPerSegmentSample = value; }
+                set
+                {
+                    checkMasterSamples(value);
+                    masterSamplesPerSegmentSample = value;
+                }
             }
 
-            public VariableTimebaseSegment(int nSegmentSamples, int masterSamplesPerSegmentSample)
+            public VariableTimebaseSegment(int nSegmentSamples, long masterSamplesPerSegmentSample)
             {
+                checkMasterSamples(masterSamplesPerSegmentSample);
                 this.nSegmentSamples = nSegmentSamples;
                 this.masterSamplesPerSegmentSample = masterSamplesPerSegmentSample;
             }
 
+            private static void checkMasterSamples(long masterSamplesPerSegmentSample)
+            {
+                if (masterSamplesPerSegmentSample > MaxMasterSamplesPerSegmentSample)
+                    throw new InvalidDataException("Variable timebase segment of " + masterSamplesPerSegmentSample + " master samples per sample exceeds the maximum of " + MaxMasterSamplesPerSegmentSample + ".");
+            }
+
+            /// <summary>
+            /// Truncates a master sample count computed in floating point, checking it against
+            /// MaxMasterSamplesPerSegmentSample before the conversion can overflow.
+            /// </summary>
+            public static long masterSamplesFromDouble(double masterSamples)
+            {
+                if (!(masterSamples <= MaxMasterSamplesPerSegmentSample))
+                    throw new InvalidDataException("Variable timebase segment of " + masterSamples + " master samples per sample exceeds the maximum of " + MaxMasterSamplesPerSegmentSample + ".");
+                return (long)masterSamples;
+            }
+
             public VariableTimebaseSegment(int nSegmentSamples)
                 : this(nSegmentSamples, 2)
             {
@@ -2022,22 +2271,22 @@ namespace DataStructures
             if (this.digitalChannelUsesPulses(digitalID))
             {
 
-                int currentMasterSample = 0;
+                long currentMasterSample = 0;
                 // now fill in any pulses which act on this channel...
                 foreach (TimeStep step in enabledTimeSteps())
                 {
 
-                        int nMasterSamplesInTimestep = timebaseSegments.nMasterSamples(step);
+                        long nMasterSamplesInTimestep = timebaseSegments.nMasterSamples(step);
 
                         if (step.DigitalData.ContainsKey(digitalID))
                         {
                             if (step.DigitalData[digitalID].usesPulse())
                             {
                                 Pulse pulse = step.DigitalData[digitalID].DigitalPulse;
-                                Pulse.PulseSampleTimes sampleTimes = pulse.getPulseSampleTimes(nMasterSamplesInTimestep, masterTimebaseSampleDuration);
+                                Pulse.PulseSampleTimes sampleTimes = pulse.getPulseSampleTimes(checked((int)nMasterSamplesInTimestep), masterTimebaseSampleDuration);
 
-                                int start = currentMasterSample + sampleTimes.startSample;
-                                int end = currentMasterSample + sampleTimes.endSample;
+                                long start = currentMasterSample + sampleTimes.startSample;
+                                long end = currentMasterSample + sampleTimes.endSample;
 
                                 // ok. Paint the pulse...
                                 // to do this, we need to find which derived sample (ie sample in this buffer) corresponds to 
@@ -2136,7 +2385,8 @@ namespace DataStructures
         /// <param name="?"></param>
         /// <returns></returns>
         public bool [] getDigitalBufferClockSharedWithVariableTimebaseClock(TimestepTimebaseSegmentCollection timebaseSegments, int digitalID, double masterTimestepSize) {
-            int nSamples = timebaseSegments.nMasterSamples();
+            // one buffer sample per master sample, so this buffer is limited to int range
+            int nSamples = checked((int)timebaseSegments.nMasterSamples());
 
             nSamples += 1 + 2; // 1 extra sample at the beginning for the clock's leading LOW, and 2 at the end for the extgra dwell pulse. (this matches
              // the number of samples in the variable timebase clock, see the following function
@@ -2156,7 +2406,7 @@ namespace DataStructures
             {
                 if (step.StepEnabled)
                 {
-                    int nStepSamples = timebaseSegments.nMasterSamples(step);
+                    int nStepSamples = (int)timebaseSegments.nMasterSamples(step);
 
                     // if the digital is true, fill this part of the buffer with trues. If not, 
                     // no need to do anything as the inital value of the array is false.
@@ -2187,7 +2437,7 @@ namespace DataStructures
                 currentSample = 1;
                 foreach (TimeStep step in enabledTimeSteps())
                 {
-                    int nStepSamples = timebaseSegments.nMasterSamples(step);
+                    int nStepSamples = (int)timebaseSegments.nMasterSamples(step);
 
                     if (step.DigitalData[digitalID].usesPulse())
                     {
@@ -2215,53 +2465,25 @@ namespace DataStructures
 
         public bool[] getVariableTimebaseClock(TimestepTimebaseSegmentCollection timebaseSegments)
         {
-            int nSamples = timebaseSegments.nMasterSamples();
-
-            nSamples += 1 + 2; // add 1 false sample at the beginning so that we start with a false, and 2 at the end so we can 
-             // trigger the dwell values;
-
-            if (nSamples % 4 != 0)
-                nSamples += (4 - nSamples % 4); // for daqMx drivers, the number of samples in a digital stream has to be a multiple of 4
-
-            bool[] ans = new bool[nSamples];
-            int currentSample = 1;  // start at sample 1, thus leaving sample 0 as false.
-
-            for (int stepID = 0; stepID < TimeSteps.Count; stepID++)
-            {
-                TimeStep currentStep = TimeSteps[stepID];
-                if (currentStep.StepEnabled)
-                {
-                    List<VariableTimebaseSegment> segments = timebaseSegments[currentStep];
-                    foreach (VariableTimebaseSegment seg in segments)
-                    {
-                        for (int i = 0; i < seg.NSegmentSamples; i++)
-                        {
-                            ans[currentSample] = true;
-
-                            // make the clock pulse a little bit longer if the clocks are sufficiently far apart
-                            // for this segment. This is mainly an aesthetic detail, it makes it easier to 
-                            // inspect the variable timebase on a scope, and should 
-                            // make no functional different
-                            if (seg.MasterSamplesPerSegmentSample > 2)
-                            {
-                                int repeats = (seg.MasterSamplesPerSegmentSample / 2);
-                                for (int j = 0; j < repeats; j++)
-                                {
-                                    ans[currentSample + j] = true;
-                                }
-                            }
-
-                            currentSample += seg.MasterSamplesPerSegmentSample;
-                        }
-                    }
-                }
-            }
+            VariableTimebaseClockEdges edges = getVariableTimebaseClockEdges(timebaseSegments);
 
-            // Add one last pulse at the end to push into dwell values? I don't remember, this comment
-            // it being written long after the code was.
-            ans[currentSample] = true;
+            // one buffer sample per master sample, so this buffer is limited to int range.
+            // 1 false sample at the beginning so that we start with a false, 2 at the end so we can 
+            // trigger the dwell values, and a multiple of 4 samples for the daqMx drivers
+            bool[] ans = new bool[checked((int)edges.ClockBufferLength)];
+            edges.renderClock(0, ans);
             return ans;
+        }
 
+        /// <summary>
+        /// Returns a generator of the clock edges of a variable timebase, which reads them (or renders
+        /// the getVariableTimebaseClock buffer) in chunks without materializing the whole buffer.
+        /// </summary>
+        /// <param name="timebaseSegments"></param>
+        /// <returns></returns>
+        public VariableTimebaseClockEdges getVariableTimebaseClockEdges(TimestepTimebaseSegmentCollection timebaseSegments)
+        {
+            return new VariableTimebaseClockEdges(enabledTimeSteps(), timebaseSegments);
         }
 
         #endregion
@@ -2276,7 +2498,7 @@ namespace DataStructures
         /// </summary>
         private class DigitalImpingement
         {
-            public int nSamplesFromTimestepStart;
+            public long nSamplesFromTimestepStart;
         }
 
         /// <summary>
@@ -2286,7 +2508,7 @@ namespace DataStructures
         /// <returns></returns>
         private Dictionary<TimeStep, List<DigitalImpingement>> getDigitalImpingements(double timeStepSize)
         {
-            int nSamplesSoFar = 0;
+            long nSamplesSoFar = 0;
             double remainderTime=0;
 
             Dictionary<TimeStep, List<DigitalImpingement>> ans = new Dictionary<TimeStep,List<DigitalImpingement>>();
@@ -2313,7 +2535,7 @@ namespace DataStructures
                         }
                     }
                 }
-                int nStepSamples = 0;
+                long nStepSamples = 0;
                 computeNSamplesAndRemainderTime(ref nStepSamples, ref remainderTime, step.StepDuration.getBaseValue(), timeStepSize);
                 nSamplesSoFar += nStepSamples;
             }
@@ -2321,10 +2543,10 @@ namespace DataStructures
             return ans;
         }
 
-        private void addImpingement(Dictionary<TimeStep, List<DigitalImpingement>> dict, int nSamplesFromStart, double timeStepSize) 
+        private void addImpingement(Dictionary<TimeStep, List<DigitalImpingement>> dict, long nSamplesFromStart, double timeStepSize) 
         {
             TimeStep impigStep = getTimestepAtSample(nSamplesFromStart, timeStepSize);
-            int impigStepSample = getSamplesAtTimestep(impigStep, timeStepSize);
+            long impigStepSample = getSamplesAtTimestep(impigStep, timeStepSize);
             DigitalImpingement impig = new DigitalImpingement();
             impig.nSamplesFromTimestepStart = nSamplesFromStart - impigStepSample;
 
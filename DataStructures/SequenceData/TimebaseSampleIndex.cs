@@ -0,0 +1,170 @@
+using System;
+using System.Collections.Generic;
+using System.Text;
+
+namespace DataStructures
+{
+    /// <summary>
+    /// Maps between master and derived (variable timebase) sample numbers in O(log n) per lookup, n being the
+    /// number of variable timebase segments. Built once from a TimestepTimebaseSegmentCollection as flat arrays
+    /// of the master and derived sample counts at the end of each segment, in timestep order; a lookup is a
+    /// binary search for the segment followed by a division within it.
+    /// 
+    /// Results are the same as those of walking the segments sample by sample, which is what
+    /// SequenceData.getDerivedSampleFromMasterSample and getMasterSampleFromDerivedSample used to do.
+    /// The index is a snapshot: it does not see later changes to the segments it was built from.
+    /// </summary>
+    public class TimebaseSampleIndex
+    {
+        // one entry per segment with at least one sample
+        private long[] endMasterSample;
+        private int[] endDerivedSample;
+        private long[] masterSamplesPerSegmentSample;
+
+        private long nMasterSamples;
+        private int nDerivedSamples;
+
+        public TimebaseSampleIndex(IList<TimeStep> enabledSteps, TimestepTimebaseSegmentCollection timebaseSegments)
+        {
+            List<long> endMaster = new List<long>();
+            List<int> endDerived = new List<int>();
+            List<long> period = new List<long>();
+
+            foreach (TimeStep step in enabledSteps)
+            {
+                foreach (SequenceData.VariableTimebaseSegment segment in timebaseSegments[step])
+                {
+                    if (segment.NSegmentSamples <= 0)
+                        continue;
+                    nMasterSamples += segment.MasterSamplesPerSegmentSample * segment.NSegmentSamples;
+                    nDerivedSamples += segment.NSegmentSamples;
+                    endMaster.Add(nMasterSamples);
+                    endDerived.Add(nDerivedSamples);
+                    period.Add(segment.MasterSamplesPerSegmentSample);
+                }
+            }
+
+            endMasterSample = endMaster.ToArray();
+            endDerivedSample = endDerived.ToArray();
+            masterSamplesPerSegmentSample = period.ToArray();
+        }
+
+        public long NMasterSamples
+        {
+            get { return nMasterSamples; }
+        }
+
+        public int NDerivedSamples
+        {
+            get { return nDerivedSamples; }
+        }
+
+        public int NSegments
+        {
+            get { return endMasterSample.Length; }
+        }
+
+        /// <summary>
+        /// Index of the first element of ends that is >= value, or ends.Length if there is none.
+        /// The loop runs a fixed number of times for a given length, and the comparison only selects
+        /// the next base, so the JIT can compile it without an unpredictable branch.
+        /// </summary>
+        private static int lowerBound(long[] ends, long value)
+        {
+            int n = ends.Length;
+            if (n == 0 || ends[n - 1] < value)
+                return n;
+            int first = 0;
+            while (n > 1)
+            {
+                int half = n >> 1;
+                first = (ends[first + half - 1] < value) ? first + half : first;
+                n -= half;
+            }
+            return first;
+        }
+
+        private static int lowerBound(int[] ends, int value)
+        {
+            int n = ends.Length;
+            if (n == 0 || ends[n - 1] < value)
+                return n;
+            int first = 0;
+            while (n > 1)
+            {
+                int half = n >> 1;
+                first = (ends[first + half - 1] < value) ? first + half : first;
+                n -= half;
+            }
+            return first;
+        }
+
+        /// <summary>
+        /// Returns the first derived sample which is on or after the given master sample.
+        /// </summary>
+        /// <param name="masterSample"></param>
+        /// <returns></returns>
+        public int derivedSampleFromMasterSample(long masterSample)
+        {
+            if (masterSample == 0)
+                return 0;
+            if (masterSample < 0)
+                return (nDerivedSamples > 0) ? 1 : 0;
+            int k = lowerBound(endMasterSample, masterSample);
+            if (k == endMasterSample.Length)
+                return nDerivedSamples;
+
+            // endMasterSample[k] >= masterSample > the end of the segment before, so this segment has a nonzero period
+            long startMaster = (k == 0) ? 0 : endMasterSample[k - 1];
+            int startDerived = (k == 0) ? 0 : endDerivedSample[k - 1];
+            long period = masterSamplesPerSegmentSample[k];
+            return startDerived + (int)((masterSample - startMaster + period - 1) / period);
+        }
+
+        /// <summary>
+        /// Returns the master sample at which the given derived sample ends.
+        /// </summary>
+        /// <param name="derivedSample"></param>
+        /// <returns></returns>
+        public long masterSampleFromDerivedSample(int derivedSample)
+        {
+            if (derivedSample == 0)
+                return 0;
+            if (derivedSample < 0)
+                derivedSample = 1;
+            int k = lowerBound(endDerivedSample, derivedSample);
+            if (k == endDerivedSample.Length)
+                return nMasterSamples;
+
+            long startMaster = (k == 0) ? 0 : endMasterSample[k - 1];
+            int startDerived = (k == 0) ? 0 : endDerivedSample[k - 1];
+            return startMaster + (derivedSample - startDerived) * masterSamplesPerSegmentSample[k];
+        }
+
+        /// <summary>
+        /// derivedSampleFromMasterSample of each element of masterSamples, into derivedSamples.
+        /// </summary>
+        /// <param name="masterSamples"></param>
+        /// <param name="derivedSamples"></param>
+        public void derivedSamplesFromMasterSamples(long[] masterSamples, int[] derivedSamples)
+        {
+            if (derivedSamples.Length < masterSamples.Length)
+                throw new ArgumentException("Output array is shorter than the input array.");
+            for (int i = 0; i < masterSamples.Length; i++)
+                derivedSamples[i] = derivedSampleFromMasterSample(masterSamples[i]);
+        }
+
+        /// <summary>
+        /// masterSampleFromDerivedSample of each element of derivedSamples, into masterSamples.
+        /// </summary>
+        /// <param name="derivedSamples"></param>
+        /// <param name="masterSamples"></param>
+        public void masterSamplesFromDerivedSamples(int[] derivedSamples, long[] masterSamples)
+        {
+            if (masterSamples.Length < derivedSamples.Length)
+                throw new ArgumentException("Output array is shorter than the input array.");
+            for (int i = 0; i < derivedSamples.Length; i++)
+                masterSamples[i] = masterSampleFromDerivedSample(derivedSamples[i]);
+        }
+    }
+}
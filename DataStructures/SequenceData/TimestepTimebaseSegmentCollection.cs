@@ -16,7 +16,7 @@ namespace DataStructures
         public override string ToString()
         {
             int ss=0;
-            int ms = 0;
+            long ms = 0;
             foreach (SequenceData.VariableTimebaseSegment seg in this)
             {
                 ss += seg.NSegmentSamples;
@@ -36,6 +36,18 @@ namespace DataStructures
             
         }
 
+        private TimebaseSampleIndex sampleIndex;
+
+        /// <summary>
+        /// Sample index built by SequenceData.getTimebaseSampleIndex on first use. The segments are
+        /// not expected to change after generation; set this to null if they do.
+        /// </summary>
+        public TimebaseSampleIndex SampleIndex
+        {
+            get { return sampleIndex; }
+            set { sampleIndex = value; }
+        }
+
         public int nSegmentSamples(TimeStep ts)
         {
             int ans=0;
@@ -53,9 +65,9 @@ namespace DataStructures
             }
         }
 
-        public int nMasterSamples(TimeStep ts)
+        public long nMasterSamples(TimeStep ts)
         {
-            int ans = 0;
+            long ans = 0;
             if (this.ContainsKey(ts))
             {
                 foreach (SequenceData.VariableTimebaseSegment segment in this[ts])
@@ -66,9 +78,9 @@ namespace DataStructures
             return ans;
         }
 
-        public int nMasterSamples()
+        public long nMasterSamples()
         {
-            int ans = 0;
+            long ans = 0;
             foreach (TimeStep step in this.Keys)
             {
                 ans += this.nMasterSamples(step);
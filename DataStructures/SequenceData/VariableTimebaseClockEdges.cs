@@ -0,0 +1,212 @@
+using System;
+using System.Collections.Generic;
+using System.Text;
+
+namespace DataStructures
+{
+    /// <summary>
+    /// Streams the clock edges of a variable timebase straight from its segments, in chunks of the
+    /// caller's size, instead of materializing the one-entry-per-master-sample buffer of
+    /// SequenceData.getVariableTimebaseClock. Memory use depends on the number of segments only, so
+    /// verification, plotting and DAQ timebase output of long shots run in constant memory.
+    /// 
+    /// There is one rising edge per derived sample. Edge positions are master sample indices counted from
+    /// the first edge; in the buffer of getVariableTimebaseClock each sits one sample later, after its
+    /// leading low sample. renderClock produces any window of that buffer.
+    /// </summary>
+    public class VariableTimebaseClockEdges
+    {
+        // one entry per segment with at least one sample
+        private long[] startMasterSample;
+        private long[] masterSamplesPerSegmentSample;
+        private int[] nSegmentSamples;
+
+        private long nMasterSamples;
+        private long nEdges;
+
+        // read position
+        private int segment;
+        private int segmentSample;
+        private long masterSample;
+
+        public VariableTimebaseClockEdges(IList<TimeStep> enabledSteps, TimestepTimebaseSegmentCollection timebaseSegments)
+        {
+            List<long> start = new List<long>();
+            List<long> period = new List<long>();
+            List<int> count = new List<int>();
+
+            foreach (TimeStep step in enabledSteps)
+            {
+                foreach (SequenceData.VariableTimebaseSegment seg in timebaseSegments[step])
+                {
+                    if (seg.NSegmentSamples <= 0)
+                        continue;
+                    start.Add(nMasterSamples);
+                    period.Add(seg.MasterSamplesPerSegmentSample);
+                    count.Add(seg.NSegmentSamples);
+                    nMasterSamples += seg.MasterSamplesPerSegmentSample * seg.NSegmentSamples;
+                    nEdges += seg.NSegmentSamples;
+                }
+            }
+
+            startMasterSample = start.ToArray();
+            masterSamplesPerSegmentSample = period.ToArray();
+            nSegmentSamples = count.ToArray();
+        }
+
+        /// <summary>
+        /// Number of clock edges, ie of derived samples.
+        /// </summary>
+        public long NEdges
+        {
+            get { return nEdges; }
+        }
+
+        public long NMasterSamples
+        {
+            get { return nMasterSamples; }
+        }
+
+        /// <summary>
+        /// Length of the buffer getVariableTimebaseClock returns: the master samples, one leading and two
+        /// trailing samples, rounded up to a multiple of 4.
+        /// </summary>
+        public long ClockBufferLength
+        {
+            get
+            {
+                long n = nMasterSamples + 1 + 2;
+                if (n % 4 != 0)
+                    n += (4 - n % 4);
+                return n;
+            }
+        }
+
+        /// <summary>
+        /// Moves the read position back to the first edge.
+        /// </summary>
+        public void reset()
+        {
+            segment = 0;
+            segmentSample = 0;
+            masterSample = 0;
+        }
+
+        /// <summary>
+        /// Reads the master sample indices of the next edges into buffer. Returns the number read,
+        /// 0 once every edge has been read.
+        /// </summary>
+        /// <param name="buffer"></param>
+        /// <returns></returns>
+        public int readMasterSamples(long[] buffer)
+        {
+            return readMasterSamples(buffer, 0, buffer.Length);
+        }
+
+        /// <summary>
+        /// Reads up to count edges into buffer, starting at offset.
+        /// </summary>
+        /// <param name="buffer"></param>
+        /// <param name="offset"></param>
+        /// <param name="count"></param>
+        /// <returns></returns>
+        public int readMasterSamples(long[] buffer, int offset, int count)
+        {
+            int n = 0;
+            while (n < count && segment < nSegmentSamples.Length)
+            {
+                long period = masterSamplesPerSegmentSample[segment];
+                int take = Math.Min(count - n, nSegmentSamples[segment] - segmentSample);
+                for (int i = 0; i < take; i++)
+                {
+                    buffer[offset + n++] = masterSample;
+                    masterSample += period;
+                }
+                segmentSample += take;
+                if (segmentSample == nSegmentSamples[segment])
+                {
+                    segment++;
+                    segmentSample = 0;
+                }
+            }
+            return n;
+        }
+
+        /// <summary>
+        /// As readMasterSamples, with the edges converted to seconds after the first one.
+        /// </summary>
+        /// <param name="buffer"></param>
+        /// <param name="masterTimebaseSampleDuration"></param>
+        /// <returns></returns>
+        public int readTimes(double[] buffer, double masterTimebaseSampleDuration)
+        {
+            long[] samples = new long[Math.Min(buffer.Length, 4096)];
+            int total = 0;
+            while (total < buffer.Length)
+            {
+                int n = readMasterSamples(samples, 0, Math.Min(samples.Length, buffer.Length - total));
+                if (n == 0)
+                    break;
+                for (int i = 0; i < n; i++)
+                    buffer[total + i] = samples[i] * masterTimebaseSampleDuration;
+                total += n;
+            }
+            return total;
+        }
+
+        /// <summary>
+        /// Fills chunk with samples firstSample onwards of the getVariableTimebaseClock buffer
+        /// (false past its end).
+        /// </summary>
+        /// <param name="firstSample"></param>
+        /// <param name="chunk"></param>
+        public void renderClock(long firstSample, bool[] chunk)
+        {
+            Array.Clear(chunk, 0, chunk.Length);
+            long end = firstSample + chunk.Length;
+
+            // buffer sample b shows master sample b - 1; find the first segment still running at the window start
+            long windowMaster = Math.Max(firstSample - 1, 0);
+            int lo = 0, hi = startMasterSample.Length;
+            while (lo < hi)
+            {
+                int mid = (lo + hi) >> 1;
+                if (startMasterSample[mid] + masterSamplesPerSegmentSample[mid] * nSegmentSamples[mid] < windowMaster)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            for (int k = lo; k < startMasterSample.Length; k++)
+            {
+                long period = masterSamplesPerSegmentSample[k];
+                long first = 1 + startMasterSample[k];
+                if (first >= end)
+                    break;
+
+                // every edge is high for one sample, or for half the period when that is longer;
+                // purely so the clock is easier to inspect on a scope
+                long high = (period > 2) ? period / 2 : 1;
+                long i = 0;
+                if (period > 0 && first < firstSample)
+                    i = Math.Min((firstSample - first) / period, nSegmentSamples[k]);
+                for (; i < nSegmentSamples[k]; i++)
+                {
+                    long pulse = first + i * period;
+                    if (pulse >= end)
+                        break;
+                    long from = Math.Max(pulse, firstSample);
+                    long to = Math.Min(pulse + high, end);
+                    for (long b = from; b < to; b++)
+                        chunk[b - firstSample] = true;
+                    if (period == 0)
+                        break;
+                }
+            }
+
+            // final pulse, into the dwell values
+            long last = 1 + nMasterSamples;
+            if (last >= firstSample && last < end)
+                chunk[last - firstSample] = true;
+        }
+    }
+}
@@ -0,0 +1,119 @@
+using System;
+using System.Collections.Generic;
+using System.Text;
+
+namespace DataStructures
+{
+    /// <summary>
+    /// Keeps the variable timebase segments generated for each timestep, keyed by the inputs that
+    /// determine them (step duration, running analog group resolutions and remaining times, digital
+    /// pulse impingements and master sample period). Passing the same cache to successive calls of
+    /// SequenceData.generateVariableTimebaseSegments, for instance over the iterations of a list run,
+    /// lets unchanged timesteps reuse their segments instead of regenerating them.
+    /// 
+    /// A hit hands out the cached collection itself rather than a copy, so a consumer can recognise an
+    /// unchanged timestep by reference (FpgaTimebaseTask reuses its encoded records that way). The
+    /// collections must therefore not be modified once generated.
+    /// 
+    /// Only the entries used by the most recent generation are kept, so the cache does not grow over a long run.
+    /// </summary>
+    public class VariableTimebaseSegmentCache
+    {
+        /// <summary>
+        /// The inputs of one timestep's segments, packed into 64 bit words by SequenceData; keys are
+        /// equal when all their words are.
+        /// </summary>
+        public class Key
+        {
+            private long[] words;
+            private int hash;
+
+            public Key(long[] words)
+            {
+                this.words = words;
+                ulong h = 14695981039346656037UL;
+                foreach (long w in words)
+                    h = (h ^ (ulong)w) * 1099511628211UL;
+                hash = (int)(h ^ (h >> 32));
+            }
+
+            public override int GetHashCode()
+            {
+                return hash;
+            }
+
+            public override bool Equals(object obj)
+            {
+                Key other = obj as Key;
+                if (other == null || other.hash != hash || other.words.Length != words.Length)
+                    return false;
+                for (int i = 0; i < words.Length; i++)
+                {
+                    if (other.words[i] != words[i])
+                        return false;
+                }
+                return true;
+            }
+        }
+
+        private Dictionary<Key, VariableTimebaseSegmentCollection> previous = new Dictionary<Key, VariableTimebaseSegmentCollection>();
+        private Dictionary<Key, VariableTimebaseSegmentCollection> current = new Dictionary<Key, VariableTimebaseSegmentCollection>();
+
+        private int hits;
+
+        /// <summary>
+        /// Number of timesteps whose segments were reused in the most recent generation.
+        /// </summary>
+        public int Hits
+        {
+            get { return hits; }
+        }
+
+        private int misses;
+
+        /// <summary>
+        /// Number of timesteps whose segments had to be generated in the most recent generation.
+        /// </summary>
+        public int Misses
+        {
+            get { return misses; }
+        }
+
+        /// <summary>
+        /// Starts a new generation. Entries not looked up or stored since the previous call are dropped.
+        /// </summary>
+        public void beginGeneration()
+        {
+            previous = current;
+            current = new Dictionary<Key, VariableTimebaseSegmentCollection>();
+            hits = 0;
+            misses = 0;
+        }
+
+        /// <summary>
+        /// Gives the cached segments for key, if there are any.
+        /// </summary>
+        /// <param name="key"></param>
+        /// <param name="segments"></param>
+        /// <returns></returns>
+        public bool tryGetSegments(Key key, out VariableTimebaseSegmentCollection segments)
+        {
+            if (!current.TryGetValue(key, out segments))
+            {
+                if (!previous.TryGetValue(key, out segments))
+                {
+                    misses++;
+                    return false;
+                }
+                current.Add(key, segments);
+            }
+            hits++;
+            return true;
+        }
+
+        public void storeSegments(Key key, VariableTimebaseSegmentCollection segments)
+        {
+            current[key] = segments;
+        }
+    }
+}
@@ -102,7 +102,8 @@ reg [3:0] nSegsGenerated; // used only to drive LEDs
 
 // bit 0: last run finished successfully
 // bit 1: last run was aborted
-// bits 2-15: reserved for future use
+// bit 2: last run was stopped by a segment FIFO underrun (stream mode, bit 1 is set too)
+// bits 3-15: reserved for future use
 reg[15:0] fpgaStatusOut;
 
 
@@ -149,6 +150,20 @@ assign soft_abort_trig_in =    ok_trig_ins[1];
 wire use_hard_trig;
 assign use_hard_trig = ok_wire_ins[0];
 
+// Stream mode: the host keeps writing segments while we generate, and marks
+// the end of the stream with a trigger. Running out of segments before that
+// is an underrun, not the end of the sequence.
+wire stream_mode;
+assign stream_mode = ok_wire_ins[2];
+
+wire soft_stream_end_trig_in;
+assign soft_stream_end_trig_in = ok_trig_ins[2];
+
+reg streamEnded;
+reg fifoUnderflowed;      // sticky since the start trigger
+
+reg [15:0] recordsRead;   // segments read from the FIFO since the start trigger
+
 
 reg [48:0] main_counter;
 reg [32:0] repeat_counter; 
@@ -166,6 +181,9 @@ initial begin
 	mistriggerDetected<=0;
 	masterSamplesGenerated<=0;
 	retriggerTimeoutCount<=0;
+	streamEnded<=0;
+	fifoUnderflowed<=0;
+	recordsRead<=0;
 	retriggerWaitSamples<=0;
 	fpgaStatusOut<=0;
 	lastRetriggerIn<=0;
@@ -209,6 +227,11 @@ always @(posedge refclk) begin
 	if (fifo_read_enable==1) begin
 		fifo_read_enable<=0;
 		clock_data_from_fifo=fifo_dout;
+		recordsRead<=recordsRead+1;
+	end
+
+	if (underflow==1) begin
+		fifoUnderflowed<=1;
 	end
 	
 	// clear fifo_reset bit if neccesary
@@ -228,11 +251,18 @@ always @(posedge refclk) begin
 			waitingForRetrigger<=0;
 			waitedCounts<=0;
 			toggler<=0;
+			recordsRead<=0;
+
+			if (soft_abort_trig_in==1 && stream_mode) begin   // in stream mode an abort while idle flushes the FIFO, so segments
+				fifo_reset<=1;                                   // streamed in after an underrun cannot leak into the next run
+			end
 
 			if (soft_generate_trig_in==1) begin
 				if (fifo_read_enable==0) begin
 					state<=s_preparing_to_generate; 
 					fifo_read_enable<=1;               // read the first list item from the FIFO before starting generation
+					streamEnded<=0;
+					fifoUnderflowed<=0;
 				end
 			end
 		end
@@ -315,7 +345,10 @@ always @(posedge refclk) begin
 							else begin										// no data in the FIFO?
 								state<=s_idle;								// then we are done. go back to idle
 								fifo_reset<=1;								// this line is probably unnecessary
-								fpgaStatusOut[0]<=1; 					// Mark the status output that we are done.
+								if (stream_mode && !streamEnded)
+									fpgaStatusOut[2:1]<=2'b11;			// unless the host had more to send: underrun
+								else
+									fpgaStatusOut[0]<=1; 				// Mark the status output that we are done.
 							end
 						end
 					end		
@@ -323,8 +356,115 @@ always @(posedge refclk) begin
 			end
 		end
 	endcase
+
+	// after the case, so that an end-of-stream trigger arriving together
+	// with the start trigger is not lost
+	if (soft_stream_end_trig_in==1) begin
+		streamEnded<=1;
+	end
+end
+
+
+// Upload integrity check: CRC-32C (Castagnoli, reflected, initial value and
+// final XOR 0xFFFFFFFF) of the byte stream written to pipe 0x80, computed as the
+// words enter the segment FIFO. Words the FIFO drops while full are left out, so
+// an upload that overflows it fails the host's comparison. Each pipe word carries two stream bytes, low
+// byte first. The host resets it with trigger 0x41 bit 0 before an upload and
+// compares it with its own CRC on wire outs 0x28 (low) / 0x29 (high) afterwards.
+wire [15:0] ok_crc_trig_ins;
+wire upload_crc_reset;
+assign upload_crc_reset = ok_crc_trig_ins[0];
+
+reg [31:0] uploadCrc;
+wire [31:0] uploadCrcOut;
+assign uploadCrcOut = ~uploadCrc;
+
+function [31:0] crc32c_byte;
+	input [31:0] crc;
+	input [7:0] data;
+	integer i;
+	begin
+		crc32c_byte = crc ^ {24'b0, data};
+		for (i=0; i<8; i=i+1)
+			crc32c_byte = crc32c_byte[0] ? ((crc32c_byte >> 1) ^ 32'h82F63B78) : (crc32c_byte >> 1);
+	end
+endfunction
+
+initial begin
+	uploadCrc<=32'hFFFFFFFF;
+end
+
+always @(posedge ti_clk) begin
+	if (upload_crc_reset==1)
+		uploadCrc<=32'hFFFFFFFF;
+	else if (pipeI_write==1 && full==0)
+		uploadCrc<=crc32c_byte(crc32c_byte(uploadCrc, pipeI_data[7:0]), pipeI_data[15:8]);
+end
+
+
+// Segment FIFO fill level, in records, for hosts that stream segments while
+// we generate (stream mode). Segments written are counted on ti_clk (eight
+// pipe words per segment, cleared with the upload CRC by trigger 0x41 bit 0);
+// segments read are counted on refclk and brought over in Gray code, so the
+// level on wire out 0x2A is never torn. It lags reads by a few ti_clk cycles,
+// which only ever overstates it, and is meaningful from the upload reset to
+// the end of the run (the FIFO reset at the end does not clear it). Wire out
+// 0x2B holds the FIFO flags.
+reg [2:0]  pipeWordCount;
+reg [15:0] recordsWritten;
+reg        fifoOverflowed;     // sticky since trigger 0x41 bit 0
+
+always @(posedge ti_clk) begin
+	if (upload_crc_reset==1) begin
+		pipeWordCount<=0;
+		recordsWritten<=0;
+		fifoOverflowed<=0;
+	end
+	else begin
+		if (pipeI_write==1 && full==0) begin
+			pipeWordCount<=pipeWordCount+1;
+			if (pipeWordCount==7)
+				recordsWritten<=recordsWritten+1;
+		end
+		if (overflow==1)
+			fifoOverflowed<=1;
+	end
 end
 
+function [15:0] gray_to_binary;
+	input [15:0] gray;
+	integer i;
+	begin
+		gray_to_binary[15] = gray[15];
+		for (i=14; i>=0; i=i-1)
+			gray_to_binary[i] = gray_to_binary[i+1] ^ gray[i];
+	end
+endfunction
+
+reg [15:0] recordsReadGray;
+reg [15:0] recordsReadGray_ti1;
+reg [15:0] recordsReadGray_ti2;
+
+always @(posedge refclk) begin
+	recordsReadGray<=recordsRead ^ (recordsRead >> 1);
+end
+
+always @(posedge ti_clk) begin
+	recordsReadGray_ti1<=recordsReadGray;
+	recordsReadGray_ti2<=recordsReadGray_ti1;
+end
+
+wire [15:0] fifoLevel;
+assign fifoLevel = recordsWritten - gray_to_binary(recordsReadGray_ti2);
+
+// bit 0: FIFO full
+// bit 1: FIFO empty
+// bit 2: FIFO overflowed (a write was dropped) since trigger 0x41 bit 0
+// bit 3: FIFO underflowed (read while empty) since the start trigger
+// bit 4: end of stream marked (trigger 0x40 bit 2)
+wire [15:0] fifoFlagsOut;
+assign fifoFlagsOut = {11'b0, streamEnded, fifoUnderflowed, fifoOverflowed, empty, full};
+
 
 // Create Opal Kelly Host Interfaces for communication with PC
 
@@ -338,6 +478,9 @@ okPipeIn ep80 (.ok1(ok1), .ok2(ok2),
 okTriggerIn trigIn40 (.ok1(ok1), .ok2(ok2),
 	.ep_clk(refclk), .ep_addr(8'h40), .ep_trigger(ok_trig_ins));
 
+okTriggerIn trigIn41 (.ok1(ok1), .ok2(ok2),
+	.ep_clk(ti_clk), .ep_addr(8'h41), .ep_trigger(ok_crc_trig_ins));
+
 okWireIn wireIn00 (.ok1(ok1), .ok2(ok2),
 	.ep_addr(8'h00), .ep_dataout(ok_wire_ins));
 	
@@ -363,6 +506,14 @@ okWireOut wire25 (.ok1(ok1), .ok2(ok2), .ep_addr(8'h25), .ep_datain(fpgaStatusOu
 okWireOut wire26 (.ok1(ok1), .ok2(ok2), .ep_addr(8'h26), .ep_datain(retriggerWaitSamples[15:0]));
 okWireOut wire27 (.ok1(ok1), .ok2(ok2), .ep_addr(8'h27), .ep_datain(retriggerWaitSamples[31:16]));
 
+// Wire outs for the CRC-32C of the last upload
+okWireOut wire28 (.ok1(ok1), .ok2(ok2), .ep_addr(8'h28), .ep_datain(uploadCrcOut[15:0]));
+okWireOut wire29 (.ok1(ok1), .ok2(ok2), .ep_addr(8'h29), .ep_datain(uploadCrcOut[31:16]));
+
+// Wire outs for streaming segments during generation
+okWireOut wire2A (.ok1(ok1), .ok2(ok2), .ep_addr(8'h2A), .ep_datain(fifoLevel));
+okWireOut wire2B (.ok1(ok1), .ok2(ok2), .ep_addr(8'h2B), .ep_datain(fifoFlagsOut));
+
 // Create the FIFO for storing data from computer
 // write clock comes from Opal Kelly Host Interface
 // as does write data and write enable. 
@@ -0,0 +1,738 @@
+//------------------------------------------------------------------------
+// okBroker.cpp
+//
+// See okBroker.h.
+//
+// One thread per client; device access is serialized by the pool's entry
+// lock.  The per-board wire-out snapshot has its own lock, held across the
+// device UpdateWireOuts, so clients queued behind a refresh pick up its
+// result instead of issuing their own.  Lock order: Board::lock before
+// m_lock or the pool entry lock; m_lock is never held while taking
+// Board::lock.
+//------------------------------------------------------------------------
+
+#if !defined(_WIN32)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <chrono>
+
+#include "okBroker.h"
+#include "okDevicePool.h"
+
+#ifndef MSG_NOSIGNAL
+	#define MSG_NOSIGNAL   0
+#endif
+
+typedef std::chrono::steady_clock okBrokerClock;
+
+
+static bool
+sendAll(int fd, const void *buf, size_t len)
+{
+	const char *p = (const char *)buf;
+	while (len > 0) {
+		ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+		if (n < 0 && EINTR == errno)
+			continue;
+		if (n <= 0)
+			return(false);
+		p += n;
+		len -= n;
+	}
+	return(true);
+}
+
+
+static bool
+recvAll(int fd, void *buf, size_t len)
+{
+	char *p = (char *)buf;
+	while (len > 0) {
+		ssize_t n = recv(fd, p, len, 0);
+		if (n < 0 && EINTR == errno)
+			continue;
+		if (n <= 0)
+			return(false);
+		p += n;
+		len -= n;
+	}
+	return(true);
+}
+
+
+struct okCBroker::Board {
+	std::string serial;
+	int handle;
+	std::mutex lock;
+	bool valid;
+	okBrokerClock::time_point stamp;
+	uint32_t wireOut[okBroker_WIRE_COUNT];
+};
+
+
+struct okCBroker::Client {
+	int id;
+	int fd;
+	std::thread thread;
+	Board *board;
+	unsigned char *shm;
+	size_t shmSize;
+	char shmName[okBroker_MAX_SHM_NAME];
+	bool shmLinked;
+	bool done;
+	okBrokerClock::time_point connected;
+	okBrokerStats stats;
+};
+
+
+okCBroker::okCBroker(okCDevicePool *pool)
+	: m_pool(pool), m_path(okBroker_DEFAULT_SOCKET), m_shmSize(okBroker_DEFAULT_SHM_SIZE),
+	  m_coalesceUs(okBroker_DEFAULT_COALESCE_US), m_listen(-1), m_nextId(1), m_running(false)
+{
+}
+
+
+okCBroker::~okCBroker()
+{
+	Stop();
+	for (size_t i=0; i<m_boards.size(); i++)
+		delete m_boards[i];
+}
+
+
+void
+okCBroker::SetSocketPath(const std::string path)
+	{ m_path = path; }
+
+
+void
+okCBroker::SetSharedMemorySize(size_t bytes)
+	{ m_shmSize = (bytes > 4096) ? (bytes) : (4096); }
+
+
+void
+okCBroker::SetCoalesceWindow(int us)
+	{ m_coalesceUs = (us > 0) ? (us) : (0); }
+
+
+bool
+okCBroker::Start()
+{
+	struct sockaddr_un addr;
+
+	if (m_running)
+		return(true);
+	if (m_path.size() >= sizeof(addr.sun_path))
+		return(false);
+
+	m_listen = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (m_listen < 0)
+		return(false);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, m_path.c_str());
+	unlink(m_path.c_str());
+	if ((0 != bind(m_listen, (struct sockaddr *)&addr, sizeof(addr))) || (0 != listen(m_listen, 16))) {
+		close(m_listen);
+		m_listen = -1;
+		return(false);
+	}
+
+	m_running = true;
+	m_accept = std::thread(&okCBroker::acceptThread, this);
+	return(true);
+}
+
+
+void
+okCBroker::Stop()
+{
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		if (!m_running)
+			return;
+		m_running = false;
+	}
+	m_accept.join();
+	close(m_listen);
+	m_listen = -1;
+	unlink(m_path.c_str());
+
+	// Wake every client thread out of recv().
+	std::vector<Client *> clients;
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		clients.swap(m_clients);
+		for (size_t i=0; i<clients.size(); i++)
+			shutdown(clients[i]->fd, SHUT_RDWR);
+	}
+	for (size_t i=0; i<clients.size(); i++) {
+		clients[i]->thread.join();
+		delete clients[i];
+	}
+}
+
+
+void
+okCBroker::acceptThread()
+{
+	while (true) {
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			if (!m_running)
+				break;
+
+			// Reap clients that have disconnected.
+			for (size_t i=0; i<m_clients.size(); ) {
+				if (m_clients[i]->done) {
+					m_clients[i]->thread.join();
+					delete m_clients[i];
+					m_clients.erase(m_clients.begin() + i);
+				} else {
+					i++;
+				}
+			}
+		}
+
+		struct pollfd pfd;
+		pfd.fd = m_listen;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		if (poll(&pfd, 1, 200) <= 0)
+			continue;
+
+		int fd = accept(m_listen, NULL, NULL);
+		if (fd < 0)
+			continue;
+
+		Client *c = new Client;
+		c->fd = fd;
+		c->board = NULL;
+		c->shm = NULL;
+		c->shmSize = 0;
+		c->shmName[0] = '\0';
+		c->shmLinked = false;
+		c->done = false;
+		c->connected = okBrokerClock::now();
+		memset(&c->stats, 0, sizeof(c->stats));
+
+		std::lock_guard<std::mutex> guard(m_lock);
+		c->id = m_nextId++;
+		m_clients.push_back(c);
+		c->thread = std::thread(&okCBroker::clientThread, this, c);
+	}
+}
+
+
+void
+okCBroker::clientThread(Client *c)
+{
+	okBrokerRequest req;
+	okBrokerResponse rsp;
+
+	while (recvAll(c->fd, &req, sizeof(req))) {
+		okBrokerClock::time_point t0 = okBrokerClock::now();
+		memset(&rsp, 0, sizeof(rsp));
+		serve(c, req, rsp);
+		double us = std::chrono::duration<double, std::micro>(okBrokerClock::now() - t0).count();
+
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			c->stats.requests++;
+			c->stats.serviceUsTotal += us;
+			if (us > c->stats.serviceUsMax)
+				c->stats.serviceUsMax = us;
+		}
+		if (!sendAll(c->fd, &rsp, sizeof(rsp)))
+			break;
+	}
+	closeClient(c);
+}
+
+
+void
+okCBroker::closeClient(Client *c)
+{
+	if (NULL != c->shm)
+		munmap(c->shm, c->shmSize);
+	if (c->shmLinked)
+		shm_unlink(c->shmName);
+	close(c->fd);
+
+	std::lock_guard<std::mutex> guard(m_lock);
+	ClientInfo info;
+	info.id = c->id;
+	info.serial = (NULL != c->board) ? (c->board->serial) : ("");
+	info.stats = c->stats;
+	info.stats.connectedSec = std::chrono::duration<double>(okBrokerClock::now() - c->connected).count();
+	m_departed.push_back(info);
+	c->done = true;
+}
+
+
+void
+okCBroker::GetClientStats(std::vector<ClientInfo>& clients)
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	okBrokerClock::time_point now = okBrokerClock::now();
+
+	clients.swap(m_departed);
+	m_departed.clear();
+	for (size_t i=0; i<m_clients.size(); i++) {
+		Client *c = m_clients[i];
+		if (c->done)
+			continue;
+		ClientInfo info;
+		info.id = c->id;
+		info.serial = (NULL != c->board) ? (c->board->serial) : ("");
+		info.stats = c->stats;
+		info.stats.connectedSec = std::chrono::duration<double>(now - c->connected).count();
+		clients.push_back(info);
+	}
+}
+
+
+okCBroker::Board *
+okCBroker::board(const std::string serial)
+{
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		for (size_t i=0; i<m_boards.size(); i++) {
+			if (m_boards[i]->serial == serial)
+				return(m_boards[i]);
+		}
+	}
+
+	// Boards not given to the broker up front are pooled on first use,
+	// without a bitfile.  Add() opens the board, so it runs without m_lock;
+	// if two clients race here the loser's Add() fails and Find() has it.
+	int handle = m_pool->Find(serial);
+	if (handle < 0)
+		handle = m_pool->Add(serial);
+	if (handle < 0)
+		handle = m_pool->Find(serial);
+	if (handle < 0)
+		return(NULL);
+
+	std::lock_guard<std::mutex> guard(m_lock);
+	for (size_t i=0; i<m_boards.size(); i++) {
+		if (m_boards[i]->serial == serial)
+			return(m_boards[i]);
+	}
+	Board *b = new Board;
+	b->serial = serial;
+	b->handle = handle;
+	b->valid = false;
+	memset(b->wireOut, 0, sizeof(b->wireOut));
+	m_boards.push_back(b);
+	return(b);
+}
+
+
+void
+okCBroker::hello(Client *c, const okBrokerRequest& req, okBrokerResponse& rsp)
+{
+	rsp.result = okCFrontPanel::Failed;
+	if ((okBroker_PROTOCOL_VERSION != req.version) || (NULL != c->board))
+		return;
+
+	char serial[okBroker_MAX_SERIAL+1];
+	memcpy(serial, req.serial, okBroker_MAX_SERIAL);
+	serial[okBroker_MAX_SERIAL] = '\0';
+	Board *b = board(serial);
+	if (NULL == b) {
+		rsp.result = okCFrontPanel::DeviceNotOpen;
+		return;
+	}
+
+	snprintf(c->shmName, sizeof(c->shmName), "/okbroker-%d-%d", (int)getpid(), c->id);
+	int fd = shm_open(c->shmName, O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (fd < 0)
+		return;
+	c->shmLinked = true;
+	if (0 == ftruncate(fd, m_shmSize)) {
+		void *p = mmap(NULL, m_shmSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (MAP_FAILED != p) {
+			c->shm = (unsigned char *)p;
+			c->shmSize = m_shmSize;
+		}
+	}
+	close(fd);
+	if (NULL == c->shm) {
+		// Free the name, or a retried Hello can never create it again.
+		shm_unlink(c->shmName);
+		c->shmLinked = false;
+		return;
+	}
+
+	c->board = b;
+	memcpy(rsp.shmName, c->shmName, sizeof(rsp.shmName));
+	rsp.shmSize = c->shmSize;
+	rsp.result = okCFrontPanel::NoError;
+}
+
+
+void
+okCBroker::serve(Client *c, const okBrokerRequest& req, okBrokerResponse& rsp)
+{
+	if (okBrokerOp_Hello == req.op) {
+		hello(c, req, rsp);
+		return;
+	}
+
+	Board *b = c->board;
+	if (NULL == b) {
+		rsp.result = okCFrontPanel::DeviceNotOpen;
+		return;
+	}
+
+	switch (req.op) {
+		case okBrokerOp_Attached: {
+			// Both ends have it mapped; the name is no longer needed.
+			if (c->shmLinked)
+				shm_unlink(c->shmName);
+			c->shmLinked = false;
+			rsp.result = okCFrontPanel::NoError;
+			break;
+		}
+
+		case okBrokerOp_UpdateWireIns: {
+			okCFrontPanel *dev = m_pool->Lock(b->handle);
+			if (NULL == dev) {
+				rsp.result = okCFrontPanel::DeviceNotOpen;
+				break;
+			}
+			for (int i=0; i<okBroker_WIRE_COUNT; i++) {
+				if (req.wireInMask & (1u << i))
+					dev->SetWireInValue(i, req.wireIn[i], req.wireInBits[i]);
+			}
+			dev->UpdateWireIns();
+			okCFrontPanel::ErrorCode err = (dev->IsOpen()) ? (okCFrontPanel::NoError) : (okCFrontPanel::DeviceNotOpen);
+			m_pool->Unlock(b->handle, err);
+			rsp.result = err;
+			break;
+		}
+
+		case okBrokerOp_UpdateWireOuts: {
+			std::lock_guard<std::mutex> guard(b->lock);
+			okBrokerClock::time_point now = okBrokerClock::now();
+			if (b->valid && (std::chrono::duration_cast<std::chrono::microseconds>(now - b->stamp).count() < m_coalesceUs)) {
+				std::lock_guard<std::mutex> sguard(m_lock);
+				c->stats.wireOutCoalesced++;
+			} else {
+				okCFrontPanel::ErrorCode err = m_pool->UpdateWireOuts(b->handle);
+				if (okCFrontPanel::NoError != err) {
+					b->valid = false;
+					rsp.result = err;
+					break;
+				}
+				for (int i=0; (okCFrontPanel::NoError == err) && (i<okBroker_WIRE_COUNT); i++)
+					b->wireOut[i] = (uint32_t)m_pool->GetWireOutValue(b->handle, okBroker_WIREOUT_BASE + i, &err);
+				if (okCFrontPanel::NoError != err) {
+					b->valid = false;
+					rsp.result = err;
+					break;
+				}
+				b->stamp = okBrokerClock::now();
+				b->valid = true;
+			}
+			memcpy(rsp.wireOut, b->wireOut, sizeof(rsp.wireOut));
+			rsp.result = okCFrontPanel::NoError;
+			break;
+		}
+
+		case okBrokerOp_ActivateTriggerIn:
+			rsp.result = m_pool->ActivateTriggerIn(b->handle, req.ep, req.bit);
+			break;
+
+		case okBrokerOp_WriteToPipeIn:
+		case okBrokerOp_ReadFromPipeOut: {
+			if ((req.length < 0) || ((uint64_t)req.length > c->shmSize)) {
+				rsp.result = okCFrontPanel::InvalidBlockSize;
+				break;
+			}
+			long n;
+			if (okBrokerOp_WriteToPipeIn == req.op)
+				n = m_pool->WriteToPipeIn(b->handle, req.ep, (long)req.length, c->shm);
+			else
+				n = m_pool->ReadFromPipeOut(b->handle, req.ep, (long)req.length, c->shm);
+			rsp.length = n;
+			rsp.result = (n < 0) ? ((int32_t)n) : (okCFrontPanel::NoError);
+			if (n > 0) {
+				std::lock_guard<std::mutex> guard(m_lock);
+				if (okBrokerOp_WriteToPipeIn == req.op)
+					c->stats.bytesIn += n;
+				else
+					c->stats.bytesOut += n;
+			}
+			break;
+		}
+
+		case okBrokerOp_GetStats: {
+			std::lock_guard<std::mutex> guard(m_lock);
+			rsp.stats = c->stats;
+			rsp.stats.connectedSec = std::chrono::duration<double>(okBrokerClock::now() - c->connected).count();
+			rsp.result = okCFrontPanel::NoError;
+			break;
+		}
+
+		default:
+			rsp.result = okCFrontPanel::Failed;
+			break;
+	}
+}
+
+
+//------------------------------------------------------------------------
+// okCBrokerClient
+//------------------------------------------------------------------------
+okCBrokerClient::okCBrokerClient()
+	: m_fd(-1), m_shm(NULL), m_shmSize(0), m_rttSum(0.0), m_rttMax(0.0), m_rttN(0)
+{
+	memset(&m_pending, 0, sizeof(m_pending));
+	memset(m_wireOut, 0, sizeof(m_wireOut));
+}
+
+
+okCBrokerClient::~okCBrokerClient()
+{
+	Close();
+}
+
+
+void
+okCBrokerClient::Close()
+{
+	if (NULL != m_shm)
+		munmap(m_shm, m_shmSize);
+	m_shm = NULL;
+	m_shmSize = 0;
+	if (m_fd >= 0)
+		close(m_fd);
+	m_fd = -1;
+}
+
+
+okCFrontPanel::ErrorCode
+okCBrokerClient::call(okBrokerRequest& req, okBrokerResponse& rsp)
+{
+	if (m_fd < 0)
+		return(okCFrontPanel::DeviceNotOpen);
+
+	req.version = okBroker_PROTOCOL_VERSION;
+	okBrokerClock::time_point t0 = okBrokerClock::now();
+	if (!sendAll(m_fd, &req, sizeof(req)) || !recvAll(m_fd, &rsp, sizeof(rsp))) {
+		Close();
+		return(okCFrontPanel::DeviceNotOpen);
+	}
+	double us = std::chrono::duration<double, std::micro>(okBrokerClock::now() - t0).count();
+	m_rttSum += us;
+	m_rttN++;
+	if (us > m_rttMax)
+		m_rttMax = us;
+	return((okCFrontPanel::ErrorCode)rsp.result);
+}
+
+
+okCFrontPanel::ErrorCode
+okCBrokerClient::Connect(const std::string serial, const std::string path)
+{
+	okBrokerRequest req;
+	okBrokerResponse rsp;
+	struct sockaddr_un addr;
+
+	Close();
+	if ((path.size() >= sizeof(addr.sun_path)) || (serial.size() > okBroker_MAX_SERIAL))
+		return(okCFrontPanel::Failed);
+
+	m_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (m_fd < 0)
+		return(okCFrontPanel::Failed);
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path.c_str());
+	if (0 != connect(m_fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		Close();
+		return(okCFrontPanel::DeviceNotOpen);
+	}
+
+	memset(&req, 0, sizeof(req));
+	req.op = okBrokerOp_Hello;
+	memcpy(req.serial, serial.c_str(), serial.size());
+	okCFrontPanel::ErrorCode err = call(req, rsp);
+	if (okCFrontPanel::NoError != err) {
+		Close();
+		return(err);
+	}
+
+	char name[okBroker_MAX_SHM_NAME+1];
+	memcpy(name, rsp.shmName, okBroker_MAX_SHM_NAME);
+	name[okBroker_MAX_SHM_NAME] = '\0';
+	int fd = shm_open(name, O_RDWR, 0);
+	if (fd >= 0) {
+		void *p = mmap(NULL, (size_t)rsp.shmSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if (MAP_FAILED != p) {
+			m_shm = (unsigned char *)p;
+			m_shmSize = (size_t)rsp.shmSize;
+		}
+	}
+	if (NULL == m_shm) {
+		Close();
+		return(okCFrontPanel::Failed);
+	}
+
+	memset(&req, 0, sizeof(req));
+	req.op = okBrokerOp_Attached;
+	err = call(req, rsp);
+	if (okCFrontPanel::NoError != err)
+		Close();
+	return(err);
+}
+
+
+okCFrontPanel::ErrorCode
+okCBrokerClient::SetWireInValue(int ep, unsigned long val, unsigned long mask)
+{
+	if ((ep < 0) || (ep >= okBroker_WIRE_COUNT))
+		return(okCFrontPanel::InvalidEndpoint);
+	m_pending.wireIn[ep] = (m_pending.wireIn[ep] & ~(uint32_t)mask) | ((uint32_t)val & (uint32_t)mask);
+	m_pending.wireInBits[ep] |= (uint32_t)mask;
+	m_pending.wireInMask |= (1u << ep);
+	return(okCFrontPanel::NoError);
+}
+
+
+okCFrontPanel::ErrorCode
+okCBrokerClient::UpdateWireIns()
+{
+	okBrokerResponse rsp;
+
+	m_pending.op = okBrokerOp_UpdateWireIns;
+	okCFrontPanel::ErrorCode err = call(m_pending, rsp);
+	if (okCFrontPanel::NoError == err) {
+		m_pending.wireInMask = 0;
+		memset(m_pending.wireInBits, 0, sizeof(m_pending.wireInBits));
+	}
+	return(err);
+}
+
+
+okCFrontPanel::ErrorCode
+okCBrokerClient::UpdateWireOuts()
+{
+	okBrokerRequest req;
+	okBrokerResponse rsp;
+
+	memset(&req, 0, sizeof(req));
+	req.op = okBrokerOp_UpdateWireOuts;
+	okCFrontPanel::ErrorCode err = call(req, rsp);
+	if (okCFrontPanel::NoError == err)
+		memcpy(m_wireOut, rsp.wireOut, sizeof(m_wireOut));
+	return(err);
+}
+
+
+unsigned long
+okCBrokerClient::GetWireOutValue(int epAddr)
+{
+	int i = epAddr - okBroker_WIREOUT_BASE;
+	if ((i < 0) || (i >= okBroker_WIRE_COUNT))
+		return(0);
+	return(m_wireOut[i]);
+}
+
+
+okCFrontPanel::ErrorCode
+okCBrokerClient::ActivateTriggerIn(int epAddr, int bit)
+{
+	okBrokerRequest req;
+	okBrokerResponse rsp;
+
+	memset(&req, 0, sizeof(req));
+	req.op = okBrokerOp_ActivateTriggerIn;
+	req.ep = epAddr;
+	req.bit = bit;
+	return(call(req, rsp));
+}
+
+
+long
+okCBrokerClient::WriteToPipeIn(int epAddr, long length, unsigned char *data)
+{
+	okBrokerRequest req;
+	okBrokerResponse rsp;
+	long done = 0;
+
+	memset(&req, 0, sizeof(req));
+	req.op = okBrokerOp_WriteToPipeIn;
+	req.ep = epAddr;
+	while (done < length) {
+		long chunk = length - done;
+		if ((size_t)chunk > m_shmSize)
+			chunk = (long)m_shmSize;
+		memcpy(m_shm, data + done, chunk);
+		req.length = chunk;
+		okCFrontPanel::ErrorCode err = call(req, rsp);
+		if (okCFrontPanel::NoError != err)
+			return((done > 0) ? (done) : ((long)err));
+		done += (long)rsp.length;
+		if (rsp.length != chunk)
+			break;
+	}
+	return(done);
+}
+
+
+long
+okCBrokerClient::ReadFromPipeOut(int epAddr, long length, unsigned char *data)
+{
+	okBrokerRequest req;
+	okBrokerResponse rsp;
+	long done = 0;
+
+	memset(&req, 0, sizeof(req));
+	req.op = okBrokerOp_ReadFromPipeOut;
+	req.ep = epAddr;
+	while (done < length) {
+		long chunk = length - done;
+		if ((size_t)chunk > m_shmSize)
+			chunk = (long)m_shmSize;
+		req.length = chunk;
+		okCFrontPanel::ErrorCode err = call(req, rsp);
+		if (okCFrontPanel::NoError != err)
+			return((done > 0) ? (done) : ((long)err));
+		memcpy(data + done, m_shm, (size_t)rsp.length);
+		done += (long)rsp.length;
+		if (rsp.length != chunk)
+			break;
+	}
+	return(done);
+}
+
+
+okCFrontPanel::ErrorCode
+okCBrokerClient::GetStats(okBrokerStats *stats)
+{
+	okBrokerRequest req;
+	okBrokerResponse rsp;
+
+	memset(&req, 0, sizeof(req));
+	req.op = okBrokerOp_GetStats;
+	okCFrontPanel::ErrorCode err = call(req, rsp);
+	if ((okCFrontPanel::NoError == err) && (NULL != stats))
+		*stats = rsp.stats;
+	return(err);
+}
+
+#endif // !_WIN32
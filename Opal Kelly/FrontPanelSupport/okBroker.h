@@ -0,0 +1,197 @@
+//------------------------------------------------------------------------
+// okBroker.h
+//
+// Local device broker.  One process (okBrokerd) owns the boards through an
+// okCDevicePool and serves any number of local clients, so Atticus,
+// monitoring tools and calibration scripts can share a board without each
+// of them paying for OpenBySerial / ConfigureFPGA.
+//
+//  - Control goes over a Unix stream socket as fixed-size request /
+//    response records (okBrokerRequest / okBrokerResponse).
+//  - Bulk pipe data goes through a per-client shared memory window that the
+//    broker creates at Hello time; only lengths travel over the socket.
+//  - Wire-ins are buffered in the client and committed together with
+//    UpdateWireIns, so clients cannot commit each other's pending values.
+//  - UpdateWireOuts returns the whole wire-out block in the response.
+//    Requests from different clients that arrive within the coalescing
+//    window share one device UpdateWireOuts.
+//  - The broker keeps per-client request counts, bytes moved and service
+//    latency; clients also track their own round-trip latency.
+//
+// POSIX only (Unix sockets, shm_open); the declarations are empty on
+// Windows.
+//------------------------------------------------------------------------
+
+#ifndef __okBroker_h__
+#define __okBroker_h__
+
+#if !defined(_WIN32)
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+
+#include "okFrontPanelDLL.h"
+
+class okCDevicePool;
+
+#define okBroker_DEFAULT_SOCKET        "/tmp/okbroker.sock"
+#define okBroker_DEFAULT_SHM_SIZE      (4*1024*1024)
+#define okBroker_DEFAULT_COALESCE_US   1000
+#define okBroker_PROTOCOL_VERSION      1
+#define okBroker_WIRE_COUNT            32      // wire-ins 0x00-0x1f, wire-outs 0x20-0x3f
+#define okBroker_WIREOUT_BASE          0x20
+#define okBroker_MAX_SERIAL            16
+#define okBroker_MAX_SHM_NAME          64
+
+enum okBrokerOp {
+	okBrokerOp_Hello            = 1,
+	okBrokerOp_Attached         = 2,
+	okBrokerOp_UpdateWireIns    = 3,
+	okBrokerOp_UpdateWireOuts   = 4,
+	okBrokerOp_ActivateTriggerIn= 5,
+	okBrokerOp_WriteToPipeIn    = 6,
+	okBrokerOp_ReadFromPipeOut  = 7,
+	okBrokerOp_GetStats         = 8
+};
+
+typedef struct {
+	uint64_t requests;
+	uint64_t bytesIn;            // pipe bytes client -> board
+	uint64_t bytesOut;           // pipe bytes board -> client
+	uint64_t wireOutCoalesced;   // UpdateWireOuts served without a device call
+	double   serviceUsTotal;     // broker-side time per request
+	double   serviceUsMax;
+	double   connectedSec;
+} okBrokerStats;
+
+typedef struct {
+	uint32_t op;
+	uint32_t version;
+	int32_t  ep;
+	int32_t  bit;
+	int64_t  length;
+	uint32_t wireInMask;         // bit n set: wireIn[n] / wireInBits[n] valid
+	uint32_t wireIn[okBroker_WIRE_COUNT];
+	uint32_t wireInBits[okBroker_WIRE_COUNT];
+	char     serial[okBroker_MAX_SERIAL];
+} okBrokerRequest;
+
+typedef struct {
+	int32_t  result;             // okCFrontPanel::ErrorCode
+	int32_t  reserved;
+	int64_t  length;
+	uint32_t wireOut[okBroker_WIRE_COUNT];
+	char     shmName[okBroker_MAX_SHM_NAME];
+	uint64_t shmSize;
+	okBrokerStats stats;
+} okBrokerResponse;
+
+
+//------------------------------------------------------------------------
+// okCBroker -- server side
+//------------------------------------------------------------------------
+class okCBroker
+{
+public:
+	struct ClientInfo {
+		int id;
+		std::string serial;
+		okBrokerStats stats;
+	};
+
+	okCBroker(okCDevicePool *pool);
+	~okCBroker();
+
+	void SetSocketPath(const std::string path);
+	void SetSharedMemorySize(size_t bytes);
+	// UpdateWireOuts requests closer together than this reuse the last
+	// device read.  0 disables coalescing.
+	void SetCoalesceWindow(int us);
+
+	bool Start();
+	void Stop();
+
+	// Connected clients plus the ones that left since the last call.
+	void GetClientStats(std::vector<ClientInfo>& clients);
+
+private:
+	struct Client;
+	struct Board;
+
+	void acceptThread();
+	void clientThread(Client *c);
+	Board *board(const std::string serial);
+	void serve(Client *c, const okBrokerRequest& req, okBrokerResponse& rsp);
+	void hello(Client *c, const okBrokerRequest& req, okBrokerResponse& rsp);
+	void closeClient(Client *c);
+
+	okCDevicePool *m_pool;
+	std::string m_path;
+	size_t m_shmSize;
+	int m_coalesceUs;
+	int m_listen;
+	int m_nextId;
+	bool m_running;
+	std::thread m_accept;
+	std::mutex m_lock;
+	std::vector<Client *> m_clients;
+	std::vector<ClientInfo> m_departed;
+	std::vector<Board *> m_boards;
+
+	okCBroker(const okCBroker&);
+	okCBroker& operator=(const okCBroker&);
+};
+
+
+//------------------------------------------------------------------------
+// okCBrokerClient -- okCFrontPanel-like access through the broker
+//------------------------------------------------------------------------
+class okCBrokerClient
+{
+public:
+	okCBrokerClient();
+	~okCBrokerClient();
+
+	okCFrontPanel::ErrorCode Connect(const std::string serial, const std::string path = okBroker_DEFAULT_SOCKET);
+	void Close();
+	bool IsOpen() const
+		{ return(m_fd >= 0); }
+
+	okCFrontPanel::ErrorCode SetWireInValue(int ep, unsigned long val, unsigned long mask = 0xffffffff);
+	okCFrontPanel::ErrorCode UpdateWireIns();
+	okCFrontPanel::ErrorCode UpdateWireOuts();
+	unsigned long GetWireOutValue(int epAddr);
+	okCFrontPanel::ErrorCode ActivateTriggerIn(int epAddr, int bit);
+	long WriteToPipeIn(int epAddr, long length, unsigned char *data);
+	long ReadFromPipeOut(int epAddr, long length, unsigned char *data);
+
+	// Broker-side statistics for this connection.
+	okCFrontPanel::ErrorCode GetStats(okBrokerStats *stats);
+	// Client-side round-trip latency.
+	double GetRoundTripUsMax() const
+		{ return(m_rttMax); }
+	double GetRoundTripUsMean() const
+		{ return((m_rttN > 0) ? (m_rttSum / m_rttN) : (0.0)); }
+
+private:
+	okCFrontPanel::ErrorCode call(okBrokerRequest& req, okBrokerResponse& rsp);
+
+	int m_fd;
+	unsigned char *m_shm;
+	size_t m_shmSize;
+	okBrokerRequest m_pending;          // wire-ins buffered until UpdateWireIns
+	uint32_t m_wireOut[okBroker_WIRE_COUNT];
+	double m_rttSum;
+	double m_rttMax;
+	long m_rttN;
+
+	okCBrokerClient(const okCBrokerClient&);
+	okCBrokerClient& operator=(const okCBrokerClient&);
+};
+
+#endif // !_WIN32
+
+#endif // __okBroker_h__
@@ -0,0 +1,122 @@
+//------------------------------------------------------------------------
+// okBrokerd.cpp
+//
+// Broker process: pools the boards named on the command line and serves
+// them to local clients through okCBroker until SIGINT / SIGTERM.  Build
+// this file as its own executable; it is not part of the support library.
+//
+//    okBrokerd [-s socket] [-m shmMB] [-c coalesceUs] [-i statsSec] serial[:bitfile] ...
+//
+// Per-client statistics are printed every statsSec seconds (0: only when
+// a client disconnects).
+//------------------------------------------------------------------------
+
+#if !defined(_WIN32)
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <thread>
+
+#include "okBroker.h"
+#include "okDevicePool.h"
+
+static volatile sig_atomic_t g_quit = 0;
+
+
+static void
+onSignal(int sig)
+{
+	g_quit = 1;
+}
+
+
+static void
+printStats(okCBroker& broker)
+{
+	std::vector<okCBroker::ClientInfo> clients;
+	broker.GetClientStats(clients);
+	for (size_t i=0; i<clients.size(); i++) {
+		const okBrokerStats& s = clients[i].stats;
+		double sec = (s.connectedSec > 0.0) ? (s.connectedSec) : (1.0);
+		printf("client %d [%s]: %llu req, in %.1f kB/s, out %.1f kB/s, latency mean %.1f us max %.1f us, %llu wire-out polls coalesced\n",
+			clients[i].id, clients[i].serial.c_str(), (unsigned long long)s.requests,
+			s.bytesIn / sec / 1024.0, s.bytesOut / sec / 1024.0,
+			(s.requests > 0) ? (s.serviceUsTotal / s.requests) : (0.0), s.serviceUsMax,
+			(unsigned long long)s.wireOutCoalesced);
+	}
+	fflush(stdout);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	const char *path = okBroker_DEFAULT_SOCKET;
+	long shmMB = okBroker_DEFAULT_SHM_SIZE / (1024*1024);
+	int coalesceUs = okBroker_DEFAULT_COALESCE_US;
+	int statsSec = 0;
+	int opt;
+
+	while (-1 != (opt = getopt(argc, argv, "s:m:c:i:"))) {
+		switch (opt) {
+			case 's': path = optarg;               break;
+			case 'm': shmMB = atol(optarg);        break;
+			case 'c': coalesceUs = atoi(optarg);   break;
+			case 'i': statsSec = atoi(optarg);     break;
+			default:
+				fprintf(stderr, "usage: %s [-s socket] [-m shmMB] [-c coalesceUs] [-i statsSec] serial[:bitfile] ...\n", argv[0]);
+				return(1);
+		}
+	}
+
+	if (FALSE == okFrontPanelDLL_LoadLib(NULL)) {
+		fprintf(stderr, "Could not load FrontPanel DLL\n");
+		return(1);
+	}
+
+	okCDevicePool pool;
+	for (int i=optind; i<argc; i++) {
+		std::string arg(argv[i]);
+		size_t colon = arg.find(':');
+		std::string serial = arg.substr(0, colon);
+		std::string bitfile = (std::string::npos == colon) ? ("") : (arg.substr(colon + 1));
+		pool.Add(serial, bitfile);
+		printf("%s: %s\n", serial.c_str(), (pool.IsConnected(pool.Find(serial))) ? ("connected") : ("waiting for board"));
+	}
+	pool.Start();
+
+	okCBroker broker(&pool);
+	broker.SetSocketPath(path);
+	broker.SetSharedMemorySize((size_t)shmMB * 1024 * 1024);
+	broker.SetCoalesceWindow(coalesceUs);
+	if (!broker.Start()) {
+		fprintf(stderr, "Could not listen on %s\n", path);
+		return(1);
+	}
+	printf("Listening on %s\n", path);
+
+	signal(SIGINT, onSignal);
+	signal(SIGTERM, onSignal);
+	signal(SIGPIPE, SIG_IGN);
+
+	std::chrono::steady_clock::time_point last = std::chrono::steady_clock::now();
+	while (!g_quit) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if ((statsSec > 0) && (now - last >= std::chrono::seconds(statsSec))) {
+			printStats(broker);
+			last = now;
+		}
+	}
+
+	broker.Stop();
+	printStats(broker);
+	pool.Stop();
+	return(0);
+}
+
+#endif // !_WIN32
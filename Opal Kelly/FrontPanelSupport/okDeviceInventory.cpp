@@ -0,0 +1,222 @@
+//------------------------------------------------------------------------
+// okDeviceInventory.cpp
+//
+// See okDeviceInventory.h.
+//
+// Everything goes through the C entry points with stack / member buffers
+// rather than the okCFrontPanel string accessors, so a snapshot does not
+// touch the heap.
+//------------------------------------------------------------------------
+
+#include <string.h>
+
+#include "okDeviceInventory.h"
+#include "okDevicePool.h"
+
+
+okCDeviceInventory::okCDeviceInventory()
+	: m_scratch(NULL), m_pool(NULL), m_ttlMs(1000), m_valid(false), m_reopen(true), m_count(0), m_previousCount(0)
+{
+	memset(m_records, 0, sizeof(m_records));
+	memset(m_previous, 0, sizeof(m_previous));
+}
+
+
+okCDeviceInventory::~okCDeviceInventory()
+{
+	if (NULL != m_scratch)
+		okFrontPanel_Destruct(m_scratch);
+}
+
+
+void
+okCDeviceInventory::SetTTL(int ms)
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	m_ttlMs = (ms > 0) ? (ms) : (0);
+}
+
+
+void
+okCDeviceInventory::SetDevicePool(okCDevicePool *pool)
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	m_pool = pool;
+	m_valid = false;
+	m_reopen = true;
+}
+
+
+void
+okCDeviceInventory::Invalidate()
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	m_valid = false;
+	m_reopen = true;
+}
+
+
+void
+okCDeviceInventory::DevicePoolStateChanged(int /*handle*/, bool /*connected*/, void *arg)
+{
+	((okCDeviceInventory *)arg)->Invalidate();
+}
+
+
+int
+okCDeviceInventory::Snapshot(okDeviceInventoryRecord *records, int maxRecords)
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (!m_valid || (std::chrono::duration_cast<std::chrono::milliseconds>(now - m_stamp).count() >= m_ttlMs)) {
+		enumerate();
+		m_stamp = now;
+		m_valid = true;
+	}
+
+	int n = (m_count < maxRecords) ? (m_count) : (maxRecords);
+	if ((NULL != records) && (n > 0))
+		memcpy(records, m_records, n * sizeof(okDeviceInventoryRecord));
+	return(m_count);
+}
+
+
+// Caller holds m_lock.
+void
+okCDeviceInventory::enumerate()
+{
+	// The previous records stand in for pooled boards that are busy, and for
+	// unpooled boards unless a hot-plug asked for them to be re-read.
+	memcpy(m_previous, m_records, sizeof(m_records));
+	m_previousCount = m_count;
+	m_count = 0;
+	memset(m_records, 0, sizeof(m_records));
+	bool reopen = m_reopen;
+	m_reopen = false;
+
+	if (NULL == m_scratch)
+		m_scratch = okFrontPanel_Construct();
+	if (NULL == m_scratch)
+		return;
+
+	int count = okFrontPanel_GetDeviceCount(m_scratch);
+	if (count > okDeviceInventory_MAX_DEVICES)
+		count = okDeviceInventory_MAX_DEVICES;
+
+	for (int i=0; i<count; i++) {
+		okDeviceInventoryRecord &rec = m_records[i];
+
+		okFrontPanel_GetDeviceListSerial(m_scratch, i, rec.serial);
+		rec.serial[MAX_SERIALNUMBER_LENGTH] = '\0';
+		rec.boardModel = (int)okFrontPanel_GetDeviceListModel(m_scratch, i);
+		okFrontPanel_GetBoardModelString(m_scratch, (ok_BoardModel)rec.boardModel, rec.boardModelString);
+		rec.boardModelString[MAX_BOARDMODELSTRING_LENGTH-1] = '\0';
+
+		// Only boards the pool does not own are ever opened here, and only
+		// the ones not seen last time.
+		int handle = (NULL != m_pool) ? (m_pool->Find(rec.serial)) : (-1);
+		if (handle >= 0)
+			fillFromPool(handle, rec);
+		else if (reopen || !fillFromPrevious(rec))
+			fillFromScratch(rec);
+	}
+	m_count = count;
+}
+
+
+void
+okCDeviceInventory::fillFromPool(int handle, okDeviceInventoryRecord &rec)
+{
+	rec.flags |= okDeviceInventory_POOLED;
+
+	// Never wait for a transfer in progress, and don't fight the pool for a
+	// board it is reconnecting; report what was seen last time instead.
+	okCFrontPanel *dev = m_pool->TryLock(handle);
+	if (NULL == dev) {
+		fillFromPrevious(rec);
+		return;
+	}
+
+	okFrontPanel_GetDeviceID(dev->h, rec.deviceID);
+	rec.deviceID[MAX_DEVICEID_LENGTH] = '\0';
+	rec.majorVersion = okFrontPanel_GetDeviceMajorVersion(dev->h);
+	rec.minorVersion = okFrontPanel_GetDeviceMinorVersion(dev->h);
+	rec.flags |= okDeviceInventory_DETAILS_VALID;
+	m_pool->Unlock(handle);
+}
+
+
+// Copies the details of the same board from the previous snapshot; false
+// if it was not in it.  Caller holds m_lock.
+bool
+okCDeviceInventory::fillFromPrevious(okDeviceInventoryRecord &rec)
+{
+	for (int i=0; i<m_previousCount; i++) {
+		const okDeviceInventoryRecord &prev = m_previous[i];
+		if (0 == strcmp(prev.serial, rec.serial)) {
+			memcpy(rec.deviceID, prev.deviceID, sizeof(rec.deviceID));
+			rec.majorVersion = prev.majorVersion;
+			rec.minorVersion = prev.minorVersion;
+			rec.flags |= (prev.flags & okDeviceInventory_DETAILS_VALID);
+			return(true);
+		}
+	}
+	return(false);
+}
+
+
+void
+okCDeviceInventory::fillFromScratch(okDeviceInventoryRecord &rec)
+{
+	okFrontPanel_HANDLE h = okFrontPanel_Construct();
+	if (NULL == h)
+		return;
+
+	if (ok_NoError == okFrontPanel_OpenBySerial(h, rec.serial)) {
+		okFrontPanel_GetDeviceID(h, rec.deviceID);
+		rec.deviceID[MAX_DEVICEID_LENGTH] = '\0';
+		rec.majorVersion = okFrontPanel_GetDeviceMajorVersion(h);
+		rec.minorVersion = okFrontPanel_GetDeviceMinorVersion(h);
+		rec.flags |= okDeviceInventory_DETAILS_VALID;
+	}
+	okFrontPanel_Destruct(h);
+}
+
+
+//------------------------------------------------------------------------
+// C entry points
+//------------------------------------------------------------------------
+okDLLEXPORT okDeviceInventory_HANDLE DLL_ENTRY
+okDeviceInventory_Construct()
+{
+	return((okDeviceInventory_HANDLE) new okCDeviceInventory);
+}
+
+
+okDLLEXPORT void DLL_ENTRY
+okDeviceInventory_Destruct(okDeviceInventory_HANDLE inv)
+{
+	delete (okCDeviceInventory *)inv;
+}
+
+
+okDLLEXPORT void DLL_ENTRY
+okDeviceInventory_SetTTL(okDeviceInventory_HANDLE inv, int ms)
+{
+	((okCDeviceInventory *)inv)->SetTTL(ms);
+}
+
+
+okDLLEXPORT void DLL_ENTRY
+okDeviceInventory_Invalidate(okDeviceInventory_HANDLE inv)
+{
+	((okCDeviceInventory *)inv)->Invalidate();
+}
+
+
+okDLLEXPORT int DLL_ENTRY
+okDeviceInventory_Snapshot(okDeviceInventory_HANDLE inv, okDeviceInventoryRecord *records, int maxRecords)
+{
+	return(((okCDeviceInventory *)inv)->Snapshot(records, maxRecords));
+}
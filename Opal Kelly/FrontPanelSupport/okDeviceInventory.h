@@ -0,0 +1,111 @@
+//------------------------------------------------------------------------
+// okDeviceInventory.h
+//
+// One-call inventory of the attached FrontPanel boards.  Snapshot() fills a
+// caller-provided array of fixed-size records with serial, model, device ID
+// and firmware version of every board, without any heap allocation.  The
+// result is cached for a configurable TTL, so status pages can poll it
+// without USB traffic; the cache is dropped on Invalidate(), which can be
+// wired to okCDevicePool's state callback to react to hot-plug.
+//
+// Device ID and firmware version need an open device.  Boards held by an
+// attached okCDevicePool are queried through the pool, without waiting: a
+// board that is busy or reconnecting keeps the details from the previous
+// snapshot.  Other boards are briefly opened on a temporary handle, but only
+// when their serial is new since the last snapshot or after Invalidate();
+// an expired TTL alone re-reads the device list and nothing else.  Boards
+// that are open elsewhere (in another process, say) only report serial and
+// model.
+//------------------------------------------------------------------------
+
+#ifndef __okDeviceInventory_h__
+#define __okDeviceInventory_h__
+
+#include <mutex>
+#include <chrono>
+
+#include "okFrontPanelDLL.h"
+
+class okCDevicePool;
+
+#define okDeviceInventory_MAX_DEVICES     32
+
+// Record flags
+#define okDeviceInventory_DETAILS_VALID   0x01     // deviceID / versions filled in
+#define okDeviceInventory_POOLED          0x02     // held by the attached okCDevicePool
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void* okDeviceInventory_HANDLE;
+
+// Plain C layout, so managed code can marshal an array of these directly.
+typedef struct {
+	char serial[MAX_SERIALNUMBER_LENGTH+1];
+	char deviceID[MAX_DEVICEID_LENGTH+1];
+	char boardModelString[MAX_BOARDMODELSTRING_LENGTH];
+	int  boardModel;
+	int  majorVersion;
+	int  minorVersion;
+	int  flags;
+} okDeviceInventoryRecord;
+
+okDLLEXPORT okDeviceInventory_HANDLE DLL_ENTRY okDeviceInventory_Construct();
+okDLLEXPORT void DLL_ENTRY okDeviceInventory_Destruct(okDeviceInventory_HANDLE inv);
+okDLLEXPORT void DLL_ENTRY okDeviceInventory_SetTTL(okDeviceInventory_HANDLE inv, int ms);
+okDLLEXPORT void DLL_ENTRY okDeviceInventory_Invalidate(okDeviceInventory_HANDLE inv);
+okDLLEXPORT int DLL_ENTRY okDeviceInventory_Snapshot(okDeviceInventory_HANDLE inv, okDeviceInventoryRecord *records, int maxRecords);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+//------------------------------------------------------------------------
+// okCDeviceInventory
+//------------------------------------------------------------------------
+class okCDeviceInventory
+{
+public:
+	okCDeviceInventory();
+	~okCDeviceInventory();
+
+	// Cached results are reused for ms milliseconds; 0 re-enumerates on
+	// every call.
+	void SetTTL(int ms);
+	void SetDevicePool(okCDevicePool *pool);
+	// Drops the cache and re-reads every board's details on the next
+	// Snapshot(); call on hot-plug.
+	void Invalidate();
+
+	// Copies up to maxRecords records and returns the number of attached
+	// boards, which may be larger than maxRecords.
+	int Snapshot(okDeviceInventoryRecord *records, int maxRecords);
+
+	// okDevicePoolStateCallback adaptor; arg is the okCDeviceInventory.
+	static void DevicePoolStateChanged(int handle, bool connected, void *arg);
+
+private:
+	void enumerate();
+	void fillFromPool(int handle, okDeviceInventoryRecord &rec);
+	void fillFromScratch(okDeviceInventoryRecord &rec);
+	bool fillFromPrevious(okDeviceInventoryRecord &rec);
+
+	std::mutex m_lock;
+	okFrontPanel_HANDLE m_scratch;
+	okCDevicePool *m_pool;
+	int m_ttlMs;
+	bool m_valid;
+	bool m_reopen;                   // re-read the details of unpooled boards
+	std::chrono::steady_clock::time_point m_stamp;
+	int m_count;
+	okDeviceInventoryRecord m_records[okDeviceInventory_MAX_DEVICES];
+	int m_previousCount;
+	okDeviceInventoryRecord m_previous[okDeviceInventory_MAX_DEVICES];
+
+	okCDeviceInventory(const okCDeviceInventory&);
+	okCDeviceInventory& operator=(const okCDeviceInventory&);
+};
+
+#endif // __okDeviceInventory_h__
@@ -0,0 +1,488 @@
+//------------------------------------------------------------------------
+// okDevicePool.cpp
+//
+// See okDevicePool.h.
+//
+// Locking: m_lock protects the entry table and the reconnect thread state,
+// each Entry::lock protects that entry's device pointer and state changes.
+// state is atomic so that the table scans under m_lock (Add, Find) can read
+// it without taking Entry::lock, which would invert the Entry::lock ->
+// m_lock order of Unlock(handle, err).  Entries are never freed before the
+// pool itself, so a handle always indexes valid memory.  Callbacks are never
+// invoked with a lock held.
+//------------------------------------------------------------------------
+
+#include <chrono>
+
+#include "okDevicePool.h"
+
+
+okCDevicePool::okCDevicePool()
+	: m_running(false), m_intervalMs(500), m_stateCallback(NULL), m_stateArg(NULL)
+{
+}
+
+
+okCDevicePool::~okCDevicePool()
+{
+	Stop();
+	for (size_t i=0; i<m_entries.size(); i++) {
+		delete m_entries[i]->dev;
+		delete m_entries[i];
+	}
+}
+
+
+int
+okCDevicePool::Add(const std::string serial, const std::string bitfile,
+		okDevicePoolConfigureCallback configure, void *arg)
+{
+	Entry *e;
+	int handle;
+
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		for (size_t i=0; i<m_entries.size(); i++) {
+			if (m_entries[i]->state != StateRemoved && m_entries[i]->serial == serial)
+				return(-1);
+		}
+
+		e = new Entry;
+		e->serial = serial;
+		e->bitfile = bitfile;
+		e->configure = configure;
+		e->configureArg = arg;
+		e->dev = NULL;
+		e->state = StateDisconnected;
+		e->reconnects = 0;
+		e->opening = true;
+		m_entries.push_back(e);
+		handle = (int)m_entries.size() - 1;
+	}
+
+	okCFrontPanel *dev = open(handle, e);
+	{
+		std::lock_guard<std::mutex> guard(e->lock);
+		e->opening = false;
+		if (NULL != dev) {
+			e->dev = dev;
+			e->state = StateConnected;
+		}
+	}
+	if (NULL == dev)
+		m_wake.notify_all();
+
+	return(handle);
+}
+
+
+void
+okCDevicePool::Remove(int handle)
+{
+	Entry *e = entry(handle);
+	if (NULL == e)
+		return;
+
+	std::lock_guard<std::mutex> guard(e->lock);
+	delete e->dev;
+	e->dev = NULL;
+	e->state = StateRemoved;
+}
+
+
+int
+okCDevicePool::Find(const std::string serial)
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	for (size_t i=0; i<m_entries.size(); i++) {
+		if (m_entries[i]->state != StateRemoved && m_entries[i]->serial == serial)
+			return((int)i);
+	}
+	return(-1);
+}
+
+
+void
+okCDevicePool::SetStateCallback(okDevicePoolStateCallback callback, void *arg)
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	m_stateCallback = callback;
+	m_stateArg = arg;
+}
+
+
+void
+okCDevicePool::SetReconnectInterval(int ms)
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	m_intervalMs = (ms > 0) ? (ms) : (1);
+}
+
+
+void
+okCDevicePool::Start()
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	if (m_running)
+		return;
+	m_running = true;
+	m_thread = std::thread(&okCDevicePool::reconnectThread, this);
+}
+
+
+void
+okCDevicePool::Stop()
+{
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		if (!m_running)
+			return;
+		m_running = false;
+	}
+	m_wake.notify_all();
+	m_thread.join();
+}
+
+
+okCDevicePool::DeviceState
+okCDevicePool::GetState(int handle)
+{
+	Entry *e = entry(handle);
+	if (NULL == e)
+		return(StateRemoved);
+
+	std::lock_guard<std::mutex> guard(e->lock);
+	return(e->state);
+}
+
+
+bool
+okCDevicePool::IsConnected(int handle)
+	{ return(StateConnected == GetState(handle)); }
+
+
+int
+okCDevicePool::GetReconnectCount(int handle)
+{
+	Entry *e = entry(handle);
+	if (NULL == e)
+		return(0);
+	return(e->reconnects.load());
+}
+
+
+std::string
+okCDevicePool::GetSerial(int handle)
+{
+	Entry *e = entry(handle);
+	if (NULL == e)
+		return(std::string());
+	return(e->serial);
+}
+
+
+bool
+okCDevicePool::IsDisconnectError(okCFrontPanel::ErrorCode err)
+{
+	return((okCFrontPanel::DeviceNotOpen == err) ||
+	       (okCFrontPanel::CommunicationError == err));
+}
+
+
+bool
+okCDevicePool::ReportError(int handle, okCFrontPanel::ErrorCode err)
+{
+	if (!IsDisconnectError(err))
+		return(false);
+
+	Entry *e = entry(handle);
+	if (NULL == e)
+		return(false);
+
+	bool changed;
+	{
+		std::lock_guard<std::mutex> guard(e->lock);
+		changed = (StateConnected == e->state);
+		if (changed)
+			markDisconnected(handle, e);
+	}
+	if (changed)
+		notify(handle, false);
+	return(true);
+}
+
+
+okCFrontPanel *
+okCDevicePool::Lock(int handle)
+{
+	Entry *e = entry(handle);
+	if (NULL == e)
+		return(NULL);
+
+	e->lock.lock();
+	if (StateConnected != e->state) {
+		e->lock.unlock();
+		return(NULL);
+	}
+	return(e->dev);
+}
+
+
+okCFrontPanel *
+okCDevicePool::TryLock(int handle, bool *busy)
+{
+	Entry *e = entry(handle);
+	if (NULL != busy)
+		*busy = false;
+	if (NULL == e)
+		return(NULL);
+
+	if (!e->lock.try_lock()) {
+		if (NULL != busy)
+			*busy = true;
+		return(NULL);
+	}
+	if (StateConnected != e->state) {
+		e->lock.unlock();
+		return(NULL);
+	}
+	return(e->dev);
+}
+
+
+void
+okCDevicePool::Unlock(int handle)
+{
+	Entry *e = entry(handle);
+	if (NULL != e)
+		e->lock.unlock();
+}
+
+
+void
+okCDevicePool::Unlock(int handle, okCFrontPanel::ErrorCode err)
+{
+	Entry *e = entry(handle);
+	if (NULL == e)
+		return;
+
+	bool changed = IsDisconnectError(err) && (StateConnected == e->state);
+	if (changed)
+		markDisconnected(handle, e);
+	e->lock.unlock();
+	if (changed)
+		notify(handle, false);
+}
+
+
+//------------------------------------------------------------------------
+// Pooled transfers
+//------------------------------------------------------------------------
+okCFrontPanel::ErrorCode
+okCDevicePool::SetWireInValue(int handle, int ep, unsigned long val, unsigned long mask)
+{
+	okCFrontPanel *dev = Lock(handle);
+	if (NULL == dev)
+		return(okCFrontPanel::DeviceNotOpen);
+	okCFrontPanel::ErrorCode err = dev->SetWireInValue(ep, val, mask);
+	Unlock(handle, err);
+	return(err);
+}
+
+
+okCFrontPanel::ErrorCode
+okCDevicePool::UpdateWireIns(int handle)
+{
+	okCFrontPanel *dev = Lock(handle);
+	if (NULL == dev)
+		return(okCFrontPanel::DeviceNotOpen);
+	dev->UpdateWireIns();
+	okCFrontPanel::ErrorCode err = (dev->IsOpen()) ? (okCFrontPanel::NoError) : (okCFrontPanel::DeviceNotOpen);
+	Unlock(handle, err);
+	return(err);
+}
+
+
+okCFrontPanel::ErrorCode
+okCDevicePool::UpdateWireOuts(int handle)
+{
+	okCFrontPanel *dev = Lock(handle);
+	if (NULL == dev)
+		return(okCFrontPanel::DeviceNotOpen);
+	dev->UpdateWireOuts();
+	okCFrontPanel::ErrorCode err = (dev->IsOpen()) ? (okCFrontPanel::NoError) : (okCFrontPanel::DeviceNotOpen);
+	Unlock(handle, err);
+	return(err);
+}
+
+
+unsigned long
+okCDevicePool::GetWireOutValue(int handle, int epAddr, okCFrontPanel::ErrorCode *err)
+{
+	okCFrontPanel *dev = Lock(handle);
+	if (NULL != err)
+		*err = (NULL == dev) ? (okCFrontPanel::DeviceNotOpen) : (okCFrontPanel::NoError);
+	if (NULL == dev)
+		return(0);
+	unsigned long val = dev->GetWireOutValue(epAddr);
+	Unlock(handle);
+	return(val);
+}
+
+
+okCFrontPanel::ErrorCode
+okCDevicePool::ActivateTriggerIn(int handle, int epAddr, int bit)
+{
+	okCFrontPanel *dev = Lock(handle);
+	if (NULL == dev)
+		return(okCFrontPanel::DeviceNotOpen);
+	okCFrontPanel::ErrorCode err = dev->ActivateTriggerIn(epAddr, bit);
+	Unlock(handle, err);
+	return(err);
+}
+
+
+long
+okCDevicePool::WriteToPipeIn(int handle, int epAddr, long length, unsigned char *data)
+{
+	okCFrontPanel *dev = Lock(handle);
+	if (NULL == dev)
+		return((long)okCFrontPanel::DeviceNotOpen);
+	long ret = dev->WriteToPipeIn(epAddr, length, data);
+	// Pipe transfers return the byte count, or a negative ErrorCode.
+	Unlock(handle, (ret < 0) ? ((okCFrontPanel::ErrorCode)ret) : (okCFrontPanel::NoError));
+	return(ret);
+}
+
+
+long
+okCDevicePool::ReadFromPipeOut(int handle, int epAddr, long length, unsigned char *data)
+{
+	okCFrontPanel *dev = Lock(handle);
+	if (NULL == dev)
+		return((long)okCFrontPanel::DeviceNotOpen);
+	long ret = dev->ReadFromPipeOut(epAddr, length, data);
+	Unlock(handle, (ret < 0) ? ((okCFrontPanel::ErrorCode)ret) : (okCFrontPanel::NoError));
+	return(ret);
+}
+
+
+//------------------------------------------------------------------------
+// Internals
+//------------------------------------------------------------------------
+okCDevicePool::Entry *
+okCDevicePool::entry(int handle)
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	if ((handle < 0) || (handle >= (int)m_entries.size()))
+		return(NULL);
+	return(m_entries[handle]);
+}
+
+
+// Caller holds e->lock.
+void
+okCDevicePool::markDisconnected(int handle, Entry *e)
+{
+	delete e->dev;
+	e->dev = NULL;
+	e->state = StateDisconnected;
+	m_wake.notify_all();
+}
+
+
+// Opens and configures a fresh device for e.  Called without e->lock held,
+// since ConfigureFPGA can take a noticeable fraction of a second.
+okCFrontPanel *
+okCDevicePool::open(int handle, Entry *e)
+{
+	okCFrontPanel *dev = new okCFrontPanel;
+
+	// Cheap presence check first, so a missing board does not cost an
+	// OpenBySerial attempt on every reconnect pass.
+	bool present = false;
+	int count = dev->GetDeviceCount();
+	for (int i=0; i<count; i++) {
+		if (dev->GetDeviceListSerial(i) == e->serial) {
+			present = true;
+			break;
+		}
+	}
+
+	if (!present || (okCFrontPanel::NoError != dev->OpenBySerial(e->serial))) {
+		delete dev;
+		return(NULL);
+	}
+
+	if (!e->bitfile.empty() && (okCFrontPanel::NoError != dev->ConfigureFPGA(e->bitfile))) {
+		delete dev;
+		return(NULL);
+	}
+
+	if ((NULL != e->configure) && (okCFrontPanel::NoError != e->configure(handle, dev, e->configureArg))) {
+		delete dev;
+		return(NULL);
+	}
+
+	return(dev);
+}
+
+
+void
+okCDevicePool::notify(int handle, bool connected)
+{
+	okDevicePoolStateCallback callback;
+	void *arg;
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		callback = m_stateCallback;
+		arg = m_stateArg;
+	}
+	if (NULL != callback)
+		callback(handle, connected, arg);
+}
+
+
+void
+okCDevicePool::reconnectThread()
+{
+	std::unique_lock<std::mutex> guard(m_lock);
+	while (m_running) {
+		m_wake.wait_for(guard, std::chrono::milliseconds(m_intervalMs));
+		if (!m_running)
+			break;
+
+		std::vector<Entry *> entries(m_entries);
+		guard.unlock();
+
+		for (size_t i=0; i<entries.size(); i++) {
+			Entry *e = entries[i];
+			{
+				std::lock_guard<std::mutex> elock(e->lock);
+				if ((StateDisconnected != e->state) || e->opening)
+					continue;
+				e->opening = true;
+			}
+
+			okCFrontPanel *dev = open((int)i, e);
+			bool rebound = false;
+			{
+				std::lock_guard<std::mutex> elock(e->lock);
+				e->opening = false;
+				// Removed while we were reopening it.
+				if ((NULL != dev) && (StateDisconnected == e->state)) {
+					e->dev = dev;
+					e->state = StateConnected;
+					e->reconnects++;
+					rebound = true;
+				}
+			}
+			if (rebound)
+				notify((int)i, true);
+			else
+				delete dev;
+		}
+
+		guard.lock();
+	}
+}
@@ -0,0 +1,134 @@
+//------------------------------------------------------------------------
+// okDevicePool.h
+//
+// Hot-plug aware pool of okCFrontPanel devices.  Boards are tracked by
+// serial number and handed out as stable logical handles.  When a transfer
+// through the pool fails with DeviceNotOpen or CommunicationError the board
+// is marked disconnected and a background thread reopens it, reconfigures
+// the FPGA and rebinds the handle to the new okCFrontPanel.  Callers keep
+// using the same handle; only the transfer that hit the glitch fails.
+//
+// The pool does not own the okFrontPanelDLL_LoadLib / FreeLib lifetime.
+//------------------------------------------------------------------------
+
+#ifndef __okDevicePool_h__
+#define __okDevicePool_h__
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "okFrontPanelDLL.h"
+
+// Called (from the reconnect thread) after a board has been reopened and its
+// bitfile loaded, before the handle is rebound.  Use it to restore wire-ins,
+// PLL settings, etc.  Returning anything but NoError retries the reconnect.
+typedef okCFrontPanel::ErrorCode (*okDevicePoolConfigureCallback)(int handle, okCFrontPanel *dev, void *arg);
+
+// Called whenever a handle changes connection state.
+typedef void (*okDevicePoolStateCallback)(int handle, bool connected, void *arg);
+
+
+//------------------------------------------------------------------------
+// okCDevicePool
+//------------------------------------------------------------------------
+class okCDevicePool
+{
+public:
+	enum DeviceState {
+		StateConnected    = 0,
+		StateDisconnected = 1,
+		StateRemoved      = 2
+	};
+
+	okCDevicePool();
+	~okCDevicePool();
+
+	// Opens the board with the given serial, loads bitfile (if not empty) and
+	// returns its logical handle, or -1 if the serial is already pooled.  A
+	// board that is not attached yet is still pooled, in the disconnected
+	// state, and is brought up by the reconnect thread once it appears.
+	int Add(const std::string serial, const std::string bitfile = "",
+			okDevicePoolConfigureCallback configure = NULL, void *arg = NULL);
+	void Remove(int handle);
+	int Find(const std::string serial);
+
+	void SetStateCallback(okDevicePoolStateCallback callback, void *arg);
+	void SetReconnectInterval(int ms);
+
+	// Starts / stops the background reconnect thread.
+	void Start();
+	void Stop();
+
+	DeviceState GetState(int handle);
+	bool IsConnected(int handle);
+	int GetReconnectCount(int handle);       // never waits for the device
+	std::string GetSerial(int handle);
+
+	// Marks the handle disconnected if err indicates the board has gone away.
+	// Without the lock held the board may have been reconnected since err
+	// was seen; after a call into the device from Lock(), report through
+	// Unlock(handle, err) instead.
+	bool ReportError(int handle, okCFrontPanel::ErrorCode err);
+	static bool IsDisconnectError(okCFrontPanel::ErrorCode err);
+
+	// Direct access for calls the pool does not wrap.  Lock() returns NULL if
+	// the board is currently disconnected; every non-NULL Lock() must be
+	// paired with Unlock().  The returned pointer is only valid until Unlock().
+	okCFrontPanel *Lock(int handle);
+	// As Lock(), but also returns NULL instead of waiting while another
+	// thread holds the device; busy (if given) tells the two cases apart.
+	okCFrontPanel *TryLock(int handle, bool *busy = NULL);
+	void Unlock(int handle);
+	// Unlock() after reporting err for the device that was locked, so it can
+	// never disconnect a device reconnected by another thread meanwhile.
+	void Unlock(int handle, okCFrontPanel::ErrorCode err);
+
+	// Pooled transfers.  These fail with DeviceNotOpen while the board is
+	// reconnecting, and trigger a reconnect on a disconnect error.
+	okCFrontPanel::ErrorCode SetWireInValue(int handle, int ep, unsigned long val, unsigned long mask = 0xffffffff);
+	okCFrontPanel::ErrorCode UpdateWireIns(int handle);
+	okCFrontPanel::ErrorCode UpdateWireOuts(int handle);
+	// Returns 0 with err (if given) set to DeviceNotOpen while the board is
+	// disconnected, so a zero register can be told from a missing board.
+	unsigned long GetWireOutValue(int handle, int epAddr, okCFrontPanel::ErrorCode *err = NULL);
+	okCFrontPanel::ErrorCode ActivateTriggerIn(int handle, int epAddr, int bit);
+	long WriteToPipeIn(int handle, int epAddr, long length, unsigned char *data);
+	long ReadFromPipeOut(int handle, int epAddr, long length, unsigned char *data);
+
+private:
+	struct Entry {
+		std::string serial;
+		std::string bitfile;
+		okDevicePoolConfigureCallback configure;
+		void *configureArg;
+		okCFrontPanel *dev;
+		std::atomic<DeviceState> state;  // written under lock, read without it
+		std::atomic<int> reconnects;     // read without the lock
+		bool opening;
+		std::mutex lock;
+	};
+
+	Entry *entry(int handle);
+	void markDisconnected(int handle, Entry *e);
+	okCFrontPanel *open(int handle, Entry *e);
+	void reconnectThread();
+	void notify(int handle, bool connected);
+
+	std::vector<Entry *> m_entries;
+	std::mutex m_lock;
+	std::condition_variable m_wake;
+	std::thread m_thread;
+	bool m_running;
+	int m_intervalMs;
+	okDevicePoolStateCallback m_stateCallback;
+	void *m_stateArg;
+
+	okCDevicePool(const okCDevicePool&);
+	okCDevicePool& operator=(const okCDevicePool&);
+};
+
+#endif // __okDevicePool_h__
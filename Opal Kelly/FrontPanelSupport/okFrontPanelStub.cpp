@@ -0,0 +1,1006 @@
+//------------------------------------------------------------------------
+// okFrontPanelStub.cpp
+//
+// Stand-in for the FrontPanel driver library.  Build it as a shared
+// library exporting the same okFrontPanel_* / okPLL* entry points as
+// libokFrontPanel.so / okFrontPanel.dll, and load it with
+//
+//    okFrontPanelDLL_LoadLib("./libokFrontPanelStub.so");
+//
+// so benchmarks and support code can run without a board.  It is not part
+// of the support library and must not be linked into the same binary as
+// okFrontPanelDLL.cpp.
+//
+// Boards are simulated as loopback devices: wire-out 0x20+n reads back
+// wire-in n, pipe-in data is counted and discarded, pipe-out data is
+// zeros.  The AvivFPGA2 upload CRC is modelled: pipe 0x80 data the FIFO
+// accepts updates a CRC-32C that trigger 0x41 bit 0 clears and wire-outs
+// 0x28 / 0x29 report.
+// Every call that would go to the board sleeps for a fixed USB latency,
+// pipe transfers additionally for length / bandwidth.
+//
+// So is the AvivFPGA2 segment FIFO and sequencer, closely enough to test
+// streaming uploads: pipe 0x80 fills a 2048-record FIFO that, like the
+// firmware's, holds one word less than its depth and so 2047 records
+// (overflowing writes are dropped), trigger 0x40 bits 0 / 1 / 2 start,
+// abort and mark the end of the stream (an abort while idle flushes the
+// FIFO only in stream mode), and the running sequence consumes records in
+// real time at the simulated master clock rate.  A retrigger arrives
+// OKSTUB_RETRIGGER_US after it is waited for; by default never, so every
+// wait with a timeout times out and one without passes straight through.
+// Wire-outs 0x2A / 0x2B report the FIFO level and flags; after the first
+// start trigger 0x22 / 0x23, 0x24, 0x25 and 0x26 / 0x27 report the master
+// sample count, retrigger timeouts, status and retrigger wait samples
+// instead of looping back.
+//
+// Environment:
+//    OKSTUB_DEVICES      comma-separated serials   (default "STUB000001")
+//    OKSTUB_LATENCY_US   per-transaction latency   (default 125)
+//    OKSTUB_PIPE_MBPS    pipe bandwidth in MB/s    (default 30)
+//    OKSTUB_MASTER_HZ    master clock rate         (default 10000000)
+//    OKSTUB_RETRIGGER_US retrigger arrival delay   (default -1, never)
+//------------------------------------------------------------------------
+
+#define FRONTPANELDLL_EXPORTS
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "okFrontPanelDLL.h"
+
+#define okStub_MAX_DEVICES   16
+#define okStub_WIRES         32
+#define okStub_PLL_INFO      256
+#define okStub_EP_CRC_PIPE   0x80
+#define okStub_EP_CRC_RESET  0x41
+#define okStub_EP_CRC_LOW    0x28
+#define okStub_EP_CRC_HIGH   0x29
+#define okStub_EP_TRIGGER    0x40
+#define okStub_EP_SAMPLES    0x22
+#define okStub_EP_TIMEOUTS   0x24
+#define okStub_EP_STATUS     0x25
+#define okStub_EP_WAITED     0x26
+#define okStub_EP_FIFO_LEVEL 0x2a
+#define okStub_EP_FIFO_FLAGS 0x2b
+#define okStub_FIFO_RECORDS  2047     // 16384 x 16-bit words, less one
+#define okStub_RECORD_SIZE   16
+
+
+struct okStubPLL22393 {
+	double reference;
+	double capload;
+	int p[3];
+	int q[3];
+	int lf[3];
+	Bool pllEnabled[3];
+	int divider[5];
+	int source[5];
+	Bool outputEnabled[5];
+};
+
+struct okStubPLL22150 {
+	double reference;
+	double capload;
+	Bool extosc;
+	int p;
+	int q;
+	int divSource[2];
+	int divider[2];
+	int source[6];
+	Bool outputEnabled[6];
+};
+
+struct okStubRecord {
+	unsigned long long on;
+	unsigned long long off;
+	unsigned int rep;
+};
+
+// AvivFPGA2 segment FIFO and sequencer.
+struct okStubSequencer {
+	std::deque<okStubRecord> fifo;
+	unsigned char partial[okStub_RECORD_SIZE];
+	int partialLength;
+	bool partialDropped;           // the FIFO was full when the record began
+	bool started;                  // a start trigger has been seen
+	bool running;
+	bool streamEnded;
+	bool overflowed;
+	bool underflowed;
+	okStubRecord current;
+	double remaining;              // master samples left in the current record
+	bool timingOut;                // the current retrigger wait ends by its timeout
+	double lastUpdate;             // seconds
+	double masterSamples;
+	double waitedSamples;          // spent waiting for retriggers
+	unsigned int timeouts;
+	unsigned int status;
+};
+
+struct okStubBoard {
+	char serial[MAX_SERIALNUMBER_LENGTH+1];
+	char deviceID[MAX_DEVICEID_LENGTH+1];
+	bool busy;
+	bool configured;
+	unsigned long wireIn[okStub_WIRES];
+	unsigned long triggerCount;
+	unsigned long long pipeInBytes;
+	unsigned int uploadCrc;
+	unsigned char pll22393[okStub_PLL_INFO];
+	unsigned char pll22150[okStub_PLL_INFO];
+	unsigned char eeprom22393[okStub_PLL_INFO];
+	unsigned char eeprom22150[okStub_PLL_INFO];
+	okStubSequencer *seq;
+};
+
+struct okStubHandle {
+	okStubBoard *board;
+	unsigned long wireIn[okStub_WIRES];
+	unsigned long wireInMask[okStub_WIRES];
+	unsigned long wireOut[okStub_WIRES];
+	long lastTransfer;
+	int timeout;
+};
+
+static std::mutex g_lock;
+static bool g_init = false;
+static int g_count = 0;
+static okStubBoard g_boards[okStub_MAX_DEVICES];
+static long g_latencyUs = 125;
+static double g_pipeMBps = 30.0;
+static double g_masterHz = 1e7;
+static double g_retriggerUs = -1.0;
+
+
+static void
+stubDefaults22393(okStubPLL22393 *pll)
+{
+	memset(pll, 0, sizeof(*pll));
+	pll->reference = 48.0;
+	for (int i=0; i<3; i++) {
+		pll->p[i] = 400;
+		pll->q[i] = 48;
+	}
+	for (int i=0; i<5; i++)
+		pll->divider[i] = 8;
+}
+
+
+static void
+stubDefaults22150(okStubPLL22150 *pll)
+{
+	memset(pll, 0, sizeof(*pll));
+	pll->reference = 48.0;
+	pll->p = 400;
+	pll->q = 48;
+	pll->divider[0] = 8;
+	pll->divider[1] = 8;
+}
+
+
+// Caller holds g_lock.
+static void
+stubInit()
+{
+	if (g_init)
+		return;
+	g_init = true;
+
+	const char *env;
+	if (NULL != (env = getenv("OKSTUB_LATENCY_US")))
+		g_latencyUs = atol(env);
+	if (NULL != (env = getenv("OKSTUB_PIPE_MBPS")))
+		g_pipeMBps = atof(env);
+	if (g_pipeMBps <= 0.0)
+		g_pipeMBps = 30.0;
+	if (NULL != (env = getenv("OKSTUB_MASTER_HZ")))
+		g_masterHz = atof(env);
+	if (g_masterHz <= 0.0)
+		g_masterHz = 1e7;
+	if (NULL != (env = getenv("OKSTUB_RETRIGGER_US")))
+		g_retriggerUs = atof(env);
+
+	const char *list = getenv("OKSTUB_DEVICES");
+	if (NULL == list)
+		list = "STUB000001";
+	memset(g_boards, 0, sizeof(g_boards));
+	while (*list && (g_count < okStub_MAX_DEVICES)) {
+		const char *end = strchr(list, ',');
+		size_t len = (NULL != end) ? ((size_t)(end - list)) : (strlen(list));
+		if (len > 0) {
+			okStubBoard *b = &g_boards[g_count++];
+			memcpy(b->serial, list, (len > MAX_SERIALNUMBER_LENGTH) ? (MAX_SERIALNUMBER_LENGTH) : (len));
+			strcpy(b->deviceID, "Stand-in");
+			b->seq = new okStubSequencer();
+
+			okStubPLL22393 p93;
+			okStubPLL22150 p50;
+			stubDefaults22393(&p93);
+			stubDefaults22150(&p50);
+			memcpy(b->pll22393, &p93, sizeof(p93));
+			memcpy(b->eeprom22393, &p93, sizeof(p93));
+			memcpy(b->pll22150, &p50, sizeof(p50));
+			memcpy(b->eeprom22150, &p50, sizeof(p50));
+		}
+		list += len;
+		if (',' == *list)
+			list++;
+	}
+}
+
+
+static void
+stubDelay(long length)
+{
+	double us = (double)g_latencyUs;
+	if (length > 0)
+		us += length / g_pipeMBps;          // bytes / (MB/s) = us
+	if (us > 0.0)
+		std::this_thread::sleep_for(std::chrono::microseconds((long)us));
+}
+
+
+static okStubHandle *
+stubHandle(okFrontPanel_HANDLE hnd)
+	{ return((okStubHandle *)hnd); }
+
+
+// Bitwise CRC-32C, as the firmware computes it; fast enough for simulated
+// pipe rates.
+static unsigned int
+stubCrc32c(unsigned int crc, const unsigned char *data, long length)
+{
+	crc = ~crc;
+	for (long i=0; i<length; i++) {
+		crc ^= data[i];
+		for (int k=0; k<8; k++)
+			crc = (crc & 1) ? ((crc >> 1) ^ 0x82F63B78) : (crc >> 1);
+	}
+	return(~crc);
+}
+
+
+//------------------------------------------------------------------------
+// Segment FIFO / sequencer model.  Callers hold g_lock.
+//------------------------------------------------------------------------
+static double
+stubNow()
+{
+	return(std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+
+// Record layout as in okSegmentDecoder.cpp.
+static okStubRecord
+stubDecodeRecord(const unsigned char *r)
+{
+	unsigned int d[4];
+	for (int i=0; i<4; i++)
+		d[i] = r[4*i] | (r[4*i+1] << 8) | (r[4*i+2] << 16) | ((unsigned int)r[4*i+3] << 24);
+	okStubRecord rec;
+	rec.on = ((unsigned long long)(d[0] & 0xffff) << 32) | (d[0] & 0xffff0000) | (d[1] & 0xffff);
+	rec.off = ((unsigned long long)(d[1] >> 16) << 32) | (d[2] << 16) | (d[2] >> 16);
+	rec.rep = (d[3] << 16) | (d[3] >> 16);
+	return(rec);
+}
+
+
+// Master samples the sequencer spends on the current record.  A retrigger
+// waits until it arrives or its timeout (on counts, if not 0) runs out,
+// whichever is first; one that never arrives and has no timeout is not
+// waited for at all.
+static void
+stubSeqLoad(okStubSequencer *s)
+{
+	const okStubRecord& r = s->current;
+	s->timingOut = false;
+	if (0 != r.rep) {
+		s->remaining = (double)(r.on + r.off) * r.rep;
+		return;
+	}
+	double arrival = g_retriggerUs * 1e-6 * g_masterHz;
+	if ((0 != r.on) && ((g_retriggerUs < 0.0) || ((double)r.on <= arrival))) {
+		s->remaining = (double)r.on;
+		s->timingOut = true;
+	}
+	else {
+		s->remaining = (g_retriggerUs < 0.0) ? (0.0) : (arrival);
+	}
+}
+
+
+static bool
+stubSeqNext(okStubSequencer *s)
+{
+	if (s->fifo.empty())
+		return(false);
+	s->current = s->fifo.front();
+	s->fifo.pop_front();
+	stubSeqLoad(s);
+	return(true);
+}
+
+
+// Runs the sequencer up to the present.
+static void
+stubSeqAdvance(okStubBoard *b)
+{
+	okStubSequencer *s = b->seq;
+	double now = stubNow();
+	double budget = (now - s->lastUpdate) * g_masterHz;
+	s->lastUpdate = now;
+
+	while (s->running) {
+		double step = (budget < s->remaining) ? (budget) : (s->remaining);
+		if (0 != s->current.rep)
+			s->masterSamples += step;
+		else
+			s->waitedSamples += step;
+		s->remaining -= step;
+		budget -= step;
+		if (s->remaining > 0.0)
+			return;
+
+		if (0 == s->current.rep) {
+			if (s->timingOut) {
+				s->timeouts++;
+				s->timingOut = false;
+			}
+			// The firmware reads past a retrigger without checking for data;
+			// on an empty FIFO it keeps the record and waits again.
+			if (!stubSeqNext(s)) {
+				s->underflowed = true;
+				stubSeqLoad(s);
+				if (s->remaining <= 0.0)
+					return;
+			}
+		}
+		else if (!stubSeqNext(s)) {
+			s->running = false;
+			s->status = (!s->streamEnded && (0 != (b->wireIn[0] & 0x04))) ? (0x06) : (0x01);
+		}
+	}
+}
+
+
+//------------------------------------------------------------------------
+// General
+//------------------------------------------------------------------------
+okDLLEXPORT void DLL_ENTRY
+okFrontPanelDLL_GetVersion(char *date, char *time)
+{
+	strcpy(date, __DATE__);
+	strcpy(time, __TIME__);
+}
+
+
+//------------------------------------------------------------------------
+// okPLL22393
+//------------------------------------------------------------------------
+#define P93(h)   ((okStubPLL22393 *)(h))
+
+okDLLEXPORT okPLL22393_HANDLE DLL_ENTRY okPLL22393_Construct()
+	{ okStubPLL22393 *p = new okStubPLL22393; stubDefaults22393(p); return(p); }
+okDLLEXPORT void DLL_ENTRY okPLL22393_Destruct(okPLL22393_HANDLE pll)
+	{ delete P93(pll); }
+okDLLEXPORT void DLL_ENTRY okPLL22393_SetCrystalLoad(okPLL22393_HANDLE pll, double capload)
+	{ P93(pll)->capload = capload; }
+okDLLEXPORT void DLL_ENTRY okPLL22393_SetReference(okPLL22393_HANDLE pll, double freq)
+	{ P93(pll)->reference = freq; }
+okDLLEXPORT double DLL_ENTRY okPLL22393_GetReference(okPLL22393_HANDLE pll)
+	{ return(P93(pll)->reference); }
+okDLLEXPORT Bool DLL_ENTRY okPLL22393_SetPLLParameters(okPLL22393_HANDLE pll, int n, int p, int q, Bool enable)
+{
+	if ((n < 0) || (n > 2) || (p < 6) || (p > 2053) || (q < 2) || (q > 257))
+		return(FALSE);
+	P93(pll)->p[n] = p;
+	P93(pll)->q[n] = q;
+	P93(pll)->pllEnabled[n] = enable;
+	return(TRUE);
+}
+okDLLEXPORT Bool DLL_ENTRY okPLL22393_SetPLLLF(okPLL22393_HANDLE pll, int n, int lf)
+{
+	if ((n < 0) || (n > 2))
+		return(FALSE);
+	P93(pll)->lf[n] = lf;
+	return(TRUE);
+}
+okDLLEXPORT Bool DLL_ENTRY okPLL22393_SetOutputDivider(okPLL22393_HANDLE pll, int n, int div)
+{
+	if ((n < 0) || (n > 4) || (div < 1) || (div > 127))
+		return(FALSE);
+	P93(pll)->divider[n] = div;
+	return(TRUE);
+}
+okDLLEXPORT Bool DLL_ENTRY okPLL22393_SetOutputSource(okPLL22393_HANDLE pll, int n, ok_ClockSource_22393 clksrc)
+{
+	if ((n < 0) || (n > 4))
+		return(FALSE);
+	P93(pll)->source[n] = clksrc;
+	return(TRUE);
+}
+okDLLEXPORT void DLL_ENTRY okPLL22393_SetOutputEnable(okPLL22393_HANDLE pll, int n, Bool enable)
+	{ if ((n >= 0) && (n <= 4)) P93(pll)->outputEnabled[n] = enable; }
+okDLLEXPORT int DLL_ENTRY okPLL22393_GetPLLP(okPLL22393_HANDLE pll, int n)
+	{ return(((n >= 0) && (n <= 2)) ? (P93(pll)->p[n]) : (0)); }
+okDLLEXPORT int DLL_ENTRY okPLL22393_GetPLLQ(okPLL22393_HANDLE pll, int n)
+	{ return(((n >= 0) && (n <= 2)) ? (P93(pll)->q[n]) : (0)); }
+okDLLEXPORT double DLL_ENTRY okPLL22393_GetPLLFrequency(okPLL22393_HANDLE pll, int n)
+{
+	if ((n < 0) || (n > 2) || (0 == P93(pll)->q[n]))
+		return(0.0);
+	return(P93(pll)->reference * P93(pll)->p[n] / P93(pll)->q[n]);
+}
+okDLLEXPORT int DLL_ENTRY okPLL22393_GetOutputDivider(okPLL22393_HANDLE pll, int n)
+	{ return(((n >= 0) && (n <= 4)) ? (P93(pll)->divider[n]) : (0)); }
+okDLLEXPORT ok_ClockSource_22393 DLL_ENTRY okPLL22393_GetOutputSource(okPLL22393_HANDLE pll, int n)
+	{ return(((n >= 0) && (n <= 4)) ? ((ok_ClockSource_22393)P93(pll)->source[n]) : (ok_ClkSrc22393_Ref)); }
+okDLLEXPORT double DLL_ENTRY okPLL22393_GetOutputFrequency(okPLL22393_HANDLE pll, int n)
+{
+	if ((n < 0) || (n > 4) || (0 == P93(pll)->divider[n]))
+		return(0.0);
+	int src = P93(pll)->source[n];
+	double f = (src < 2) ? (P93(pll)->reference) : (okPLL22393_GetPLLFrequency(pll, (src - 2) / 2));
+	return(f / P93(pll)->divider[n]);
+}
+okDLLEXPORT Bool DLL_ENTRY okPLL22393_IsOutputEnabled(okPLL22393_HANDLE pll, int n)
+	{ return(((n >= 0) && (n <= 4)) ? (P93(pll)->outputEnabled[n]) : (FALSE)); }
+okDLLEXPORT Bool DLL_ENTRY okPLL22393_IsPLLEnabled(okPLL22393_HANDLE pll, int n)
+	{ return(((n >= 0) && (n <= 2)) ? (P93(pll)->pllEnabled[n]) : (FALSE)); }
+okDLLEXPORT void DLL_ENTRY okPLL22393_InitFromProgrammingInfo(okPLL22393_HANDLE pll, unsigned char *buf)
+	{ memcpy(pll, buf, sizeof(okStubPLL22393)); }
+okDLLEXPORT void DLL_ENTRY okPLL22393_GetProgrammingInfo(okPLL22393_HANDLE pll, unsigned char *buf)
+	{ memcpy(buf, pll, sizeof(okStubPLL22393)); }
+
+
+//------------------------------------------------------------------------
+// okPLL22150
+//------------------------------------------------------------------------
+#define P50(h)   ((okStubPLL22150 *)(h))
+
+okDLLEXPORT okPLL22150_HANDLE DLL_ENTRY okPLL22150_Construct()
+	{ okStubPLL22150 *p = new okStubPLL22150; stubDefaults22150(p); return(p); }
+okDLLEXPORT void DLL_ENTRY okPLL22150_Destruct(okPLL22150_HANDLE pll)
+	{ delete P50(pll); }
+okDLLEXPORT void DLL_ENTRY okPLL22150_SetCrystalLoad(okPLL22150_HANDLE pll, double capload)
+	{ P50(pll)->capload = capload; }
+okDLLEXPORT void DLL_ENTRY okPLL22150_SetReference(okPLL22150_HANDLE pll, double freq, Bool extosc)
+	{ P50(pll)->reference = freq; P50(pll)->extosc = extosc; }
+okDLLEXPORT double DLL_ENTRY okPLL22150_GetReference(okPLL22150_HANDLE pll)
+	{ return(P50(pll)->reference); }
+okDLLEXPORT Bool DLL_ENTRY okPLL22150_SetVCOParameters(okPLL22150_HANDLE pll, int p, int q)
+{
+	if ((p < 6) || (p > 2053) || (q < 2) || (q > 129))
+		return(FALSE);
+	P50(pll)->p = p;
+	P50(pll)->q = q;
+	return(TRUE);
+}
+okDLLEXPORT int DLL_ENTRY okPLL22150_GetVCOP(okPLL22150_HANDLE pll)
+	{ return(P50(pll)->p); }
+okDLLEXPORT int DLL_ENTRY okPLL22150_GetVCOQ(okPLL22150_HANDLE pll)
+	{ return(P50(pll)->q); }
+okDLLEXPORT double DLL_ENTRY okPLL22150_GetVCOFrequency(okPLL22150_HANDLE pll)
+	{ return((0 != P50(pll)->q) ? (P50(pll)->reference * P50(pll)->p / P50(pll)->q) : (0.0)); }
+okDLLEXPORT void DLL_ENTRY okPLL22150_SetDiv1(okPLL22150_HANDLE pll, ok_DividerSource divsrc, int n)
+	{ P50(pll)->divSource[0] = divsrc; P50(pll)->divider[0] = n; }
+okDLLEXPORT void DLL_ENTRY okPLL22150_SetDiv2(okPLL22150_HANDLE pll, ok_DividerSource divsrc, int n)
+	{ P50(pll)->divSource[1] = divsrc; P50(pll)->divider[1] = n; }
+okDLLEXPORT ok_DividerSource DLL_ENTRY okPLL22150_GetDiv1Source(okPLL22150_HANDLE pll)
+	{ return((ok_DividerSource)P50(pll)->divSource[0]); }
+okDLLEXPORT ok_DividerSource DLL_ENTRY okPLL22150_GetDiv2Source(okPLL22150_HANDLE pll)
+	{ return((ok_DividerSource)P50(pll)->divSource[1]); }
+okDLLEXPORT int DLL_ENTRY okPLL22150_GetDiv1Divider(okPLL22150_HANDLE pll)
+	{ return(P50(pll)->divider[0]); }
+okDLLEXPORT int DLL_ENTRY okPLL22150_GetDiv2Divider(okPLL22150_HANDLE pll)
+	{ return(P50(pll)->divider[1]); }
+okDLLEXPORT void DLL_ENTRY okPLL22150_SetOutputSource(okPLL22150_HANDLE pll, int output, ok_ClockSource_22150 clksrc)
+	{ if ((output >= 0) && (output < 6)) P50(pll)->source[output] = clksrc; }
+okDLLEXPORT void DLL_ENTRY okPLL22150_SetOutputEnable(okPLL22150_HANDLE pll, int output, Bool enable)
+	{ if ((output >= 0) && (output < 6)) P50(pll)->outputEnabled[output] = enable; }
+okDLLEXPORT ok_ClockSource_22150 DLL_ENTRY okPLL22150_GetOutputSource(okPLL22150_HANDLE pll, int output)
+	{ return(((output >= 0) && (output < 6)) ? ((ok_ClockSource_22150)P50(pll)->source[output]) : (ok_ClkSrc22150_Ref)); }
+okDLLEXPORT double DLL_ENTRY okPLL22150_GetOutputFrequency(okPLL22150_HANDLE pll, int output)
+{
+	if ((output < 0) || (output >= 6))
+		return(0.0);
+	okStubPLL22150 *p = P50(pll);
+	int d = (p->source[output] >= ok_ClkSrc22150_Div2ByN) ? (1) : (0);
+	double in = (ok_DivSrc_VCO == p->divSource[d]) ? (okPLL22150_GetVCOFrequency(pll)) : (p->reference);
+	switch (p->source[output]) {
+		case ok_ClkSrc22150_Ref:      return(p->reference);
+		case ok_ClkSrc22150_Div1ByN:
+		case ok_ClkSrc22150_Div2ByN:  return((p->divider[d] > 0) ? (in / p->divider[d]) : (0.0));
+		case ok_ClkSrc22150_Div1By2:
+		case ok_ClkSrc22150_Div2By2:  return(in / 2.0);
+		case ok_ClkSrc22150_Div1By3:  return(in / 3.0);
+		case ok_ClkSrc22150_Div2By4:  return(in / 4.0);
+	}
+	return(0.0);
+}
+okDLLEXPORT Bool DLL_ENTRY okPLL22150_IsOutputEnabled(okPLL22150_HANDLE pll, int output)
+	{ return(((output >= 0) && (output < 6)) ? (P50(pll)->outputEnabled[output]) : (FALSE)); }
+okDLLEXPORT void DLL_ENTRY okPLL22150_InitFromProgrammingInfo(okPLL22150_HANDLE pll, unsigned char *buf)
+	{ memcpy(pll, buf, sizeof(okStubPLL22150)); }
+okDLLEXPORT void DLL_ENTRY okPLL22150_GetProgrammingInfo(okPLL22150_HANDLE pll, unsigned char *buf)
+	{ memcpy(buf, pll, sizeof(okStubPLL22150)); }
+
+
+//------------------------------------------------------------------------
+// okFrontPanel
+//------------------------------------------------------------------------
+okDLLEXPORT okFrontPanel_HANDLE DLL_ENTRY
+okFrontPanel_Construct()
+{
+	std::lock_guard<std::mutex> guard(g_lock);
+	stubInit();
+	okStubHandle *h = new okStubHandle;
+	memset(h, 0, sizeof(*h));
+	h->timeout = 1000;
+	return(h);
+}
+
+
+okDLLEXPORT void DLL_ENTRY
+okFrontPanel_Destruct(okFrontPanel_HANDLE hnd)
+{
+	okStubHandle *h = stubHandle(hnd);
+	std::lock_guard<std::mutex> guard(g_lock);
+	if (NULL != h->board)
+		h->board->busy = false;
+	delete h;
+}
+
+
+okDLLEXPORT ok_ErrorCode DLL_ENTRY
+okFrontPanel_WriteI2C(okFrontPanel_HANDLE hnd, const int /*addr*/, int /*length*/, unsigned char * /*data*/)
+{
+	if (NULL == stubHandle(hnd)->board)
+		return(ok_DeviceNotOpen);
+	stubDelay(0);
+	return(ok_NoError);
+}
+
+
+okDLLEXPORT ok_ErrorCode DLL_ENTRY
+okFrontPanel_ReadI2C(okFrontPanel_HANDLE hnd, const int /*addr*/, int length, unsigned char *data)
+{
+	if (NULL == stubHandle(hnd)->board)
+		return(ok_DeviceNotOpen);
+	stubDelay(0);
+	memset(data, 0, length);
+	return(ok_NoError);
+}
+
+
+okDLLEXPORT int DLL_ENTRY okFrontPanel_GetHostInterfaceWidth(okFrontPanel_HANDLE /*hnd*/)
+	{ return(16); }
+okDLLEXPORT Bool DLL_ENTRY okFrontPanel_IsHighSpeed(okFrontPanel_HANDLE /*hnd*/)
+	{ return(TRUE); }
+okDLLEXPORT ok_BoardModel DLL_ENTRY okFrontPanel_GetBoardModel(okFrontPanel_HANDLE hnd)
+	{ return((NULL != stubHandle(hnd)->board) ? (ok_brdXEM3001v2) : (ok_brdUnknown)); }
+
+
+okDLLEXPORT void DLL_ENTRY
+okFrontPanel_GetBoardModelString(okFrontPanel_HANDLE /*hnd*/, ok_BoardModel m, char *buf)
+{
+	strcpy(buf, (ok_brdXEM3001v2 == m) ? ("XEM3001v2") : ("Unknown"));
+}
+
+
+okDLLEXPORT int DLL_ENTRY
+okFrontPanel_GetDeviceCount(okFrontPanel_HANDLE /*hnd*/)
+{
+	std::lock_guard<std::mutex> guard(g_lock);
+	return(g_count);
+}
+
+
+okDLLEXPORT ok_BoardModel DLL_ENTRY
+okFrontPanel_GetDeviceListModel(okFrontPanel_HANDLE /*hnd*/, int num)
+{
+	std::lock_guard<std::mutex> guard(g_lock);
+	return(((num >= 0) && (num < g_count)) ? (ok_brdXEM3001v2) : (ok_brdUnknown));
+}
+
+
+okDLLEXPORT void DLL_ENTRY
+okFrontPanel_GetDeviceListSerial(okFrontPanel_HANDLE /*hnd*/, int num, char *buf)
+{
+	std::lock_guard<std::mutex> guard(g_lock);
+	if ((num >= 0) && (num < g_count))
+		memcpy(buf, g_boards[num].serial, MAX_SERIALNUMBER_LENGTH);
+	else
+		memset(buf, 0, MAX_SERIALNUMBER_LENGTH);
+}
+
+
+okDLLEXPORT ok_ErrorCode DLL_ENTRY
+okFrontPanel_OpenBySerial(okFrontPanel_HANDLE hnd, const char *serial)
+{
+	okStubHandle *h = stubHandle(hnd);
+	std::lock_guard<std::mutex> guard(g_lock);
+
+	if (NULL != h->board) {
+		h->board->busy = false;
+		h->board = NULL;
+	}
+	for (int i=0; i<g_count; i++) {
+		okStubBoard *b = &g_boards[i];
+		if (b->busy)
+			continue;
+		if ((NULL == serial) || ('\0' == serial[0]) || (0 == strcmp(serial, b->serial))) {
+			b->busy = true;
+			h->board = b;
+			return(ok_NoError);
+		}
+	}
+	return(ok_DeviceNotOpen);
+}
+
+
+okDLLEXPORT Bool DLL_ENTRY okFrontPanel_IsOpen(okFrontPanel_HANDLE hnd)
+	{ return((NULL != stubHandle(hnd)->board) ? (TRUE) : (FALSE)); }
+okDLLEXPORT void DLL_ENTRY okFrontPanel_EnableAsynchronousTransfers(okFrontPanel_HANDLE /*hnd*/, Bool /*enable*/)
+	{ }
+okDLLEXPORT ok_ErrorCode DLL_ENTRY okFrontPanel_SetBTPipePollingInterval(okFrontPanel_HANDLE /*hnd*/, int /*interval*/)
+	{ return(ok_NoError); }
+okDLLEXPORT void DLL_ENTRY okFrontPanel_SetTimeout(okFrontPanel_HANDLE hnd, int timeout)
+	{ stubHandle(hnd)->timeout = timeout; }
+okDLLEXPORT int DLL_ENTRY okFrontPanel_GetDeviceMajorVersion(okFrontPanel_HANDLE /*hnd*/)
+	{ return(4); }
+okDLLEXPORT int DLL_ENTRY okFrontPanel_GetDeviceMinorVersion(okFrontPanel_HANDLE /*hnd*/)
+	{ return(0); }
+
+
+okDLLEXPORT ok_ErrorCode DLL_ENTRY
+okFrontPanel_ResetFPGA(okFrontPanel_HANDLE hnd)
+{
+	okStubHandle *h = stubHandle(hnd);
+	if (NULL == h->board)
+		return(ok_DeviceNotOpen);
+	stubDelay(0);
+	std::lock_guard<std::mutex> guard(g_lock);
+	memset(h->board->wireIn, 0, sizeof(h->board->wireIn));
+	*h->board->seq = okStubSequencer();
+	return(ok_NoError);
+}
+
+
+okDLLEXPORT void DLL_ENTRY
+okFrontPanel_GetSerialNumber(okFrontPanel_HANDLE hnd, char *buf)
+{
+	okStubHandle *h = stubHandle(hnd);
+	if (NULL != h->board)
+		memcpy(buf, h->board->serial, MAX_SERIALNUMBER_LENGTH);
+	else
+		memset(buf, 0, MAX_SERIALNUMBER_LENGTH);
+}
+
+
+okDLLEXPORT void DLL_ENTRY
+okFrontPanel_GetDeviceID(okFrontPanel_HANDLE hnd, char *buf)
+{
+	okStubHandle *h = stubHandle(hnd);
+	if (NULL != h->board)
+		memcpy(buf, h->board->deviceID, MAX_DEVICEID_LENGTH);
+	else
+		memset(buf, 0, MAX_DEVICEID_LENGTH);
+}
+
+
+okDLLEXPORT void DLL_ENTRY
+okFrontPanel_SetDeviceID(okFrontPanel_HANDLE hnd, const char *strID)
+{
+	okStubHandle *h = stubHandle(hnd);
+	if (NULL == h->board)
+		return;
+	std::lock_guard<std::mutex> guard(g_lock);
+	strncpy(h->board->deviceID, strID, MAX_DEVICEID_LENGTH);
+	h->board->deviceID[MAX_DEVICEID_LENGTH] = '\0';
+}
+
+
+okDLLEXPORT ok_ErrorCode DLL_ENTRY
+okFrontPanel_ConfigureFPGA(okFrontPanel_HANDLE hnd, const char *strFilename)
+{
+	okStubHandle *h = stubHandle(hnd);
+	if (NULL == h->board)
+		return(ok_DeviceNotOpen);
+	FILE *f = fopen(strFilename, "rb");
+	if (NULL == f)
+		return(ok_FileError);
+	fclose(f);
+	stubDelay(0);
+	h->board->configured = true;
+	return(ok_NoError);
+}
+
+
+okDLLEXPORT ok_ErrorCode DLL_ENTRY
+okFrontPanel_ConfigureFPGAFromMemory(okFrontPanel_HANDLE hnd, unsigned char * /*data*/, unsigned long length)
+{
+	okStubHandle *h = stubHandle(hnd);
+	if (NULL == h->board)
+		return(ok_DeviceNotOpen);
+	stubDelay((long)length);
+	h->board->configured = true;
+	return(ok_NoError);
+}
+
+
+static ok_ErrorCode
+stubPLLCopy(okFrontPanel_HANDLE hnd, void *pll, size_t size, unsigned char *store, bool toBoard)
+{
+	okStubHandle *h = stubHandle(hnd);
+	if (NULL == h->board)
+		return(ok_DeviceNotOpen);
+	stubDelay(0);
+	std::lock_guard<std::mutex> guard(g_lock);
+	if (toBoard)
+		memcpy(store, pll, size);
+	else
+		memcpy(pll, store, size);
+	return(ok_NoError);
+}
+
+
+okDLLEXPORT ok_ErrorCode DLL_ENTRY okFrontPanel_GetPLL22150Configuration(okFrontPanel_HANDLE hnd, okPLL22150_HANDLE pll)
+	{ return(stubPLLCopy(hnd, pll, sizeof(okStubPLL22150), stubHandle(hnd)->board ? stubHandle(hnd)->board->pll22150 : NULL, false)); }
+okDLLEXPORT ok_ErrorCode DLL_ENTRY okFrontPanel_SetPLL22150Configuration(okFrontPanel_HANDLE hnd, okPLL22150_HANDLE pll)
+	{ return(stubPLLCopy(hnd, pll, sizeof(okStubPLL22150), stubHandle(hnd)->board ? stubHandle(hnd)->board->pll22150 : NULL, true)); }
+okDLLEXPORT ok_ErrorCode DLL_ENTRY okFrontPanel_GetEepromPLL22150Configuration(okFrontPanel_HANDLE hnd, okPLL22150_HANDLE pll)
+	{ return(stubPLLCopy(hnd, pll, sizeof(okStubPLL22150), stubHandle(hnd)->board ? stubHandle(hnd)->board->eeprom22150 : NULL, false)); }
+okDLLEXPORT ok_ErrorCode DLL_ENTRY okFrontPanel_SetEepromPLL22150Configuration(okFrontPanel_HANDLE hnd, okPLL22150_HANDLE pll)
+	{ return(stubPLLCopy(hnd, pll, sizeof(okStubPLL22150), stubHandle(hnd)->board ? stubHandle(hnd)->board->eeprom22150 : NULL, true)); }
+okDLLEXPORT ok_ErrorCode DLL_ENTRY okFrontPanel_GetPLL22393Configuration(okFrontPanel_HANDLE hnd, okPLL22393_HANDLE pll)
+	{ return(stubPLLCopy(hnd, pll, sizeof(okStubPLL22393), stubHandle(hnd)->board ? stubHandle(hnd)->board->pll22393 : NULL, false)); }
+okDLLEXPORT ok_ErrorCode DLL_ENTRY okFrontPanel_SetPLL22393Configuration(okFrontPanel_HANDLE hnd, okPLL22393_HANDLE pll)
+	{ return(stubPLLCopy(hnd, pll, sizeof(okStubPLL22393), stubHandle(hnd)->board ? stubHandle(hnd)->board->pll22393 : NULL, true)); }
+okDLLEXPORT ok_ErrorCode DLL_ENTRY okFrontPanel_GetEepromPLL22393Configuration(okFrontPanel_HANDLE hnd, okPLL22393_HANDLE pll)
+	{ return(stubPLLCopy(hnd, pll, sizeof(okStubPLL22393), stubHandle(hnd)->board ? stubHandle(hnd)->board->eeprom22393 : NULL, false)); }
+okDLLEXPORT ok_ErrorCode DLL_ENTRY okFrontPanel_SetEepromPLL22393Configuration(okFrontPanel_HANDLE hnd, okPLL22393_HANDLE pll)
+	{ return(stubPLLCopy(hnd, pll, sizeof(okStubPLL22393), stubHandle(hnd)->board ? stubHandle(hnd)->board->eeprom22393 : NULL, true)); }
+
+
+okDLLEXPORT ok_ErrorCode DLL_ENTRY
+okFrontPanel_LoadDefaultPLLConfiguration(okFrontPanel_HANDLE hnd)
+{
+	okStubHandle *h = stubHandle(hnd);
+	if (NULL == h->board)
+		return(ok_DeviceNotOpen);
+	stubDelay(0);
+	std::lock_guard<std::mutex> guard(g_lock);
+	memcpy(h->board->pll22393, h->board->eeprom22393, okStub_PLL_INFO);
+	memcpy(h->board->pll22150, h->board->eeprom22150, okStub_PLL_INFO);
+	return(ok_NoError);
+}
+
+
+okDLLEXPORT Bool DLL_ENTRY okFrontPanel_IsFrontPanelEnabled(okFrontPanel_HANDLE hnd)
+	{ return((NULL != stubHandle(hnd)->board) && stubHandle(hnd)->board->configured); }
+okDLLEXPORT Bool DLL_ENTRY okFrontPanel_IsFrontPanel3Supported(okFrontPanel_HANDLE /*hnd*/)
+	{ return(TRUE); }
+
+
+okDLLEXPORT void DLL_ENTRY
+okFrontPanel_UpdateWireIns(okFrontPanel_HANDLE hnd)
+{
+	okStubHandle *h = stubHandle(hnd);
+	if (NULL == h->board)
+		return;
+	stubDelay(0);
+	std::lock_guard<std::mutex> guard(g_lock);
+	for (int i=0; i<okStub_WIRES; i++) {
+		h->board->wireIn[i] = (h->board->wireIn[i] & ~h->wireInMask[i]) | (h->wireIn[i] & h->wireInMask[i]);
+		h->wireInMask[i] = 0;
+	}
+}
+
+
+okDLLEXPORT ok_ErrorCode DLL_ENTRY
+okFrontPanel_SetWireInValue(okFrontPanel_HANDLE hnd, int ep, unsigned long val, unsigned long mask)
+{
+	okStubHandle *h = stubHandle(hnd);
+	if ((ep < 0) || (ep >= okStub_WIRES))
+		return(ok_InvalidEndpoint);
+	h->wireIn[ep] = (h->wireIn[ep] & ~mask) | (val & mask);
+	h->wireInMask[ep] |= mask;
+	return(ok_NoError);
+}
+
+
+okDLLEXPORT void DLL_ENTRY
+okFrontPanel_UpdateWireOuts(okFrontPanel_HANDLE hnd)
+{
+	okStubHandle *h = stubHandle(hnd);
+	if (NULL == h->board)
+		return;
+	stubDelay(0);
+	std::lock_guard<std::mutex> guard(g_lock);
+	for (int i=0; i<okStub_WIRES; i++)
+		h->wireOut[i] = h->board->wireIn[i] & 0xffff;
+	h->wireOut[okStub_EP_CRC_LOW - 0x20] = h->board->uploadCrc & 0xffff;
+	h->wireOut[okStub_EP_CRC_HIGH - 0x20] = h->board->uploadCrc >> 16;
+
+	okStubSequencer *s = h->board->seq;
+	stubSeqAdvance(h->board);
+	size_t level = s->fifo.size();
+	h->wireOut[okStub_EP_FIFO_LEVEL - 0x20] = (unsigned long)level;
+	h->wireOut[okStub_EP_FIFO_FLAGS - 0x20] = ((level >= okStub_FIFO_RECORDS) ? (0x01) : (0)) |
+			((0 == level) ? (0x02) : (0)) | ((s->overflowed) ? (0x04) : (0)) |
+			((s->underflowed) ? (0x08) : (0)) | ((s->streamEnded) ? (0x10) : (0));
+	if (s->started) {
+		unsigned long samples = (unsigned long)(unsigned long long)s->masterSamples;
+		h->wireOut[okStub_EP_SAMPLES - 0x20] = samples & 0xffff;
+		h->wireOut[okStub_EP_SAMPLES + 1 - 0x20] = (samples >> 16) & 0xffff;
+		h->wireOut[okStub_EP_STATUS - 0x20] = s->status;
+		unsigned long waited = (unsigned long)(unsigned long long)s->waitedSamples;
+		h->wireOut[okStub_EP_TIMEOUTS - 0x20] = s->timeouts & 0xffff;
+		h->wireOut[okStub_EP_WAITED - 0x20] = waited & 0xffff;
+		h->wireOut[okStub_EP_WAITED + 1 - 0x20] = (waited >> 16) & 0xffff;
+	}
+}
+
+
+okDLLEXPORT unsigned long DLL_ENTRY
+okFrontPanel_GetWireOutValue(okFrontPanel_HANDLE hnd, int epAddr)
+{
+	int i = epAddr - 0x20;
+	if ((i < 0) || (i >= okStub_WIRES))
+		return(0);
+	return(stubHandle(hnd)->wireOut[i]);
+}
+
+
+okDLLEXPORT ok_ErrorCode DLL_ENTRY
+okFrontPanel_ActivateTriggerIn(okFrontPanel_HANDLE hnd, int epAddr, int bit)
+{
+	okStubHandle *h = stubHandle(hnd);
+	if (NULL == h->board)
+		return(ok_DeviceNotOpen);
+	if ((epAddr < 0x40) || (epAddr > 0x5f) || (bit < 0) || (bit > 15))
+		return(ok_InvalidEndpoint);
+	stubDelay(0);
+	std::lock_guard<std::mutex> guard(g_lock);
+	h->board->triggerCount++;
+	okStubSequencer *s = h->board->seq;
+	if ((okStub_EP_CRC_RESET == epAddr) && (0 == bit)) {
+		h->board->uploadCrc = 0;
+		s->partialLength = 0;
+		s->overflowed = false;
+	}
+	if (okStub_EP_TRIGGER == epAddr) {
+		stubSeqAdvance(h->board);
+		if ((0 == bit) && !s->running) {
+			// As in the firmware, the first record is read whether or not
+			// there is one; an empty FIFO gives a zero record, i.e. a wait.
+			s->started = true;
+			s->running = true;
+			s->streamEnded = false;
+			s->underflowed = false;
+			s->status = 0;
+			s->masterSamples = 0.0;
+			s->waitedSamples = 0.0;
+			s->timeouts = 0;
+			s->lastUpdate = stubNow();
+			if (!stubSeqNext(s)) {
+				memset(&s->current, 0, sizeof(s->current));
+				stubSeqLoad(s);
+				s->underflowed = true;
+			}
+			stubSeqAdvance(h->board);
+		}
+		else if (1 == bit) {
+			// While idle the firmware only flushes the FIFO, and only in
+			// stream mode.
+			if (s->running) {
+				s->status |= 0x02;
+				s->running = false;
+				s->fifo.clear();
+			}
+			else if (0 != (h->board->wireIn[0] & 0x04)) {
+				s->fifo.clear();
+			}
+		}
+		else if (2 == bit) {
+			s->streamEnded = true;
+		}
+	}
+	return(ok_NoError);
+}
+
+
+okDLLEXPORT void DLL_ENTRY
+okFrontPanel_UpdateTriggerOuts(okFrontPanel_HANDLE hnd)
+{
+	if (NULL != stubHandle(hnd)->board)
+		stubDelay(0);
+}
+
+
+okDLLEXPORT Bool DLL_ENTRY okFrontPanel_IsTriggered(okFrontPanel_HANDLE /*hnd*/, int /*epAddr*/, unsigned long /*mask*/)
+	{ return(FALSE); }
+okDLLEXPORT long DLL_ENTRY okFrontPanel_GetLastTransferLength(okFrontPanel_HANDLE hnd)
+	{ return(stubHandle(hnd)->lastTransfer); }
+
+
+okDLLEXPORT long DLL_ENTRY
+okFrontPanel_WriteToPipeIn(okFrontPanel_HANDLE hnd, int epAddr, long length, unsigned char *data)
+{
+	okStubHandle *h = stubHandle(hnd);
+	if (NULL == h->board)
+		return(ok_DeviceNotOpen);
+	if ((epAddr < 0x80) || (epAddr > 0x9f))
+		return(ok_InvalidEndpoint);
+	if (length % 2)
+		return(ok_DataAlignmentError);
+	stubDelay(length);
+	std::lock_guard<std::mutex> guard(g_lock);
+	h->board->pipeInBytes += length;
+	if (okStub_EP_CRC_PIPE == epAddr) {
+		// The sequencer has been running while the transfer was on the bus;
+		// the records are counted as arriving at its end.  As in the
+		// firmware, only words the FIFO takes go into the upload CRC.
+		okStubSequencer *s = h->board->seq;
+		stubSeqAdvance(h->board);
+		for (long i=0; i<length; i++) {
+			if (0 == s->partialLength)
+				s->partialDropped = (s->fifo.size() >= okStub_FIFO_RECORDS);
+			if (!s->partialDropped)
+				h->board->uploadCrc = stubCrc32c(h->board->uploadCrc, &data[i], 1);
+			s->partial[s->partialLength++] = data[i];
+			if (okStub_RECORD_SIZE == s->partialLength) {
+				s->partialLength = 0;
+				if (!s->partialDropped)
+					s->fifo.push_back(stubDecodeRecord(s->partial));
+				else
+					s->overflowed = true;
+			}
+		}
+		stubSeqAdvance(h->board);
+	}
+	h->lastTransfer = length;
+	return(length);
+}
+
+
+okDLLEXPORT long DLL_ENTRY
+okFrontPanel_ReadFromPipeOut(okFrontPanel_HANDLE hnd, int epAddr, long length, unsigned char *data)
+{
+	okStubHandle *h = stubHandle(hnd);
+	if (NULL == h->board)
+		return(ok_DeviceNotOpen);
+	if ((epAddr < 0xa0) || (epAddr > 0xbf))
+		return(ok_InvalidEndpoint);
+	if (length % 2)
+		return(ok_DataAlignmentError);
+	stubDelay(length);
+	memset(data, 0, length);
+	h->lastTransfer = length;
+	return(length);
+}
+
+
+okDLLEXPORT long DLL_ENTRY
+okFrontPanel_WriteToBlockPipeIn(okFrontPanel_HANDLE hnd, int epAddr, int blockSize, long length, unsigned char *data)
+{
+	if ((blockSize <= 0) || (length % blockSize))
+		return(ok_InvalidBlockSize);
+	return(okFrontPanel_WriteToPipeIn(hnd, epAddr, length, data));
+}
+
+
+okDLLEXPORT long DLL_ENTRY
+okFrontPanel_ReadFromBlockPipeOut(okFrontPanel_HANDLE hnd, int epAddr, int blockSize, long length, unsigned char *data)
+{
+	if ((blockSize <= 0) || (length % blockSize))
+		return(ok_InvalidBlockSize);
+	return(okFrontPanel_ReadFromPipeOut(hnd, epAddr, length, data));
+}
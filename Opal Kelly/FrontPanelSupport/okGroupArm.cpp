@@ -0,0 +1,337 @@
+//------------------------------------------------------------------------
+// okGroupArm.cpp
+//
+// See okGroupArm.h.
+//------------------------------------------------------------------------
+
+#include <string.h>
+#include <chrono>
+
+#include "okGroupArm.h"
+#include "okUploadCRC.h"
+
+
+okCGroupArm::okCGroupArm()
+	: m_armed(false), m_verifyCrc(false), m_preflight(true), m_running(false), m_fire(false),
+	  m_shotNext(0), m_shotCount(0), m_skewMax(0.0), m_skewSum(0.0), m_skewN(0)
+{
+	m_boards.reserve(okGroupArm_MAX_BOARDS);
+	m_shots.resize(okGroupArm_HISTORY);
+	okCRealtime::DefaultConfig(&m_realtime);
+	m_realtime.priority = 99;
+}
+
+
+void
+okCGroupArm::SetRealtimeConfig(const okRealtimeConfig& config)
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	m_realtime = config;
+}
+
+
+okCGroupArm::~okCGroupArm()
+{
+	stopStartThread();
+}
+
+
+int
+okCGroupArm::AddBoard(okCFrontPanel *dev)
+{
+	if ((NULL == dev) || ((int)m_boards.size() >= okGroupArm_MAX_BOARDS))
+		return(-1);
+
+	Board b;
+	b.dev = dev;
+	b.data = NULL;
+	b.length = 0;
+	b.mode = 0;
+	b.debounce = 0;
+	b.verifyCrc = false;
+	b.preflight = false;
+	memset(&b.stats, 0, sizeof(b.stats));
+	b.stats.firstBadRecord = -1;
+	b.armResult = okCFrontPanel::NoError;
+	m_boards.push_back(b);
+	m_armed = false;
+	return((int)m_boards.size() - 1);
+}
+
+
+void
+okCGroupArm::ClearBoards()
+{
+	m_boards.clear();
+	m_armed = false;
+}
+
+
+void
+okCGroupArm::SetUpload(int board, const unsigned char *data, long length, unsigned int mode, unsigned int debounce)
+{
+	if ((board < 0) || (board >= (int)m_boards.size()))
+		return;
+	m_boards[board].data = data;
+	m_boards[board].length = length;
+	m_boards[board].mode = mode;
+	m_boards[board].debounce = debounce;
+}
+
+
+void
+okCGroupArm::armBoard(Board *b)
+{
+	okCFrontPanel *dev = b->dev;
+	okCFrontPanel::ErrorCode err;
+
+	if (b->preflight && (b->length > 0)) {
+		if (!okCSegmentDecoder::Validate(b->data, b->length, 0.0, &b->stats)) {
+			b->armResult = okCFrontPanel::Failed;
+			return;
+		}
+	}
+
+	err = dev->ActivateTriggerIn(okGroupArm_EP_TRIGGER, okGroupArm_BIT_ABORT);
+	if (okCFrontPanel::NoError == err)
+		err = dev->SetWireInValue(okGroupArm_EP_MODE, b->mode);
+	if (okCFrontPanel::NoError == err)
+		err = dev->SetWireInValue(okGroupArm_EP_DEBOUNCE, b->debounce);
+	if (okCFrontPanel::NoError == err) {
+		dev->UpdateWireIns();
+		if (!dev->IsOpen())
+			err = okCFrontPanel::DeviceNotOpen;
+	}
+	if ((okCFrontPanel::NoError == err) && b->verifyCrc)
+		err = okCUploadCRC::ResetDevice(dev);
+	if ((okCFrontPanel::NoError == err) && (b->length > 0)) {
+		long xfered = dev->WriteToPipeIn(okGroupArm_EP_SEGMENTS, b->length, (unsigned char *)b->data);
+		if (xfered < 0)
+			err = (okCFrontPanel::ErrorCode)xfered;
+		else if (xfered != b->length)
+			err = okCFrontPanel::Failed;
+	}
+	if ((okCFrontPanel::NoError == err) && b->verifyCrc)
+		err = okCUploadCRC::VerifyDevice(dev, okCUploadCRC::Compute(b->data, (b->length > 0) ? (b->length) : (0)));
+	b->armResult = err;
+}
+
+
+okCFrontPanel::ErrorCode
+okCGroupArm::Arm()
+{
+	m_armed = false;
+	if (m_boards.empty())
+		return(okCFrontPanel::Failed);
+
+	// The calling thread takes the first board itself.
+	for (size_t i=0; i<m_boards.size(); i++) {
+		m_boards[i].verifyCrc = m_verifyCrc;
+		m_boards[i].preflight = m_preflight;
+	}
+
+	std::vector<std::thread> workers;
+	workers.reserve(m_boards.size() - 1);
+	for (size_t i=1; i<m_boards.size(); i++)
+		workers.push_back(std::thread(armBoard, &m_boards[i]));
+	armBoard(&m_boards[0]);
+	for (size_t i=0; i<workers.size(); i++)
+		workers[i].join();
+
+	for (size_t i=0; i<m_boards.size(); i++) {
+		if (okCFrontPanel::NoError != m_boards[i].armResult)
+			return(m_boards[i].armResult);
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		if (!m_running) {
+			m_running = true;
+			m_thread = std::thread(&okCGroupArm::startThread, this);
+		}
+	}
+	m_armed = true;
+	return(okCFrontPanel::NoError);
+}
+
+
+okCFrontPanel::ErrorCode
+okCGroupArm::GetArmResult(int board) const
+{
+	if ((board < 0) || (board >= (int)m_boards.size()))
+		return(okCFrontPanel::Failed);
+	return(m_boards[board].armResult);
+}
+
+
+bool
+okCGroupArm::GetUploadStats(int board, okSegmentStats *stats) const
+{
+	if ((board < 0) || (board >= (int)m_boards.size()) || (NULL == stats))
+		return(false);
+	*stats = m_boards[board].stats;
+	return(true);
+}
+
+
+okCFrontPanel::ErrorCode
+okCGroupArm::Start()
+{
+	if (!m_armed)
+		return(okCFrontPanel::Failed);
+	m_armed = false;
+
+	std::unique_lock<std::mutex> lock(m_lock);
+	m_fire = true;
+	m_wake.notify_all();
+	while (m_fire)
+		m_done.wait(lock);
+
+	int last = (m_shotNext + okGroupArm_HISTORY - 1) % okGroupArm_HISTORY;
+	return(m_shots[last].result);
+}
+
+
+okCFrontPanel::ErrorCode
+okCGroupArm::Abort()
+{
+	okCFrontPanel::ErrorCode first = okCFrontPanel::NoError;
+
+	m_armed = false;
+	for (size_t i=0; i<m_boards.size(); i++) {
+		okCFrontPanel::ErrorCode err = m_boards[i].dev->ActivateTriggerIn(okGroupArm_EP_TRIGGER, okGroupArm_BIT_ABORT);
+		if ((okCFrontPanel::NoError != err) && (okCFrontPanel::NoError == first))
+			first = err;
+	}
+	return(first);
+}
+
+
+void
+okCGroupArm::startThread()
+{
+	// Best effort: without the privilege the triggers still go out, just
+	// at normal priority.
+	okRealtimeConfig config;
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		config = m_realtime;
+	}
+	okCRealtime::Apply(config);
+
+	std::unique_lock<std::mutex> lock(m_lock);
+	while (true) {
+		while (m_running && !m_fire)
+			m_wake.wait(lock);
+		if (!m_running)
+			break;
+
+		lock.unlock();
+		fire();
+		lock.lock();
+
+		m_fire = false;
+		m_done.notify_all();
+	}
+}
+
+
+void
+okCGroupArm::fire()
+{
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point issue[okGroupArm_MAX_BOARDS];
+	Clock::time_point complete[okGroupArm_MAX_BOARDS];
+	okCFrontPanel::ErrorCode first = okCFrontPanel::NoError;
+	int n = (int)m_boards.size();
+
+	// Nothing but the trigger calls and clock reads in this loop.
+	for (int i=0; i<n; i++) {
+		issue[i] = Clock::now();
+		okCFrontPanel::ErrorCode err = m_boards[i].dev->ActivateTriggerIn(okGroupArm_EP_TRIGGER, okGroupArm_BIT_START);
+		complete[i] = Clock::now();
+		if ((okCFrontPanel::NoError != err) && (okCFrontPanel::NoError == first))
+			first = err;
+	}
+
+	okGroupArmShot shot;
+	memset(&shot, 0, sizeof(shot));
+	shot.boards = n;
+	shot.result = first;
+	for (int i=0; i<n; i++) {
+		shot.issueUs[i] = std::chrono::duration<double, std::micro>(issue[i] - issue[0]).count();
+		shot.completeUs[i] = std::chrono::duration<double, std::micro>(complete[i] - issue[0]).count();
+	}
+	shot.skewUs = (n > 0) ? (shot.completeUs[n-1] - shot.completeUs[0]) : (0.0);
+
+	std::lock_guard<std::mutex> guard(m_lock);
+	m_shots[m_shotNext] = shot;
+	m_shotNext = (m_shotNext + 1) % okGroupArm_HISTORY;
+	if (m_shotCount < okGroupArm_HISTORY)
+		m_shotCount++;
+	if (shot.skewUs > m_skewMax)
+		m_skewMax = shot.skewUs;
+	m_skewSum += shot.skewUs;
+	m_skewN++;
+}
+
+
+void
+okCGroupArm::stopStartThread()
+{
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		if (!m_running)
+			return;
+		m_running = false;
+		m_wake.notify_all();
+	}
+	m_thread.join();
+}
+
+
+int
+okCGroupArm::GetShotCount() const
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	return(m_shotCount);
+}
+
+
+bool
+okCGroupArm::GetShot(int index, okGroupArmShot *shot) const
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	if ((index < 0) || (index >= m_shotCount) || (NULL == shot))
+		return(false);
+	*shot = m_shots[(m_shotNext - 1 - index + 2*okGroupArm_HISTORY) % okGroupArm_HISTORY];
+	return(true);
+}
+
+
+double
+okCGroupArm::GetMaxSkewUs() const
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	return(m_skewMax);
+}
+
+
+double
+okCGroupArm::GetMeanSkewUs() const
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	return((m_skewN > 0) ? (m_skewSum / m_skewN) : (0.0));
+}
+
+
+void
+okCGroupArm::ClearShots()
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	m_shotNext = 0;
+	m_shotCount = 0;
+	m_skewMax = 0.0;
+	m_skewSum = 0.0;
+	m_skewN = 0;
+}
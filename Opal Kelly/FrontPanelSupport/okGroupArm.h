@@ -0,0 +1,157 @@
+//------------------------------------------------------------------------
+// okGroupArm.h
+//
+// Arms and starts several variable timebase boards (AvivFPGA2 firmware)
+// as one group.  Arm() runs the per-board sequence that FpgaTimebaseTask
+// does today -- abort trigger, mode / debounce wire-ins, segment pipe
+// upload -- on all boards in parallel and returns once every board has
+// taken its full upload.  Start() then fires the software start triggers
+// back to back from a single thread, configured through okCRealtime and
+// created at Arm() time, so no thread start-up sits between the first and
+// the last trigger.
+//
+// Each Start() records the host-side issue / completion time of every
+// trigger.  The skew of a shot is the time from the first trigger call
+// returning to the last one returning, which bounds the inter-board start
+// offset as seen from the host.
+//
+// With SetVerifyCRC(true), every upload is checked against the firmware's
+// CRC-32C of what reached the segment FIFO (see okUploadCRC.h); a mismatch
+// fails Arm() with okCFrontPanel::Failed.
+//
+// Every upload is also run through okCSegmentDecoder::Validate() before
+// the board is touched; a malformed one fails Arm() with
+// okCFrontPanel::Failed and GetUploadStats() tells why.
+//------------------------------------------------------------------------
+
+#ifndef __okGroupArm_h__
+#define __okGroupArm_h__
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "okFrontPanelDLL.h"
+#include "okRealtime.h"
+#include "okSegmentDecoder.h"
+
+// AvivFPGA2 endpoints
+#define okGroupArm_EP_MODE          0x00     // wire-in: bit 0 external start, bit 1 RF modulation
+#define okGroupArm_EP_DEBOUNCE      0x01     // wire-in: retrigger debounce samples
+#define okGroupArm_EP_TRIGGER       0x40     // trigger-in
+#define okGroupArm_EP_SEGMENTS      0x80     // pipe-in
+#define okGroupArm_BIT_START        0
+#define okGroupArm_BIT_ABORT        1
+
+#define okGroupArm_MAX_BOARDS       16
+#define okGroupArm_HISTORY          256      // shots kept for GetShot()
+
+// Host-side timing of one Start(), in microseconds relative to the first
+// trigger being issued.
+typedef struct {
+	int boards;
+	okCFrontPanel::ErrorCode result;
+	double issueUs[okGroupArm_MAX_BOARDS];
+	double completeUs[okGroupArm_MAX_BOARDS];
+	double skewUs;
+} okGroupArmShot;
+
+
+//------------------------------------------------------------------------
+// okCGroupArm
+//------------------------------------------------------------------------
+class okCGroupArm
+{
+public:
+	okCGroupArm();
+	~okCGroupArm();
+
+	// Boards are started in the order they were added.  Returns the board
+	// index, or -1 when the group is full.  dev must stay valid for the
+	// lifetime of the group.
+	int AddBoard(okCFrontPanel *dev);
+	void ClearBoards();
+	int GetBoardCount() const
+		{ return((int)m_boards.size()); }
+
+	// data is not copied and must stay valid until Arm() returns.
+	void SetUpload(int board, const unsigned char *data, long length, unsigned int mode, unsigned int debounce);
+
+	// Uploads to every board in parallel.  Returns the first board's error,
+	// see GetArmResult() for each board.  Start() is refused until an Arm()
+	// has succeeded.
+	okCFrontPanel::ErrorCode Arm();
+	okCFrontPanel::ErrorCode GetArmResult(int board) const;
+
+	// Off by default: firmware built before the upload CRC reads back 0.
+	void SetVerifyCRC(bool verify)
+		{ m_verifyCrc = verify; }
+	// On by default.
+	void SetPreflight(bool check)
+		{ m_preflight = check; }
+	// Preflight result of the board's last Arm(): expected master samples
+	// and clock edges, or the reason for a rejection.  The durations are 0
+	// (the group does not know the master clock period).
+	bool GetUploadStats(int board, okSegmentStats *stats) const;
+
+	// Scheduling of the start thread, applied when it is created by the
+	// first successful Arm().  Default: highest SCHED_FIFO priority, no
+	// affinity, no memory locking.
+	void SetRealtimeConfig(const okRealtimeConfig& config);
+
+	// Fires the start triggers and blocks until all have been sent.
+	okCFrontPanel::ErrorCode Start();
+	// Sends the abort trigger to every board; also disarms the group.
+	okCFrontPanel::ErrorCode Abort();
+
+	// Shot history, most recent first (index 0).
+	int GetShotCount() const;
+	bool GetShot(int index, okGroupArmShot *shot) const;
+	double GetMaxSkewUs() const;
+	double GetMeanSkewUs() const;
+	void ClearShots();
+
+private:
+	struct Board {
+		okCFrontPanel *dev;
+		const unsigned char *data;
+		long length;
+		unsigned int mode;
+		unsigned int debounce;
+		bool verifyCrc;
+		bool preflight;
+		okSegmentStats stats;
+		okCFrontPanel::ErrorCode armResult;
+	};
+
+	static void armBoard(Board *board);
+	void startThread();
+	void fire();
+	void stopStartThread();
+
+	std::vector<Board> m_boards;
+	bool m_armed;
+	bool m_verifyCrc;
+	bool m_preflight;
+
+	okRealtimeConfig m_realtime;
+	std::thread m_thread;
+	mutable std::mutex m_lock;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+	bool m_running;
+	bool m_fire;
+
+	std::vector<okGroupArmShot> m_shots;     // ring of okGroupArm_HISTORY
+	int m_shotNext;
+	int m_shotCount;
+	double m_skewMax;
+	double m_skewSum;
+	long m_skewN;
+
+	okCGroupArm(const okCGroupArm&);
+	okCGroupArm& operator=(const okCGroupArm&);
+};
+
+#endif // __okGroupArm_h__
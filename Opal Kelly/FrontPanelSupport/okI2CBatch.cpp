@@ -0,0 +1,263 @@
+//------------------------------------------------------------------------
+// okI2CBatch.cpp
+//
+// See okI2CBatch.h.
+//
+// The FrontPanel firmware executes exactly one I2C transfer per WriteI2C /
+// ReadI2C call, so "one batch" on the wire means as few of those calls as
+// the register layout allows, issued back to back without giving up the
+// device in between.
+//------------------------------------------------------------------------
+
+#include <string.h>
+
+#include "okI2CBatch.h"
+#include "okDevicePool.h"
+
+
+okCI2CBatch::okCI2CBatch()
+	: m_maxTransfer(okI2CBatch_DEFAULT_MAX_TRANSFER), m_stopOnError(true),
+	  m_failed(-1), m_errors(0), m_transactions(0)
+{
+	memset(m_autoIncrement, 0, sizeof(m_autoIncrement));
+}
+
+
+void
+okCI2CBatch::SetAutoIncrement(int addr, bool enable)
+{
+	if ((addr >= 0) && (addr < 2*okI2CBatch_MAX_ADDRESSES))
+		m_autoIncrement[addr >> 1] = enable;
+}
+
+
+void
+okCI2CBatch::SetMaxTransfer(int bytes)
+	{ m_maxTransfer = (bytes > 1) ? (bytes) : (1); }
+
+
+void
+okCI2CBatch::SetStopOnError(bool stop)
+	{ m_stopOnError = stop; }
+
+
+void
+okCI2CBatch::Clear()
+{
+	m_ops.clear();
+	m_data.clear();
+	m_failed = -1;
+	m_errors = 0;
+	m_transactions = 0;
+}
+
+
+int
+okCI2CBatch::queue(OpKind kind, int addr, int reg, int length, const unsigned char *data, unsigned char *buf)
+{
+	if ((addr < 0) || (addr >= 2*okI2CBatch_MAX_ADDRESSES) || (length <= 0))
+		return(-1);
+	if (((OpWriteRegister == kind) || (OpReadRegister == kind)) && ((reg < 0) || (reg > 0xff)))
+		return(-1);
+
+	Op op;
+	op.kind = kind;
+	op.addr = addr;
+	op.reg = reg;
+	op.length = length;
+	op.offset = (int)m_data.size();
+	op.buf = buf;
+	op.result = okCFrontPanel::NoError;
+	if (NULL != data)
+		m_data.insert(m_data.end(), data, data + length);
+	m_ops.push_back(op);
+	return((int)m_ops.size() - 1);
+}
+
+
+int
+okCI2CBatch::Write(int addr, const unsigned char *data, int length)
+	{ return(queue(OpWrite, addr, -1, length, data, NULL)); }
+
+
+int
+okCI2CBatch::Read(int addr, unsigned char *buf, int length)
+	{ return(queue(OpRead, addr, -1, length, NULL, buf)); }
+
+
+int
+okCI2CBatch::WriteRegister(int addr, int reg, const unsigned char *data, int length)
+	{ return(queue(OpWriteRegister, addr, reg, length, data, NULL)); }
+
+
+int
+okCI2CBatch::WriteRegister(int addr, int reg, unsigned char value)
+	{ return(queue(OpWriteRegister, addr, reg, 1, &value, NULL)); }
+
+
+int
+okCI2CBatch::ReadRegister(int addr, int reg, unsigned char *buf, int length)
+	{ return(queue(OpReadRegister, addr, reg, length, NULL, buf)); }
+
+
+okCFrontPanel::ErrorCode
+okCI2CBatch::GetResult(int index) const
+{
+	if ((index < 0) || (index >= (int)m_ops.size()))
+		return(okCFrontPanel::Failed);
+	return(m_ops[index].result);
+}
+
+
+// runLength is the payload already collected for the run, excluding the
+// register byte.
+bool
+okCI2CBatch::mergeable(const Op& prev, const Op& next, int runLength) const
+{
+	if ((prev.kind != next.kind) || (prev.addr != next.addr))
+		return(false);
+	if ((OpWriteRegister != next.kind) && (OpReadRegister != next.kind))
+		return(false);
+	if (!m_autoIncrement[next.addr >> 1])
+		return(false);
+	if (next.reg != prev.reg + prev.length)
+		return(false);
+	return(1 + runLength + next.length <= m_maxTransfer);
+}
+
+
+int
+okCI2CBatch::runEnd(size_t first) const
+{
+	size_t last = first + 1;
+	int runLength = m_ops[first].length;
+	while ((last < m_ops.size()) && mergeable(m_ops[last-1], m_ops[last], runLength)) {
+		runLength += m_ops[last].length;
+		last++;
+	}
+	return((int)last);
+}
+
+
+okCFrontPanel::ErrorCode
+okCI2CBatch::runWrite(okCFrontPanel *dev, size_t first, size_t last)
+{
+	const Op& op = m_ops[first];
+
+	if (OpWrite == op.kind) {
+		m_transactions++;
+		return(dev->WriteI2C(op.addr, op.length, &m_data[op.offset]));
+	}
+
+	m_xfer.clear();
+	m_xfer.push_back((unsigned char)op.reg);
+	for (size_t i=first; i<last; i++)
+		m_xfer.insert(m_xfer.end(), m_data.begin() + m_ops[i].offset,
+		              m_data.begin() + m_ops[i].offset + m_ops[i].length);
+	m_transactions++;
+	return(dev->WriteI2C(op.addr, (int)m_xfer.size(), &m_xfer[0]));
+}
+
+
+okCFrontPanel::ErrorCode
+okCI2CBatch::runRead(okCFrontPanel *dev, size_t first, size_t last)
+{
+	const Op& op = m_ops[first];
+
+	if (OpRead == op.kind) {
+		m_transactions++;
+		return(dev->ReadI2C(op.addr, op.length, op.buf));
+	}
+
+	unsigned char reg = (unsigned char)op.reg;
+	m_transactions++;
+	okCFrontPanel::ErrorCode err = dev->WriteI2C(op.addr, 1, &reg);
+	if (okCFrontPanel::NoError != err)
+		return(err);
+
+	if (last - first == 1) {
+		m_transactions++;
+		return(dev->ReadI2C(op.addr, op.length, op.buf));
+	}
+
+	int total = 0;
+	for (size_t i=first; i<last; i++)
+		total += m_ops[i].length;
+	m_xfer.resize(total);
+	m_transactions++;
+	err = dev->ReadI2C(op.addr, total, &m_xfer[0]);
+	if (okCFrontPanel::NoError != err)
+		return(err);
+
+	int pos = 0;
+	for (size_t i=first; i<last; i++) {
+		memcpy(m_ops[i].buf, &m_xfer[pos], m_ops[i].length);
+		pos += m_ops[i].length;
+	}
+	return(okCFrontPanel::NoError);
+}
+
+
+void
+okCI2CBatch::finish(size_t first, size_t last, okCFrontPanel::ErrorCode err)
+{
+	for (size_t i=first; i<last; i++)
+		m_ops[i].result = err;
+	if (okCFrontPanel::NoError != err) {
+		m_errors += (int)(last - first);
+		if (m_failed < 0)
+			m_failed = (int)first;
+	}
+}
+
+
+okCFrontPanel::ErrorCode
+okCI2CBatch::Submit(okCFrontPanel *dev)
+{
+	okCFrontPanel::ErrorCode first = okCFrontPanel::NoError;
+
+	m_failed = -1;
+	m_errors = 0;
+	m_transactions = 0;
+
+	size_t i = 0;
+	while (i < m_ops.size()) {
+		size_t last = runEnd(i);
+		okCFrontPanel::ErrorCode err;
+		if ((OpWrite == m_ops[i].kind) || (OpWriteRegister == m_ops[i].kind))
+			err = runWrite(dev, i, last);
+		else
+			err = runRead(dev, i, last);
+		finish(i, last, err);
+		i = last;
+
+		if (okCFrontPanel::NoError != err) {
+			if (okCFrontPanel::NoError == first)
+				first = err;
+			// No point carrying on against a board that has gone away.
+			if (m_stopOnError || okCDevicePool::IsDisconnectError(err))
+				break;
+		}
+	}
+
+	// Operations skipped after the failure count as errors too.
+	finish(i, m_ops.size(), okCFrontPanel::Failed);
+	return(first);
+}
+
+
+okCFrontPanel::ErrorCode
+okCI2CBatch::Submit(okCDevicePool *pool, int handle)
+{
+	okCFrontPanel *dev = pool->Lock(handle);
+	if (NULL == dev) {
+		m_failed = -1;
+		m_errors = 0;
+		m_transactions = 0;
+		finish(0, m_ops.size(), okCFrontPanel::DeviceNotOpen);
+		return(okCFrontPanel::DeviceNotOpen);
+	}
+	okCFrontPanel::ErrorCode err = Submit(dev);
+	pool->Unlock(handle, err);
+	return(err);
+}
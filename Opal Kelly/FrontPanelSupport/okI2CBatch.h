@@ -0,0 +1,124 @@
+//------------------------------------------------------------------------
+// okI2CBatch.h
+//
+// Queues I2C writes and reads to any number of bus addresses and submits
+// them together.  On Submit() the queue is coalesced before anything goes
+// out on USB:
+//
+//  - consecutive register writes to the same address whose registers are
+//    contiguous become one WriteI2C (register pointer + all data bytes),
+//  - consecutive register reads to the same address whose registers are
+//    contiguous become one pointer write + one ReadI2C, scattered back into
+//    the callers' buffers,
+//
+// for addresses marked with SetAutoIncrement() (most PLLs, EEPROMs and
+// codecs auto-increment their register pointer; the merge is opt-in since
+// some parts do not).  The whole batch runs under a single okCDevicePool
+// lock when submitted through the pool.
+//
+// Every queued operation gets its own result code; Submit() returns the
+// first error and GetFailedIndex() says which operation produced it.
+//
+//    okCI2CBatch batch;
+//    batch.SetAutoIncrement(0xd2, true);
+//    batch.WriteRegister(0xd2, 0x40, cfg, 3);
+//    batch.WriteRegister(0xd2, 0x43, cfg+3, 5);     // merged with the above
+//    batch.ReadRegister(0xa0, 0x00, id, 8);
+//    err = batch.Submit(dev);
+//------------------------------------------------------------------------
+
+#ifndef __okI2CBatch_h__
+#define __okI2CBatch_h__
+
+#include <vector>
+
+#include "okFrontPanelDLL.h"
+
+class okCDevicePool;
+
+// Largest payload (including the register byte) handed to one WriteI2C /
+// ReadI2C.  Merged transfers are split at this size.
+#define okI2CBatch_DEFAULT_MAX_TRANSFER   64
+#define okI2CBatch_MAX_ADDRESSES          128
+
+
+//------------------------------------------------------------------------
+// okCI2CBatch
+//------------------------------------------------------------------------
+class okCI2CBatch
+{
+public:
+	okCI2CBatch();
+
+	// addr is the 8-bit bus address as taken by okCFrontPanel::WriteI2C.
+	void SetAutoIncrement(int addr, bool enable);
+	void SetMaxTransfer(int bytes);
+	// Keep going after a failed operation (default: stop, and report the
+	// remaining operations as Failed).
+	void SetStopOnError(bool stop);
+
+	// Raw transfers; never merged.  data is copied, buf is filled on Submit().
+	int Write(int addr, const unsigned char *data, int length);
+	int Read(int addr, unsigned char *buf, int length);
+
+	// Register transfers: the register pointer is written first.
+	int WriteRegister(int addr, int reg, const unsigned char *data, int length);
+	int WriteRegister(int addr, int reg, unsigned char value);
+	int ReadRegister(int addr, int reg, unsigned char *buf, int length);
+
+	// Drops all queued operations and results; buffers keep their capacity.
+	void Clear();
+	int GetCount() const
+		{ return((int)m_ops.size()); }
+
+	okCFrontPanel::ErrorCode Submit(okCFrontPanel *dev);
+	okCFrontPanel::ErrorCode Submit(okCDevicePool *pool, int handle);
+
+	// Results of the last Submit().
+	okCFrontPanel::ErrorCode GetResult(int index) const;
+	int GetFailedIndex() const
+		{ return(m_failed); }
+	// Operations that failed or were skipped after a failure.
+	int GetErrorCount() const
+		{ return(m_errors); }
+	// USB transactions (WriteI2C + ReadI2C calls) used by the last Submit().
+	int GetTransactionCount() const
+		{ return(m_transactions); }
+
+private:
+	enum OpKind {
+		OpWrite         = 0,
+		OpRead          = 1,
+		OpWriteRegister = 2,
+		OpReadRegister  = 3
+	};
+
+	struct Op {
+		OpKind kind;
+		int addr;
+		int reg;
+		int length;
+		int offset;                  // into m_data, writes only
+		unsigned char *buf;          // reads only
+		okCFrontPanel::ErrorCode result;
+	};
+
+	int queue(OpKind kind, int addr, int reg, int length, const unsigned char *data, unsigned char *buf);
+	bool mergeable(const Op& prev, const Op& next, int runLength) const;
+	int runEnd(size_t first) const;
+	okCFrontPanel::ErrorCode runWrite(okCFrontPanel *dev, size_t first, size_t last);
+	okCFrontPanel::ErrorCode runRead(okCFrontPanel *dev, size_t first, size_t last);
+	void finish(size_t first, size_t last, okCFrontPanel::ErrorCode err);
+
+	std::vector<Op> m_ops;
+	std::vector<unsigned char> m_data;
+	std::vector<unsigned char> m_xfer;
+	bool m_autoIncrement[okI2CBatch_MAX_ADDRESSES];
+	int m_maxTransfer;
+	bool m_stopOnError;
+	int m_failed;
+	int m_errors;
+	int m_transactions;
+};
+
+#endif // __okI2CBatch_h__
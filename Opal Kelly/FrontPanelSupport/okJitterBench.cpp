@@ -0,0 +1,332 @@
+//------------------------------------------------------------------------
+// okJitterBench.cpp
+//
+// Host timing-jitter benchmark for the trigger and poll paths.  Build this
+// file as its own executable together with okFrontPanelDLL.cpp and
+// okRealtime.cpp.
+//
+// Repeatedly times ActivateTriggerIn, UpdateWireOuts and a short
+// WriteToPipeIn, optionally under synthetic CPU, memory and disk load, once
+// per thread configuration, and prints p50 / p99 / p99.9 / max per call.
+// Runs against real boards or against the stand-in library
+// (okFrontPanelStub.cpp) with -l.
+//
+//    okJitterBench [-l lib] [-s serial] [-n count] [-p pipeBytes]
+//                  [-w pipeEp] [-t trigEp:bit] [-C cpuThreads]
+//                  [-M memThreads] [-D dir] [-T cpu:prio:lock ...] [-o csv]
+//
+// -T may be repeated; each entry is one thread configuration
+// (okRealtimeConfig fields, e.g. "-T -1:0:0 -T 2:80:1").  The default is a
+// single unconfigured run.
+//
+// The default trigger is 0x40 bit 1 (abort on AvivFPGA2), which is
+// harmless on an idle board.  Pipe writes land in the segment FIFO, so
+// reload the bitfile or abort before the next real shot.
+//------------------------------------------------------------------------
+
+#if !defined(_WIN32)
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "okFrontPanelDLL.h"
+#include "okRealtime.h"
+
+#define okJitterBench_WARMUP     100
+#define okJitterBench_MEM_BYTES  (64*1024*1024)
+#define okJitterBench_DISK_CHUNK (4*1024*1024)
+
+enum okJitterCall {
+	okJitterCall_Trigger        = 0,
+	okJitterCall_UpdateWireOuts = 1,
+	okJitterCall_PipeIn         = 2,
+	okJitterCall_Count          = 3
+};
+
+static const char *okJitterCallNames[okJitterCall_Count] = {
+	"ActivateTriggerIn", "UpdateWireOuts", "WriteToPipeIn"
+};
+
+struct okJitterOptions {
+	std::string lib;
+	std::string serial;
+	int count;
+	int pipeBytes;
+	int pipeEp;
+	int trigEp;
+	int trigBit;
+	int cpuThreads;
+	int memThreads;
+	std::string diskDir;
+	std::vector<okRealtimeConfig> configs;
+	std::string csv;
+};
+
+static std::atomic<bool> g_loadRunning(false);
+
+
+//------------------------------------------------------------------------
+// Background load
+//------------------------------------------------------------------------
+static void
+cpuLoad()
+{
+	volatile double x = 1.0;
+	while (g_loadRunning)
+		for (int i=0; i<100000; i++)
+			x = x * 1.0000001 + 0.0000001;
+}
+
+
+static void
+memLoad()
+{
+	std::vector<unsigned char> a(okJitterBench_MEM_BYTES / 2, 1);
+	std::vector<unsigned char> b(okJitterBench_MEM_BYTES / 2, 2);
+	while (g_loadRunning) {
+		memcpy(&a[0], &b[0], a.size());
+		memcpy(&b[0], &a[0], b.size());
+	}
+}
+
+
+static void
+diskLoad(std::string dir)
+{
+	std::string path = dir + "/okJitterBench.tmp";
+	std::vector<unsigned char> chunk(okJitterBench_DISK_CHUNK, 0x5a);
+	int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		fprintf(stderr, "Disk load: cannot open %s\n", path.c_str());
+		return;
+	}
+	unlink(path.c_str());
+	int n = 0;
+	while (g_loadRunning) {
+		if (write(fd, &chunk[0], chunk.size()) < 0)
+			break;
+		fsync(fd);
+		// Keep the file bounded.
+		if (++n == 64) {
+			n = 0;
+			if (0 != ftruncate(fd, 0) || lseek(fd, 0, SEEK_SET) < 0)
+				break;
+		}
+	}
+	close(fd);
+}
+
+
+//------------------------------------------------------------------------
+// Measurement
+//------------------------------------------------------------------------
+static bool
+callOnce(okCFrontPanel *dev, const okJitterOptions& opt, int call, unsigned char *pipe)
+{
+	switch (call) {
+		case okJitterCall_Trigger:
+			return(okCFrontPanel::NoError == dev->ActivateTriggerIn(opt.trigEp, opt.trigBit));
+		case okJitterCall_UpdateWireOuts:
+			dev->UpdateWireOuts();
+			return(dev->IsOpen());
+		case okJitterCall_PipeIn:
+			return(opt.pipeBytes == dev->WriteToPipeIn(opt.pipeEp, opt.pipeBytes, pipe));
+	}
+	return(false);
+}
+
+
+static void
+measure(okCFrontPanel *dev, const okJitterOptions& opt, const okRealtimeConfig& config,
+		int *applied, std::vector<double> samples[okJitterCall_Count], int errors[okJitterCall_Count])
+{
+	typedef std::chrono::steady_clock Clock;
+	std::vector<unsigned char> pipe(opt.pipeBytes, 0);
+
+	*applied = okCRealtime::Apply(config);
+	for (int call=0; call<okJitterCall_Count; call++) {
+		samples[call].clear();
+		samples[call].reserve(opt.count);
+		errors[call] = 0;
+
+		for (int i=0; i<okJitterBench_WARMUP; i++)
+			callOnce(dev, opt, call, &pipe[0]);
+		for (int i=0; i<opt.count; i++) {
+			Clock::time_point t0 = Clock::now();
+			bool ok = callOnce(dev, opt, call, &pipe[0]);
+			Clock::time_point t1 = Clock::now();
+			if (!ok)
+				errors[call]++;
+			samples[call].push_back(std::chrono::duration<double, std::micro>(t1 - t0).count());
+		}
+	}
+}
+
+
+static bool
+parseConfig(const char *arg, okRealtimeConfig *config)
+{
+	okCRealtime::DefaultConfig(config);
+	return(3 == sscanf(arg, "%d:%d:%d", &config->cpu, &config->priority, &config->lockMemory));
+}
+
+
+static void
+usage(const char *argv0)
+{
+	fprintf(stderr, "usage: %s [-l lib] [-s serial] [-n count] [-p pipeBytes] [-w pipeEp] [-t trigEp:bit]\n"
+		"       [-C cpuThreads] [-M memThreads] [-D dir] [-T cpu:prio:lock ...] [-o csv]\n", argv0);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	okJitterOptions opt;
+	opt.count = 10000;
+	opt.pipeBytes = 64;
+	opt.pipeEp = 0x80;
+	opt.trigEp = 0x40;
+	opt.trigBit = 1;
+	opt.cpuThreads = 0;
+	opt.memThreads = 0;
+
+	int c;
+	while (-1 != (c = getopt(argc, argv, "l:s:n:p:w:t:C:M:D:T:o:"))) {
+		okRealtimeConfig config;
+		switch (c) {
+			case 'l': opt.lib = optarg;                          break;
+			case 's': opt.serial = optarg;                       break;
+			case 'n': opt.count = atoi(optarg);                  break;
+			case 'p': opt.pipeBytes = atoi(optarg) & ~1;         break;
+			case 'w': opt.pipeEp = (int)strtol(optarg, NULL, 0); break;
+			case 't':
+				if (2 != sscanf(optarg, "%i:%i", &opt.trigEp, &opt.trigBit)) {
+					usage(argv[0]);
+					return(1);
+				}
+				break;
+			case 'C': opt.cpuThreads = atoi(optarg);             break;
+			case 'M': opt.memThreads = atoi(optarg);             break;
+			case 'D': opt.diskDir = optarg;                      break;
+			case 'T':
+				if (!parseConfig(optarg, &config)) {
+					usage(argv[0]);
+					return(1);
+				}
+				opt.configs.push_back(config);
+				break;
+			case 'o': opt.csv = optarg;                          break;
+			default:
+				usage(argv[0]);
+				return(1);
+		}
+	}
+	if ((opt.count <= 0) || (opt.pipeBytes <= 0)) {
+		usage(argv[0]);
+		return(1);
+	}
+	if (opt.configs.empty()) {
+		okRealtimeConfig config;
+		okCRealtime::DefaultConfig(&config);
+		config.prefaultStack = 0;
+		opt.configs.push_back(config);
+	}
+
+	if (FALSE == okFrontPanelDLL_LoadLib(opt.lib.empty() ? NULL : opt.lib.c_str())) {
+		fprintf(stderr, "Could not load FrontPanel library\n");
+		return(1);
+	}
+
+	okCFrontPanel dev;
+	if (okCFrontPanel::NoError != dev.OpenBySerial(opt.serial)) {
+		fprintf(stderr, "Could not open board '%s'\n", opt.serial.c_str());
+		return(1);
+	}
+	printf("Board %s (%s), %d samples per call, %d-byte pipe writes\n",
+		dev.GetSerialNumber().c_str(), dev.GetBoardModelString(dev.GetBoardModel()).c_str(), opt.count, opt.pipeBytes);
+	printf("Load: %d CPU, %d memory, disk %s\n\n", opt.cpuThreads, opt.memThreads,
+		opt.diskDir.empty() ? "off" : opt.diskDir.c_str());
+
+	std::vector<std::thread> load;
+	g_loadRunning = true;
+	for (int i=0; i<opt.cpuThreads; i++)
+		load.push_back(std::thread(cpuLoad));
+	for (int i=0; i<opt.memThreads; i++)
+		load.push_back(std::thread(memLoad));
+	if (!opt.diskDir.empty())
+		load.push_back(std::thread(diskLoad, opt.diskDir));
+
+	FILE *csv = NULL;
+	if (!opt.csv.empty()) {
+		csv = fopen(opt.csv.c_str(), "w");
+		if (NULL != csv)
+			fprintf(csv, "config,call,index,us\n");
+	}
+
+	printf("%-16s %-18s %8s %9s %9s %9s %9s %9s %9s %6s\n",
+		"config", "call", "n", "mean", "stddev", "p50", "p99", "p99.9", "max", "errors");
+
+	for (size_t k=0; k<opt.configs.size(); k++) {
+		const okRealtimeConfig& config = opt.configs[k];
+		std::vector<double> samples[okJitterCall_Count];
+		int errors[okJitterCall_Count];
+		int applied = 0;
+
+		// Each configuration runs on a fresh thread, so its affinity and
+		// priority do not leak into the next one.  mlockall() applies to the
+		// whole process and has to be undone explicitly.
+		std::thread t(measure, &dev, std::cref(opt), std::cref(config), &applied, samples, errors);
+		t.join();
+		if (applied & okRealtime_MEMORY_LOCKED)
+			munlockall();
+
+		char name[32];
+		snprintf(name, sizeof(name), "%d:%d:%d%s", config.cpu, config.priority, config.lockMemory,
+			(((config.cpu >= 0) && !(applied & okRealtime_AFFINITY)) ||
+			 ((config.priority > 0) && !(applied & okRealtime_PRIORITY)) ||
+			 (config.lockMemory && !(applied & okRealtime_MEMORY_LOCKED))) ? ("*") : (""));
+
+		for (int call=0; call<okJitterCall_Count; call++) {
+			std::vector<double>& s = samples[call];
+			if (NULL != csv) {
+				for (size_t i=0; i<s.size(); i++)
+					fprintf(csv, "%s,%s,%u,%.3f\n", name, okJitterCallNames[call], (unsigned)i, s[i]);
+			}
+
+			double sum = 0.0, sum2 = 0.0;
+			for (size_t i=0; i<s.size(); i++) {
+				sum += s[i];
+				sum2 += s[i] * s[i];
+			}
+			double mean = sum / s.size();
+			double var = sum2 / s.size() - mean * mean;
+			std::sort(s.begin(), s.end());
+			printf("%-16s %-18s %8u %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f %6d\n",
+				name, okJitterCallNames[call], (unsigned)s.size(), mean, sqrt((var > 0.0) ? (var) : (0.0)),
+				okCRealtime::Percentile(s, 50.0), okCRealtime::Percentile(s, 99.0), okCRealtime::Percentile(s, 99.9), s.back(), errors[call]);
+		}
+	}
+	printf("\nAll times in microseconds.  '*': some settings of that configuration\n"
+		"could not be applied (missing privileges).\n");
+
+	g_loadRunning = false;
+	for (size_t i=0; i<load.size(); i++)
+		load[i].join();
+	if (NULL != csv)
+		fclose(csv);
+	return(0);
+}
+
+#endif // !_WIN32
@@ -0,0 +1,306 @@
+//------------------------------------------------------------------------
+// okPLL22393Solver.cpp
+//
+// See okPLL22393Solver.h.
+//
+// For every Q the VCO limits bound P to a contiguous range, so the valid
+// (P, Q) space is stored as one [pmin, pmax] pair per Q.  For the default
+// 48 MHz reference that table is built at compile time; other references
+// evaluate the same constexpr functions once in the constructor.  A query
+// then only walks the dividers whose VCO frequency is in range and, for each
+// Q, rounds to the nearest legal P.
+//------------------------------------------------------------------------
+
+#include <math.h>
+#include <string.h>
+
+#include "okPLL22393Solver.h"
+
+
+namespace {
+
+struct pqRange {
+	short pmin;
+	short pmax;
+};
+
+struct pqTable {
+	pqRange q[okPLL22393_Q_MAX + 1];
+};
+
+template<int... I> struct okIndexList {};
+template<int N, int... I> struct okMakeIndexList : okMakeIndexList<N-1, N-1, I...> {};
+template<int... I> struct okMakeIndexList<0, I...> { typedef okIndexList<I...> type; };
+
+constexpr long ceilPositive(double x)
+	{ return(((double)(long)x < x) ? ((long)x + 1) : ((long)x)); }
+constexpr long maxLong(long a, long b)
+	{ return((a > b) ? (a) : (b)); }
+constexpr long minLong(long a, long b)
+	{ return((a < b) ? (a) : (b)); }
+
+// An empty range (pmin > pmax) marks a Q that cannot be used at all.
+constexpr pqRange rangeForQ(double ref, int q)
+{
+	return(((q < okPLL22393_Q_MIN) || (ref / q < okPLL22393_PFD_MIN))
+		? pqRange{ 1, 0 }
+		: pqRange{ (short)maxLong(okPLL22393_P_MIN, ceilPositive(okPLL22393_VCO_MIN * q / ref)),
+		           (short)minLong(okPLL22393_P_MAX, (long)(okPLL22393_VCO_MAX * q / ref)) });
+}
+
+template<int... Q>
+constexpr pqTable makeTable(double ref, okIndexList<Q...>)
+	{ return(pqTable{ { rangeForQ(ref, Q)... } }); }
+
+constexpr pqTable defaultTable =
+	makeTable(okPLL22393_DEFAULT_REFERENCE, okMakeIndexList<okPLL22393_Q_MAX + 1>::type());
+
+} // namespace
+
+
+okCPLL22393Solver::okCPLL22393Solver(double reference)
+	: m_reference(reference), m_hits(0), m_misses(0)
+{
+	for (int q=0; q<=okPLL22393_Q_MAX; q++) {
+		pqRange r = (reference == okPLL22393_DEFAULT_REFERENCE)
+			? (defaultTable.q[q]) : (rangeForQ(reference, q));
+		m_range[q].pmin = r.pmin;
+		m_range[q].pmax = r.pmax;
+	}
+}
+
+
+// Best divider of a fixed source frequency.
+bool
+okCPLL22393Solver::solveDivider(double source, double frequency, double tolerance, int &div, double &achieved) const
+{
+	int d = (int)floor(source / frequency + 0.5);
+	if (d < okPLL22393_DIV_MIN)
+		d = okPLL22393_DIV_MIN;
+	if (d > okPLL22393_DIV_MAX)
+		d = okPLL22393_DIV_MAX;
+
+	div = d;
+	achieved = source / d;
+	return(fabs(achieved - frequency) <= tolerance);
+}
+
+
+// Best (P, Q, divider) for a dedicated PLL.
+bool
+okCPLL22393Solver::solvePLL(double frequency, double tolerance, int &p, int &q, int &div, double &achieved) const
+{
+	double bestErr = HUGE_VAL;
+
+	if (frequency <= 0.0)
+		return(false);
+
+	int dmin = (int)ceil(okPLL22393_VCO_MIN / frequency);
+	int dmax = (int)floor(okPLL22393_VCO_MAX / frequency);
+	if (dmin < okPLL22393_DIV_MIN)
+		dmin = okPLL22393_DIV_MIN;
+	if (dmax > okPLL22393_DIV_MAX)
+		dmax = okPLL22393_DIV_MAX;
+
+	for (int d=dmin; d<=dmax; d++) {
+		double scale = frequency * d / m_reference;
+		for (int qq=okPLL22393_Q_MIN; qq<=okPLL22393_Q_MAX; qq++) {
+			const PRange &r = m_range[qq];
+			if (r.pmin > r.pmax)
+				continue;
+
+			int pp = (int)floor(scale * qq + 0.5);
+			if (pp < r.pmin)
+				pp = r.pmin;
+			if (pp > r.pmax)
+				pp = r.pmax;
+
+			double f = m_reference * pp / qq / d;
+			double err = fabs(f - frequency);
+			if (err < bestErr) {
+				bestErr = err;
+				p = pp;
+				q = qq;
+				div = d;
+				achieved = f;
+				if (0.0 == err)
+					return(true);
+			}
+		}
+	}
+
+	return(bestErr <= tolerance);
+}
+
+
+bool
+okCPLL22393Solver::Solve(const double *frequencies, const double *tolerances, int count,
+		okPLL22393Settings &settings)
+{
+	if ((count < 0) || (count > okPLL22393_OUTPUT_COUNT))
+		return(false);
+
+	std::vector<double> key;
+	key.reserve(1 + 2*count);
+	key.push_back(m_reference);
+	for (int i=0; i<count; i++) {
+		key.push_back(frequencies[i]);
+		key.push_back(tolerances[i]);
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		std::map<std::vector<double>, std::pair<bool, okPLL22393Settings> >::const_iterator it = m_cache.find(key);
+		if (it != m_cache.end()) {
+			m_hits++;
+			settings = it->second.second;
+			return(it->second.first);
+		}
+		m_misses++;
+	}
+
+	// The dedicated PLL of an output does not depend on the others, so it
+	// is solved once here rather than at every node of the search.
+	Search st;
+	memset(&st, 0, sizeof(st));
+	st.frequencies = frequencies;
+	st.tolerances = tolerances;
+	st.count = count;
+	st.current.reference = m_reference;
+	st.bestErr = HUGE_VAL;
+	st.bestPLLs = okPLL22393_PLL_COUNT + 1;
+	for (int i=0; i<count; i++) {
+		okPLL22393Settings::PLL &pll = st.dedicated[i];
+		double achieved;
+		pll.enabled = solvePLL(frequencies[i], tolerances[i], pll.p, pll.q, st.dedicatedDivider[i], achieved);
+		if (pll.enabled)
+			pll.frequency = m_reference * pll.p / pll.q;
+	}
+	search(st, 0, 0, 0.0);
+
+	bool ok = (st.bestErr < HUGE_VAL);
+	okPLL22393Settings s = st.best;
+	if (!ok) {
+		memset(&s, 0, sizeof(s));
+		s.reference = m_reference;
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		if (m_cache.insert(std::make_pair(key, std::make_pair(ok, s))).second) {
+			m_cacheOrder.push_back(key);
+			if (m_cacheOrder.size() > okPLL22393_CACHE_SIZE) {
+				m_cache.erase(m_cacheOrder.front());
+				m_cacheOrder.pop_front();
+			}
+		}
+	}
+
+	settings = s;
+	return(ok);
+}
+
+
+// Depth-first over the sources of output i onwards, given the PLLs the
+// earlier outputs claimed and their total error so far.  Branches that
+// cannot beat the best complete assignment are cut.
+void
+okCPLL22393Solver::search(Search &s, int i, int nPLLs, double err) const
+{
+	if ((err > s.bestErr) || ((err == s.bestErr) && (nPLLs >= s.bestPLLs)))
+		return;
+	if (i == s.count) {
+		s.best = s.current;
+		s.bestErr = err;
+		s.bestPLLs = nPLLs;
+		return;
+	}
+
+	okPLL22393Settings::Output &out = s.current.output[i];
+	double frequency = s.frequencies[i];
+	double tolerance = s.tolerances[i];
+	int div;
+	double achieved;
+
+	out.enabled = true;
+	// Sources that leave the PLLs free first, so that ties stop early.
+	for (int n=-1; n<nPLLs; n++) {
+		double source = (n < 0) ? (m_reference) : (s.current.pll[n].frequency);
+		if (solveDivider(source, frequency, tolerance, div, achieved)) {
+			out.pll = n;
+			out.divider = div;
+			out.frequency = achieved;
+			search(s, i+1, nPLLs, err + fabs(achieved - frequency));
+		}
+	}
+	if ((nPLLs < okPLL22393_PLL_COUNT) && s.dedicated[i].enabled) {
+		const okPLL22393Settings::PLL &pll = s.dedicated[i];
+		s.current.pll[nPLLs] = pll;
+		out.pll = nPLLs;
+		out.divider = s.dedicatedDivider[i];
+		out.frequency = pll.frequency / out.divider;
+		search(s, i+1, nPLLs+1, err + fabs(out.frequency - frequency));
+		memset(&s.current.pll[nPLLs], 0, sizeof(s.current.pll[nPLLs]));
+	}
+	memset(&out, 0, sizeof(out));
+}
+
+
+bool
+okCPLL22393Solver::Solve(double frequency, double tolerance, okPLL22393Settings &settings)
+	{ return(Solve(&frequency, &tolerance, 1, settings)); }
+
+
+void
+okCPLL22393Solver::Apply(const okPLL22393Settings &settings, okCPLL22393 &pll)
+{
+	pll.SetReference(settings.reference);
+
+	for (int n=0; n<okPLL22393_PLL_COUNT; n++) {
+		const okPLL22393Settings::PLL &s = settings.pll[n];
+		if (s.enabled)
+			pll.SetPLLParameters(n, s.p, s.q, true);
+		else
+			pll.SetPLLParameters(n, okPLL22393_P_MIN, okPLL22393_Q_MIN, false);
+	}
+
+	for (int i=0; i<okPLL22393_OUTPUT_COUNT; i++) {
+		const okPLL22393Settings::Output &o = settings.output[i];
+		if (!o.enabled) {
+			pll.SetOutputEnable(i, false);
+			continue;
+		}
+		pll.SetOutputSource(i, (o.pll < 0)
+			? (okCPLL22393::ClkSrc_Ref)
+			: ((okCPLL22393::ClockSource)(okCPLL22393::ClkSrc_PLL0_0 + 2*o.pll)));
+		pll.SetOutputDivider(i, o.divider);
+		pll.SetOutputEnable(i, true);
+	}
+}
+
+
+int
+okCPLL22393Solver::GetCacheHits()
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	return(m_hits);
+}
+
+
+int
+okCPLL22393Solver::GetCacheMisses()
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	return(m_misses);
+}
+
+
+void
+okCPLL22393Solver::ClearCache()
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	m_cache.clear();
+	m_cacheOrder.clear();
+	m_hits = 0;
+	m_misses = 0;
+}
@@ -0,0 +1,123 @@
+//------------------------------------------------------------------------
+// okPLL22393Solver.h
+//
+// Finds CY22393 settings (okCPLL22393) for a set of target output
+// frequencies.  Each target is driven by the reference clock, a divider of
+// a PLL another output already uses, or a PLL of its own; a source is usable
+// when it lands within the target's tolerance.  Every assignment of usable
+// sources is searched (at most 5^5), so a solution is found whenever one
+// exists with one dedicated PLL setting per output; of those the one with
+// the smallest total error wins, and on equal error the one that uses fewer
+// PLLs.
+// Results carry the exact achieved frequency, so callers can
+// hand the true master clock period to the timebase code instead of the
+// nominal one.
+//
+// All frequencies and tolerances are in MHz, as in okCPLL22393.
+//------------------------------------------------------------------------
+
+#ifndef __okPLL22393Solver_h__
+#define __okPLL22393Solver_h__
+
+#include <deque>
+#include <map>
+#include <vector>
+#include <mutex>
+
+#include "okFrontPanelDLL.h"
+
+// CY22393 limits, as accepted by okCPLL22393::SetPLLParameters and
+// okCPLL22393::SetOutputDivider.
+#define okPLL22393_P_MIN             6
+#define okPLL22393_P_MAX             2053
+#define okPLL22393_Q_MIN             2
+#define okPLL22393_Q_MAX             257
+#define okPLL22393_VCO_MIN           100.0    // MHz
+#define okPLL22393_VCO_MAX           400.0    // MHz
+#define okPLL22393_PFD_MIN           0.25     // MHz, minimum reference / Q
+#define okPLL22393_DIV_MIN           1
+#define okPLL22393_DIV_MAX           127
+#define okPLL22393_PLL_COUNT         3
+#define okPLL22393_OUTPUT_COUNT      5
+#define okPLL22393_DEFAULT_REFERENCE 48.0     // MHz, XEM3001 crystal
+
+// Solutions remembered per solver; the oldest is dropped beyond this.
+#define okPLL22393_CACHE_SIZE        256
+
+
+struct okPLL22393Settings
+{
+	struct PLL {
+		bool enabled;
+		int p;
+		int q;
+		double frequency;
+	};
+	struct Output {
+		bool enabled;
+		int pll;                    // -1 when driven by the reference
+		int divider;
+		double frequency;           // exact achieved frequency
+	};
+
+	double reference;
+	PLL pll[okPLL22393_PLL_COUNT];
+	Output output[okPLL22393_OUTPUT_COUNT];
+};
+
+
+//------------------------------------------------------------------------
+// okCPLL22393Solver
+//------------------------------------------------------------------------
+class okCPLL22393Solver
+{
+public:
+	okCPLL22393Solver(double reference = okPLL22393_DEFAULT_REFERENCE);
+
+	// Solves for count (<= 5) targets, target i on output i.  Returns false
+	// if some target cannot be met within its tolerance with the PLLs left.
+	bool Solve(const double *frequencies, const double *tolerances, int count,
+			okPLL22393Settings &settings);
+	bool Solve(double frequency, double tolerance, okPLL22393Settings &settings);
+
+	// Programs settings into pll (does not touch the device).
+	static void Apply(const okPLL22393Settings &settings, okCPLL22393 &pll);
+
+	double GetReference() const
+		{ return(m_reference); }
+	int GetCacheHits();
+	int GetCacheMisses();
+	void ClearCache();
+
+private:
+	struct PRange {
+		short pmin;
+		short pmax;
+	};
+	struct Search {
+		const double *frequencies;
+		const double *tolerances;
+		int count;
+		okPLL22393Settings::PLL dedicated[okPLL22393_OUTPUT_COUNT];   // own PLL of each output, if usable
+		int dedicatedDivider[okPLL22393_OUTPUT_COUNT];
+		okPLL22393Settings current;
+		okPLL22393Settings best;
+		double bestErr;
+		int bestPLLs;
+	};
+
+	bool solvePLL(double frequency, double tolerance, int &p, int &q, int &div, double &achieved) const;
+	bool solveDivider(double source, double frequency, double tolerance, int &div, double &achieved) const;
+	void search(Search &s, int i, int nPLLs, double err) const;
+
+	double m_reference;
+	PRange m_range[okPLL22393_Q_MAX + 1];
+
+	std::mutex m_lock;
+	std::map<std::vector<double>, std::pair<bool, okPLL22393Settings> > m_cache;
+	std::deque<std::vector<double> > m_cacheOrder;
+	int m_hits;
+	int m_misses;
+};
+
+#endif // __okPLL22393Solver_h__
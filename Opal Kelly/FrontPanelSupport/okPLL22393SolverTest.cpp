@@ -0,0 +1,97 @@
+//------------------------------------------------------------------------
+// okPLL22393SolverTest.cpp
+//
+// Regression checks for okCPLL22393Solver.  Build this file as its own
+// executable together with okFrontPanelDLL.cpp and okPLL22393Solver.cpp;
+// it needs no board or driver library.  Prints one line per check and
+// exits non-zero if any fails.
+//------------------------------------------------------------------------
+
+#include <math.h>
+#include <stdio.h>
+
+#include "okPLL22393Solver.h"
+
+
+static int failures = 0;
+
+
+static void
+check(bool ok, const char *what)
+{
+	printf("%s  %s\n", (ok) ? ("ok  ") : ("FAIL"), what);
+	if (!ok)
+		failures++;
+}
+
+
+// Every enabled output within its tolerance of its target and driven by an
+// enabled PLL (or the reference) at the frequency that PLL gives.
+static bool
+meets(const okPLL22393Settings &s, const double *frequencies, const double *tolerances, int count)
+{
+	for (int i=0; i<count; i++) {
+		const okPLL22393Settings::Output &o = s.output[i];
+		if (!o.enabled || (fabs(o.frequency - frequencies[i]) > tolerances[i]))
+			return(false);
+		double source = (o.pll < 0) ? (s.reference) : (s.pll[o.pll].frequency);
+		if (((o.pll >= 0) && !s.pll[o.pll].enabled) || (fabs(source / o.divider - o.frequency) > 1e-9))
+			return(false);
+	}
+	return(true);
+}
+
+
+int
+main(int /*argc*/, char * /*argv*/[])
+{
+	okCPLL22393Solver solver;
+	okPLL22393Settings s;
+
+	// A loose target is met exactly by a PLL of its own when one is free,
+	// rather than by the nearest reference divider (48 / 5 = 9.6).
+	check(solver.Solve(10.0, 0.5, s) && (10.0 == s.output[0].frequency),
+			"10 MHz +/- 0.5 comes out exact");
+
+	// The first three targets are within tolerance of reference dividers
+	// (48/5, 48/7, 48/4) but closer with PLLs of their own; the last two need
+	// a PLL each.  Claiming a PLL for each of the first three left none for
+	// the last two.
+	{
+		const double f[] = { 9.7, 6.9, 12.05, 17.0, 23.3 };
+		const double t[] = { 0.5, 0.2, 0.2, 0.001, 0.001 };
+		bool ok = solver.Solve(f, t, 5, s);
+		check(ok && meets(s, f, t, 5), "5 outputs: loose targets leave PLLs for the tight ones");
+		check(ok && (s.output[3].pll >= 0) && (s.output[4].pll >= 0) && (s.output[3].pll != s.output[4].pll),
+				"5 outputs: tight targets on PLLs of their own");
+	}
+
+	// Outputs sharing a PLL through its dividers.
+	{
+		const double f[] = { 10.0, 20.0, 5.0 };
+		const double t[] = { 1e-6, 1e-6, 1e-6 };
+		bool ok = solver.Solve(f, t, 3, s);
+		check(ok && meets(s, f, t, 3) && (s.output[0].pll == s.output[1].pll) && (s.output[1].pll == s.output[2].pll),
+				"10 / 20 / 5 MHz share one PLL");
+	}
+
+	// More distinct tight targets than PLLs.
+	{
+		const double f[] = { 13.37, 17.0, 23.3, 29.11 };
+		const double t[] = { 1e-6, 1e-6, 1e-6, 1e-6 };
+		check(!solver.Solve(f, t, 4, s), "4 unrelated tight targets fail");
+	}
+
+	// Cached answers match fresh ones.
+	{
+		const double f[] = { 9.7, 6.9, 12.05, 17.0, 23.3 };
+		const double t[] = { 0.5, 0.2, 0.2, 0.001, 0.001 };
+		okPLL22393Settings cached;
+		int hits = solver.GetCacheHits();
+		bool ok = solver.Solve(f, t, 5, cached);
+		check(ok && (solver.GetCacheHits() == hits + 1) && meets(cached, f, t, 5), "repeated request served from the cache");
+	}
+
+	printf("%d failed\n", failures);
+	return((0 == failures) ? (0) : (1));
+}
@@ -0,0 +1,176 @@
+//------------------------------------------------------------------------
+// okPLLConfigCache.cpp
+//
+// See okPLLConfigCache.h.
+//
+// The FrontPanel API only exposes whole-chip programming, and the mapping
+// from the programming-info blob to CY22393/CY22150 registers is private to
+// the firmware, so a changed configuration is still written in full.  What
+// the cache removes is the common case of rewriting an identical one.
+//------------------------------------------------------------------------
+
+#include <string.h>
+#include <chrono>
+#include <thread>
+
+#include "okPLLConfigCache.h"
+#include "okPLLPool.h"
+
+
+okCPLLConfigCache::okCPLLConfigCache(okCFrontPanel *dev)
+	: m_dev(dev), m_chip(ChipNone), m_settleMs(0), m_verify(false), m_writes(0), m_skips(0)
+{
+	memset(m_info, 0, sizeof(m_info));
+}
+
+
+void
+okCPLLConfigCache::Invalidate()
+{
+	m_chip = ChipNone;
+	memset(m_info, 0, sizeof(m_info));
+}
+
+
+void
+okCPLLConfigCache::SetSettleTime(int ms)
+	{ m_settleMs = (ms > 0) ? (ms) : (0); }
+
+
+void
+okCPLLConfigCache::SetVerify(bool verify)
+	{ m_verify = verify; }
+
+
+bool
+okCPLLConfigCache::matches(Chip chip, const unsigned char *info) const
+{
+	return((m_chip == chip) && (0 == memcmp(m_info, info, sizeof(m_info))));
+}
+
+
+void
+okCPLLConfigCache::store(Chip chip, const unsigned char *info)
+{
+	m_chip = chip;
+	memcpy(m_info, info, sizeof(m_info));
+}
+
+
+void
+okCPLLConfigCache::settle()
+{
+	if (m_settleMs > 0)
+		std::this_thread::sleep_for(std::chrono::milliseconds(m_settleMs));
+}
+
+
+okCFrontPanel::ErrorCode
+okCPLLConfigCache::SetPLL22393Configuration(okCPLL22393& pll)
+{
+	unsigned char info[okPLL_PROGRAMMINGINFO_MAXLENGTH];
+	memset(info, 0, sizeof(info));
+	pll.GetProgrammingInfo(info);
+
+	if (matches(Chip22393, info)) {
+		m_skips++;
+		return(okCFrontPanel::NoError);
+	}
+
+	// Whatever happens below, the chip state is no longer known.
+	Invalidate();
+
+	okCFrontPanel::ErrorCode err = m_dev->SetPLL22393Configuration(pll);
+	if (okCFrontPanel::NoError != err)
+		return(err);
+	m_writes++;
+	settle();
+
+	if (m_verify) {
+		okCPLLPool<okCPLL22393>::Lease readback = okCPLLPool<okCPLL22393>::ThisThread().Acquire();
+		unsigned char rinfo[okPLL_PROGRAMMINGINFO_MAXLENGTH];
+		memset(rinfo, 0, sizeof(rinfo));
+		err = m_dev->GetPLL22393Configuration(*readback);
+		if (okCFrontPanel::NoError != err)
+			return(err);
+		readback->GetProgrammingInfo(rinfo);
+		if (0 != memcmp(info, rinfo, sizeof(info)))
+			return(okCFrontPanel::Failed);
+	}
+
+	store(Chip22393, info);
+	return(okCFrontPanel::NoError);
+}
+
+
+okCFrontPanel::ErrorCode
+okCPLLConfigCache::SetPLL22150Configuration(okCPLL22150& pll)
+{
+	unsigned char info[okPLL_PROGRAMMINGINFO_MAXLENGTH];
+	memset(info, 0, sizeof(info));
+	pll.GetProgrammingInfo(info);
+
+	if (matches(Chip22150, info)) {
+		m_skips++;
+		return(okCFrontPanel::NoError);
+	}
+
+	Invalidate();
+
+	okCFrontPanel::ErrorCode err = m_dev->SetPLL22150Configuration(pll);
+	if (okCFrontPanel::NoError != err)
+		return(err);
+	m_writes++;
+	settle();
+
+	if (m_verify) {
+		okCPLLPool<okCPLL22150>::Lease readback = okCPLLPool<okCPLL22150>::ThisThread().Acquire();
+		unsigned char rinfo[okPLL_PROGRAMMINGINFO_MAXLENGTH];
+		memset(rinfo, 0, sizeof(rinfo));
+		err = m_dev->GetPLL22150Configuration(*readback);
+		if (okCFrontPanel::NoError != err)
+			return(err);
+		readback->GetProgrammingInfo(rinfo);
+		if (0 != memcmp(info, rinfo, sizeof(info)))
+			return(okCFrontPanel::Failed);
+	}
+
+	store(Chip22150, info);
+	return(okCFrontPanel::NoError);
+}
+
+
+okCFrontPanel::ErrorCode
+okCPLLConfigCache::Refresh22393()
+{
+	okCPLLPool<okCPLL22393>::Lease current = okCPLLPool<okCPLL22393>::ThisThread().Acquire();
+	unsigned char info[okPLL_PROGRAMMINGINFO_MAXLENGTH];
+
+	Invalidate();
+	okCFrontPanel::ErrorCode err = m_dev->GetPLL22393Configuration(*current);
+	if (okCFrontPanel::NoError != err)
+		return(err);
+
+	memset(info, 0, sizeof(info));
+	current->GetProgrammingInfo(info);
+	store(Chip22393, info);
+	return(okCFrontPanel::NoError);
+}
+
+
+okCFrontPanel::ErrorCode
+okCPLLConfigCache::Refresh22150()
+{
+	okCPLLPool<okCPLL22150>::Lease current = okCPLLPool<okCPLL22150>::ThisThread().Acquire();
+	unsigned char info[okPLL_PROGRAMMINGINFO_MAXLENGTH];
+
+	Invalidate();
+	okCFrontPanel::ErrorCode err = m_dev->GetPLL22150Configuration(*current);
+	if (okCFrontPanel::NoError != err)
+		return(err);
+
+	memset(info, 0, sizeof(info));
+	current->GetProgrammingInfo(info);
+	store(Chip22150, info);
+	return(okCFrontPanel::NoError);
+}
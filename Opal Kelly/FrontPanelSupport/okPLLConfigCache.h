@@ -0,0 +1,72 @@
+//------------------------------------------------------------------------
+// okPLLConfigCache.h
+//
+// Per-board cache of the last PLL configuration applied through
+// okCFrontPanel::SetPLL22393Configuration / SetPLL22150Configuration.
+// A new configuration is compared against the cached GetProgrammingInfo
+// blob and the I2C programming (plus settle delay and optional readback
+// verify) is skipped entirely when nothing changed.
+//
+// Call Invalidate() whenever the PLL may have been reprogrammed behind the
+// cache's back: after OpenBySerial, LoadDefaultPLLConfiguration, an EEPROM
+// load, or a reconnect through okCDevicePool.
+//------------------------------------------------------------------------
+
+#ifndef __okPLLConfigCache_h__
+#define __okPLLConfigCache_h__
+
+#include "okFrontPanelDLL.h"
+
+// Upper bound on the GetProgrammingInfo blob size for either PLL.  The
+// buffers are zero-filled first, so unused tail bytes always compare equal.
+#define okPLL_PROGRAMMINGINFO_MAXLENGTH   256
+
+
+//------------------------------------------------------------------------
+// okCPLLConfigCache
+//------------------------------------------------------------------------
+class okCPLLConfigCache
+{
+public:
+	okCPLLConfigCache(okCFrontPanel *dev);
+
+	okCFrontPanel::ErrorCode SetPLL22393Configuration(okCPLL22393& pll);
+	okCFrontPanel::ErrorCode SetPLL22150Configuration(okCPLL22150& pll);
+
+	// Seeds the cache from the configuration currently on the board, so the
+	// first Set after opening a device can already be skipped.
+	okCFrontPanel::ErrorCode Refresh22393();
+	okCFrontPanel::ErrorCode Refresh22150();
+	void Invalidate();
+
+	// Delay after a real reprogram before the clock is trusted (default 0).
+	void SetSettleTime(int ms);
+	// Read the configuration back after a real reprogram (default off).
+	void SetVerify(bool verify);
+
+	int GetWriteCount() const
+		{ return(m_writes); }
+	int GetSkipCount() const
+		{ return(m_skips); }
+
+private:
+	enum Chip {
+		ChipNone = 0,
+		Chip22393 = 1,
+		Chip22150 = 2
+	};
+
+	bool matches(Chip chip, const unsigned char *info) const;
+	void store(Chip chip, const unsigned char *info);
+	void settle();
+
+	okCFrontPanel *m_dev;
+	Chip m_chip;
+	unsigned char m_info[okPLL_PROGRAMMINGINFO_MAXLENGTH];
+	int m_settleMs;
+	bool m_verify;
+	int m_writes;
+	int m_skips;
+};
+
+#endif // __okPLLConfigCache_h__
@@ -0,0 +1,128 @@
+//------------------------------------------------------------------------
+// okPLLPool.h
+//
+// Small per-thread pool of constructed okCPLL22150 / okCPLL22393 objects.
+// Short-lived PLL objects (readback, verify, solver previews) are leased
+// from the pool instead of going through okPLL*_Construct / _Destruct in
+// the driver on every query.  A leased object is reset to the driver's
+// power-on defaults, so it behaves exactly like a freshly constructed one.
+//
+//    okCPLLPool<okCPLL22393>::Lease pll = okCPLLPool<okCPLL22393>::ThisThread().Acquire();
+//    dev->GetPLL22393Configuration(*pll);
+//
+// Leases must be released on the thread that acquired them; they are
+// returned to the pool when they go out of scope.
+//------------------------------------------------------------------------
+
+#ifndef __okPLLPool_h__
+#define __okPLLPool_h__
+
+#include <string.h>
+#include <utility>
+#include <vector>
+
+#include "okFrontPanelDLL.h"
+
+// Matches okPLL_PROGRAMMINGINFO_MAXLENGTH in okPLLConfigCache.h.
+#define okPLLPool_PROGRAMMINGINFO_MAXLENGTH   256
+#define okPLLPool_DEFAULT_CAPACITY            4
+
+
+//------------------------------------------------------------------------
+// okCPLLPool
+//------------------------------------------------------------------------
+template<class PLL>
+class okCPLLPool
+{
+public:
+	class Lease
+	{
+	public:
+		Lease(Lease&& other)
+			: m_pool(other.m_pool), m_pll(std::move(other.m_pll)), m_valid(other.m_valid)
+			{ other.m_valid = false; }
+		~Lease()
+			{ if (m_valid) m_pool->release(std::move(m_pll)); }
+
+		PLL& operator*()
+			{ return(m_pll); }
+		PLL *operator->()
+			{ return(&m_pll); }
+
+	private:
+		friend class okCPLLPool;
+		Lease(okCPLLPool *pool, PLL&& pll)
+			: m_pool(pool), m_pll(std::move(pll)), m_valid(true) {}
+		Lease(const Lease&);
+		Lease& operator=(const Lease&);
+		Lease& operator=(Lease&&);
+
+		okCPLLPool *m_pool;
+		PLL m_pll;
+		bool m_valid;
+	};
+
+	static okCPLLPool& ThisThread()
+	{
+		static thread_local okCPLLPool pool;
+		return(pool);
+	}
+
+	okCPLLPool()
+		: m_capacity(okPLLPool_DEFAULT_CAPACITY), m_constructed(0), m_reused(0), m_haveDefaults(false)
+	{
+		memset(m_defaults, 0, sizeof(m_defaults));
+		m_free.reserve(m_capacity);
+	}
+
+	Lease Acquire()
+	{
+		if (m_free.empty()) {
+			PLL pll;
+			m_constructed++;
+			if (!m_haveDefaults) {
+				pll.GetProgrammingInfo(m_defaults);
+				m_haveDefaults = true;
+			}
+			return(Lease(this, std::move(pll)));
+		}
+
+		PLL pll(std::move(m_free.back()));
+		m_free.pop_back();
+		m_reused++;
+		pll.InitFromProgrammingInfo(m_defaults);
+		return(Lease(this, std::move(pll)));
+	}
+
+	// Objects beyond capacity are destroyed on release rather than kept.
+	void SetCapacity(int capacity)
+	{
+		m_capacity = (capacity > 0) ? (capacity) : (0);
+		while ((int)m_free.size() > m_capacity)
+			m_free.pop_back();
+	}
+
+	int GetConstructCount() const
+		{ return(m_constructed); }
+	int GetReuseCount() const
+		{ return(m_reused); }
+
+private:
+	void release(PLL&& pll)
+	{
+		if ((int)m_free.size() < m_capacity)
+			m_free.push_back(std::move(pll));
+	}
+
+	okCPLLPool(const okCPLLPool&);
+	okCPLLPool& operator=(const okCPLLPool&);
+
+	std::vector<PLL> m_free;
+	int m_capacity;
+	int m_constructed;
+	int m_reused;
+	bool m_haveDefaults;
+	unsigned char m_defaults[okPLLPool_PROGRAMMINGINFO_MAXLENGTH];
+};
+
+#endif // __okPLLPool_h__
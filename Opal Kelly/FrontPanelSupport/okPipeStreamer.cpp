@@ -0,0 +1,392 @@
+//------------------------------------------------------------------------
+// okPipeStreamer.cpp
+//
+// See okPipeStreamer.h.
+//
+// Direct I/O needs the buffer address, file offset and read size aligned
+// to the device block size.  Buffers and read sizes are multiples of
+// okPipeStreamer_ALIGNMENT and reads always start at an aligned offset;
+// an unaligned start offset is handled by dropping the leading bytes of
+// the first buffer.
+//------------------------------------------------------------------------
+
+#if !defined(_WIN32) && !defined(_GNU_SOURCE)
+	#define _GNU_SOURCE          // O_DIRECT
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+
+#if defined(_WIN32)
+	#include <windows.h>
+	#include <malloc.h>
+#else
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/stat.h>
+#endif
+
+#include "okPipeStreamer.h"
+
+
+//------------------------------------------------------------------------
+// Minimal positional file access
+//------------------------------------------------------------------------
+struct okPipeStreamerFile {
+#if defined(_WIN32)
+	HANDLE h;
+#else
+	int fd;
+#endif
+	bool direct;
+};
+
+
+static bool
+streamerOpen(okPipeStreamerFile *f, const char *path, bool direct)
+{
+#if defined(_WIN32)
+	DWORD flags = FILE_FLAG_SEQUENTIAL_SCAN;
+	f->direct = false;
+	if (direct) {
+		f->h = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, flags | FILE_FLAG_NO_BUFFERING, NULL);
+		if (INVALID_HANDLE_VALUE != f->h) {
+			f->direct = true;
+			return(true);
+		}
+	}
+	f->h = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, flags, NULL);
+	return(INVALID_HANDLE_VALUE != f->h);
+#else
+	f->direct = false;
+	#if defined(O_DIRECT)
+	if (direct) {
+		f->fd = open(path, O_RDONLY | O_DIRECT);
+		if (f->fd >= 0) {
+			f->direct = true;
+			return(true);
+		}
+	}
+	#endif
+	f->fd = open(path, O_RDONLY);
+	if (f->fd < 0)
+		return(false);
+	#if defined(POSIX_FADV_SEQUENTIAL)
+	posix_fadvise(f->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	#endif
+	return(true);
+#endif
+}
+
+
+static long long
+streamerSize(okPipeStreamerFile *f)
+{
+#if defined(_WIN32)
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(f->h, &size))
+		return(-1);
+	return(size.QuadPart);
+#else
+	struct stat st;
+	if (0 != fstat(f->fd, &st))
+		return(-1);
+	return(st.st_size);
+#endif
+}
+
+
+// Returns bytes read, 0 at end of file, -1 on error.
+static long
+streamerRead(okPipeStreamerFile *f, long long offset, unsigned char *buf, long length)
+{
+#if defined(_WIN32)
+	OVERLAPPED ov;
+	DWORD got = 0;
+	memset(&ov, 0, sizeof(ov));
+	ov.Offset = (DWORD)(offset & 0xffffffff);
+	ov.OffsetHigh = (DWORD)(offset >> 32);
+	if (!ReadFile(f->h, buf, (DWORD)length, &got, &ov))
+		return((ERROR_HANDLE_EOF == GetLastError()) ? (0) : (-1));
+	return((long)got);
+#else
+	long done = 0;
+	while (done < length) {
+		ssize_t n = pread(f->fd, buf + done, length - done, offset + done);
+		if (n < 0)
+			return(-1);
+		if (0 == n)
+			break;
+		done += (long)n;
+		// A short direct read means end of file; the remainder of the
+		// block is not there.
+		if (f->direct)
+			break;
+	}
+	return(done);
+#endif
+}
+
+
+static void
+streamerClose(okPipeStreamerFile *f)
+{
+#if defined(_WIN32)
+	CloseHandle(f->h);
+#else
+	close(f->fd);
+#endif
+}
+
+
+//------------------------------------------------------------------------
+// okCPipeStreamer
+//------------------------------------------------------------------------
+okCPipeStreamer::okCPipeStreamer(okCFrontPanel *dev)
+	: m_dev(dev), m_bufferSize(okPipeStreamer_DEFAULT_BUFFER), m_bufferCount(okPipeStreamer_DEFAULT_BUFFERS),
+	  m_direct(true), m_recordSize(16), m_validate(true), m_progress(NULL), m_progressArg(NULL),
+	  m_readDone(false), m_readError(false), m_abort(false),
+	  m_written(0), m_elapsedSec(0.0), m_stallSec(0.0), m_usedDirect(false), m_validated(false)
+{
+	okCSegmentDecoder::ValidateBegin(&m_upload);
+}
+
+
+okCPipeStreamer::~okCPipeStreamer()
+{
+	release();
+}
+
+
+void
+okCPipeStreamer::SetBufferSize(long bytes)
+{
+	if (bytes < okPipeStreamer_ALIGNMENT)
+		bytes = okPipeStreamer_ALIGNMENT;
+	bytes = (bytes + okPipeStreamer_ALIGNMENT - 1) & ~(long)(okPipeStreamer_ALIGNMENT - 1);
+	if (bytes != m_bufferSize) {
+		release();
+		m_bufferSize = bytes;
+	}
+}
+
+
+void
+okCPipeStreamer::SetBufferCount(int count)
+{
+	if (count < 2)
+		count = 2;
+	if (count != m_bufferCount) {
+		release();
+		m_bufferCount = count;
+	}
+}
+
+
+void
+okCPipeStreamer::SetDirectIO(bool enable)
+	{ m_direct = enable; }
+
+
+void
+okCPipeStreamer::SetRecordSize(int bytes)
+	{ m_recordSize = (bytes > 0) ? (bytes) : (1); }
+
+
+void
+okCPipeStreamer::SetProgressCallback(okPipeStreamerProgressCallback callback, void *arg)
+{
+	m_progress = callback;
+	m_progressArg = arg;
+}
+
+
+bool
+okCPipeStreamer::allocate()
+{
+	if (!m_buffers.empty())
+		return(true);
+
+	for (int i=0; i<m_bufferCount; i++) {
+		Buffer b;
+#if defined(_WIN32)
+		b.data = (unsigned char *)_aligned_malloc(m_bufferSize, okPipeStreamer_ALIGNMENT);
+#else
+		void *p = NULL;
+		b.data = (0 == posix_memalign(&p, okPipeStreamer_ALIGNMENT, m_bufferSize)) ? ((unsigned char *)p) : (NULL);
+#endif
+		if (NULL == b.data) {
+			release();
+			return(false);
+		}
+		b.length = 0;
+		b.skip = 0;
+		m_buffers.push_back(b);
+	}
+	return(true);
+}
+
+
+void
+okCPipeStreamer::release()
+{
+	for (size_t i=0; i<m_buffers.size(); i++) {
+#if defined(_WIN32)
+		_aligned_free(m_buffers[i].data);
+#else
+		free(m_buffers[i].data);
+#endif
+	}
+	m_buffers.clear();
+}
+
+
+void
+okCPipeStreamer::readerThread(void *file, long long start, long long skip, long long length)
+{
+	okPipeStreamerFile *f = (okPipeStreamerFile *)file;
+	long long pos = start;
+	long long remaining = skip + length;        // bytes from pos that are still wanted
+
+	while (remaining > 0) {
+		int index;
+		{
+			std::unique_lock<std::mutex> lock(m_lock);
+			while (m_free.empty() && !m_abort)
+				m_cond.wait(lock);
+			if (m_abort)
+				return;
+			index = m_free.back();
+			m_free.pop_back();
+		}
+
+		Buffer& b = m_buffers[index];
+		long n = streamerRead(f, pos, b.data, m_bufferSize);
+		if (n <= 0) {
+			// Error, or the file is shorter than it was a moment ago.
+			std::lock_guard<std::mutex> guard(m_lock);
+			m_readError = true;
+			m_free.push_back(index);
+			m_cond.notify_all();
+			return;
+		}
+
+		b.skip = (long)skip;
+		b.length = (n < remaining) ? (n) : ((long)remaining);
+		skip = 0;
+		pos += n;
+		remaining -= b.length;
+
+		std::lock_guard<std::mutex> guard(m_lock);
+		m_filled.push_back(index);
+		m_cond.notify_all();
+	}
+
+	std::lock_guard<std::mutex> guard(m_lock);
+	m_readDone = true;
+	m_cond.notify_all();
+}
+
+
+long long
+okCPipeStreamer::StreamFile(int epAddr, const char *path, long long offset, long long length)
+{
+	typedef std::chrono::steady_clock Clock;
+	okPipeStreamerFile file;
+
+	m_written = 0;
+	m_elapsedSec = 0.0;
+	m_stallSec = 0.0;
+	m_usedDirect = false;
+	m_crc.Reset();
+	m_validated = m_validate && (okSegmentDecoder_RECORD_SIZE == m_recordSize);
+	okCSegmentDecoder::ValidateBegin(&m_upload);
+
+	if ((offset < 0) || (0 != offset % m_recordSize))
+		return(okCFrontPanel::Failed);
+	if (!streamerOpen(&file, path, m_direct))
+		return(okCFrontPanel::FileError);
+
+	long long size = streamerSize(&file);
+	if ((size < 0) || (offset > size)) {
+		streamerClose(&file);
+		return(okCFrontPanel::FileError);
+	}
+	if ((length < 0) || (offset + length > size))
+		length = size - offset;
+	if ((0 != length % m_recordSize) || !allocate()) {
+		streamerClose(&file);
+		return(okCFrontPanel::Failed);
+	}
+	m_usedDirect = file.direct;
+	if (0 == length) {
+		streamerClose(&file);
+		return(0);
+	}
+
+	m_free.clear();
+	m_filled.clear();
+	for (int i=(int)m_buffers.size()-1; i>=0; i--)
+		m_free.push_back(i);
+	m_readDone = false;
+	m_readError = false;
+	m_abort = false;
+
+	long long start = offset & ~(long long)(okPipeStreamer_ALIGNMENT - 1);
+	Clock::time_point t0 = Clock::now();
+	std::thread reader(&okCPipeStreamer::readerThread, this, (void *)&file, start, offset - start, length);
+
+	long long result = 0;
+	while (true) {
+		int index;
+		{
+			std::unique_lock<std::mutex> lock(m_lock);
+			if (m_filled.empty() && !m_readDone && !m_readError) {
+				Clock::time_point w0 = Clock::now();
+				while (m_filled.empty() && !m_readDone && !m_readError)
+					m_cond.wait(lock);
+				m_stallSec += std::chrono::duration<double>(Clock::now() - w0).count();
+			}
+			if (m_filled.empty()) {
+				if (m_readError)
+					result = okCFrontPanel::FileError;
+				break;
+			}
+			index = m_filled.front();
+			m_filled.erase(m_filled.begin());
+		}
+
+		// Buffers hold whole records: offset, length and the buffer size
+		// are all multiples of the record size.
+		Buffer& b = m_buffers[index];
+		long n = b.length - b.skip;
+		bool valid = !m_validated || okCSegmentDecoder::ValidateAdd(b.data + b.skip, n, &m_upload);
+		long xfered = (valid) ? (m_dev->WriteToPipeIn(epAddr, n, b.data + b.skip)) : (0);
+		if (xfered == n)
+			m_crc.Update(b.data + b.skip, n);
+
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			m_free.push_back(index);
+			if (xfered != n)
+				m_abort = true;
+			m_cond.notify_all();
+		}
+		if (xfered != n) {
+			result = (xfered < 0) ? (xfered) : ((long long)okCFrontPanel::Failed);
+			break;
+		}
+		m_written += n;
+		if (NULL != m_progress)
+			m_progress(m_written, length, m_progressArg);
+	}
+
+	reader.join();
+	streamerClose(&file);
+	if (m_validated && (0 == result) && !okCSegmentDecoder::ValidateEnd(0.0, &m_upload))
+		result = okCFrontPanel::Failed;
+	m_elapsedSec = std::chrono::duration<double>(Clock::now() - t0).count();
+	return((0 == result) ? (m_written) : (result));
+}
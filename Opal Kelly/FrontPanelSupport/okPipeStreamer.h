@@ -0,0 +1,130 @@
+//------------------------------------------------------------------------
+// okPipeStreamer.h
+//
+// Streams a file straight into okCFrontPanel::WriteToPipeIn.  A reader
+// thread fills a small ring of aligned buffers with unbuffered (O_DIRECT /
+// FILE_FLAG_NO_BUFFERING) sequential reads while the calling thread pushes
+// the filled buffers down the pipe, so disk reads overlap USB writes and
+// the file is never held in memory as a whole.  Precomputed segment tables
+// of several hundred megabytes upload at USB speed.
+//
+// Buffers are kept between calls.  When the file system refuses direct
+// I/O the streamer falls back to buffered reads with a sequential access
+// hint.
+//
+// With 16-byte records (the default) every buffer is checked with
+// okCSegmentDecoder::ValidateAdd() just before it goes down the pipe, so
+// the table is validated without a second pass over the file.  A bad
+// record stops the stream with Failed before its buffer is written, but
+// the buffers ahead of it are already in the FIFO: abort the board before
+// using it again.  A table without a single timed record fails the same
+// way once it is written.  GetUploadStats() has the totals.
+//------------------------------------------------------------------------
+
+#ifndef __okPipeStreamer_h__
+#define __okPipeStreamer_h__
+
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+#include "okFrontPanelDLL.h"
+#include "okSegmentDecoder.h"
+#include "okUploadCRC.h"
+
+#define okPipeStreamer_ALIGNMENT        4096
+#define okPipeStreamer_DEFAULT_BUFFER   (1024*1024)
+#define okPipeStreamer_DEFAULT_BUFFERS  4
+
+// Called from the streaming thread after every pipe write.
+typedef void (*okPipeStreamerProgressCallback)(long long written, long long total, void *arg);
+
+
+//------------------------------------------------------------------------
+// okCPipeStreamer
+//------------------------------------------------------------------------
+class okCPipeStreamer
+{
+public:
+	okCPipeStreamer(okCFrontPanel *dev);
+	~okCPipeStreamer();
+
+	// Size of one pipe transfer; rounded up to okPipeStreamer_ALIGNMENT.
+	void SetBufferSize(long bytes);
+	void SetBufferCount(int count);
+	void SetDirectIO(bool enable);
+	// The streamed length must be a multiple of this (16 for segment
+	// tables); anything else is refused before the upload starts.
+	void SetRecordSize(int bytes);
+	// Validate segment records on the way through; default true, only
+	// applies when the record size is 16.
+	void SetValidation(bool enable)
+		{ m_validate = enable; }
+	void SetProgressCallback(okPipeStreamerProgressCallback callback, void *arg);
+
+	// Writes length bytes of the file starting at offset (length < 0: to
+	// the end of the file) to the pipe.  Returns the number of bytes
+	// written, or a negative okCFrontPanel::ErrorCode; FileError if the
+	// file cannot be opened or read.
+	long long StreamFile(int epAddr, const char *path, long long offset = 0, long long length = -1);
+
+	// Statistics of the last StreamFile().
+	long long GetBytesWritten() const
+		{ return(m_written); }
+	double GetElapsedSec() const
+		{ return(m_elapsedSec); }
+	// Time the pipe writer spent waiting for the disk.
+	double GetReadStallSec() const
+		{ return(m_stallSec); }
+	bool UsedDirectIO() const
+		{ return(m_usedDirect); }
+	// CRC-32C of the bytes written, for okCUploadCRC::VerifyDevice().
+	unsigned int GetCRC() const
+		{ return(m_crc.GetValue()); }
+	// Validation totals of the records written (durations left at 0);
+	// false if the last StreamFile() did not validate.
+	bool GetUploadStats(okSegmentStats *stats) const
+		{ *stats = m_upload; return(m_validated); }
+
+private:
+	struct Buffer {
+		unsigned char *data;
+		long length;           // valid bytes
+		long skip;             // leading bytes to drop (unaligned start offset)
+	};
+
+	bool allocate();
+	void release();
+	void readerThread(void *file, long long start, long long skip, long long length);
+
+	okCFrontPanel *m_dev;
+	long m_bufferSize;
+	int m_bufferCount;
+	bool m_direct;
+	int m_recordSize;
+	bool m_validate;
+	okPipeStreamerProgressCallback m_progress;
+	void *m_progressArg;
+
+	std::vector<Buffer> m_buffers;
+	std::vector<int> m_free;
+	std::vector<int> m_filled;           // FIFO of buffer indices
+	std::mutex m_lock;
+	std::condition_variable m_cond;
+	bool m_readDone;
+	bool m_readError;
+	bool m_abort;
+
+	long long m_written;
+	double m_elapsedSec;
+	double m_stallSec;
+	bool m_usedDirect;
+	okCUploadCRC m_crc;
+	bool m_validated;
+	okSegmentStats m_upload;
+
+	okCPipeStreamer(const okCPipeStreamer&);
+	okCPipeStreamer& operator=(const okCPipeStreamer&);
+};
+
+#endif // __okPipeStreamer_h__
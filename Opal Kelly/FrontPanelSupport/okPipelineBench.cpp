@@ -0,0 +1,331 @@
+//------------------------------------------------------------------------
+// okPipelineBench.cpp
+//
+// Throughput benchmark for the native half of the sequence-to-FIFO path.
+// Build this file as its own executable together with okFrontPanelDLL.cpp,
+// okSegmentDecoder.cpp, okSegmentEncoder.cpp and okUploadCRC.cpp.
+//
+// Each corpus is a segment FIFO stream (the pipe 0x80 upload).  The
+// VariableTimebaseBenchmarkTest in CiceroSuiteUnitTests times segment
+// generation and createByteArray on synthetic sequences and saves the
+// streams as <corpus>.fifo; pass those files here.  Without files a
+// built-in record-level corpus is synthesized (-N records each).  Stages,
+// each timed separately:
+//
+//    validate      okCSegmentDecoder::Validate, the upload preflight
+//    decode        okCSegmentDecoder::Decode back to on / off / repeat arrays
+//    nativeEncode  okCSegmentEncoder::Encode48; output must match the corpus
+//    upload        CRC reset, one WriteToPipeIn of the stream, CRC check
+//    poll          UpdateWireOuts and the sample count / status wire-outs, as
+//                  FpgaTimebaseTask polls a running shot
+//
+// and reported as records/s and MB/s (for poll, one record is one poll of
+// the 64-byte wire-out block).  The fastest of -r repetitions is kept.
+// Runs against real boards or against the stand-in library
+// (okFrontPanelStub.cpp) with -l; the stand-in drops records past its
+// 2048-record FIFO, which does not change the timing.
+//
+//    okPipelineBench [-l lib] [-s serial] [-r reps] [-N records]
+//                    [-p polls] [-o csv] [corpus.fifo ...]
+//
+// The csv has the columns of VariableTimebaseBenchmark.csv and is appended
+// to, so the results of both halves and of successive runs can be kept in
+// one file for regression tracking.  Pipe writes land in the segment FIFO;
+// the board is aborted after each upload.
+//------------------------------------------------------------------------
+
+#if !defined(_WIN32)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "okFrontPanelDLL.h"
+#include "okSegmentDecoder.h"
+#include "okSegmentEncoder.h"
+#include "okUploadCRC.h"
+
+#define okPipelineBench_EP_SAMPLES_LOW   0x22
+#define okPipelineBench_EP_SAMPLES_HIGH  0x23
+#define okPipelineBench_EP_STATUS        0x25
+#define okPipelineBench_EP_TRIGGER       0x40
+#define okPipelineBench_EP_SEGMENTS      0x80
+#define okPipelineBench_BIT_ABORT        1
+#define okPipelineBench_WIREOUT_BYTES    64          // UpdateWireOuts reads all 32 wire-outs
+#define okPipelineBench_MASTER_PERIOD    1e-7
+
+struct okPipelineCorpus {
+	std::string name;
+	std::vector<unsigned char> data;
+};
+
+struct okPipelineOptions {
+	std::string lib;
+	std::string serial;
+	int reps;
+	long records;
+	int polls;
+	std::string csv;
+};
+
+typedef std::chrono::steady_clock okBenchClock;
+
+
+static double
+secondsSince(okBenchClock::time_point t)
+{
+	return(std::chrono::duration<double>(okBenchClock::now() - t).count());
+}
+
+
+//------------------------------------------------------------------------
+// Corpus
+//------------------------------------------------------------------------
+static bool
+loadCorpus(const char *path, okPipelineCorpus *corpus)
+{
+	FILE *f = fopen(path, "rb");
+	if (NULL == f)
+		return(false);
+	fseek(f, 0, SEEK_END);
+	long length = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	corpus->data.resize((length > 0) ? (length) : (0));
+	bool ok = (length > 0) && (1 == fread(&corpus->data[0], length, 1, f));
+	fclose(f);
+
+	std::string name(path);
+	size_t slash = name.find_last_of('/');
+	if (std::string::npos != slash)
+		name = name.substr(slash + 1);
+	size_t dot = name.rfind(".fifo");
+	if (std::string::npos != dot)
+		name = name.substr(0, dot);
+	corpus->name = name;
+	return(ok);
+}
+
+
+// Record-level stand-ins for the test's sequences: closely spaced segments
+// of varying period, retrigger waits between short segments, and hour-long
+// dwells that need the full 48-bit counts.  Each ends with the 100 us
+// finishing pulse createByteArray appends.
+static void
+synthesize(const char *name, long records, okPipelineCorpus *corpus)
+{
+	std::vector<unsigned long long> on(records), off(records);
+	std::vector<unsigned int> rep(records);
+
+	for (long i=0; i<records-1; i++) {
+		if (0 == strcmp(name, "segments")) {
+			off[i] = 1 + (i * 7) % 250;
+			on[i] = off[i] + (i & 1);
+			rep[i] = 1 + (unsigned int)((i * 13) % 1000);
+		}
+		else if (0 == strcmp(name, "retriggers")) {
+			if (0 == (i & 1)) {
+				on[i] = 100000;                          // 10 ms timeout
+				off[i] = (unsigned long long)(i % 4);    // edge / polarity flags
+				rep[i] = 0;
+			}
+			else {
+				on[i] = off[i] = 50;
+				rep[i] = 8;
+			}
+		}
+		else {
+			if (0 == (i & 1)) {
+				on[i] = off[i] = 18000000000ULL + (unsigned long long)i;
+				rep[i] = 1;
+			}
+			else {
+				on[i] = off[i] = 5;
+				rep[i] = 900;
+			}
+		}
+	}
+	on[records-1] = off[records-1] = 1000;
+	rep[records-1] = 1;
+
+	corpus->name = name;
+	corpus->data.resize(okSegmentEncoder_RECORD_SIZE * records);
+	okCSegmentEncoder::Encode48(&on[0], &off[0], &rep[0], records, &corpus->data[0]);
+}
+
+
+//------------------------------------------------------------------------
+// Measurement
+//------------------------------------------------------------------------
+static void
+report(FILE *csv, const std::string& corpus, const char *stage, long records, double seconds)
+{
+	long long bytes = (0 == strcmp(stage, "poll")) ?
+			((long long)records * okPipelineBench_WIREOUT_BYTES) : ((long long)records * okSegmentEncoder_RECORD_SIZE);
+	if (seconds <= 0.0)
+		seconds = 1e-9;
+	printf("%-16s %-12s %9ld %12.3f %14.0f %10.1f\n",
+		corpus.c_str(), stage, records, seconds * 1000.0, records / seconds, bytes / seconds / 1e6);
+	if (NULL != csv)
+		fprintf(csv, "%s,%s,%ld,%lld,%.9g,%.0f,%.3f\n",
+			corpus.c_str(), stage, records, bytes, seconds, records / seconds, bytes / seconds / 1e6);
+}
+
+
+// Returns false if the stream fails the preflight, does not re-encode to
+// the same bytes, or does not reach the board intact.
+static bool
+benchmark(okCFrontPanel *dev, const okPipelineOptions& opt, const okPipelineCorpus& corpus, FILE *csv)
+{
+	const unsigned char *data = &corpus.data[0];
+	long length = (long)corpus.data.size();
+	long records = length / okSegmentDecoder_RECORD_SIZE;
+	std::vector<unsigned long long> on(records), off(records);
+	std::vector<unsigned int> rep(records);
+	std::vector<unsigned char> encoded(length);
+	unsigned int crc = okCUploadCRC::Compute(data, length);
+	double best[5] = { 1e30, 1e30, 1e30, 1e30, 1e30 };
+	okSegmentStats stats;
+	bool valid = true, same = true, uploaded = true;
+
+	for (int r=0; r<opt.reps; r++) {
+		okBenchClock::time_point t = okBenchClock::now();
+		valid = okCSegmentDecoder::Validate(data, length, okPipelineBench_MASTER_PERIOD, &stats);
+		best[0] = std::min(best[0], secondsSince(t));
+
+		t = okBenchClock::now();
+		okCSegmentDecoder::Decode(data, length, &on[0], &off[0], &rep[0]);
+		best[1] = std::min(best[1], secondsSince(t));
+
+		t = okBenchClock::now();
+		long long n = okCSegmentEncoder::Encode48(&on[0], &off[0], &rep[0], records, &encoded[0]);
+		best[2] = std::min(best[2], secondsSince(t));
+		same = (n == length) && (0 == memcmp(data, &encoded[0], length));
+
+		t = okBenchClock::now();
+		okCFrontPanel::ErrorCode err = okCUploadCRC::ResetDevice(dev);
+		if (okCFrontPanel::NoError == err)
+			err = (length == dev->WriteToPipeIn(okPipelineBench_EP_SEGMENTS, length, (unsigned char *)data)) ?
+					(okCFrontPanel::NoError) : (okCFrontPanel::Failed);
+		if (okCFrontPanel::NoError == err)
+			err = okCUploadCRC::VerifyDevice(dev, crc);
+		best[3] = std::min(best[3], secondsSince(t));
+		uploaded = (okCFrontPanel::NoError == err);
+		dev->ActivateTriggerIn(okPipelineBench_EP_TRIGGER, okPipelineBench_BIT_ABORT);
+
+		t = okBenchClock::now();
+		for (int i=0; i<opt.polls; i++) {
+			dev->UpdateWireOuts();
+			volatile unsigned long samples = (dev->GetWireOutValue(okPipelineBench_EP_SAMPLES_HIGH) << 16) |
+					dev->GetWireOutValue(okPipelineBench_EP_SAMPLES_LOW);
+			volatile unsigned long status = dev->GetWireOutValue(okPipelineBench_EP_STATUS);
+			(void)samples;
+			(void)status;
+		}
+		best[4] = std::min(best[4], secondsSince(t));
+	}
+
+	report(csv, corpus.name, "validate", records, best[0]);
+	report(csv, corpus.name, "decode", records, best[1]);
+	report(csv, corpus.name, "nativeEncode", records, best[2]);
+	report(csv, corpus.name, "upload", records, best[3]);
+	report(csv, corpus.name, "poll", opt.polls, best[4]);
+
+	if (!valid)
+		fprintf(stderr, "%s: fails the upload preflight (flags 0x%02x, first bad record %lld)\n",
+			corpus.name.c_str(), stats.flags, (long long)stats.firstBadRecord);
+	if (!same)
+		fprintf(stderr, "%s: okSegmentEncoder output differs from the corpus\n", corpus.name.c_str());
+	if (!uploaded)
+		fprintf(stderr, "%s: upload failed or CRC mismatch\n", corpus.name.c_str());
+	return(valid && same && uploaded);
+}
+
+
+static void
+usage(const char *argv0)
+{
+	fprintf(stderr, "usage: %s [-l lib] [-s serial] [-r reps] [-N records] [-p polls] [-o csv] [corpus.fifo ...]\n", argv0);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	okPipelineOptions opt;
+	opt.reps = 5;
+	opt.records = 20000;
+	opt.polls = 1000;
+
+	int c;
+	while (-1 != (c = getopt(argc, argv, "l:s:r:N:p:o:"))) {
+		switch (c) {
+			case 'l': opt.lib = optarg;             break;
+			case 's': opt.serial = optarg;          break;
+			case 'r': opt.reps = atoi(optarg);      break;
+			case 'N': opt.records = atol(optarg);   break;
+			case 'p': opt.polls = atoi(optarg);     break;
+			case 'o': opt.csv = optarg;             break;
+			default:
+				usage(argv[0]);
+				return(1);
+		}
+	}
+	if ((opt.reps <= 0) || (opt.records < 2) || (opt.polls <= 0)) {
+		usage(argv[0]);
+		return(1);
+	}
+
+	std::vector<okPipelineCorpus> corpora;
+	for (int i=optind; i<argc; i++) {
+		okPipelineCorpus corpus;
+		if (!loadCorpus(argv[i], &corpus) || (0 != corpus.data.size() % okSegmentDecoder_RECORD_SIZE)) {
+			fprintf(stderr, "Could not read a segment stream from %s\n", argv[i]);
+			return(1);
+		}
+		corpora.push_back(corpus);
+	}
+	if (corpora.empty()) {
+		const char *names[] = { "segments", "retriggers", "dwells" };
+		for (int i=0; i<3; i++) {
+			corpora.push_back(okPipelineCorpus());
+			synthesize(names[i], opt.records, &corpora.back());
+		}
+	}
+
+	if (FALSE == okFrontPanelDLL_LoadLib(opt.lib.empty() ? NULL : opt.lib.c_str())) {
+		fprintf(stderr, "Could not load FrontPanel library\n");
+		return(1);
+	}
+
+	okCFrontPanel dev;
+	if (okCFrontPanel::NoError != dev.OpenBySerial(opt.serial)) {
+		fprintf(stderr, "Could not open board '%s'\n", opt.serial.c_str());
+		return(1);
+	}
+	printf("Board %s (%s), best of %d, %d polls, encoder ISA %d\n\n",
+		dev.GetSerialNumber().c_str(), dev.GetBoardModelString(dev.GetBoardModel()).c_str(),
+		opt.reps, opt.polls, okCSegmentEncoder::GetInstructionSet());
+
+	FILE *csv = NULL;
+	if (!opt.csv.empty()) {
+		csv = fopen(opt.csv.c_str(), "a");
+		if ((NULL != csv) && (0 == ftell(csv)))
+			fprintf(csv, "corpus,stage,records,bytes,seconds,records_per_s,MB_per_s\n");
+	}
+
+	printf("%-16s %-12s %9s %12s %14s %10s\n", "corpus", "stage", "records", "ms", "records/s", "MB/s");
+	bool ok = true;
+	for (size_t i=0; i<corpora.size(); i++)
+		ok = benchmark(&dev, opt, corpora[i], csv) && ok;
+
+	if (NULL != csv)
+		fclose(csv);
+	return(ok ? (0) : (2));
+}
+
+#endif // !_WIN32
@@ -0,0 +1,260 @@
+//------------------------------------------------------------------------
+// okRealtime.cpp
+//
+// See okRealtime.h.
+//------------------------------------------------------------------------
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+#include <thread>
+
+#if defined(_WIN32)
+	#include <windows.h>
+	#include <malloc.h>
+#else
+	#include <pthread.h>
+	#include <sched.h>
+	#include <time.h>
+	#include <alloca.h>
+	#include <sys/mman.h>
+#endif
+
+#include "okRealtime.h"
+
+
+void
+okCRealtime::DefaultConfig(okRealtimeConfig *config)
+{
+	config->cpu = -1;
+	config->priority = 0;
+	config->lockMemory = 0;
+	config->prefaultStack = okRealtime_DEFAULT_STACK;
+}
+
+
+// Touches the given amount of stack below the caller so those pages are
+// resident (and, after mlockall, locked) before the time-critical work.
+void
+okCRealtime::PrefaultStack(int bytes)
+{
+	if (bytes <= 0)
+		return;
+	if (bytes > okRealtime_MAX_STACK)
+		bytes = okRealtime_MAX_STACK;
+#if defined(_WIN32)
+	volatile unsigned char *p = (volatile unsigned char *)_alloca(bytes);
+#else
+	volatile unsigned char *p = (volatile unsigned char *)alloca(bytes);
+#endif
+	for (int i=0; i<bytes; i+=4096)
+		p[i] = 0;
+	p[bytes-1] = 0;
+}
+
+
+int
+okCRealtime::Apply(const okRealtimeConfig& config)
+{
+	int result = 0;
+
+#if defined(_WIN32)
+	if ((config.cpu >= 0) && (config.cpu < (int)(8*sizeof(DWORD_PTR)))) {
+		if (0 != SetThreadAffinityMask(GetCurrentThread(), ((DWORD_PTR)1) << config.cpu))
+			result |= okRealtime_AFFINITY;
+	}
+	if (config.priority > 0) {
+		if (SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL))
+			result |= okRealtime_PRIORITY;
+	}
+#else
+	#if defined(__linux__)
+	if (config.cpu >= 0) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(config.cpu, &set);
+		if (0 == pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+			result |= okRealtime_AFFINITY;
+	}
+	#endif
+	if (config.priority > 0) {
+		struct sched_param param;
+		memset(&param, 0, sizeof(param));
+		int lo = sched_get_priority_min(SCHED_FIFO);
+		int hi = sched_get_priority_max(SCHED_FIFO);
+		param.sched_priority = (config.priority < lo) ? (lo) : ((config.priority > hi) ? (hi) : (config.priority));
+		if (0 == pthread_setschedparam(pthread_self(), SCHED_FIFO, &param))
+			result |= okRealtime_PRIORITY;
+	}
+	if (config.lockMemory) {
+		if (0 == mlockall(MCL_CURRENT | MCL_FUTURE))
+			result |= okRealtime_MEMORY_LOCKED;
+	}
+#endif
+
+	// After mlockall, so the touched pages stay locked.
+	if (config.prefaultStack > 0) {
+		PrefaultStack(config.prefaultStack);
+		result |= okRealtime_STACK_PREFAULTED;
+	}
+	return(result);
+}
+
+
+double
+okCRealtime::Percentile(const std::vector<double>& sorted, double p)
+{
+	if (sorted.empty())
+		return(0.0);
+	size_t i = (size_t)ceil(p / 100.0 * sorted.size());
+	if (i > 0)
+		i--;
+	if (i >= sorted.size())
+		i = sorted.size() - 1;
+	return(sorted[i]);
+}
+
+
+//------------------------------------------------------------------------
+// okCRealtimeLoop
+//------------------------------------------------------------------------
+okCRealtimeLoop::okCRealtimeLoop(int periodUs)
+	: m_started(false)
+{
+	SetPeriod(periodUs);
+	ResetStats();
+}
+
+
+void
+okCRealtimeLoop::SetPeriod(int periodUs)
+{
+	m_period = std::chrono::microseconds((periodUs > 0) ? (periodUs) : (1));
+}
+
+
+void
+okCRealtimeLoop::Start()
+{
+	m_deadline = std::chrono::steady_clock::now();
+	m_started = true;
+}
+
+
+void
+okCRealtimeLoop::Wait()
+{
+	if (!m_started)
+		Start();
+	m_deadline += m_period;
+
+#if defined(__linux__)
+	// steady_clock is CLOCK_MONOTONIC on Linux, so the deadline can be
+	// handed to the kernel as an absolute time.
+	std::chrono::nanoseconds ns = std::chrono::duration_cast<std::chrono::nanoseconds>(m_deadline.time_since_epoch());
+	struct timespec ts;
+	ts.tv_sec = (time_t)(ns.count() / 1000000000);
+	ts.tv_nsec = (long)(ns.count() % 1000000000);
+	while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL))
+		;
+#else
+	std::this_thread::sleep_until(m_deadline);
+#endif
+
+	Record(m_deadline);
+
+	// Don't try to catch up on periods that are already gone.
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	while (now - m_deadline > m_period) {
+		m_deadline += m_period;
+		m_overruns++;
+	}
+}
+
+
+void
+okCRealtimeLoop::Record(std::chrono::steady_clock::time_point due)
+{
+	double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - due).count();
+	if (us < 0.0)
+		us = 0.0;
+
+	if ((0 == m_wakeups) || (us < m_min))
+		m_min = us;
+	if (us > m_max)
+		m_max = us;
+	m_sum += us;
+	m_wakeups++;
+
+	int bin = 0;
+	while ((bin < okRealtime_HISTOGRAM_BINS-1) && (us >= (double)(1L << bin)))
+		bin++;
+	m_histogram[bin]++;
+}
+
+
+void
+okCRealtimeLoop::GetStats(okRealtimeStats *stats) const
+{
+	stats->wakeups = m_wakeups;
+	stats->overruns = m_overruns;
+	stats->latencyUsMin = m_min;
+	stats->latencyUsMax = m_max;
+	stats->latencyUsMean = (m_wakeups > 0) ? (m_sum / m_wakeups) : (0.0);
+	memcpy(stats->histogram, m_histogram, sizeof(m_histogram));
+}
+
+
+void
+okCRealtimeLoop::ResetStats()
+{
+	m_wakeups = 0;
+	m_overruns = 0;
+	m_min = 0.0;
+	m_max = 0.0;
+	m_sum = 0.0;
+	memset(m_histogram, 0, sizeof(m_histogram));
+}
+
+
+//------------------------------------------------------------------------
+// C entry points
+//------------------------------------------------------------------------
+okDLLEXPORT int DLL_ENTRY
+okRealtime_Apply(int cpu, int priority, int lockMemory, int prefaultStack)
+{
+	okRealtimeConfig config;
+	config.cpu = cpu;
+	config.priority = priority;
+	config.lockMemory = lockMemory;
+	config.prefaultStack = prefaultStack;
+	return(okCRealtime::Apply(config));
+}
+
+
+okDLLEXPORT okRealtimeLoop_HANDLE DLL_ENTRY
+okRealtimeLoop_Construct(int periodUs)
+{
+	return((okRealtimeLoop_HANDLE) new okCRealtimeLoop(periodUs));
+}
+
+
+okDLLEXPORT void DLL_ENTRY
+okRealtimeLoop_Destruct(okRealtimeLoop_HANDLE loop)
+{
+	delete (okCRealtimeLoop *)loop;
+}
+
+
+okDLLEXPORT void DLL_ENTRY
+okRealtimeLoop_Wait(okRealtimeLoop_HANDLE loop)
+{
+	((okCRealtimeLoop *)loop)->Wait();
+}
+
+
+okDLLEXPORT void DLL_ENTRY
+okRealtimeLoop_GetStats(okRealtimeLoop_HANDLE loop, okRealtimeStats *stats)
+{
+	((okCRealtimeLoop *)loop)->GetStats(stats);
+}
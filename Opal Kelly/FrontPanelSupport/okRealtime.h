@@ -0,0 +1,125 @@
+//------------------------------------------------------------------------
+// okRealtime.h
+//
+// Helpers for the threads that talk to the board during a shot (status
+// polling, start trigger, streaming upload).
+//
+// okCRealtime::Apply() configures the calling thread: CPU affinity, an
+// optional SCHED_FIFO priority, mlockall() and a pre-faulted stack, so the
+// first page faults and migrations happen before the shot instead of in
+// the middle of it.  It returns the okRealtime_* flags of the settings that
+// actually took effect; without the needed privileges the thread simply
+// keeps running at normal priority.
+//
+// okCRealtimeLoop is a fixed-period run loop on absolute deadlines that
+// records how late each wakeup was -- the scheduling latency the thread
+// actually sees on the machine.
+//
+// okCRealtime::Percentile() is the nearest-rank percentile the latency and
+// shot telemetry reports share.
+//
+// Windows: affinity and THREAD_PRIORITY_TIME_CRITICAL are supported,
+// memory locking is not.
+//------------------------------------------------------------------------
+
+#ifndef __okRealtime_h__
+#define __okRealtime_h__
+
+#include <stddef.h>
+#include <chrono>
+#include <vector>
+
+#include "okFrontPanelDLL.h"
+
+// Apply() result flags
+#define okRealtime_AFFINITY          0x01
+#define okRealtime_PRIORITY          0x02
+#define okRealtime_MEMORY_LOCKED     0x04
+#define okRealtime_STACK_PREFAULTED  0x08
+
+#define okRealtime_DEFAULT_STACK     (256*1024)
+#define okRealtime_MAX_STACK         (4*1024*1024)
+#define okRealtime_HISTOGRAM_BINS    16       // bin n: latency < 2^n us; last bin catches the rest
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void* okRealtimeLoop_HANDLE;
+
+typedef struct {
+	int cpu;                     // -1: leave affinity alone
+	int priority;                // SCHED_FIFO priority 1-99, 0: leave alone
+	int lockMemory;              // mlockall(MCL_CURRENT | MCL_FUTURE)
+	int prefaultStack;           // bytes, 0: none
+} okRealtimeConfig;
+
+typedef struct {
+	long wakeups;
+	long overruns;               // periods skipped because a wakeup was later than one period
+	double latencyUsMin;
+	double latencyUsMax;
+	double latencyUsMean;
+	long histogram[okRealtime_HISTOGRAM_BINS];
+} okRealtimeStats;
+
+okDLLEXPORT int DLL_ENTRY okRealtime_Apply(int cpu, int priority, int lockMemory, int prefaultStack);
+okDLLEXPORT okRealtimeLoop_HANDLE DLL_ENTRY okRealtimeLoop_Construct(int periodUs);
+okDLLEXPORT void DLL_ENTRY okRealtimeLoop_Destruct(okRealtimeLoop_HANDLE loop);
+okDLLEXPORT void DLL_ENTRY okRealtimeLoop_Wait(okRealtimeLoop_HANDLE loop);
+okDLLEXPORT void DLL_ENTRY okRealtimeLoop_GetStats(okRealtimeLoop_HANDLE loop, okRealtimeStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+//------------------------------------------------------------------------
+// okCRealtime
+//------------------------------------------------------------------------
+class okCRealtime
+{
+public:
+	static void DefaultConfig(okRealtimeConfig *config);
+	static int Apply(const okRealtimeConfig& config);
+	static void PrefaultStack(int bytes);
+	// Nearest-rank percentile (0 - 100) of an ascending sample; 0 if empty.
+	static double Percentile(const std::vector<double>& sorted, double p);
+};
+
+
+//------------------------------------------------------------------------
+// okCRealtimeLoop
+//------------------------------------------------------------------------
+class okCRealtimeLoop
+{
+public:
+	okCRealtimeLoop(int periodUs);
+
+	void SetPeriod(int periodUs);
+	// Restarts the deadline sequence from now.  Called implicitly by the
+	// first Wait().
+	void Start();
+	// Sleeps until the next deadline and records the wakeup latency.
+	void Wait();
+
+	// Records the latency of a wakeup the caller scheduled itself, e.g.
+	// after waiting on an event with a known due time.
+	void Record(std::chrono::steady_clock::time_point due);
+
+	void GetStats(okRealtimeStats *stats) const;
+	void ResetStats();
+
+private:
+	std::chrono::steady_clock::duration m_period;
+	std::chrono::steady_clock::time_point m_deadline;
+	bool m_started;
+	long m_wakeups;
+	long m_overruns;
+	double m_min;
+	double m_max;
+	double m_sum;
+	long m_histogram[okRealtime_HISTOGRAM_BINS];
+};
+
+#endif // __okRealtime_h__
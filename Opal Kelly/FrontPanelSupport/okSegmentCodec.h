@@ -0,0 +1,40 @@
+//------------------------------------------------------------------------
+// okSegmentCodec.h
+//
+// Export decoration for okSegmentCodec, the DLL / shared object that
+// packages okSegmentEncoder, okSegmentDecoder and okTimebaseCache for
+// managed code (Atticus loads it through AtticusServer/Wrappers/
+// OkSegmentCodec.cs and OkTimebaseCache.cs).  okUploadCRC and, for the
+// okCFrontPanel calls okUploadCRC makes, okFrontPanelDLL.cpp go in with
+// them.  Build it with okSEGMENTCODEC_EXPORTS defined:
+//
+//    Windows   okSegmentCodec.vcxproj (in WordGenerator.sln; Visual Studio
+//              2012 or later for the AVX2 intrinsics), giving
+//              bin\Win32\okSegmentCodec.dll and bin\x64\okSegmentCodec.dll,
+//              which the Atticus post-build step copies next to Atticus.exe
+//    POSIX     g++ -std=c++11 -O2 -shared -fPIC -fvisibility=hidden
+//                  -DokSEGMENTCODEC_EXPORTS -I<API dir> okSegmentEncoder.cpp
+//                  okSegmentDecoder.cpp okTimebaseCache.cpp okUploadCRC.cpp
+//                  <API dir>/okFrontPanelDLL.cpp -ldl -o libokSegmentCodec.so
+//
+// Code that compiles the sources into its own binary needs neither.  The
+// entry points use DLL_ENTRY (__stdcall on 32-bit Windows), which is what
+// [DllImport] assumes by default.
+//------------------------------------------------------------------------
+
+#ifndef __okSegmentCodec_h__
+#define __okSegmentCodec_h__
+
+#include "okFrontPanelDLL.h"
+
+#if defined(_WIN32)
+	#if defined(okSEGMENTCODEC_EXPORTS)
+		#define okSEGMENTCODEC_API    __declspec(dllexport)
+	#else
+		#define okSEGMENTCODEC_API
+	#endif
+#else
+	#define okSEGMENTCODEC_API        __attribute__((visibility("default")))
+#endif
+
+#endif // __okSegmentCodec_h__
@@ -0,0 +1,293 @@
+//------------------------------------------------------------------------
+// okSegmentDecoder.cpp
+//
+// See okSegmentDecoder.h.
+//
+// Viewed as four little-endian 32-bit words d0..d3 (see okSegmentEncoder),
+//
+//    on  = (d0 & 0xffff) << 32  |  d0 & 0xffff0000  |  d1 & 0xffff
+//    off = (d1 >> 16) << 32     |  rotl(d2, 16)
+//    rep = rotl(d3, 16)
+//
+// so the SSE2 path transposes four records into d0..d3 registers and
+// widens the halves back into 64-bit counts with unpacks.
+//------------------------------------------------------------------------
+
+#include <string.h>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+	#include <emmintrin.h>
+	#define okSegmentDecoder_SSE2   1
+#endif
+
+#include "okSegmentDecoder.h"
+
+#define CHUNK   256                  // records decoded at a time by Validate()
+
+
+static inline unsigned int
+word(const unsigned char *p)
+{
+	return((unsigned int)p[0] | ((unsigned int)p[1] << 8) | ((unsigned int)p[2] << 16) | ((unsigned int)p[3] << 24));
+}
+
+
+static inline unsigned int
+rotl16(unsigned int x)
+{
+	return((x << 16) | (x >> 16));
+}
+
+
+static void
+decodeScalar(const unsigned char *data, long count, unsigned long long *on,
+		unsigned long long *off, unsigned int *rep)
+{
+	for (long i=0; i<count; i++) {
+		const unsigned char *r = data + okSegmentDecoder_RECORD_SIZE * i;
+		unsigned int d0 = word(r), d1 = word(r + 4), d2 = word(r + 8), d3 = word(r + 12);
+		if (NULL != on)
+			on[i] = ((unsigned long long)(d0 & 0xffff) << 32) | (d0 & 0xffff0000) | (d1 & 0xffff);
+		if (NULL != off)
+			off[i] = ((unsigned long long)(d1 >> 16) << 32) | rotl16(d2);
+		if (NULL != rep)
+			rep[i] = rotl16(d3);
+	}
+}
+
+
+#if defined(okSegmentDecoder_SSE2)
+// Four records per iteration; all three outputs are required.
+static long
+decodeSSE2(const unsigned char *data, long count, unsigned long long *on,
+		unsigned long long *off, unsigned int *rep)
+{
+	const __m128i loMask = _mm_set1_epi32(0x0000ffff);
+	const __m128i hiMask = _mm_set1_epi32((int)0xffff0000);
+	long i = 0;
+
+	for (; i+4<=count; i+=4) {
+		const __m128i *r = (const __m128i *)(data + okSegmentDecoder_RECORD_SIZE * i);
+		__m128i r0 = _mm_loadu_si128(r + 0);
+		__m128i r1 = _mm_loadu_si128(r + 1);
+		__m128i r2 = _mm_loadu_si128(r + 2);
+		__m128i r3 = _mm_loadu_si128(r + 3);
+
+		__m128i t0 = _mm_unpacklo_epi32(r0, r1);         // a0 b0 a1 b1
+		__m128i t1 = _mm_unpacklo_epi32(r2, r3);         // c0 d0 c1 d1
+		__m128i t2 = _mm_unpackhi_epi32(r0, r1);         // a2 b2 a3 b3
+		__m128i t3 = _mm_unpackhi_epi32(r2, r3);         // c2 d2 c3 d3
+		__m128i d0 = _mm_unpacklo_epi64(t0, t1);
+		__m128i d1 = _mm_unpackhi_epi64(t0, t1);
+		__m128i d2 = _mm_unpacklo_epi64(t2, t3);
+		__m128i d3 = _mm_unpackhi_epi64(t2, t3);
+
+		__m128i onLo = _mm_or_si128(_mm_and_si128(d0, hiMask), _mm_and_si128(d1, loMask));
+		__m128i onHi = _mm_and_si128(d0, loMask);
+		__m128i offLo = _mm_or_si128(_mm_slli_epi32(d2, 16), _mm_srli_epi32(d2, 16));
+		__m128i offHi = _mm_srli_epi32(d1, 16);
+		__m128i repR = _mm_or_si128(_mm_slli_epi32(d3, 16), _mm_srli_epi32(d3, 16));
+
+		_mm_storeu_si128((__m128i *)(on + i),      _mm_unpacklo_epi32(onLo, onHi));
+		_mm_storeu_si128((__m128i *)(on + i + 2),  _mm_unpackhi_epi32(onLo, onHi));
+		_mm_storeu_si128((__m128i *)(off + i),     _mm_unpacklo_epi32(offLo, offHi));
+		_mm_storeu_si128((__m128i *)(off + i + 2), _mm_unpackhi_epi32(offLo, offHi));
+		_mm_storeu_si128((__m128i *)(rep + i),     repR);
+	}
+	return(i);
+}
+#endif
+
+
+long
+okCSegmentDecoder::Decode(const unsigned char *data, long length, unsigned long long *onCounts,
+		unsigned long long *offCounts, unsigned int *repeats)
+{
+	if ((length < 0) || (0 != length % okSegmentDecoder_RECORD_SIZE))
+		return(-1);
+
+	long count = length / okSegmentDecoder_RECORD_SIZE;
+	long done = 0;
+#if defined(okSegmentDecoder_SSE2)
+	if ((NULL != onCounts) && (NULL != offCounts) && (NULL != repeats))
+		done = decodeSSE2(data, count, onCounts, offCounts, repeats);
+#endif
+	decodeScalar(data + okSegmentDecoder_RECORD_SIZE * done, count - done,
+			(NULL != onCounts) ? (onCounts + done) : (NULL),
+			(NULL != offCounts) ? (offCounts + done) : (NULL),
+			(NULL != repeats) ? (repeats + done) : (NULL));
+	return(count);
+}
+
+
+// (on + off) * rep; false on overflow.  The period is at most 49 bits, so
+// the product is formed from 32-bit halves.
+static inline bool
+recordSamples(unsigned long long on, unsigned long long off, unsigned int rep, unsigned long long *samples)
+{
+	unsigned long long period = on + off;
+	unsigned long long hi = (period >> 32) * rep;
+	unsigned long long lo = (period & 0xffffffffULL) * rep;
+	if (hi >> 32)
+		return(false);
+	*samples = (hi << 32) + lo;
+	return(*samples >= lo);
+}
+
+
+// Inclusive scan of 64-bit values, two lanes at a time: each pair is
+// scanned in-register and offset by the running total of the pairs before.
+static void
+scan64(unsigned long long *x, long count)
+{
+	long i = 0;
+#if defined(okSegmentDecoder_SSE2)
+	__m128i carry = _mm_setzero_si128();
+	for (; i+2<=count; i+=2) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(x + i));
+		v = _mm_add_epi64(v, _mm_slli_si128(v, 8));
+		v = _mm_add_epi64(v, carry);
+		_mm_storeu_si128((__m128i *)(x + i), v);
+		carry = _mm_unpackhi_epi64(v, v);
+	}
+#endif
+	for (; i<count; i++)
+		x[i] += (i > 0) ? (x[i-1]) : (0);
+}
+
+
+bool
+okCSegmentDecoder::PrefixSums(const unsigned long long *onCounts, const unsigned long long *offCounts,
+		const unsigned int *repeats, long count, unsigned long long *clockEdges,
+		unsigned long long *masterSamples)
+{
+	if (count <= 0)
+		return(true);
+
+	if (NULL != clockEdges) {
+		for (long i=0; i<count; i++)
+			clockEdges[i] = repeats[i];
+		scan64(clockEdges, count);
+	}
+
+	if (NULL != masterSamples) {
+		// Overflow is checked on the way in: with a total that fits, no
+		// partial sum of the scan can wrap.
+		unsigned long long total = 0;
+		for (long i=0; i<count; i++) {
+			if (!recordSamples(onCounts[i], offCounts[i], repeats[i], &masterSamples[i]))
+				return(false);
+			total += masterSamples[i];
+			if (total < masterSamples[i])
+				return(false);
+		}
+		scan64(masterSamples, count);
+	}
+	return(true);
+}
+
+
+void
+okCSegmentDecoder::ValidateBegin(okSegmentStats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+	stats->firstBadRecord = -1;
+}
+
+
+bool
+okCSegmentDecoder::ValidateAdd(const unsigned char *data, long long length, okSegmentStats *stats)
+{
+	unsigned long long on[CHUNK], off[CHUNK];
+	unsigned int rep[CHUNK];
+	okSegmentStats &s = *stats;
+
+	if ((length < 0) || (0 != length % okSegmentDecoder_RECORD_SIZE))
+		s.flags |= okSegmentDecoder_TRUNCATED;
+
+	long long count = (length > 0) ? (length / okSegmentDecoder_RECORD_SIZE) : (0);
+	for (long long base=0; base<count; base+=CHUNK) {
+		long n = (count - base < CHUNK) ? ((long)(count - base)) : (CHUNK);
+		Decode(data + okSegmentDecoder_RECORD_SIZE * base, okSegmentDecoder_RECORD_SIZE * n, on, off, rep);
+
+		for (long i=0; i<n; i++) {
+			unsigned int bad = 0;
+			if (0 == rep[i]) {
+				s.retriggers++;
+				if (0 == on[i]) {
+					s.untimedRetriggers++;
+					if (0 == off[i])
+						s.flags |= okSegmentDecoder_ALL_ZERO;
+				}
+				// The firmware counts the wait in 32 bits.
+				if (on[i] > 0xffffffffULL)
+					bad |= okSegmentDecoder_OVERFLOW;
+				else
+					s.retriggerTimeoutSamples += on[i];
+				if (off[i] > 3)
+					bad |= okSegmentDecoder_RETRIGGER_FLAGS;
+			}
+			else {
+				unsigned long long samples;
+				s.clockEdges += rep[i];
+				if ((0 == on[i]) || (0 == off[i]))
+					bad |= okSegmentDecoder_ZERO_PHASE;
+				if (!recordSamples(on[i], off[i], rep[i], &samples) ||
+						(s.masterSamples + samples < samples)) {
+					bad |= okSegmentDecoder_OVERFLOW;
+				}
+				else {
+					s.masterSamples += samples;
+				}
+			}
+			if (0 != bad) {
+				s.flags |= bad;
+				if (s.badRecords++ == 0)
+					s.firstBadRecord = s.records + base + i;
+			}
+		}
+	}
+	s.records += count;
+	return(0 == (s.flags & okSegmentDecoder_ERRORS));
+}
+
+
+bool
+okCSegmentDecoder::ValidateEnd(double masterClockPeriod, okSegmentStats *stats)
+{
+	okSegmentStats &s = *stats;
+
+	if (s.records == s.retriggers)
+		s.flags |= okSegmentDecoder_EMPTY;
+
+	s.minDuration = (double)s.masterSamples * masterClockPeriod;
+	if (s.untimedRetriggers > 0)
+		s.maxDuration = -1.0;
+	else
+		s.maxDuration = (double)(s.masterSamples + s.retriggerTimeoutSamples) * masterClockPeriod;
+	return(0 == (s.flags & okSegmentDecoder_ERRORS));
+}
+
+
+bool
+okCSegmentDecoder::Validate(const unsigned char *data, long long length, double masterClockPeriod, okSegmentStats *stats)
+{
+	okSegmentStats s;
+
+	ValidateBegin(&s);
+	ValidateAdd(data, length, &s);
+	bool ok = ValidateEnd(masterClockPeriod, &s);
+	if (NULL != stats)
+		*stats = s;
+	return(ok);
+}
+
+
+//------------------------------------------------------------------------
+// C exports
+//------------------------------------------------------------------------
+okSEGMENTCODEC_API int DLL_ENTRY
+okSegmentDecoder_Validate(const unsigned char *data, long long length, double masterClockPeriod, okSegmentStats *stats)
+{
+	return(okCSegmentDecoder::Validate(data, length, masterClockPeriod, stats) ? (1) : (0));
+}
@@ -0,0 +1,108 @@
+//------------------------------------------------------------------------
+// okSegmentDecoder.h
+//
+// Decoder and preflight validator for AvivFPGA2 segment FIFO records, the
+// inverse of okSegmentEncoder.  Each 16-byte record decodes to 48-bit on /
+// off counts and 32-bit repeats; repeats == 0 marks a wait-for-retrigger
+// record whose on count is the timeout (0 = none) and whose off count holds
+// the trigger flags (bit 0 edge, bit 1 positive).
+//
+// Validate() checks a whole upload and totals what the board will do with
+// it.  For the timed records the firmware spends (on + off) master samples
+// per repeat and gives one clock edge per repeat, so
+//
+//    masterSamples   final value of the master-sample counter (0x22 / 0x23
+//                    hold its low 32 bits)
+//    clockEdges      derived samples clocked out
+//    duration        masterSamples * period, plus the retrigger waits
+//
+// Run it before WriteToPipeIn: a malformed upload is rejected in
+// microseconds instead of showing up as a wasted shot.  okGroupArm,
+// okSegmentStreamer, okPipeStreamer (SetValidation) and, through
+// okSegmentCodec, Atticus' FpgaTimebaseTask all do.  Uploads that are
+// streamed in pieces use ValidateBegin() / ValidateAdd() / ValidateEnd(),
+// which give the same result as one Validate() over the whole upload.
+// PrefixSums() gives the running edge / sample counts per record, e.g. to
+// map a mistrigger sample number back to its record.
+//
+// okSegmentStats has only 64-bit and double fields ahead of flags, so its
+// layout is the same on every platform and marshals as is.
+//------------------------------------------------------------------------
+
+#ifndef __okSegmentDecoder_h__
+#define __okSegmentDecoder_h__
+
+#include "okSegmentCodec.h"
+
+#define okSegmentDecoder_RECORD_SIZE       16
+
+// okSegmentStats.flags
+#define okSegmentDecoder_ZERO_PHASE        0x01     // timed record with on or off count 0
+#define okSegmentDecoder_OVERFLOW          0x02     // totals overflow, or retrigger timeout beyond 32 bits
+#define okSegmentDecoder_RETRIGGER_FLAGS   0x04     // retrigger record with bits above 1 set in its flags
+#define okSegmentDecoder_TRUNCATED         0x08     // length is not a whole number of records
+#define okSegmentDecoder_EMPTY             0x10     // no timed record at all
+#define okSegmentDecoder_ALL_ZERO          0x20     // retrigger record with no timeout and flags 0; legal but
+                                                    // usually a segment that should have been filtered out
+#define okSegmentDecoder_ERRORS            0x1f     // flags that fail Validate()
+
+typedef struct {
+	long long records;
+	long long retriggers;
+	long long untimedRetriggers;             // retriggers without a timeout
+	unsigned long long masterSamples;
+	unsigned long long clockEdges;
+	unsigned long long retriggerTimeoutSamples;   // sum of the timeouts that are set
+	double minDuration;                      // seconds, every retrigger arriving at once
+	double maxDuration;                      // seconds, every timed retrigger timing out;
+	                                         // negative when an untimed retrigger can wait forever
+	unsigned int flags;
+	long long badRecords;                    // records with an error flag
+	long long firstBadRecord;                // -1 if none
+} okSegmentStats;
+
+
+//------------------------------------------------------------------------
+// okCSegmentDecoder
+//------------------------------------------------------------------------
+class okCSegmentDecoder
+{
+public:
+	// Decodes length / 16 records into the arrays (each may be NULL).
+	// Returns the number of records, or -1 if length is not a multiple of 16.
+	static long Decode(const unsigned char *data, long length, unsigned long long *onCounts,
+			unsigned long long *offCounts, unsigned int *repeats);
+
+	// Inclusive running totals of clock edges and master samples per record
+	// (either output may be NULL).  Retrigger records add nothing.  Returns
+	// false if a master sample total overflows 64 bits.
+	static bool PrefixSums(const unsigned long long *onCounts, const unsigned long long *offCounts,
+			const unsigned int *repeats, long count, unsigned long long *clockEdges,
+			unsigned long long *masterSamples);
+
+	// Checks and totals an encoded upload.  Returns true when no error flag
+	// is set.  masterClockPeriod is in seconds.
+	static bool Validate(const unsigned char *data, long long length, double masterClockPeriod, okSegmentStats *stats);
+
+	// The same in pieces: Begin() clears stats, each Add() checks the next
+	// length bytes (record numbers continue across calls) and End() sets the
+	// durations and the EMPTY flag.  Add() returns false as soon as an error
+	// flag is set, so a streamer can stop before writing the bad piece.
+	static void ValidateBegin(okSegmentStats *stats);
+	static bool ValidateAdd(const unsigned char *data, long long length, okSegmentStats *stats);
+	static bool ValidateEnd(double masterClockPeriod, okSegmentStats *stats);
+};
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+okSEGMENTCODEC_API int DLL_ENTRY okSegmentDecoder_Validate(const unsigned char *data, long long length,
+		double masterClockPeriod, okSegmentStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __okSegmentDecoder_h__
@@ -0,0 +1,271 @@
+//------------------------------------------------------------------------
+// okSegmentEncoder.cpp
+//
+// See okSegmentEncoder.h.
+//
+// Viewed as four little-endian 32-bit words, a record is
+//
+//    on & 0xffff0000,  on & 0x0000ffff,  rotl(off, 16),  rotl(rep, 16)
+//
+// so the vector paths mask / rotate whole registers of counts and then
+// transpose them into records with unpack instructions.
+//------------------------------------------------------------------------
+
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+	#define okSegmentEncoder_X86    1
+	#if defined(_MSC_VER)
+		#include <intrin.h>
+		#include <immintrin.h>
+		#define okSegmentEncoder_AVX2_TARGET
+	#else
+		#include <cpuid.h>
+		#include <immintrin.h>
+		#define okSegmentEncoder_AVX2_TARGET __attribute__((target("avx2")))
+	#endif
+	#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+		#define okSegmentEncoder_SSE2   1
+	#endif
+#endif
+
+#include "okSegmentEncoder.h"
+
+
+//------------------------------------------------------------------------
+// Scalar
+//------------------------------------------------------------------------
+static void
+encodeScalar(const unsigned int *on, const unsigned int *off, const unsigned int *rep,
+		long long count, unsigned char *out)
+{
+	for (long long i=0; i<count; i++) {
+		unsigned int a = on[i], b = off[i], c = rep[i];
+		unsigned char *r = out + okSegmentEncoder_RECORD_SIZE * i;
+		r[0]  = 0;                       r[1]  = 0;
+		r[2]  = (unsigned char)(a >> 16); r[3]  = (unsigned char)(a >> 24);
+		r[4]  = (unsigned char)(a);       r[5]  = (unsigned char)(a >> 8);
+		r[6]  = 0;                       r[7]  = 0;
+		r[8]  = (unsigned char)(b >> 16); r[9]  = (unsigned char)(b >> 24);
+		r[10] = (unsigned char)(b);       r[11] = (unsigned char)(b >> 8);
+		r[12] = (unsigned char)(c >> 16); r[13] = (unsigned char)(c >> 24);
+		r[14] = (unsigned char)(c);       r[15] = (unsigned char)(c >> 8);
+	}
+}
+
+
+//------------------------------------------------------------------------
+// SSE2: four records per iteration
+//------------------------------------------------------------------------
+#if defined(okSegmentEncoder_SSE2)
+static long long
+encodeSSE2(const unsigned int *on, const unsigned int *off, const unsigned int *rep,
+		long long count, unsigned char *out)
+{
+	const __m128i hiMask = _mm_set1_epi32((int)0xffff0000);
+	const __m128i loMask = _mm_set1_epi32(0x0000ffff);
+	long long i = 0;
+
+	for (; i+4<=count; i+=4) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(on + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(off + i));
+		__m128i c = _mm_loadu_si128((const __m128i *)(rep + i));
+
+		__m128i onHi = _mm_and_si128(a, hiMask);
+		__m128i onLo = _mm_and_si128(a, loMask);
+		__m128i offR = _mm_or_si128(_mm_slli_epi32(b, 16), _mm_srli_epi32(b, 16));
+		__m128i repR = _mm_or_si128(_mm_slli_epi32(c, 16), _mm_srli_epi32(c, 16));
+
+		__m128i t0 = _mm_unpacklo_epi32(onHi, onLo);     // h0 l0 h1 l1
+		__m128i t1 = _mm_unpacklo_epi32(offR, repR);     // o0 r0 o1 r1
+		__m128i t2 = _mm_unpackhi_epi32(onHi, onLo);     // h2 l2 h3 l3
+		__m128i t3 = _mm_unpackhi_epi32(offR, repR);     // o2 r2 o3 r3
+
+		__m128i *r = (__m128i *)(out + okSegmentEncoder_RECORD_SIZE * i);
+		_mm_storeu_si128(r + 0, _mm_unpacklo_epi64(t0, t1));
+		_mm_storeu_si128(r + 1, _mm_unpackhi_epi64(t0, t1));
+		_mm_storeu_si128(r + 2, _mm_unpacklo_epi64(t2, t3));
+		_mm_storeu_si128(r + 3, _mm_unpackhi_epi64(t2, t3));
+	}
+	return(i);
+}
+#endif
+
+
+//------------------------------------------------------------------------
+// AVX2: eight records per iteration.  The unpacks work within 128-bit
+// lanes, so records come out as (0,4) (1,5) (2,6) (3,7) and are put in
+// order with lane permutes.
+//------------------------------------------------------------------------
+#if defined(okSegmentEncoder_X86)
+static okSegmentEncoder_AVX2_TARGET long long
+encodeAVX2(const unsigned int *on, const unsigned int *off, const unsigned int *rep,
+		long long count, unsigned char *out)
+{
+	const __m256i hiMask = _mm256_set1_epi32((int)0xffff0000);
+	const __m256i loMask = _mm256_set1_epi32(0x0000ffff);
+	long long i = 0;
+
+	for (; i+8<=count; i+=8) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)(on + i));
+		__m256i b = _mm256_loadu_si256((const __m256i *)(off + i));
+		__m256i c = _mm256_loadu_si256((const __m256i *)(rep + i));
+
+		__m256i onHi = _mm256_and_si256(a, hiMask);
+		__m256i onLo = _mm256_and_si256(a, loMask);
+		__m256i offR = _mm256_or_si256(_mm256_slli_epi32(b, 16), _mm256_srli_epi32(b, 16));
+		__m256i repR = _mm256_or_si256(_mm256_slli_epi32(c, 16), _mm256_srli_epi32(c, 16));
+
+		__m256i t0 = _mm256_unpacklo_epi32(onHi, onLo);
+		__m256i t1 = _mm256_unpacklo_epi32(offR, repR);
+		__m256i t2 = _mm256_unpackhi_epi32(onHi, onLo);
+		__m256i t3 = _mm256_unpackhi_epi32(offR, repR);
+
+		__m256i r04 = _mm256_unpacklo_epi64(t0, t1);
+		__m256i r15 = _mm256_unpackhi_epi64(t0, t1);
+		__m256i r26 = _mm256_unpacklo_epi64(t2, t3);
+		__m256i r37 = _mm256_unpackhi_epi64(t2, t3);
+
+		__m256i *r = (__m256i *)(out + okSegmentEncoder_RECORD_SIZE * i);
+		_mm256_storeu_si256(r + 0, _mm256_permute2x128_si256(r04, r15, 0x20));
+		_mm256_storeu_si256(r + 1, _mm256_permute2x128_si256(r26, r37, 0x20));
+		_mm256_storeu_si256(r + 2, _mm256_permute2x128_si256(r04, r15, 0x31));
+		_mm256_storeu_si256(r + 3, _mm256_permute2x128_si256(r26, r37, 0x31));
+	}
+	return(i);
+}
+
+
+static int
+detectInstructionSet()
+{
+	unsigned int info[4];
+#if defined(_MSC_VER)
+	__cpuid((int *)info, 0);
+	unsigned int maxLeaf = info[0];
+	__cpuid((int *)info, 1);
+#else
+	unsigned int maxLeaf = __get_cpuid_max(0, NULL);
+	if (0 == __get_cpuid(1, &info[0], &info[1], &info[2], &info[3]))
+		return(okSegmentEncoder_ISA_SCALAR);
+#endif
+	int isa = (info[3] & (1u << 26)) ? (okSegmentEncoder_ISA_SSE2) : (okSegmentEncoder_ISA_SCALAR);
+
+	// AVX2 needs the OS to save YMM state (OSXSAVE, XCR0 bits 1 and 2).
+	bool osxsave = (0 != (info[2] & (1u << 27)));
+	if (!osxsave || (maxLeaf < 7))
+		return(isa);
+#if defined(_MSC_VER)
+	unsigned long long xcr0 = _xgetbv(0);
+	__cpuidex((int *)info, 7, 0);
+#else
+	unsigned int xlo, xhi;
+	__asm__ ("xgetbv" : "=a" (xlo), "=d" (xhi) : "c" (0));
+	unsigned long long xcr0 = ((unsigned long long)xhi << 32) | xlo;
+	__cpuid_count(7, 0, info[0], info[1], info[2], info[3]);
+#endif
+	if ((6 == (xcr0 & 6)) && (info[1] & (1u << 5)))
+		isa = okSegmentEncoder_ISA_AVX2;
+	return(isa);
+}
+#endif
+
+
+int
+okCSegmentEncoder::GetInstructionSet()
+{
+#if defined(okSegmentEncoder_X86)
+	static const int isa = detectInstructionSet();
+	return(isa);
+#else
+	return(okSegmentEncoder_ISA_SCALAR);
+#endif
+}
+
+
+long long
+okCSegmentEncoder::EncodeWith(int isa, const unsigned int *onCounts, const unsigned int *offCounts,
+		const unsigned int *repeats, long long count, unsigned char *output)
+{
+	if (count <= 0)
+		return(0);
+	if (isa > GetInstructionSet())
+		isa = GetInstructionSet();
+
+	long long done = 0;
+#if defined(okSegmentEncoder_X86)
+	if (okSegmentEncoder_ISA_AVX2 == isa)
+		done = encodeAVX2(onCounts, offCounts, repeats, count, output);
+#endif
+#if defined(okSegmentEncoder_SSE2)
+	if (okSegmentEncoder_ISA_SCALAR != isa)
+		done += encodeSSE2(onCounts + done, offCounts + done, repeats + done, count - done,
+				output + okSegmentEncoder_RECORD_SIZE * done);
+#endif
+	encodeScalar(onCounts + done, offCounts + done, repeats + done, count - done,
+			output + okSegmentEncoder_RECORD_SIZE * done);
+	return(okSegmentEncoder_RECORD_SIZE * count);
+}
+
+
+long long
+okCSegmentEncoder::Encode(const unsigned int *onCounts, const unsigned int *offCounts,
+		const unsigned int *repeats, long long count, unsigned char *output)
+{
+	return(EncodeWith(GetInstructionSet(), onCounts, offCounts, repeats, count, output));
+}
+
+
+// Counts this wide are rare (long dwells), so this is plain C: each record
+// is built as two 64-bit words and stored byte by byte.
+long long
+okCSegmentEncoder::Encode48(const unsigned long long *onCounts, const unsigned long long *offCounts,
+		const unsigned int *repeats, long long count, unsigned char *output)
+{
+	if (count <= 0)
+		return(0);
+
+	for (long long i=0; i<count; i++) {
+		unsigned long long a = onCounts[i], b = offCounts[i];
+		unsigned long long c = repeats[i];
+		if ((a > okSegmentEncoder_MAX_COUNTS) || (b > okSegmentEncoder_MAX_COUNTS))
+			return(-1);
+
+		unsigned long long q0 = ((a >> 32) & 0xffff) | (((a >> 16) & 0xffff) << 16) |
+		                        ((a & 0xffff) << 32) | ((b >> 32) << 48);
+		unsigned long long q1 = ((b >> 16) & 0xffff) | ((b & 0xffff) << 16) |
+		                        ((c >> 16) << 32) | ((c & 0xffff) << 48);
+		unsigned char *r = output + okSegmentEncoder_RECORD_SIZE * i;
+		for (int k=0; k<8; k++) {
+			r[k]     = (unsigned char)(q0 >> (8 * k));
+			r[k + 8] = (unsigned char)(q1 >> (8 * k));
+		}
+	}
+	return(okSegmentEncoder_RECORD_SIZE * count);
+}
+
+
+//------------------------------------------------------------------------
+// C exports
+//------------------------------------------------------------------------
+okSEGMENTCODEC_API long long DLL_ENTRY
+okSegmentEncoder_Encode(const unsigned int *onCounts, const unsigned int *offCounts,
+		const unsigned int *repeats, int count, unsigned char *output)
+{
+	return(okCSegmentEncoder::Encode(onCounts, offCounts, repeats, count, output));
+}
+
+
+okSEGMENTCODEC_API long long DLL_ENTRY
+okSegmentEncoder_Encode48(const unsigned long long *onCounts, const unsigned long long *offCounts,
+		const unsigned int *repeats, int count, unsigned char *output)
+{
+	return(okCSegmentEncoder::Encode48(onCounts, offCounts, repeats, count, output));
+}
+
+
+okSEGMENTCODEC_API int DLL_ENTRY
+okSegmentEncoder_GetInstructionSet()
+{
+	return(okCSegmentEncoder::GetInstructionSet());
+}
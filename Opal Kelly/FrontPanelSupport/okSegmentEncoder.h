@@ -0,0 +1,78 @@
+//------------------------------------------------------------------------
+// okSegmentEncoder.h
+//
+// Batch encoder for AvivFPGA2 segment FIFO records.  The 16-bit pipe 0x80
+// feeds the 128-bit TestFifo most significant word first, so each
+// (onCounts, offCounts, repeats) segment becomes 16 bytes holding eight
+// little-endian 16-bit words:
+//
+//    on[47:32] on[31:16] on[15:0] off[47:32] off[31:16] off[15:0] rep[31:16] rep[15:0]
+//
+// which is the byte stream FpgaTimebaseTask.createByteArray produces.
+// Encode() takes 32-bit counts and leaves the [47:32] words zero; Encode48()
+// takes the full 48-bit on / off range and rejects anything wider.
+//
+// Input is struct-of-arrays.  Encode() picks AVX2, SSE2 or plain C at run
+// time; all paths give identical output.  Counts and byte totals are
+// long long, since long is 32 bits on Windows and 16 * count passes it
+// beyond 2^27 records.
+//
+// The C entry points are exported from the okSegmentCodec library (see
+// okSegmentCodec.h); Atticus calls them through
+// AtticusServer/Wrappers/okSegmentCodec.cs with arrays and a byte[] of
+// 16 * count bytes.
+//------------------------------------------------------------------------
+
+#ifndef __okSegmentEncoder_h__
+#define __okSegmentEncoder_h__
+
+#include "okSegmentCodec.h"
+
+#define okSegmentEncoder_RECORD_SIZE   16
+#define okSegmentEncoder_MAX_COUNTS    0xffffffffffffULL     // on / off counts are 48 bits
+
+#define okSegmentEncoder_ISA_SCALAR    0
+#define okSegmentEncoder_ISA_SSE2      1
+#define okSegmentEncoder_ISA_AVX2      2
+
+
+//------------------------------------------------------------------------
+// okCSegmentEncoder
+//------------------------------------------------------------------------
+class okCSegmentEncoder
+{
+public:
+	// Writes count records to output (16 * count bytes); returns the number
+	// of bytes written.
+	static long long Encode(const unsigned int *onCounts, const unsigned int *offCounts,
+			const unsigned int *repeats, long long count, unsigned char *output);
+	// Same with a given instruction set (for benchmarks and tests); falls
+	// back to the best supported one below it.
+	static long long EncodeWith(int isa, const unsigned int *onCounts, const unsigned int *offCounts,
+			const unsigned int *repeats, long long count, unsigned char *output);
+	// 48-bit on / off counts.  Returns -1 (and leaves output undefined) if a
+	// count does not fit in 48 bits.
+	static long long Encode48(const unsigned long long *onCounts, const unsigned long long *offCounts,
+			const unsigned int *repeats, long long count, unsigned char *output);
+
+	// Best instruction set this CPU supports.
+	static int GetInstructionSet();
+};
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Byte counts are 64-bit: 16 * count does not fit an int past 2^27 records.
+okSEGMENTCODEC_API long long DLL_ENTRY okSegmentEncoder_Encode(const unsigned int *onCounts, const unsigned int *offCounts,
+		const unsigned int *repeats, int count, unsigned char *output);
+okSEGMENTCODEC_API long long DLL_ENTRY okSegmentEncoder_Encode48(const unsigned long long *onCounts, const unsigned long long *offCounts,
+		const unsigned int *repeats, int count, unsigned char *output);
+okSEGMENTCODEC_API int DLL_ENTRY okSegmentEncoder_GetInstructionSet();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __okSegmentEncoder_h__
@@ -0,0 +1,183 @@
+//------------------------------------------------------------------------
+// okSegmentStreamer.cpp
+//
+// See okSegmentStreamer.h.
+//------------------------------------------------------------------------
+
+#include <string.h>
+#include <chrono>
+#include <thread>
+
+#include "okSegmentStreamer.h"
+
+typedef std::chrono::steady_clock okStreamClock;
+
+
+static double
+secondsSince(okStreamClock::time_point t)
+{
+	return(std::chrono::duration<double>(okStreamClock::now() - t).count());
+}
+
+
+okCSegmentStreamer::okCSegmentStreamer(okCFrontPanel *dev)
+	: m_dev(dev), m_prefill(okSegmentStreamer_FIFO_CAPACITY), m_chunk(256), m_pollUs(200), m_verifyCrc(false),
+	  m_preflight(true)
+{
+	memset(&m_stats, 0, sizeof(m_stats));
+	m_stats.upload.firstBadRecord = -1;
+}
+
+
+void
+okCSegmentStreamer::SetPrefill(long records)
+{
+	if (records < 1)
+		records = 1;
+	m_prefill = (records > okSegmentStreamer_FIFO_CAPACITY) ? (okSegmentStreamer_FIFO_CAPACITY) : (records);
+}
+
+
+void
+okCSegmentStreamer::SetChunk(long records)
+{
+	if (records < 1)
+		records = 1;
+	m_chunk = (records > okSegmentStreamer_FIFO_CAPACITY) ? (okSegmentStreamer_FIFO_CAPACITY) : (records);
+}
+
+
+void
+okCSegmentStreamer::SetPollInterval(int us)
+{
+	m_pollUs = (us < 0) ? (0) : (us);
+}
+
+
+okCFrontPanel::ErrorCode
+okCSegmentStreamer::write(const unsigned char *data, long long records)
+{
+	long length = (long)(records * okSegmentStreamer_RECORD_SIZE);
+	long xfered = m_dev->WriteToPipeIn(okSegmentStreamer_EP_SEGMENTS, length, (unsigned char *)data);
+	if (xfered < 0)
+		return((okCFrontPanel::ErrorCode)xfered);
+	if (xfered != length)
+		return(okCFrontPanel::Failed);
+	m_crc.Update(data, (size_t)length);
+	m_stats.records += records;
+	return(okCFrontPanel::NoError);
+}
+
+
+// Reads level, status and flags; Failed once the stream can no longer
+// play out as written.
+okCFrontPanel::ErrorCode
+okCSegmentStreamer::poll(long *level)
+{
+	m_dev->UpdateWireOuts();
+	if (!m_dev->IsOpen())
+		return(okCFrontPanel::DeviceNotOpen);
+	m_stats.polls++;
+	m_stats.status = (unsigned int)m_dev->GetWireOutValue(okSegmentStreamer_EP_STATUS);
+	m_stats.fifoFlags = (unsigned int)m_dev->GetWireOutValue(okSegmentStreamer_EP_FIFO_FLAGS);
+	*level = (long)m_dev->GetWireOutValue(okSegmentStreamer_EP_FIFO_LEVEL);
+	if ((m_stats.minLevel < 0) || (*level < m_stats.minLevel))
+		m_stats.minLevel = *level;
+
+	if (m_stats.fifoFlags & okSegmentStreamer_FIFO_OVERFLOW)
+		m_stats.overflow = true;
+	// Finishing before the end of the stream is marked is an underrun too
+	// (firmware without stream mode reports it that way).
+	if ((m_stats.status & (okSegmentStreamer_STATUS_UNDERRUN | okSegmentStreamer_STATUS_DONE)) ||
+			(m_stats.fifoFlags & okSegmentStreamer_FIFO_UNDERFLOW)) {
+		m_stats.underrun = true;
+	}
+	if (m_stats.status & okSegmentStreamer_STATUS_ABORTED)
+		return(okCFrontPanel::Failed);
+	return((m_stats.overflow || m_stats.underrun) ? (okCFrontPanel::Failed) : (okCFrontPanel::NoError));
+}
+
+
+okCFrontPanel::ErrorCode
+okCSegmentStreamer::Run(const unsigned char *data, long long length, unsigned int mode, unsigned int debounce)
+{
+	okCFrontPanel::ErrorCode err;
+
+	memset(&m_stats, 0, sizeof(m_stats));
+	m_stats.minLevel = -1;
+	m_stats.upload.firstBadRecord = -1;
+	if ((NULL == data) || (length <= 0) || (0 != length % okSegmentStreamer_RECORD_SIZE))
+		return(okCFrontPanel::Failed);
+	if (m_preflight && !okCSegmentDecoder::Validate(data, length, 0.0, &m_stats.upload)) {
+		m_stats.invalid = true;
+		return(okCFrontPanel::Failed);
+	}
+	long long total = length / okSegmentStreamer_RECORD_SIZE;
+	m_crc.Reset();
+
+	// Same arm sequence as an ordinary upload, with stream mode on.  The CRC
+	// reset also clears the firmware's count of records written, which the
+	// fill level is taken from.
+	okStreamClock::time_point t0 = okStreamClock::now();
+	err = m_dev->ActivateTriggerIn(okSegmentStreamer_EP_TRIGGER, okSegmentStreamer_BIT_ABORT);
+	if (okCFrontPanel::NoError == err)
+		err = m_dev->SetWireInValue(okSegmentStreamer_EP_MODE, mode | okSegmentStreamer_MODE_STREAM);
+	if (okCFrontPanel::NoError == err)
+		err = m_dev->SetWireInValue(okSegmentStreamer_EP_DEBOUNCE, debounce);
+	if (okCFrontPanel::NoError == err) {
+		m_dev->UpdateWireIns();
+		if (!m_dev->IsOpen())
+			err = okCFrontPanel::DeviceNotOpen;
+	}
+	if (okCFrontPanel::NoError == err)
+		err = okCUploadCRC::ResetDevice(m_dev);
+	if (okCFrontPanel::NoError == err) {
+		m_stats.prefillRecords = (long)((total < m_prefill) ? (total) : (m_prefill));
+		err = write(data, m_stats.prefillRecords);
+	}
+	m_stats.armSec = secondsSince(t0);
+	if (okCFrontPanel::NoError != err)
+		return(err);
+
+	okStreamClock::time_point t1 = okStreamClock::now();
+	err = m_dev->ActivateTriggerIn(okSegmentStreamer_EP_TRIGGER, okSegmentStreamer_BIT_START);
+	while ((okCFrontPanel::NoError == err) && (m_stats.records < total)) {
+		long level;
+		err = poll(&level);
+		if (okCFrontPanel::NoError != err)
+			break;
+
+		long long room = okSegmentStreamer_FIFO_CAPACITY - level;
+		long long left = total - m_stats.records;
+		if (room > left)
+			room = left;
+		if ((room >= m_chunk) || ((room == left) && (room > 0))) {
+			err = write(data + m_stats.records * okSegmentStreamer_RECORD_SIZE, room);
+			m_stats.writes++;
+		}
+		else if (m_pollUs > 0) {
+			std::this_thread::sleep_for(std::chrono::microseconds(m_pollUs));
+		}
+	}
+
+	// A FIFO that drains between the last write and this trigger is flagged
+	// as an underrun by the firmware; with that little margin it was one.
+	if (okCFrontPanel::NoError == err)
+		err = m_dev->ActivateTriggerIn(okSegmentStreamer_EP_TRIGGER, okSegmentStreamer_BIT_STREAM_END);
+	m_stats.streamSec = secondsSince(t1);
+	if ((okCFrontPanel::NoError == err) && m_verifyCrc)
+		err = okCUploadCRC::VerifyDevice(m_dev, m_crc.GetValue());
+	if (okCFrontPanel::NoError == err) {
+		m_dev->UpdateWireOuts();
+		m_stats.status = (unsigned int)m_dev->GetWireOutValue(okSegmentStreamer_EP_STATUS);
+		m_stats.fifoFlags = (unsigned int)m_dev->GetWireOutValue(okSegmentStreamer_EP_FIFO_FLAGS);
+		if ((m_stats.status & okSegmentStreamer_STATUS_UNDERRUN) || (m_stats.fifoFlags & okSegmentStreamer_FIFO_UNDERFLOW)) {
+			m_stats.underrun = true;
+			err = okCFrontPanel::Failed;
+		}
+	}
+
+	if (okCFrontPanel::NoError != err)
+		m_dev->ActivateTriggerIn(okSegmentStreamer_EP_TRIGGER, okSegmentStreamer_BIT_ABORT);
+	return(err);
+}
@@ -0,0 +1,131 @@
+//------------------------------------------------------------------------
+// okSegmentStreamer.h
+//
+// Runs a variable timebase sequence longer than the AvivFPGA2 segment FIFO
+// (2048 records) by feeding the FIFO while the sequence plays.  Run()
+// pre-fills the FIFO, fires the start trigger and then tops the FIFO up
+// from the fill level the firmware reports on wire-out 0x2A whenever a
+// chunk fits, so arm time no longer grows with the table and the table
+// size is only limited by how fast the board eats records.  Once the last
+// record is written the end of the stream is marked (trigger 0x40 bit 2);
+// a FIFO that runs dry before that stops the board with status bits 1 and
+// 2 set, which Run() reports as an underrun.
+//
+// Run() checks the whole table with okCSegmentDecoder::Validate() before
+// the board is touched (SetPreflight(false) skips it); a malformed table
+// fails without aborting a shot that may still be running, and the totals
+// land in okSegmentStreamStats::upload either way.
+//
+// The firmware has to be built from the current AvivFPGA2.v (stream mode,
+// wire-outs 0x2A / 0x2B).  okFrontPanelStub models the FIFO and sequencer
+// in real time, so pre-fill and chunk settings can be tried against
+// OKSTUB_MASTER_HZ / OKSTUB_PIPE_MBPS without a board.
+//------------------------------------------------------------------------
+
+#ifndef __okSegmentStreamer_h__
+#define __okSegmentStreamer_h__
+
+#include "okFrontPanelDLL.h"
+#include "okSegmentDecoder.h"
+#include "okUploadCRC.h"
+
+// AvivFPGA2 endpoints
+#define okSegmentStreamer_EP_MODE           0x00     // wire-in: bit 0 external start, bit 1 RF modulation
+#define okSegmentStreamer_EP_DEBOUNCE       0x01     // wire-in: retrigger debounce samples
+#define okSegmentStreamer_EP_STATUS         0x25     // wire-out
+#define okSegmentStreamer_EP_FIFO_LEVEL     0x2a     // wire-out, records
+#define okSegmentStreamer_EP_FIFO_FLAGS     0x2b     // wire-out
+#define okSegmentStreamer_EP_TRIGGER        0x40     // trigger-in
+#define okSegmentStreamer_EP_SEGMENTS       0x80     // pipe-in
+#define okSegmentStreamer_BIT_START         0
+#define okSegmentStreamer_BIT_ABORT         1
+#define okSegmentStreamer_BIT_STREAM_END    2
+#define okSegmentStreamer_MODE_STREAM       0x04     // wire-in 0x00
+
+// Status (wire-out 0x25)
+#define okSegmentStreamer_STATUS_DONE       0x01
+#define okSegmentStreamer_STATUS_ABORTED    0x02
+#define okSegmentStreamer_STATUS_UNDERRUN   0x04
+
+// FIFO flags (wire-out 0x2B)
+#define okSegmentStreamer_FIFO_FULL         0x01
+#define okSegmentStreamer_FIFO_EMPTY        0x02
+#define okSegmentStreamer_FIFO_OVERFLOW     0x04
+#define okSegmentStreamer_FIFO_UNDERFLOW    0x08
+#define okSegmentStreamer_FIFO_STREAM_END   0x10
+
+#define okSegmentStreamer_RECORD_SIZE       16
+#define okSegmentStreamer_FIFO_RECORDS      2048
+// The FIFO's write side holds one word less than its depth, so at most
+// 2047 whole records fit; writing more overflows it.
+#define okSegmentStreamer_FIFO_CAPACITY     (okSegmentStreamer_FIFO_RECORDS - 1)
+
+typedef struct {
+	long long records;                 // records written
+	long prefillRecords;
+	long writes;                       // pipe transfers after the start trigger
+	long polls;
+	long minLevel;                     // lowest FIFO level seen while streaming, records
+	double armSec;                     // reset, mode and pre-fill
+	double streamSec;                  // start trigger to end of stream
+	unsigned int status;               // wire-out 0x25 at the last poll
+	unsigned int fifoFlags;            // wire-out 0x2B at the last poll
+	bool underrun;
+	bool overflow;
+	bool invalid;                      // preflight found errors; nothing was written
+	okSegmentStats upload;             // preflight totals (durations left at 0)
+} okSegmentStreamStats;
+
+
+//------------------------------------------------------------------------
+// okCSegmentStreamer
+//------------------------------------------------------------------------
+class okCSegmentStreamer
+{
+public:
+	okCSegmentStreamer(okCFrontPanel *dev);
+
+	// Records written before the start trigger; default (and at most)
+	// okSegmentStreamer_FIFO_CAPACITY.
+	void SetPrefill(long records);
+	// Smallest top-up transfer, so the pipe is not driven with a handful of
+	// records at a time; default 256.
+	void SetChunk(long records);
+	// Sleep between polls while there is no room for a chunk; default 200.
+	void SetPollInterval(int us);
+	void SetVerifyCRC(bool verify)
+		{ m_verifyCrc = verify; }
+	// Validate the table before arming; default true.
+	void SetPreflight(bool preflight)
+		{ m_preflight = preflight; }
+
+	// Streams length bytes of encoded records and returns once the last one
+	// is in the FIFO and the end of the stream is marked; the board then
+	// finishes on its own.  mode / debounce go to wire-ins 0x00 / 0x01 as for
+	// an ordinary upload.  Failed on an underrun, a dropped write or a CRC
+	// mismatch; the board is aborted in that case.  Failed as well, with
+	// the board left alone, when the preflight rejects the table.
+	okCFrontPanel::ErrorCode Run(const unsigned char *data, long long length, unsigned int mode, unsigned int debounce);
+
+	// Statistics of the last Run().
+	void GetStats(okSegmentStreamStats *stats) const
+		{ *stats = m_stats; }
+
+private:
+	okCFrontPanel::ErrorCode write(const unsigned char *data, long long records);
+	okCFrontPanel::ErrorCode poll(long *level);
+
+	okCFrontPanel *m_dev;
+	long m_prefill;
+	long m_chunk;
+	int m_pollUs;
+	bool m_verifyCrc;
+	bool m_preflight;
+	okCUploadCRC m_crc;
+	okSegmentStreamStats m_stats;
+
+	okCSegmentStreamer(const okCSegmentStreamer&);
+	okCSegmentStreamer& operator=(const okCSegmentStreamer&);
+};
+
+#endif // __okSegmentStreamer_h__
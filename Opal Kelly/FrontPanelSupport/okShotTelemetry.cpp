@@ -0,0 +1,292 @@
+//------------------------------------------------------------------------
+// okShotTelemetry.cpp
+//
+// See okShotTelemetry.h.
+//------------------------------------------------------------------------
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "okShotTelemetry.h"
+#include "okRealtime.h"
+
+
+okCShotTelemetry::okCShotTelemetry(okCDevicePool *pool, int handle, long capacity)
+	: m_pool(pool), m_handle(handle), m_rateHz(1000.0), m_masterClockPeriod(1e-7),
+	  m_ring((capacity > 1) ? (capacity) : (2)), m_head(0), m_tail(0), m_dropped(0), m_failed(0),
+	  m_running(false), m_startEpochNs(0)
+{
+}
+
+
+okCShotTelemetry::~okCShotTelemetry()
+{
+	stop();
+}
+
+
+void
+okCShotTelemetry::SetRate(double hz)
+{
+	if (hz > 0.0)
+		m_rateHz = hz;
+}
+
+
+void
+okCShotTelemetry::SetMasterClockPeriod(double seconds)
+{
+	if (seconds > 0.0)
+		m_masterClockPeriod = seconds;
+}
+
+
+void
+okCShotTelemetry::Start()
+{
+	stop();
+	m_head.store(0);
+	m_tail.store(0);
+	m_dropped.store(0);
+	m_failed.store(0);
+	m_trace.clear();
+	m_start = Clock::now();
+	m_startEpochNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count();
+	m_running = true;
+	m_thread = std::thread(&okCShotTelemetry::sampleThread, this);
+}
+
+
+void
+okCShotTelemetry::stop()
+{
+	m_running = false;
+	if (m_thread.joinable())
+		m_thread.join();
+}
+
+
+void
+okCShotTelemetry::sampleThread()
+{
+	const Clock::duration period = std::chrono::duration_cast<Clock::duration>(
+			std::chrono::duration<double>(1.0 / m_rateHz));
+	const unsigned long long capacity = m_ring.size();
+	Clock::time_point due = Clock::now();
+
+	while (m_running) {
+		okShotTelemetrySample s;
+		bool ok = false;
+		okCFrontPanel *dev = m_pool->Lock(m_handle);
+		if (NULL != dev) {
+			Clock::time_point t0 = Clock::now();
+			dev->UpdateWireOuts();
+			Clock::time_point t1 = Clock::now();
+			ok = dev->IsOpen();
+			if (ok) {
+				for (int i=0; i<okShotTelemetry_WORDS; i++)
+					s.words[i] = (unsigned short)dev->GetWireOutValue(okShotTelemetry_FIRST_EP + i);
+				s.hostNs = std::chrono::duration_cast<std::chrono::nanoseconds>((t0 - m_start) + (t1 - t0) / 2).count();
+			}
+			m_pool->Unlock(m_handle, (ok) ? (okCFrontPanel::NoError) : (okCFrontPanel::DeviceNotOpen));
+		}
+
+		if (!ok) {
+			m_failed.fetch_add(1, std::memory_order_relaxed);
+		}
+		else {
+			unsigned long long head = m_head.load(std::memory_order_relaxed);
+			if (head - m_tail.load(std::memory_order_acquire) >= capacity) {
+				m_dropped.fetch_add(1, std::memory_order_relaxed);
+			}
+			else {
+				m_ring[head % capacity] = s;
+				m_head.store(head + 1, std::memory_order_release);
+			}
+		}
+
+		// Fixed rate; a late sample does not push the next ones back.
+		due += period;
+		Clock::time_point now = Clock::now();
+		if (due < now)
+			due = now;
+		std::this_thread::sleep_until(due);
+	}
+}
+
+
+long
+okCShotTelemetry::Drain()
+{
+	const unsigned long long capacity = m_ring.size();
+	unsigned long long tail = m_tail.load(std::memory_order_relaxed);
+	unsigned long long head = m_head.load(std::memory_order_acquire);
+	for (unsigned long long i=tail; i<head; i++)
+		m_trace.push_back(m_ring[i % capacity]);
+	m_tail.store(head, std::memory_order_release);
+	return((long)(head - tail));
+}
+
+
+bool
+okCShotTelemetry::Finish(const char *path, okShotTelemetryStats *stats)
+{
+	okShotTelemetryHeader h;
+
+	stop();
+	Drain();
+	memset(&h, 0, sizeof(h));
+	ComputeStats(m_trace.empty() ? (NULL) : (&m_trace[0]), (long long)m_trace.size(), m_masterClockPeriod, &h.stats);
+	h.stats.dropped = m_dropped.load();
+	h.stats.failedReads = m_failed.load();
+	if (NULL != stats)
+		*stats = h.stats;
+	if (NULL == path)
+		return(true);
+
+	h.magic = okShotTelemetry_MAGIC;
+	h.version = okShotTelemetry_VERSION;
+	h.sampleSize = sizeof(okShotTelemetrySample);
+	h.words = okShotTelemetry_WORDS;
+	h.rateHz = m_rateHz;
+	h.masterClockPeriod = m_masterClockPeriod;
+	h.startEpochNs = m_startEpochNs;
+	h.count = (long long)m_trace.size();
+
+	FILE *f = fopen(path, "wb");
+	if (NULL == f)
+		return(false);
+	bool ok = (1 == fwrite(&h, sizeof(h), 1, f));
+	if (ok && !m_trace.empty())
+		ok = (m_trace.size() == fwrite(&m_trace[0], sizeof(okShotTelemetrySample), m_trace.size(), f));
+	if (0 != fclose(f))
+		ok = false;
+	return(ok);
+}
+
+
+bool
+okCShotTelemetry::LoadTrace(const char *path, okShotTelemetryHeader *header, std::vector<okShotTelemetrySample> *samples)
+{
+	okShotTelemetryHeader h;
+	FILE *f = fopen(path, "rb");
+	if (NULL == f)
+		return(false);
+	bool ok = (1 == fread(&h, sizeof(h), 1, f)) && (okShotTelemetry_MAGIC == h.magic) &&
+			(okShotTelemetry_VERSION == h.version) && (sizeof(okShotTelemetrySample) == h.sampleSize) &&
+			(h.count >= 0);
+	if (ok && (NULL != samples)) {
+		samples->resize((size_t)h.count);
+		if (h.count > 0)
+			ok = ((size_t)h.count == fread(&(*samples)[0], sizeof(okShotTelemetrySample), (size_t)h.count, f));
+	}
+	fclose(f);
+	if (ok && (NULL != header))
+		*header = h;
+	return(ok);
+}
+
+
+//------------------------------------------------------------------------
+// Statistics
+//------------------------------------------------------------------------
+static inline unsigned int
+word32(const okShotTelemetrySample& s, int low)
+{
+	return((unsigned int)s.words[low] | ((unsigned int)s.words[low + 1] << 16));
+}
+
+
+// Extends a 32-bit counter across rollovers.  The firmware only clears its
+// counts at the start of a run, so within a shot they never go backwards.
+static inline unsigned long long
+unwrap(unsigned long long previous, unsigned int value)
+{
+	unsigned long long v = (previous & ~0xffffffffULL) | value;
+	if (v < previous)
+		v += 0x100000000ULL;
+	return(v);
+}
+
+
+void
+okCShotTelemetry::ComputeStats(const okShotTelemetrySample *samples, long long count,
+		double masterClockPeriod, okShotTelemetryStats *stats)
+{
+	okShotTelemetryStats st;
+	std::vector<double> waits;
+	double episode = 0.0;
+	double sumDev = 0.0, sumDev2 = 0.0;
+	unsigned int master0 = 0, waited0 = 0;
+	unsigned long long master = 0, waited = 0;   // counted from the first sample
+
+	memset(&st, 0, sizeof(st));
+	st.samples = count;
+	if (count > 0) {
+		master0 = word32(samples[0], okShotTelemetry_SAMPLES_LOW);
+		waited0 = word32(samples[0], okShotTelemetry_WAITED_LOW);
+	}
+
+	for (long long i=1; i<count; i++) {
+		const okShotTelemetrySample& a = samples[i-1];
+		const okShotTelemetrySample& b = samples[i];
+		bool stopped = (0 != (b.words[okShotTelemetry_STATUS] & 0x3));
+		unsigned long long m = unwrap(master, word32(b, okShotTelemetry_SAMPLES_LOW) - master0);
+		unsigned long long w = unwrap(waited, word32(b, okShotTelemetry_WAITED_LOW) - waited0);
+		double dt = (b.hostNs - a.hostNs) * 1e-9;
+
+		if (dt * 1e6 > st.maxIntervalUs)
+			st.maxIntervalUs = dt * 1e6;
+
+		// A wait is one run of intervals in which the wait count moved.
+		if (w > waited) {
+			episode += (double)(w - waited);
+		}
+		else if (episode > 0.0) {
+			waits.push_back(episode);
+			episode = 0.0;
+		}
+
+		// Only intervals of plain running: counting, no wait, not stopped.
+		if ((w == waited) && (m > master) && (dt > 0.0) && (0 == (a.words[okShotTelemetry_STATUS] & 0x3)) && !stopped) {
+			double dev = (double)(m - master) * masterClockPeriod / dt - 1.0;
+			st.rateIntervals++;
+			sumDev += dev;
+			sumDev2 += dev * dev;
+			if (fabs(dev) > fabs(st.rateMaxDeviation))
+				st.rateMaxDeviation = dev;
+		}
+		master = m;
+		waited = w;
+	}
+	if (episode > 0.0)
+		waits.push_back(episode);
+
+	if (count > 0) {
+		const okShotTelemetrySample& last = samples[count-1];
+		st.durationSec = (last.hostNs - samples[0].hostNs) * 1e-9;
+		if (count > 1)
+			st.meanIntervalUs = st.durationSec * 1e6 / (count - 1);
+		st.mistriggerIndex = word32(last, okShotTelemetry_MISTRIGGER_LOW);
+		st.status = last.words[okShotTelemetry_STATUS];
+		st.retriggerTimeouts = last.words[okShotTelemetry_TIMEOUTS];
+		st.retriggerWaitSamples = (unsigned int)waited;
+		st.masterSamples = master;
+	}
+
+	std::sort(waits.begin(), waits.end());
+	st.retriggerWaits = (long)waits.size();
+	st.waitP50 = okCRealtime::Percentile(waits, 50.0);
+	st.waitP90 = okCRealtime::Percentile(waits, 90.0);
+	st.waitP99 = okCRealtime::Percentile(waits, 99.0);
+	st.waitMax = waits.empty() ? (0.0) : (waits.back());
+
+	if (st.rateIntervals > 0) {
+		st.rateMeanDeviation = sumDev / st.rateIntervals;
+		st.rateRmsDeviation = sqrt(sumDev2 / st.rateIntervals);
+	}
+	*stats = st;
+}
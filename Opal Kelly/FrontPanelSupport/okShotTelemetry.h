@@ -0,0 +1,169 @@
+//------------------------------------------------------------------------
+// okShotTelemetry.h
+//
+// Per-shot recorder of the AvivFPGA2 run wire-outs 0x20 - 0x27 (mistrigger
+// index, master samples, retrigger timeouts, status, retrigger wait
+// samples).  After Start() a sampler thread takes one UpdateWireOuts per
+// period through the device pool, stamps it with the host time and pushes
+// it into a preallocated single-producer / single-consumer ring; the
+// sampler never blocks on the consumer and counts what it has to drop.
+// The owner drains the ring into the shot's trace with Drain() whenever
+// convenient (FpgaTimebaseTask's polling loop) and with Finish() at the
+// end of the shot:
+//
+//    okCShotTelemetry rec(&pool, handle);
+//    rec.SetRate(2000.0);
+//    rec.Start();                     // right after the start trigger
+//    ... rec.Drain(); ...
+//    rec.Finish("run.fpgatrace", &stats);
+//
+// Finish() writes the trace as a small header (including the statistics)
+// followed by 24-byte samples, in host byte order, and fills in
+// okShotTelemetryStats: the final register values -- the ones getRunReport
+// puts in FpgaRunReport -- the distribution of individual retrigger waits
+// and how far the master-sample rate strayed from the master clock.  Both
+// are seen at the sampling resolution: waits closer together than a
+// sampling period merge, and rate deviations include the host's timestamp
+// jitter over one period.  Master-sample and retrigger-wait counts are
+// deltas from the first sample, latched at shot start; the firmware clears
+// both registers when a run starts and at no other time, so within a shot
+// they only count up.  LoadTrace() and ComputeStats() re-analyse a trace
+// after the fact.
+//------------------------------------------------------------------------
+
+#ifndef __okShotTelemetry_h__
+#define __okShotTelemetry_h__
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "okFrontPanelDLL.h"
+#include "okDevicePool.h"
+
+// AvivFPGA2 wire-outs, as indices into okShotTelemetrySample.words
+#define okShotTelemetry_FIRST_EP            0x20
+#define okShotTelemetry_WORDS               8
+#define okShotTelemetry_MISTRIGGER_LOW      0        // 0x20 / 0x21
+#define okShotTelemetry_MISTRIGGER_HIGH     1
+#define okShotTelemetry_SAMPLES_LOW         2        // 0x22 / 0x23
+#define okShotTelemetry_SAMPLES_HIGH        3
+#define okShotTelemetry_TIMEOUTS            4        // 0x24
+#define okShotTelemetry_STATUS              5        // 0x25: bit 0 finished, bit 1 aborted
+#define okShotTelemetry_WAITED_LOW          6        // 0x26 / 0x27
+#define okShotTelemetry_WAITED_HIGH         7
+
+#define okShotTelemetry_MAGIC               0x5453544f    // "OTST"
+#define okShotTelemetry_VERSION             1
+
+typedef struct {
+	long long hostNs;                        // since Start(), middle of the UpdateWireOuts
+	unsigned short words[okShotTelemetry_WORDS];
+} okShotTelemetrySample;
+
+typedef struct {
+	long long samples;
+	long long dropped;                       // ring full
+	long long failedReads;                   // board disconnected or not answering
+	double durationSec;                      // first to last sample
+	double meanIntervalUs;                   // sampling interval achieved
+	double maxIntervalUs;
+
+	// Last sample
+	unsigned int mistriggerIndex;
+	unsigned int status;
+	unsigned int retriggerTimeouts;
+	unsigned int retriggerWaitSamples;       // since the first sample
+	unsigned long long masterSamples;        // since the first sample, rollovers of the 32-bit count unwrapped
+
+	// Retrigger waits, master samples each
+	long retriggerWaits;
+	double waitP50;
+	double waitP90;
+	double waitP99;
+	double waitMax;
+
+	// (master samples counted / master samples expected) - 1 over the
+	// sampling intervals with no retrigger wait in them
+	long rateIntervals;
+	double rateMeanDeviation;
+	double rateRmsDeviation;
+	double rateMaxDeviation;                 // largest in magnitude, signed
+} okShotTelemetryStats;
+
+typedef struct {
+	unsigned int magic;
+	unsigned int version;
+	unsigned int sampleSize;
+	unsigned int words;
+	double rateHz;
+	double masterClockPeriod;
+	long long startEpochNs;                  // wall clock at Start()
+	long long count;
+	okShotTelemetryStats stats;
+} okShotTelemetryHeader;
+
+
+//------------------------------------------------------------------------
+// okCShotTelemetry
+//------------------------------------------------------------------------
+class okCShotTelemetry
+{
+public:
+	// capacity is the ring size in samples; it only has to cover the time
+	// between two Drain() calls.
+	okCShotTelemetry(okCDevicePool *pool, int handle, long capacity = 16384);
+	~okCShotTelemetry();
+
+	void SetRate(double hz);                           // default 1000
+	void SetMasterClockPeriod(double seconds);         // default 1e-7
+
+	// Clears the previous shot and starts sampling.
+	void Start();
+	// Moves the samples taken so far from the ring into the trace; returns
+	// how many.  Call from one thread at a time.
+	long Drain();
+	// Stops sampling, drains the ring and computes the statistics.  Writes
+	// the trace to path unless it is NULL; false if that fails.
+	bool Finish(const char *path, okShotTelemetryStats *stats);
+
+	const std::vector<okShotTelemetrySample>& GetTrace() const
+		{ return(m_trace); }
+	long long GetDropCount() const
+		{ return(m_dropped.load(std::memory_order_relaxed)); }
+
+	static void ComputeStats(const okShotTelemetrySample *samples, long long count,
+			double masterClockPeriod, okShotTelemetryStats *stats);
+	static bool LoadTrace(const char *path, okShotTelemetryHeader *header,
+			std::vector<okShotTelemetrySample> *samples);
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	void sampleThread();
+	void stop();
+
+	okCDevicePool *m_pool;
+	int m_handle;
+	double m_rateHz;
+	double m_masterClockPeriod;
+
+	std::vector<okShotTelemetrySample> m_ring;
+	std::atomic<unsigned long long> m_head;          // written by the sampler
+	std::atomic<unsigned long long> m_tail;          // written by Drain()
+	std::atomic<long long> m_dropped;
+	std::atomic<long long> m_failed;
+	std::atomic<bool> m_running;
+	std::thread m_thread;
+	Clock::time_point m_start;
+	long long m_startEpochNs;
+
+	std::vector<okShotTelemetrySample> m_trace;
+
+	okCShotTelemetry(const okCShotTelemetry&);
+	okCShotTelemetry& operator=(const okCShotTelemetry&);
+};
+
+#endif // __okShotTelemetry_h__
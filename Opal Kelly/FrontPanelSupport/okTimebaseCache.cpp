@@ -0,0 +1,496 @@
+//------------------------------------------------------------------------
+// okTimebaseCache.cpp
+//
+// See okTimebaseCache.h.
+//
+// Entry file <hash>.otb:
+//
+//    header (32 bytes)   magic, version, key length, CRC-32C of the stream,
+//                        stream length, caller's value
+//    key                 padded to a multiple of 16
+//    stream
+//
+// New entries are written to a temporary name and renamed into place, so a
+// reader never maps a half-written file.
+//------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(_WIN32)
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <dirent.h>
+	#include <utime.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+#endif
+
+#include "okTimebaseCache.h"
+#include "okUploadCRC.h"
+
+#define MAGIC       0x42544b4f      // "OKTB"
+#define VERSION     2
+#define SUFFIX      ".otb"
+
+struct okTimebaseCacheHeader {
+	unsigned int magic;
+	unsigned int version;
+	unsigned int keyLength;
+	unsigned int crc;
+	unsigned long long length;
+	unsigned long long value;
+};
+
+
+static size_t
+dataOffset(size_t keyLength)
+{
+	return((sizeof(okTimebaseCacheHeader) + keyLength + 15) & ~(size_t)15);
+}
+
+
+static bool
+isEntryName(const char *name)
+{
+	size_t n = strlen(name);
+	return((n == 16 + strlen(SUFFIX)) && (0 == strcmp(name + 16, SUFFIX)));
+}
+
+
+okCTimebaseCache::okCTimebaseCache()
+	: m_open(false), m_maxBytes(okTimebaseCache_DEFAULT_MAXBYTES), m_size(0),
+	  m_hits(0), m_misses(0), m_evictions(0)
+{
+}
+
+
+okCTimebaseCache::~okCTimebaseCache()
+{
+	Close();
+}
+
+
+unsigned long long
+okCTimebaseCache::Hash(const void *key, size_t keyLength)
+{
+	const unsigned char *p = (const unsigned char *)key;
+	unsigned long long h = 0xcbf29ce484222325ULL;
+	for (size_t i=0; i<keyLength; i++) {
+		h ^= p[i];
+		h *= 0x100000001b3ULL;
+	}
+	return(h);
+}
+
+
+std::string
+okCTimebaseCache::path(const std::string& name) const
+{
+	return(m_dir + "/" + name);
+}
+
+
+bool
+okCTimebaseCache::Open(const char *directory, unsigned long long maxBytes)
+{
+	Close();
+
+	std::lock_guard<std::mutex> guard(m_lock);
+	m_dir = directory;
+	m_maxBytes = maxBytes;
+	m_size = 0;
+	m_entries.clear();
+
+#if defined(_WIN32)
+	CreateDirectoryA(directory, NULL);
+	WIN32_FIND_DATAA fd;
+	HANDLE h = FindFirstFileA(path("*" SUFFIX).c_str(), &fd);
+	if (INVALID_HANDLE_VALUE == h) {
+		if (ERROR_FILE_NOT_FOUND != GetLastError())
+			return(false);
+	}
+	else {
+		do {
+			if (!isEntryName(fd.cFileName))
+				continue;
+			ULARGE_INTEGER t;
+			t.LowPart = fd.ftLastWriteTime.dwLowDateTime;
+			t.HighPart = fd.ftLastWriteTime.dwHighDateTime;
+			Entry e;
+			e.size = ((unsigned long long)fd.nFileSizeHigh << 32) | fd.nFileSizeLow;
+			e.lastUse = (long long)(t.QuadPart / 10000000ULL) - 11644473600LL;
+			e.mapped = 0;
+			e.verified = false;
+			m_entries[fd.cFileName] = e;
+			m_size += e.size;
+		} while (FindNextFileA(h, &fd));
+		FindClose(h);
+	}
+#else
+	mkdir(directory, 0755);
+	DIR *d = opendir(directory);
+	if (NULL == d)
+		return(false);
+	struct dirent *de;
+	while (NULL != (de = readdir(d))) {
+		struct stat st;
+		if (!isEntryName(de->d_name) || (0 != stat(path(de->d_name).c_str(), &st)))
+			continue;
+		Entry e;
+		e.size = (unsigned long long)st.st_size;
+		e.lastUse = (long long)st.st_mtime;
+		e.mapped = 0;
+		e.verified = false;
+		m_entries[de->d_name] = e;
+		m_size += e.size;
+	}
+	closedir(d);
+#endif
+	m_open = true;
+	evict(std::string());
+	return(true);
+}
+
+
+void
+okCTimebaseCache::unmapView(Mapping& m)
+{
+#if defined(_WIN32)
+	UnmapViewOfFile(m.base);
+	CloseHandle((HANDLE)m.map);
+	CloseHandle((HANDLE)m.file);
+#else
+	munmap(m.base, m.size);
+#endif
+}
+
+
+// Caller holds m_lock.
+void
+okCTimebaseCache::unmap(Mapping& m)
+{
+	unmapView(m);
+	std::map<std::string, Entry>::iterator it = m_entries.find(m.name);
+	if ((it != m_entries.end()) && (it->second.mapped > 0))
+		it->second.mapped--;
+}
+
+
+void
+okCTimebaseCache::Close()
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	for (size_t i=0; i<m_mappings.size(); i++)
+		unmap(m_mappings[i]);
+	m_mappings.clear();
+	m_entries.clear();
+	m_size = 0;
+	m_open = false;
+}
+
+
+void
+okCTimebaseCache::SetMaxSize(unsigned long long maxBytes)
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	m_maxBytes = maxBytes;
+	if (m_open)
+		evict(std::string());
+}
+
+
+// Caller holds m_lock.
+void
+okCTimebaseCache::touch(const std::string& name, Entry *e)
+{
+	e->lastUse = (long long)time(NULL);
+#if defined(_WIN32)
+	HANDLE h = CreateFileA(path(name).c_str(), FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE,
+			NULL, OPEN_EXISTING, 0, NULL);
+	if (INVALID_HANDLE_VALUE != h) {
+		FILETIME ft;
+		GetSystemTimeAsFileTime(&ft);
+		SetFileTime(h, NULL, NULL, &ft);
+		CloseHandle(h);
+	}
+#else
+	utime(path(name).c_str(), NULL);
+#endif
+}
+
+
+// Drops least recently used entries, other than keep, until the directory
+// fits.  Caller holds m_lock.
+void
+okCTimebaseCache::evict(const std::string& keep)
+{
+	while (m_size > m_maxBytes) {
+		std::map<std::string, Entry>::iterator victim = m_entries.end();
+		for (std::map<std::string, Entry>::iterator it=m_entries.begin(); it!=m_entries.end(); ++it) {
+			if ((it->second.mapped > 0) || (it->first == keep))
+				continue;
+			if ((victim == m_entries.end()) || (it->second.lastUse < victim->second.lastUse))
+				victim = it;
+		}
+		if (victim == m_entries.end())
+			return;
+		remove(victim);
+		m_evictions++;
+	}
+}
+
+
+// Deletes an entry's file.  Caller holds m_lock.
+void
+okCTimebaseCache::remove(std::map<std::string, Entry>::iterator it)
+{
+#if defined(_WIN32)
+	DeleteFileA(path(it->first).c_str());
+#else
+	unlink(path(it->first).c_str());
+#endif
+	m_size -= it->second.size;
+	m_entries.erase(it);
+}
+
+
+const unsigned char *
+okCTimebaseCache::Lookup(const void *key, size_t keyLength, long long *length, unsigned int *crc,
+		unsigned long long *value)
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx" SUFFIX, Hash(key, keyLength));
+
+	std::map<std::string, Entry>::iterator it = m_entries.find(name);
+	if (!m_open || (it == m_entries.end())) {
+		m_misses++;
+		return(NULL);
+	}
+
+	Mapping m;
+	m.name = name;
+	m.size = (size_t)it->second.size;
+	m.base = NULL;
+	if (m.size >= sizeof(okTimebaseCacheHeader)) {
+#if defined(_WIN32)
+		m.file = CreateFileA(path(name).c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+				FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (INVALID_HANDLE_VALUE != (HANDLE)m.file) {
+			m.map = CreateFileMappingA((HANDLE)m.file, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (NULL != m.map)
+				m.base = MapViewOfFile((HANDLE)m.map, FILE_MAP_READ, 0, 0, 0);
+			if (NULL == m.base) {
+				if (NULL != m.map)
+					CloseHandle((HANDLE)m.map);
+				CloseHandle((HANDLE)m.file);
+			}
+		}
+#else
+		int fd = open(path(name).c_str(), O_RDONLY);
+		struct stat st;
+		if ((fd >= 0) && (0 == fstat(fd, &st)) && ((size_t)st.st_size == m.size)) {
+			m.base = mmap(NULL, m.size, PROT_READ, MAP_SHARED, fd, 0);
+			if (MAP_FAILED == m.base)
+				m.base = NULL;
+			else
+				madvise(m.base, m.size, MADV_WILLNEED);
+		}
+		if (fd >= 0)
+			close(fd);
+#endif
+	}
+	if (NULL == m.base) {
+		m_misses++;
+		return(NULL);
+	}
+
+	// Same key (not just the same hash) and complete.  The stream itself
+	// is checked against its CRC once, on the first hit since Open().
+	const okTimebaseCacheHeader *h = (const okTimebaseCacheHeader *)m.base;
+	size_t offset = dataOffset(keyLength);
+	bool valid = (MAGIC == h->magic) && (VERSION == h->version);
+	bool sameKey = valid && (h->keyLength == keyLength) && (m.size >= offset) &&
+			(0 == memcmp((const unsigned char *)m.base + sizeof(okTimebaseCacheHeader), key, keyLength));
+	if (sameKey) {
+		valid = (h->length == m.size - offset);
+		if (valid && !it->second.verified)
+			valid = (h->crc == okCUploadCRC::Compute((const unsigned char *)m.base + offset, (size_t)h->length));
+		it->second.verified = valid;
+	}
+	if (!sameKey || !valid) {
+		unmapView(m);
+		if (!valid)
+			remove(it);
+		m_misses++;
+		return(NULL);
+	}
+
+	m.data = (const unsigned char *)m.base + offset;
+	m_mappings.push_back(m);
+	it->second.mapped++;
+	touch(it->first, &it->second);
+	m_hits++;
+	if (NULL != length)
+		*length = (long long)h->length;
+	if (NULL != crc)
+		*crc = h->crc;
+	if (NULL != value)
+		*value = h->value;
+	return(m.data);
+}
+
+
+void
+okCTimebaseCache::Release(const unsigned char *data)
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	for (size_t i=0; i<m_mappings.size(); i++) {
+		if (data == m_mappings[i].data) {
+			unmap(m_mappings[i]);
+			m_mappings.erase(m_mappings.begin() + i);
+			evict(std::string());
+			return;
+		}
+	}
+}
+
+
+bool
+okCTimebaseCache::Store(const void *key, size_t keyLength, const unsigned char *data, long long length,
+		unsigned long long value)
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	size_t offset = dataOffset(keyLength);
+	if (!m_open || (length <= 0) || (keyLength > 0xffffffffUL) || (offset + (unsigned long long)length > m_maxBytes))
+		return(false);
+
+	char name[32], tmp[64];
+	snprintf(name, sizeof(name), "%016llx" SUFFIX, Hash(key, keyLength));
+	std::map<std::string, Entry>::iterator it = m_entries.find(name);
+	if ((it != m_entries.end()) && (it->second.mapped > 0))
+		return(false);            // cannot replace a file that is in use
+#if defined(_WIN32)
+	snprintf(tmp, sizeof(tmp), "%s.%lu.tmp", name, (unsigned long)GetCurrentProcessId());
+#else
+	snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", name, (long)getpid());
+#endif
+
+	okTimebaseCacheHeader h;
+	memset(&h, 0, sizeof(h));
+	h.magic = MAGIC;
+	h.version = VERSION;
+	h.keyLength = (unsigned int)keyLength;
+	h.crc = okCUploadCRC::Compute(data, (size_t)length);
+	h.length = (unsigned long long)length;
+	h.value = value;
+	static const unsigned char pad[16] = { 0 };
+	size_t padLength = offset - sizeof(h) - keyLength;
+
+	FILE *f = fopen(path(tmp).c_str(), "wb");
+	if (NULL == f)
+		return(false);
+	bool ok = (1 == fwrite(&h, sizeof(h), 1, f));
+	ok = ok && ((0 == keyLength) || (1 == fwrite(key, keyLength, 1, f)));
+	ok = ok && ((0 == padLength) || (1 == fwrite(pad, padLength, 1, f)));
+	ok = ok && (1 == fwrite(data, (size_t)length, 1, f));
+	ok = (0 == fclose(f)) && ok;
+#if defined(_WIN32)
+	ok = ok && MoveFileExA(path(tmp).c_str(), path(name).c_str(), MOVEFILE_REPLACE_EXISTING);
+	if (!ok)
+		DeleteFileA(path(tmp).c_str());
+#else
+	ok = ok && (0 == rename(path(tmp).c_str(), path(name).c_str()));
+	if (!ok)
+		unlink(path(tmp).c_str());
+#endif
+	if (!ok)
+		return(false);
+
+	if (it != m_entries.end())
+		m_size -= it->second.size;
+	Entry& e = m_entries[name];
+	e.size = offset + (unsigned long long)length;
+	e.lastUse = (long long)time(NULL);
+	e.mapped = 0;
+	e.verified = true;
+	m_size += e.size;
+	evict(name);
+	return(true);
+}
+
+
+void
+okCTimebaseCache::GetStats(okTimebaseCacheStats *stats)
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	stats->hits = m_hits;
+	stats->misses = m_misses;
+	stats->evictions = m_evictions;
+	stats->entries = (long long)m_entries.size();
+	stats->size = m_size;
+	stats->maxSize = m_maxBytes;
+}
+
+
+//------------------------------------------------------------------------
+// C exports
+//------------------------------------------------------------------------
+okSEGMENTCODEC_API okCTimebaseCache * DLL_ENTRY
+okTimebaseCache_Open(const char *directory, unsigned long long maxBytes)
+{
+	okCTimebaseCache *cache = new okCTimebaseCache();
+	if (!cache->Open(directory, maxBytes)) {
+		delete cache;
+		return(NULL);
+	}
+	return(cache);
+}
+
+
+okSEGMENTCODEC_API void DLL_ENTRY
+okTimebaseCache_Close(okCTimebaseCache *cache)
+{
+	delete cache;
+}
+
+
+okSEGMENTCODEC_API void DLL_ENTRY
+okTimebaseCache_SetMaxSize(okCTimebaseCache *cache, unsigned long long maxBytes)
+{
+	cache->SetMaxSize(maxBytes);
+}
+
+
+okSEGMENTCODEC_API const unsigned char * DLL_ENTRY
+okTimebaseCache_Lookup(okCTimebaseCache *cache, const void *key, long long keyLength, long long *length,
+		unsigned int *crc, unsigned long long *value)
+{
+	return(cache->Lookup(key, (size_t)keyLength, length, crc, value));
+}
+
+
+okSEGMENTCODEC_API void DLL_ENTRY
+okTimebaseCache_Release(okCTimebaseCache *cache, const unsigned char *data)
+{
+	cache->Release(data);
+}
+
+
+okSEGMENTCODEC_API int DLL_ENTRY
+okTimebaseCache_Store(okCTimebaseCache *cache, const void *key, long long keyLength, const unsigned char *data,
+		long long length, unsigned long long value)
+{
+	return(cache->Store(key, (size_t)keyLength, data, length, value) ? (1) : (0));
+}
+
+
+okSEGMENTCODEC_API void DLL_ENTRY
+okTimebaseCache_GetStats(okCTimebaseCache *cache, okTimebaseCacheStats *stats)
+{
+	cache->GetStats(stats);
+}
@@ -0,0 +1,161 @@
+//------------------------------------------------------------------------
+// okTimebaseCache.h
+//
+// Persistent cache of encoded segment FIFO streams (the pipe 0x80 upload)
+// in a directory on disk.  Entries are keyed by a caller-built description
+// of the sequence's timing inputs -- whatever determines the stream, the
+// master clock period included -- and are written once, then memory-mapped
+// on every later lookup.  A known sequence, after a server restart or when
+// a few sequences alternate, goes straight from the page cache to the
+// upload without regenerating or re-encoding anything:
+//
+//    const unsigned char *data = cache.Lookup(key, keyLength, &length, &crc);
+//    if (NULL == data) {
+//        ... generate and encode into buffer ...
+//        cache.Store(key, keyLength, buffer, length);
+//    }
+//    dev->WriteToPipeIn(0x80, length, (unsigned char *)data);
+//    okCUploadCRC::VerifyDevice(dev, crc);
+//    cache.Release(data);
+//
+// Each file holds the full key and the CRC-32C of the stream (the value
+// okCUploadCRC and the AvivFPGA2 firmware compute), so a hash collision is
+// a miss rather than a wrong upload.  The CRC of an entry is checked on its
+// first lookup after Open() only; a damaged file is deleted and missed.
+// The directory is kept under a size limit by dropping the least recently
+// used entries; use times are kept in the file modification times and so
+// survive restarts.
+//
+// Atticus reaches the cache through the okTimebaseCache_* C entry points of
+// okSegmentCodec.dll (see okSegmentCodec.h).
+//------------------------------------------------------------------------
+
+#ifndef __okTimebaseCache_h__
+#define __okTimebaseCache_h__
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+
+#include "okFrontPanelDLL.h"
+#include "okSegmentCodec.h"
+
+#define okTimebaseCache_DEFAULT_MAXBYTES   (256ULL * 1024 * 1024)
+
+struct okTimebaseCacheStats {
+	long long hits;
+	long long misses;
+	long long evictions;
+	long long entries;
+	unsigned long long size;             // bytes in the directory
+	unsigned long long maxSize;
+};
+
+
+//------------------------------------------------------------------------
+// okCTimebaseCache
+//------------------------------------------------------------------------
+class okCTimebaseCache
+{
+public:
+	okCTimebaseCache();
+	~okCTimebaseCache();
+
+	// Creates the directory if needed and indexes the entries already in
+	// it.  The size limit is applied right away.
+	bool Open(const char *directory, unsigned long long maxBytes = okTimebaseCache_DEFAULT_MAXBYTES);
+	// Unmaps everything still mapped.
+	void Close();
+	void SetMaxSize(unsigned long long maxBytes);
+
+	// Returns the mapped stream, its length and CRC-32C, and the value
+	// stored with it, or NULL on a miss.  The mapping stays valid until
+	// Release() or Close(); a mapped entry is never evicted.
+	const unsigned char *Lookup(const void *key, size_t keyLength, long long *length,
+			unsigned int *crc = NULL, unsigned long long *value = NULL);
+	void Release(const unsigned char *data);
+	// Writes an entry (replacing any with the same key), along with a value
+	// of the caller's that Lookup() hands back.  Fails for streams larger
+	// than the size limit.
+	bool Store(const void *key, size_t keyLength, const unsigned char *data, long long length,
+			unsigned long long value = 0);
+
+	// 64-bit FNV-1a; names the entry files.
+	static unsigned long long Hash(const void *key, size_t keyLength);
+
+	void GetStats(okTimebaseCacheStats *stats);
+	long long GetHitCount() const
+		{ return(m_hits); }
+	long long GetMissCount() const
+		{ return(m_misses); }
+	long long GetEvictionCount() const
+		{ return(m_evictions); }
+	unsigned long long GetSize() const
+		{ return(m_size); }
+	int GetEntryCount() const
+		{ return((int)m_entries.size()); }
+
+private:
+	struct Entry {
+		unsigned long long size;
+		long long lastUse;               // seconds since the epoch
+		int mapped;
+		bool verified;                   // CRC checked since Open()
+	};
+	struct Mapping {
+		const unsigned char *data;
+		void *base;
+		size_t size;
+		std::string name;
+#if defined(_WIN32)
+		void *file;
+		void *map;
+#endif
+	};
+
+	std::string path(const std::string& name) const;
+	void touch(const std::string& name, Entry *e);
+	void evict(const std::string& keep);
+	void remove(std::map<std::string, Entry>::iterator it);
+	static void unmapView(Mapping& m);
+	void unmap(Mapping& m);
+
+	std::string m_dir;
+	bool m_open;
+	unsigned long long m_maxBytes;
+	unsigned long long m_size;
+	std::map<std::string, Entry> m_entries;
+	std::vector<Mapping> m_mappings;
+	std::mutex m_lock;
+
+	long long m_hits;
+	long long m_misses;
+	long long m_evictions;
+
+	okCTimebaseCache(const okCTimebaseCache&);
+	okCTimebaseCache& operator=(const okCTimebaseCache&);
+};
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// NULL if the directory cannot be opened.
+okSEGMENTCODEC_API okCTimebaseCache * DLL_ENTRY okTimebaseCache_Open(const char *directory, unsigned long long maxBytes);
+okSEGMENTCODEC_API void DLL_ENTRY okTimebaseCache_Close(okCTimebaseCache *cache);
+okSEGMENTCODEC_API void DLL_ENTRY okTimebaseCache_SetMaxSize(okCTimebaseCache *cache, unsigned long long maxBytes);
+okSEGMENTCODEC_API const unsigned char * DLL_ENTRY okTimebaseCache_Lookup(okCTimebaseCache *cache,
+		const void *key, long long keyLength, long long *length, unsigned int *crc, unsigned long long *value);
+okSEGMENTCODEC_API void DLL_ENTRY okTimebaseCache_Release(okCTimebaseCache *cache, const unsigned char *data);
+okSEGMENTCODEC_API int DLL_ENTRY okTimebaseCache_Store(okCTimebaseCache *cache, const void *key, long long keyLength,
+		const unsigned char *data, long long length, unsigned long long value);
+okSEGMENTCODEC_API void DLL_ENTRY okTimebaseCache_GetStats(okCTimebaseCache *cache, okTimebaseCacheStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __okTimebaseCache_h__
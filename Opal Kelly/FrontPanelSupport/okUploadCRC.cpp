@@ -0,0 +1,195 @@
+//------------------------------------------------------------------------
+// okUploadCRC.cpp
+//
+// See okUploadCRC.h.
+//------------------------------------------------------------------------
+
+#include <string.h>
+
+#if defined(_M_X64) || defined(__x86_64__)
+	#define okUploadCRC_X86      1
+	#define okUploadCRC_X86_64   1
+#elif defined(_M_IX86) || defined(__i386__)
+	#define okUploadCRC_X86      1
+#endif
+
+#if defined(okUploadCRC_X86)
+	#if defined(_MSC_VER)
+		#include <intrin.h>
+		#include <nmmintrin.h>
+		#define okUploadCRC_TARGET
+	#else
+		#include <cpuid.h>
+		#include <nmmintrin.h>
+		#define okUploadCRC_TARGET __attribute__((target("sse4.2")))
+	#endif
+#endif
+
+#include "okUploadCRC.h"
+
+#define okUploadCRC_POLY   0x82F63B78      // reflected Castagnoli polynomial
+
+
+//------------------------------------------------------------------------
+// Table-driven fallback (slicing by 4)
+//------------------------------------------------------------------------
+struct okUploadCRCTable {
+	unsigned int t[4][256];
+
+	okUploadCRCTable() {
+		for (unsigned int i=0; i<256; i++) {
+			unsigned int c = i;
+			for (int k=0; k<8; k++)
+				c = (c & 1) ? ((c >> 1) ^ okUploadCRC_POLY) : (c >> 1);
+			t[0][i] = c;
+		}
+		for (unsigned int i=0; i<256; i++) {
+			for (int j=1; j<4; j++)
+				t[j][i] = (t[j-1][i] >> 8) ^ t[0][t[j-1][i] & 0xff];
+		}
+	}
+};
+
+
+static unsigned int
+crcTable(const unsigned char *data, size_t length, unsigned int crc)
+{
+	static const okUploadCRCTable table;
+	const unsigned int (*t)[256] = table.t;
+
+	while ((length > 0) && ((size_t)data & 3)) {
+		crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xff];
+		length--;
+	}
+	while (length >= 4) {
+		unsigned int w;
+		memcpy(&w, data, 4);
+		// Little-endian hosts only, as everywhere else in this library.
+		crc ^= w;
+		crc = t[3][crc & 0xff] ^ t[2][(crc >> 8) & 0xff] ^ t[1][(crc >> 16) & 0xff] ^ t[0][crc >> 24];
+		data += 4;
+		length -= 4;
+	}
+	while (length-- > 0)
+		crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xff];
+	return(crc);
+}
+
+
+//------------------------------------------------------------------------
+// SSE4.2
+//------------------------------------------------------------------------
+#if defined(okUploadCRC_X86)
+static okUploadCRC_TARGET unsigned int
+crcHardware(const unsigned char *data, size_t length, unsigned int crc)
+{
+	while ((length > 0) && ((size_t)data & 7)) {
+		crc = _mm_crc32_u8(crc, *data++);
+		length--;
+	}
+#if defined(okUploadCRC_X86_64)
+	unsigned long long c = crc;
+	while (length >= 8) {
+		unsigned long long w;
+		memcpy(&w, data, 8);
+		c = _mm_crc32_u64(c, w);
+		data += 8;
+		length -= 8;
+	}
+	crc = (unsigned int)c;
+#endif
+	while (length >= 4) {
+		unsigned int w;
+		memcpy(&w, data, 4);
+		crc = _mm_crc32_u32(crc, w);
+		data += 4;
+		length -= 4;
+	}
+	while (length-- > 0)
+		crc = _mm_crc32_u8(crc, *data++);
+	return(crc);
+}
+
+
+static bool
+detectHardware()
+{
+	unsigned int ecx;
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	ecx = (unsigned int)info[2];
+#else
+	unsigned int eax, ebx, edx;
+	if (0 == __get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return(false);
+#endif
+	return(0 != (ecx & (1 << 20)));       // SSE4.2
+}
+#endif
+
+
+bool
+okCUploadCRC::HasHardwareSupport()
+{
+#if defined(okUploadCRC_X86)
+	static const bool hw = detectHardware();
+	return(hw);
+#else
+	return(false);
+#endif
+}
+
+
+unsigned int
+okCUploadCRC::Compute(const unsigned char *data, size_t length, unsigned int crc)
+{
+	crc = ~crc;
+#if defined(okUploadCRC_X86)
+	if (HasHardwareSupport())
+		return(~crcHardware(data, length, crc));
+#endif
+	return(~crcTable(data, length, crc));
+}
+
+
+okCFrontPanel::ErrorCode
+okCUploadCRC::ResetDevice(okCFrontPanel *dev)
+{
+	return(dev->ActivateTriggerIn(okUploadCRC_EP_RESET, okUploadCRC_BIT_RESET));
+}
+
+
+okCFrontPanel::ErrorCode
+okCUploadCRC::ReadDevice(okCFrontPanel *dev, unsigned int *crc)
+{
+	dev->UpdateWireOuts();
+	if (!dev->IsOpen())
+		return(okCFrontPanel::DeviceNotOpen);
+	*crc = (unsigned int)(dev->GetWireOutValue(okUploadCRC_EP_LOW) & 0xffff) |
+	       ((unsigned int)(dev->GetWireOutValue(okUploadCRC_EP_HIGH) & 0xffff) << 16);
+	return(okCFrontPanel::NoError);
+}
+
+
+okCFrontPanel::ErrorCode
+okCUploadCRC::VerifyDevice(okCFrontPanel *dev, unsigned int expected)
+{
+	unsigned int crc;
+	okCFrontPanel::ErrorCode err = ReadDevice(dev, &crc);
+	if (okCFrontPanel::NoError != err)
+		return(err);
+	return((crc == expected) ? (okCFrontPanel::NoError) : (okCFrontPanel::Failed));
+}
+
+
+//------------------------------------------------------------------------
+// C exports
+//------------------------------------------------------------------------
+okDLLEXPORT unsigned int DLL_ENTRY
+okUploadCRC_Compute(const unsigned char *data, long length, unsigned int crc)
+{
+	if (length <= 0)
+		return(crc);
+	return(okCUploadCRC::Compute(data, (size_t)length, crc));
+}
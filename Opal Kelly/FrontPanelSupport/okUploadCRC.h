@@ -0,0 +1,75 @@
+//------------------------------------------------------------------------
+// okUploadCRC.h
+//
+// CRC-32C (Castagnoli) of segment uploads.  The AvivFPGA2 firmware computes
+// the same CRC over every byte written to pipe 0x80 and exposes it on a
+// wire-out pair, so an upload is verified with one UpdateWireOuts instead
+// of a readback or a test shot:
+//
+//    okCUploadCRC::ResetDevice(dev);
+//    dev->WriteToPipeIn(0x80, length, data);
+//    err = okCUploadCRC::VerifyDevice(dev, okCUploadCRC::Compute(data, length));
+//
+// Compute() uses the SSE4.2 CRC32 instruction when the CPU has it and a
+// table otherwise.  Values follow the usual convention (initial value and
+// final XOR 0xFFFFFFFF); passing a previous result as crc continues it.
+//------------------------------------------------------------------------
+
+#ifndef __okUploadCRC_h__
+#define __okUploadCRC_h__
+
+#include <stddef.h>
+
+#include "okFrontPanelDLL.h"
+
+// AvivFPGA2 endpoints
+#define okUploadCRC_EP_RESET        0x41     // trigger-in
+#define okUploadCRC_BIT_RESET       0
+#define okUploadCRC_EP_LOW          0x28     // wire-out, CRC[15:0]
+#define okUploadCRC_EP_HIGH         0x29     // wire-out, CRC[31:16]
+
+
+//------------------------------------------------------------------------
+// okCUploadCRC
+//------------------------------------------------------------------------
+class okCUploadCRC
+{
+public:
+	okCUploadCRC()
+		: m_crc(0) { }
+
+	// Running CRC for uploads that are sent in pieces.
+	void Reset()
+		{ m_crc = 0; }
+	void Update(const unsigned char *data, size_t length)
+		{ m_crc = Compute(data, length, m_crc); }
+	unsigned int GetValue() const
+		{ return(m_crc); }
+
+	static unsigned int Compute(const unsigned char *data, size_t length, unsigned int crc = 0);
+	static bool HasHardwareSupport();
+
+	// Clears the firmware CRC; call before the upload.
+	static okCFrontPanel::ErrorCode ResetDevice(okCFrontPanel *dev);
+	// Calls UpdateWireOuts and returns the firmware CRC.
+	static okCFrontPanel::ErrorCode ReadDevice(okCFrontPanel *dev, unsigned int *crc);
+	// Failed when the firmware CRC does not match expected.
+	static okCFrontPanel::ErrorCode VerifyDevice(okCFrontPanel *dev, unsigned int expected);
+
+private:
+	unsigned int m_crc;
+};
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// For managed encoders that build the upload themselves.
+okDLLEXPORT unsigned int DLL_ENTRY okUploadCRC_Compute(const unsigned char *data, long length, unsigned int crc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __okUploadCRC_h__
@@ -0,0 +1,315 @@
+//------------------------------------------------------------------------
+// okWatchdog.cpp
+//
+// See okWatchdog.h.
+//------------------------------------------------------------------------
+
+#include "okWatchdog.h"
+
+
+okCWatchdog::okCWatchdog(okCDevicePool *pool)
+	: m_pool(pool), m_callback(NULL), m_callbackArg(NULL),
+	  m_idleMs(1000), m_shotMs(20), m_stallMs(250), m_running(false), m_checks(0)
+{
+}
+
+
+okCWatchdog::~okCWatchdog()
+{
+	Stop();
+}
+
+
+// Caller holds m_lock.
+okCWatchdog::Board *
+okCWatchdog::board(int handle)
+{
+	for (size_t i=0; i<m_boards.size(); i++) {
+		if (handle == m_boards[i].handle)
+			return(&m_boards[i]);
+	}
+	return(NULL);
+}
+
+
+void
+okCWatchdog::AddBoard(int handle)
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	if (NULL != board(handle))
+		return;
+
+	Board b;
+	b.handle = handle;
+	b.vanished = false;
+	b.reconnects = m_pool->GetReconnectCount(handle);
+	b.shot = false;
+	b.waitForStart = false;
+	b.running = false;
+	b.progressSeen = false;
+	b.stallReported = false;
+	b.busy = false;
+	b.busyReported = false;
+	b.samples = 0;
+	b.waited = 0;
+	b.lastProgress = Clock::now();
+	b.due = b.lastProgress;
+	m_boards.push_back(b);
+	m_wake.notify_all();
+}
+
+
+void
+okCWatchdog::RemoveBoard(int handle)
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	for (size_t i=0; i<m_boards.size(); i++) {
+		if (handle == m_boards[i].handle) {
+			m_boards.erase(m_boards.begin() + i);
+			return;
+		}
+	}
+}
+
+
+void
+okCWatchdog::SetCallback(okWatchdogCallback callback, void *arg)
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	m_callback = callback;
+	m_callbackArg = arg;
+}
+
+
+void
+okCWatchdog::SetIdleInterval(int ms)
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	m_idleMs = (ms > 0) ? (ms) : (1);
+}
+
+
+void
+okCWatchdog::SetShotInterval(int ms)
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	m_shotMs = (ms > 0) ? (ms) : (1);
+}
+
+
+void
+okCWatchdog::SetStallTimeout(int ms)
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	m_stallMs = (ms > 0) ? (ms) : (1);
+}
+
+
+void
+okCWatchdog::BeginShot(int handle, bool waitForStart)
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	Board *b = board(handle);
+	if (NULL == b)
+		return;
+	b->shot = true;
+	b->waitForStart = waitForStart;
+	b->running = false;
+	b->progressSeen = false;
+	b->stallReported = false;
+	b->lastProgress = Clock::now();
+	// Take the baseline now rather than up to one idle interval later.
+	b->due = b->lastProgress;
+	m_wake.notify_all();
+}
+
+
+void
+okCWatchdog::EndShot(int handle)
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	Board *b = board(handle);
+	if (NULL != b)
+		b->shot = false;
+}
+
+
+bool
+okCWatchdog::IsShotRunning(int handle)
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	Board *b = board(handle);
+	return((NULL != b) && b->shot);
+}
+
+
+// Called without m_lock, which is only taken to update the board's state;
+// the USB transfer and the callback run unlocked.
+void
+okCWatchdog::check(int handle)
+{
+	bool busy = false;
+	okCFrontPanel *dev = m_pool->TryLock(handle, &busy);
+	bool alive = false;
+	unsigned int samples = 0, waited = 0, status = 0;
+
+	if (NULL != dev) {
+		dev->UpdateWireOuts();
+		alive = dev->IsOpen();
+		if (alive) {
+			samples = (dev->GetWireOutValue(okWatchdog_EP_SAMPLES_LOW) & 0xffff) |
+			          ((dev->GetWireOutValue(okWatchdog_EP_SAMPLES_HIGH) & 0xffff) << 16);
+			waited = (dev->GetWireOutValue(okWatchdog_EP_WAIT_LOW) & 0xffff) |
+			         ((dev->GetWireOutValue(okWatchdog_EP_WAIT_HIGH) & 0xffff) << 16);
+			status = dev->GetWireOutValue(okWatchdog_EP_STATUS) & 0x3;
+		}
+		m_pool->Unlock(handle, (alive) ? (okCFrontPanel::NoError) : (okCFrontPanel::DeviceNotOpen));
+	}
+	int reconnects = m_pool->GetReconnectCount(handle);
+
+	okWatchdogCallback callback;
+	void *arg;
+	int event = 0;
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		Board *b = board(handle);
+		if (NULL == b)
+			return;                 // removed meanwhile
+		Clock::time_point now = Clock::now();
+		m_checks++;
+		event = update(b, now, busy, alive, reconnects, samples, waited, status);
+
+		// Fixed rate per board; a late check does not push the next one back.
+		// A board found locked is watched at the shot rate until it is free.
+		b->due += std::chrono::milliseconds((b->shot || b->busy) ? (m_shotMs) : (m_idleMs));
+		if (b->due < now)
+			b->due = now;
+		callback = m_callback;
+		arg = m_callbackArg;
+	}
+	if ((0 != event) && (NULL != callback))
+		callback(handle, (okWatchdogEvent)event, arg);
+}
+
+
+// Caller holds m_lock.  Returns the event to report, or 0.
+int
+okCWatchdog::update(Board *b, Clock::time_point now, bool busy, bool alive, int reconnects,
+		unsigned int samples, unsigned int waited, unsigned int status)
+{
+	// Someone else holds the board.  Brief contention is normal; a transfer
+	// that keeps it for the stall timeout has hung.
+	if (busy) {
+		if (!b->busy) {
+			b->busy = true;
+			b->busySince = now;
+		}
+		if (!b->busyReported && (now - b->busySince > std::chrono::milliseconds(m_stallMs))) {
+			b->busyReported = true;
+			return(okWatchdog_Stalled);
+		}
+		return(0);
+	}
+	b->busy = false;
+	b->busyReported = false;
+
+	if (!alive) {
+		if (b->vanished)
+			return(0);
+		b->vanished = true;
+		b->shot = false;
+		return(okWatchdog_Vanished);
+	}
+	if (b->vanished || (reconnects != b->reconnects)) {
+		// Whatever was running did not survive the reconnect.
+		b->vanished = false;
+		b->reconnects = reconnects;
+		b->shot = false;
+		b->samples = samples;
+		b->waited = waited;
+		return(okWatchdog_Reconnected);
+	}
+
+	bool progress = (samples != b->samples) || (waited != b->waited);
+	b->samples = samples;
+	b->waited = waited;
+	if (!b->shot)
+		return(0);
+
+	// The finished / aborted bits of the previous run stay set until the
+	// next run starts, so they only end this shot once it has been seen
+	// running.
+	if (0 == status)
+		b->running = true;
+	if (progress) {
+		b->running = true;
+		b->progressSeen = true;
+		b->lastProgress = now;
+	}
+	if (0 != status) {
+		if (b->running)
+			b->shot = false;
+		return(0);
+	}
+
+	if (b->stallReported || (b->waitForStart && !b->progressSeen))
+		return(0);
+	if (now - b->lastProgress > std::chrono::milliseconds(m_stallMs)) {
+		b->stallReported = true;
+		return(okWatchdog_Stalled);
+	}
+	return(0);
+}
+
+
+void
+okCWatchdog::watchThread()
+{
+	std::unique_lock<std::mutex> guard(m_lock);
+	while (m_running) {
+		Clock::time_point now = Clock::now();
+		m_due.clear();
+		for (size_t i=0; i<m_boards.size(); i++) {
+			if (m_boards[i].due <= now)
+				m_due.push_back(m_boards[i].handle);
+		}
+
+		guard.unlock();
+		for (size_t i=0; i<m_due.size(); i++)
+			check(m_due[i]);
+		guard.lock();
+
+		Clock::time_point next = Clock::now() + std::chrono::milliseconds(m_idleMs);
+		for (size_t i=0; i<m_boards.size(); i++) {
+			if (m_boards[i].due < next)
+				next = m_boards[i].due;
+		}
+		if (m_running)
+			m_wake.wait_until(guard, next);
+	}
+}
+
+
+void
+okCWatchdog::Start()
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	if (m_running)
+		return;
+	m_running = true;
+	m_thread = std::thread(&okCWatchdog::watchThread, this);
+}
+
+
+void
+okCWatchdog::Stop()
+{
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		if (!m_running)
+			return;
+		m_running = false;
+	}
+	m_wake.notify_all();
+	m_thread.join();
+}
@@ -0,0 +1,136 @@
+//------------------------------------------------------------------------
+// okWatchdog.h
+//
+// Liveness watchdog for pooled variable timebase boards (AvivFPGA2
+// firmware).  Each check is a single UpdateWireOuts -- the cheapest
+// transaction that needs the board to answer -- and runs at a slow rate
+// while a board is idle and at a fast rate while a shot is running.
+//
+//   Vanished   the board did not answer (or the pool already has it
+//              disconnected).  The handle is reported to the pool, which
+//              starts reconnecting it right away.
+//   Stalled    a shot is running, the status register shows neither
+//              finished nor aborted, and neither the master-sample count
+//              (0x22 / 0x23) nor the retrigger wait count (0x26 / 0x27)
+//              moved for the stall timeout.  A board waiting for its
+//              retrigger keeps counting wait samples and is not stalled.
+//              Also reported, shot or not, when another thread has held the
+//              board in the pool for the stall timeout: the watchdog only
+//              ever TryLock()s, so a hung transfer cannot hang it too.
+//   Reconnected the pool brought a vanished board back (also reported when
+//              the pool reconnected it between two checks).
+//
+// Detection is bounded: a vanished board is reported within one check
+// interval plus the USB timeout, a stall within the stall timeout plus one
+// shot interval -- instead of after the sequence duration plus margin.
+//------------------------------------------------------------------------
+
+#ifndef __okWatchdog_h__
+#define __okWatchdog_h__
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include "okFrontPanelDLL.h"
+#include "okDevicePool.h"
+
+// AvivFPGA2 wire-outs
+#define okWatchdog_EP_SAMPLES_LOW   0x22
+#define okWatchdog_EP_SAMPLES_HIGH  0x23
+#define okWatchdog_EP_STATUS        0x25     // bit 0 finished, bit 1 aborted
+#define okWatchdog_EP_WAIT_LOW      0x26
+#define okWatchdog_EP_WAIT_HIGH     0x27
+
+enum okWatchdogEvent {
+	okWatchdog_Vanished    = 1,
+	okWatchdog_Stalled     = 2,
+	okWatchdog_Reconnected = 3
+};
+
+// Called from the watchdog thread, without the watchdog's lock; may call
+// anything but Stop().
+typedef void (*okWatchdogCallback)(int handle, okWatchdogEvent event, void *arg);
+
+
+//------------------------------------------------------------------------
+// okCWatchdog
+//------------------------------------------------------------------------
+class okCWatchdog
+{
+public:
+	okCWatchdog(okCDevicePool *pool);
+	~okCWatchdog();
+
+	// Boards are identified by their okCDevicePool handle.
+	void AddBoard(int handle);
+	void RemoveBoard(int handle);
+	void SetCallback(okWatchdogCallback callback, void *arg);
+
+	void SetIdleInterval(int ms);            // default 1000
+	void SetShotInterval(int ms);            // default 20
+	void SetStallTimeout(int ms);            // default 250
+
+	// Call right after the start trigger.  With waitForStart (external
+	// start trigger) stall checking begins only once the board has been
+	// seen counting.  A shot ends by itself when the board reports finished
+	// or aborted.
+	void BeginShot(int handle, bool waitForStart);
+	void EndShot(int handle);
+	bool IsShotRunning(int handle);
+
+	void Start();
+	void Stop();
+
+	long GetCheckCount() const
+		{ return(m_checks); }
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	struct Board {
+		int handle;
+		bool vanished;
+		int reconnects;
+		bool shot;
+		bool waitForStart;
+		bool running;                // status seen clear, or counters moved, during this shot
+		bool progressSeen;
+		bool stallReported;
+		bool busy;                   // the last check found the board locked
+		bool busyReported;
+		Clock::time_point busySince;
+		unsigned int samples;
+		unsigned int waited;
+		Clock::time_point lastProgress;
+		Clock::time_point due;
+	};
+
+	Board *board(int handle);
+	void check(int handle);
+	int update(Board *b, Clock::time_point now, bool busy, bool alive, int reconnects,
+			unsigned int samples, unsigned int waited, unsigned int status);
+	void watchThread();
+
+	okCDevicePool *m_pool;
+	std::vector<Board> m_boards;
+	std::vector<int> m_due;          // boards of the round in progress
+	okWatchdogCallback m_callback;
+	void *m_callbackArg;
+	int m_idleMs;
+	int m_shotMs;
+	int m_stallMs;
+
+	std::mutex m_lock;
+	std::condition_variable m_wake;
+	std::thread m_thread;
+	bool m_running;
+	long m_checks;
+
+	okCWatchdog(const okCWatchdog&);
+	okCWatchdog& operator=(const okCWatchdog&);
+};
+
+#endif // __okWatchdog_h__
@@ -0,0 +1,277 @@
+//------------------------------------------------------------------------
+// okWireOutPublisher.cpp
+//
+// See okWireOutPublisher.h.
+//------------------------------------------------------------------------
+
+#include <string.h>
+#include <chrono>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+	#include <emmintrin.h>
+	#define okWireOutPublisher_SSE2   1
+#endif
+
+#include "okWireOutPublisher.h"
+
+
+okCWireOutPublisher::okCWireOutPublisher(okCDevicePool *pool)
+	: m_pool(pool), m_nextId(1), m_running(false), m_intervalMs(50), m_polls(0), m_deliveries(0)
+{
+}
+
+
+okCWireOutPublisher::~okCWireOutPublisher()
+{
+	Stop();
+	for (size_t i=0; i<m_boards.size(); i++)
+		delete m_boards[i];
+}
+
+
+unsigned int
+okCWireOutPublisher::Diff(const unsigned short *a, const unsigned short *b)
+{
+#if defined(okWireOutPublisher_SSE2)
+	const __m128i *va = (const __m128i *)a;
+	const __m128i *vb = (const __m128i *)b;
+	// Each compare yields 0xffff per equal lane; packing two of them to bytes
+	// gives one movemask bit per register.
+	__m128i lo = _mm_packs_epi16(_mm_cmpeq_epi16(_mm_load_si128(va+0), _mm_load_si128(vb+0)),
+	                             _mm_cmpeq_epi16(_mm_load_si128(va+1), _mm_load_si128(vb+1)));
+	__m128i hi = _mm_packs_epi16(_mm_cmpeq_epi16(_mm_load_si128(va+2), _mm_load_si128(vb+2)),
+	                             _mm_cmpeq_epi16(_mm_load_si128(va+3), _mm_load_si128(vb+3)));
+	unsigned int equal = (unsigned int)_mm_movemask_epi8(lo) | ((unsigned int)_mm_movemask_epi8(hi) << 16);
+	return(~equal);
+#else
+	unsigned int changed = 0;
+	for (int i=0; i<okWireOutPublisher_COUNT; i++) {
+		if (a[i] != b[i])
+			changed |= 1u << i;
+	}
+	return(changed);
+#endif
+}
+
+
+void
+okCWireOutPublisher::AddBoard(int handle)
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	for (size_t i=0; i<m_boards.size(); i++) {
+		if (handle == m_boards[i]->handle)
+			return;
+	}
+
+	Board *b = new Board;
+	memset(b->storage, 0, sizeof(b->storage));
+	unsigned short *p = b->storage;
+	while ((size_t)p & 15)
+		p++;
+	b->handle = handle;
+	b->valid = false;
+	b->reconnects = 0;
+	b->regs = p;
+	b->prev = p + okWireOutPublisher_COUNT;
+	m_boards.push_back(b);
+}
+
+
+void
+okCWireOutPublisher::RemoveBoard(int handle)
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	for (size_t i=0; i<m_boards.size(); i++) {
+		if (handle == m_boards[i]->handle) {
+			delete m_boards[i];
+			m_boards.erase(m_boards.begin() + i);
+			return;
+		}
+	}
+}
+
+
+int
+okCWireOutPublisher::Subscribe(int handle, unsigned int mask, okWireOutCallback callback, void *arg)
+{
+	if ((NULL == callback) || (0 == mask))
+		return(-1);
+
+	std::lock_guard<std::mutex> guard(m_lock);
+	Subscription s;
+	s.id = m_nextId++;
+	s.handle = handle;
+	s.mask = mask;
+	s.callback = callback;
+	s.arg = arg;
+	m_subs.push_back(s);
+	return(s.id);
+}
+
+
+void
+okCWireOutPublisher::Unsubscribe(int id)
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	for (size_t i=0; i<m_subs.size(); i++) {
+		if (id == m_subs[i].id) {
+			m_subs.erase(m_subs.begin() + i);
+			return;
+		}
+	}
+}
+
+
+bool
+okCWireOutPublisher::GetSnapshot(int handle, unsigned short *snapshot)
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	for (size_t i=0; i<m_boards.size(); i++) {
+		Board *b = m_boards[i];
+		if ((handle == b->handle) && b->valid) {
+			memcpy(snapshot, b->regs, okWireOutPublisher_COUNT * sizeof(unsigned short));
+			return(true);
+		}
+	}
+	return(false);
+}
+
+
+void
+okCWireOutPublisher::SetInterval(int ms)
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	m_intervalMs = (ms > 0) ? (ms) : (1);
+}
+
+
+// Caller holds m_pollLock, not m_lock.  The USB transfer and the callbacks
+// run unlocked; m_lock is only held to swap in the new snapshot and to pick
+// the subscriptions to deliver to.
+void
+okCWireOutPublisher::pollBoard(int handle)
+{
+	unsigned short storage[okWireOutPublisher_COUNT + 8];
+	unsigned short *regs = storage;
+	while ((size_t)regs & 15)
+		regs++;
+
+	bool ok = false;
+	okCFrontPanel *dev = m_pool->Lock(handle);
+	if (NULL != dev) {
+		dev->UpdateWireOuts();
+		ok = dev->IsOpen();
+		if (ok) {
+			for (int i=0; i<okWireOutPublisher_COUNT; i++)
+				regs[i] = (unsigned short)dev->GetWireOutValue(okWireOutPublisher_FIRST + i);
+		}
+		m_pool->Unlock(handle, (ok) ? (okCFrontPanel::NoError) : (okCFrontPanel::DeviceNotOpen));
+	}
+	int reconnects = m_pool->GetReconnectCount(handle);
+
+	m_pending.clear();
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		Board *b = NULL;
+		for (size_t i=0; (NULL == b) && (i<m_boards.size()); i++) {
+			if (handle == m_boards[i]->handle)
+				b = m_boards[i];
+		}
+		if (NULL == b)
+			return;                 // removed meanwhile
+		if (!ok) {
+			b->valid = false;
+			return;
+		}
+
+		unsigned short *t = b->prev;
+		b->prev = b->regs;
+		b->regs = t;
+		memcpy(b->regs, regs, okWireOutPublisher_COUNT * sizeof(unsigned short));
+
+		// A reconnected board may have been reconfigured; report everything.
+		unsigned int changed = 0xffffffff;
+		if (b->valid && (reconnects == b->reconnects))
+			changed = Diff(b->regs, b->prev);
+		b->valid = true;
+		b->reconnects = reconnects;
+
+		for (size_t i=0; (0 != changed) && (i<m_subs.size()); i++) {
+			Subscription s = m_subs[i];
+			s.mask &= changed;
+			if ((0 != s.mask) && ((-1 == s.handle) || (handle == s.handle))) {
+				m_pending.push_back(s);
+				m_deliveries++;
+			}
+		}
+	}
+
+	for (size_t i=0; i<m_pending.size(); i++)
+		m_pending[i].callback(handle, m_pending[i].mask, regs, m_pending[i].arg);
+}
+
+
+void
+okCWireOutPublisher::Poll()
+{
+	std::lock_guard<std::mutex> polling(m_pollLock);
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		m_handles.clear();
+		for (size_t i=0; i<m_boards.size(); i++)
+			m_handles.push_back(m_boards[i]->handle);
+	}
+	for (size_t i=0; i<m_handles.size(); i++)
+		pollBoard(m_handles[i]);
+
+	std::lock_guard<std::mutex> guard(m_lock);
+	m_polls++;
+}
+
+
+void
+okCWireOutPublisher::pollThread()
+{
+	typedef std::chrono::steady_clock Clock;
+	std::unique_lock<std::mutex> guard(m_lock);
+	Clock::time_point next = Clock::now();
+
+	while (m_running) {
+		guard.unlock();
+		Poll();
+		guard.lock();
+
+		// Fixed rate; a slow poll does not push the following ones back.
+		next += std::chrono::milliseconds(m_intervalMs);
+		Clock::time_point now = Clock::now();
+		if (next < now)
+			next = now;
+		while (m_running && (Clock::now() < next))
+			m_wake.wait_until(guard, next);
+	}
+}
+
+
+void
+okCWireOutPublisher::Start()
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	if (m_running)
+		return;
+	m_running = true;
+	m_thread = std::thread(&okCWireOutPublisher::pollThread, this);
+}
+
+
+void
+okCWireOutPublisher::Stop()
+{
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		if (!m_running)
+			return;
+		m_running = false;
+	}
+	m_wake.notify_all();
+	m_thread.join();
+}
@@ -0,0 +1,125 @@
+//------------------------------------------------------------------------
+// okWireOutPublisher.h
+//
+// Polls the wire-outs of pooled boards once per interval and hands only the
+// registers that changed to the subscribers of those addresses.  Each poll
+// is one UpdateWireOuts per board; the new 32-register snapshot is compared
+// with the previous one using SSE2 (four 16-bit lane compares), so idle
+// boards cost one USB round trip and no callbacks.
+//
+// A subscription names a set of addresses as a bit mask (bit n: wire-out
+// 0x20+n).  Multi-word values such as the master-sample count (0x22 / 0x23)
+// are subscribed together and read from the snapshot passed to the
+// callback, so both halves always come from the same UpdateWireOuts.
+//
+// The first snapshot after a board is added or reconnected reports every
+// address as changed.
+//------------------------------------------------------------------------
+
+#ifndef __okWireOutPublisher_h__
+#define __okWireOutPublisher_h__
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "okFrontPanelDLL.h"
+#include "okDevicePool.h"
+
+#define okWireOutPublisher_FIRST     0x20
+#define okWireOutPublisher_COUNT     32
+#define okWireOutPublisher_BIT(ep)   (1u << ((ep) - okWireOutPublisher_FIRST))
+
+// AvivFPGA2 registers
+#define okWireOutPublisher_MISTRIGGER      (okWireOutPublisher_BIT(0x20) | okWireOutPublisher_BIT(0x21))
+#define okWireOutPublisher_MASTER_SAMPLES  (okWireOutPublisher_BIT(0x22) | okWireOutPublisher_BIT(0x23))
+#define okWireOutPublisher_RETRIGGER       (okWireOutPublisher_BIT(0x24) | okWireOutPublisher_BIT(0x26) | okWireOutPublisher_BIT(0x27))
+#define okWireOutPublisher_STATUS          okWireOutPublisher_BIT(0x25)
+
+// Called from the polling thread with the board's pool handle, the changed
+// addresses (restricted to the subscription mask) and the full snapshot,
+// indexed by address - 0x20.  Callbacks run without the publisher's lock and
+// may call GetSnapshot(), Subscribe() and Unsubscribe() (a subscription
+// removed during a poll can still receive that poll's delivery), but not
+// Stop().
+typedef void (*okWireOutCallback)(int handle, unsigned int changed, const unsigned short *snapshot, void *arg);
+
+
+//------------------------------------------------------------------------
+// okCWireOutPublisher
+//------------------------------------------------------------------------
+class okCWireOutPublisher
+{
+public:
+	okCWireOutPublisher(okCDevicePool *pool);
+	~okCWireOutPublisher();
+
+	// Boards are identified by their okCDevicePool handle.
+	void AddBoard(int handle);
+	void RemoveBoard(int handle);
+
+	// handle -1 subscribes to every board.  Returns a subscription id for
+	// Unsubscribe().
+	int Subscribe(int handle, unsigned int mask, okWireOutCallback callback, void *arg);
+	void Unsubscribe(int id);
+
+	void SetInterval(int ms);
+	void Start();
+	void Stop();
+	// One poll of every board from the calling thread (when not started).
+	void Poll();
+
+	// Last snapshot of a board; false if it has none yet.
+	bool GetSnapshot(int handle, unsigned short *snapshot);
+
+	long GetPollCount() const
+		{ return(m_polls); }
+	long GetDeliveryCount() const
+		{ return(m_deliveries); }
+
+	// Bit n set where a[n] != b[n]; both arrays hold okWireOutPublisher_COUNT
+	// registers and must be 16-byte aligned.
+	static unsigned int Diff(const unsigned short *a, const unsigned short *b);
+
+private:
+	struct Board {
+		int handle;
+		bool valid;
+		int reconnects;
+		unsigned short *regs;          // current, aligned
+		unsigned short *prev;          // previous, aligned
+		unsigned short storage[2 * okWireOutPublisher_COUNT + 8];
+	};
+
+	struct Subscription {
+		int id;
+		int handle;
+		unsigned int mask;
+		okWireOutCallback callback;
+		void *arg;
+	};
+
+	void pollBoard(int handle);
+	void pollThread();
+
+	okCDevicePool *m_pool;
+	std::vector<Board *> m_boards;
+	std::vector<Subscription> m_subs;
+	int m_nextId;
+	std::mutex m_lock;
+	std::mutex m_pollLock;             // one poll at a time; held without m_lock
+	std::vector<int> m_handles;        // boards of the poll in progress
+	std::vector<Subscription> m_pending;
+	std::condition_variable m_wake;
+	std::thread m_thread;
+	bool m_running;
+	int m_intervalMs;
+	long m_polls;
+	long m_deliveries;
+
+	okCWireOutPublisher(const okCWireOutPublisher&);
+	okCWireOutPublisher& operator=(const okCWireOutPublisher&);
+};
+
+#endif // __okWireOutPublisher_h__
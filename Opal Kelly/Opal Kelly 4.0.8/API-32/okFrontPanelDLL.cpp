@@ -70,6 +70,21 @@ Bool okCPLL22150::from_bool(bool x)
 	{ return( (x==true)?(TRUE):(FALSE) ); }
 okCPLL22150::okCPLL22150()
 	{ h=okPLL22150_Construct(); }
+okCPLL22150::~okCPLL22150()
+	{ if (h) okPLL22150_Destruct(h); }
+#if defined(okPLL_HAS_MOVE)
+okCPLL22150::okCPLL22150(okCPLL22150&& other)
+	{ h=other.h; other.h=NULL; }
+okCPLL22150& okCPLL22150::operator=(okCPLL22150&& other)
+	{
+		if (this != &other) {
+			if (h) okPLL22150_Destruct(h);
+			h=other.h;
+			other.h=NULL;
+		}
+		return(*this);
+	}
+#endif
 void okCPLL22150::SetCrystalLoad(double capload)
 	{ okPLL22150_SetCrystalLoad(h, capload); }
 void okCPLL22150::SetReference(double freq, bool extosc)
@@ -120,6 +135,21 @@ Bool okCPLL22393::from_bool(bool x)
 	{ return( (x==true)?(TRUE):(FALSE) ); }
 okCPLL22393::okCPLL22393()
 	{ h=okPLL22393_Construct(); }
+okCPLL22393::~okCPLL22393()
+	{ if (h) okPLL22393_Destruct(h); }
+#if defined(okPLL_HAS_MOVE)
+okCPLL22393::okCPLL22393(okCPLL22393&& other)
+	{ h=other.h; other.h=NULL; }
+okCPLL22393& okCPLL22393::operator=(okCPLL22393&& other)
+	{
+		if (this != &other) {
+			if (h) okPLL22393_Destruct(h);
+			h=other.h;
+			other.h=NULL;
+		}
+		return(*this);
+	}
+#endif
 void okCPLL22393::SetCrystalLoad(double capload)
 	{ okPLL22393_SetCrystalLoad(h, capload); }
 void okCPLL22393::SetReference(double freq)
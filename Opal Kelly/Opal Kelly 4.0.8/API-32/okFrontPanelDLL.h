@@ -236,6 +236,13 @@ okDLLEXPORT long DLL_ENTRY okFrontPanel_ReadFromBlockPipeOut(okFrontPanel_HANDLE
 
 #ifdef __cplusplus
 #if !defined(FRONTPANELDLL_EXPORTS)
+// The PLL wrappers own their driver-side handle: they are destroyed with
+// okPLL*_Destruct and cannot be copied.  Compilers with rvalue references
+// can move them.
+#if (__cplusplus >= 201103L) || (defined(_MSC_VER) && (_MSC_VER >= 1600))
+	#define okPLL_HAS_MOVE
+#endif
+
 //------------------------------------------------------------------------
 // okCPLL22150 C++ wrapper class
 //------------------------------------------------------------------------
@@ -258,8 +265,15 @@ public:
 private:
 	bool to_bool(Bool x);
 	Bool from_bool(bool x);
+	okCPLL22150(const okCPLL22150&);
+	okCPLL22150& operator=(const okCPLL22150&);
 public:
 	okCPLL22150();
+	~okCPLL22150();
+#if defined(okPLL_HAS_MOVE)
+	okCPLL22150(okCPLL22150&& other);
+	okCPLL22150& operator=(okCPLL22150&& other);
+#endif
 	void SetCrystalLoad(double capload);
 	void SetReference(double freq, bool extosc);
 	double GetReference();
@@ -300,8 +314,15 @@ public:
 private:
 	bool to_bool(Bool x);
 	Bool from_bool(bool x);
+	okCPLL22393(const okCPLL22393&);
+	okCPLL22393& operator=(const okCPLL22393&);
 public:
 	okCPLL22393();
+	~okCPLL22393();
+#if defined(okPLL_HAS_MOVE)
+	okCPLL22393(okCPLL22393&& other);
+	okCPLL22393& operator=(okCPLL22393&& other);
+#endif
 	void SetCrystalLoad(double capload);
 	void SetReference(double freq);
 	double GetReference();